@@ -22,6 +22,14 @@
 
 #import <Foundation/Foundation.h>
 #import "DropboxSDK.h"
+#import "DVVaultIndex.h"
+#import "DVTrace.h"
+
+//
+//  How many deletes are sent to DropBox at once.
+//
+
+#define kDVCacheManagerMaxConcurrentDeletes   4
 
 //
 //  The different states that a file in the cache can be in.
@@ -88,8 +96,14 @@ typedef enum {
   id<DVCacheManagerDelegate> delegate_;
   DBRestClient *restClient_;
   DBMetadata *metadata_;
+  DVVaultIndex *vaultIndex_;
   NSMutableArray *tombstones_;
+  NSMutableArray *queuedDeletes_;
+  NSMutableSet *inFlightDeletes_;
   NSMutableArray *pendingUploads_;
+  BOOL metadataRecovered_;
+  DVTraceSpan metadataSpan_;
+  NSMutableDictionary *downloadSpans_;
 }
 
 //  ----------------------------------------------------------------------------
@@ -108,11 +122,21 @@ typedef enum {
 @property (nonatomic, retain) DBRestClient *restClient;
 
 //
-//  This is the metadata for the DropVault directory.
+//  This is the metadata for the DropVault directory. The copy saved by the
+//  last run is read the first time it's asked for, not when the cache
+//  manager is created.
 //
 
 @property (nonatomic, retain) DBMetadata *metadata;
 
+//
+//  The vault entries in |metadata|, classified and paired up. Built the
+//  first time it's asked for after |metadata| changes; |nil| if there is no
+//  metadata.
+//
+
+@property (nonatomic, readonly) DVVaultIndex *vaultIndex;
+
 //  ----------------------------------------------------------------------------
 //  Class methods
 
@@ -170,12 +194,29 @@ typedef enum {
 
 - (IBAction)cacheCopyOfDropBoxPath:(NSString *)path;
 
+//
+//  Cache a copy of a DropBox file. If it has to be downloaded, the download
+//  is traced as a child of |parent|.
+//
+
+- (void)cacheCopyOfDropBoxPath:(NSString *)path parentSpan:(DVTraceSpan)parent;
+
 //
 //  Delete a file, from the cache and from DropBox.
 //
 
 - (IBAction)deleteDropBoxPath:(NSString *)path;
 
+//
+//  Delete a batch of files, from the cache and from DropBox. All of the
+//  tombstones are written in one go, at most
+//  |kDVCacheManagerMaxConcurrentDeletes| deletes are sent to DropBox at a
+//  time, and the metadata is reloaded once, when the last delete is done.
+//  Deletes asked for while a batch is running join that batch.
+//
+
+- (void)deleteDropBoxPaths:(NSArray *)paths;
+
 //
 //  Upload the cached copy of a file to DropBox.
 //
@@ -19,10 +19,20 @@
 //
 
 #import "DVCacheManager.h"
+#import "DVMetadataSnapshot.h"
 
 static NSString *cacheRoot_;
 static NSArray *cacheRootComponents_;
 
+@interface DVCacheManager ()
+
+- (void)loadTombstones;
+- (void)startQueuedDeletes;
+- (void)finishDeleteOfPath:(NSString *)path;
+- (void)loadPendingUploads;
+- (void)recoverMetadata;
+
+@end
 
 @implementation DVCacheManager
 
@@ -44,11 +54,14 @@ static NSArray *cacheRootComponents_;
 }
 
 //
-//  PRIVATE: Get the tombstones array, creating it if necessary.
+//  PRIVATE: Get the tombstones array, loading or creating it if necessary.
 //
 
 - (NSMutableArray *)tombstones {
   
+  if (tombstones_ == nil) {
+    [self loadTombstones];
+  }
   if (tombstones_ == nil) {
     tombstones_ = [[NSMutableArray alloc] init];
   }
@@ -56,11 +69,14 @@ static NSArray *cacheRootComponents_;
 }
 
 //
-//  PRIVATE: Get the pending uploads array, creating it if necessary.
+//  PRIVATE: Get the pending uploads array, loading or creating it if necessary.
 //
 
 - (NSMutableArray *)pendingUploads {
   
+  if (pendingUploads_ == nil) {
+    [self loadPendingUploads];
+  }
   if (pendingUploads_ == nil) {
     pendingUploads_ = [[NSMutableArray alloc] init];
   }
@@ -68,25 +84,53 @@ static NSArray *cacheRootComponents_;
 }
 
 //
-//  PRIVATE: Archive the metadata object.
+//  PRIVATE: Gets the path of the metadata snapshot.
+//
+
+- (NSString *)metadataSnapshotPath {
+  return [[[DVCacheManager cacheRoot] stringByDeletingLastPathComponent]
+          stringByAppendingPathComponent:@"metadata.snapshot"];
+}
+
+//
+//  PRIVATE: Archive the metadata object. If the metadata we have came from
+//  the snapshot and the root hash hasn't changed, the snapshot on disk is
+//  already current and we skip the write.
 //
 
 - (void)archiveMetadata {
   
-  NSString *archivePath = [[[DVCacheManager cacheRoot] stringByDeletingLastPathComponent]
-                           stringByAppendingPathComponent:@"metadata.dat"];
-  [NSKeyedArchiver archiveRootObject:self.metadata toFile:archivePath];
+  if (self.metadata == nil) {
+    return;
+  }
+  NSArray *contents = self.metadata.contents;
+  if ([contents isKindOfClass:[DVMetadataSnapshotContents class]] &&
+      [[(DVMetadataSnapshotContents *)contents snapshot].rootHash isEqualToString:self.metadata.hash]) {
+    return;
+  }
+  [DVMetadataSnapshot writeMetadata:self.metadata toFile:[self metadataSnapshotPath]];
 }
 
 //
-//  PRIVATE: Recover the metadata archive.
+//  PRIVATE: Recover the metadata archive. The snapshot is memory-mapped and
+//  decoded lazily, so this is cheap no matter how large the vault is. If we
+//  only find the old |NSKeyedArchiver| archive, convert it once.
 //
 
 - (void)recoverMetadata {
   
+  DVMetadataSnapshot *snapshot = [DVMetadataSnapshot snapshotWithContentsOfFile:[self metadataSnapshotPath]];
+  if (snapshot != nil) {
+    self.metadata = [snapshot rootMetadata];
+    return;
+  }
   NSString *archivePath = [[[DVCacheManager cacheRoot] stringByDeletingLastPathComponent]
                            stringByAppendingPathComponent:@"metadata.dat"];
-  self.metadata = [NSKeyedUnarchiver unarchiveObjectWithFile:archivePath];
+  if ([[NSFileManager defaultManager] fileExistsAtPath:archivePath]) {
+    self.metadata = [NSKeyedUnarchiver unarchiveObjectWithFile:archivePath];
+    [self archiveMetadata];
+    [[NSFileManager defaultManager] removeItemAtPath:archivePath error:NULL];
+  }
 }
 
 //
@@ -139,25 +183,30 @@ static NSArray *cacheRootComponents_;
 #pragma mark Lifecycle Management
 
 //
-//  Initialization. Ensure that |self.cacheRoot| exists.
+//  Initialization. Ensure that |self.cacheRoot| exists. Everything else we
+//  saved -- metadata, tombstones, pending uploads -- is read the first time
+//  it's needed, so creating a cache manager stays cheap during launch.
 //
 
 - (id)init {
   
   if ((self = [super init]) != nil) {
     [DVCacheManager createCacheRootDirectory];
-    [self recoverMetadata];
-    [self loadTombstones];
-    [self loadPendingUploads];
+    queuedDeletes_ = [[NSMutableArray alloc] init];
+    inFlightDeletes_ = [[NSMutableSet alloc] init];
   }
   return self;
 }
 
 - (void)dealloc {
   [metadata_ release];
+  [vaultIndex_ release];
   [restClient_ release];
   [tombstones_ release];
+  [queuedDeletes_ release];
+  [inFlightDeletes_ release];
   [pendingUploads_ release];
+  [downloadSpans_ release];
   [super dealloc];
 }
 
@@ -176,7 +225,46 @@ static NSArray *cacheRootComponents_;
 
 #pragma mark Loading metadata
 
+//
+//  Sets the metadata, and throws away the index of the old metadata.
+//
+
+- (void)setMetadata:(DBMetadata *)metadata {
+  
+  metadataRecovered_ = YES;
+  if (metadata == metadata_) {
+    return;
+  }
+  [metadata_ release];
+  metadata_ = [metadata retain];
+  [vaultIndex_ release];
+  vaultIndex_ = nil;
+}
+
+//
+//  Gets the metadata, recovering the saved copy if nothing has been set yet.
+//
+
+- (DBMetadata *)metadata {
+  
+  if (!metadataRecovered_) {
+    metadataRecovered_ = YES;
+    [self recoverMetadata];
+  }
+  return metadata_;
+}
+
+- (DVVaultIndex *)vaultIndex {
+  
+  if (vaultIndex_ == nil && self.metadata != nil) {
+    vaultIndex_ = [[DVVaultIndex alloc] initWithMetadata:metadata_];
+  }
+  return vaultIndex_;
+}
+
 - (IBAction)loadMetadata {
+  DVTraceEnd(metadataSpan_);
+  metadataSpan_ = DVTraceBeginAsync(@"metadata request", kDVTraceNetwork, kDVTraceNoSpan);
   [self.restClient loadMetadata:kDropVaultPath];
 }
 
@@ -185,6 +273,8 @@ static NSArray *cacheRootComponents_;
 //
 
 - (void)restClient:(DBRestClient *)client loadedMetadata:(DBMetadata *)metadata {
+  DVTraceEnd(metadataSpan_);
+  metadataSpan_ = kDVTraceNoSpan;
   self.metadata = metadata;
   [self archiveMetadata];
   if ([delegate_ respondsToSelector:@selector(cacheManagerDidLoadMetadata:)]) {
@@ -192,11 +282,24 @@ static NSArray *cacheRootComponents_;
   }
 }
 
+//
+//  Traces each step of parsing the listing. This runs on the rest client's
+//  parse queue.
+//
+
+- (void)restClient:(DBRestClient *)client parseMetadataStep:(NSString *)step usingBlock:(void (^)(void))block {
+  DVTraceSpan span = DVTraceBegin(step, kDVTraceParse);
+  block();
+  DVTraceEnd(span);
+}
+
 //
 //  Failed to load metadata. Let the delegate know.
 //
 
 - (void)restClient:(DBRestClient *)client loadMetadataFailedWithError:(NSError *)error {
+  DVTraceEnd(metadataSpan_);
+  metadataSpan_ = kDVTraceNoSpan;
   if ([delegate_ respondsToSelector:@selector(cacheManagerLoadMetadataFailed:)]) {
     [delegate_ cacheManagerLoadMetadataFailed:self];
   }
@@ -270,7 +373,26 @@ static NSArray *cacheRootComponents_;
 
 - (DBMetadata *)metadataForPath:(NSString *)path {
   
-  NSUInteger index = [metadata_.contents indexOfObjectPassingTest:^(id obj, NSUInteger idx, BOOL *stop) {
+  DBMetadata *metadata = self.metadata;
+  
+  //
+  //  If the metadata came from a snapshot, use its path index instead of 
+  //  decoding every entry. The snapshot is keyed by DropBox path, so make sure
+  //  the match really maps back to |path|.
+  //
+  
+  if ([metadata.contents isKindOfClass:[DVMetadataSnapshotContents class]]) {
+    DVMetadataSnapshot *snapshot = [(DVMetadataSnapshotContents *)metadata.contents snapshot];
+    NSUInteger index = [snapshot indexOfMetadataWithPath:[DVCacheManager dropBoxPathForCachePath:path]];
+    if (index != NSNotFound) {
+      DBMetadata *candidate = [metadata.contents objectAtIndex:index];
+      if ([[DVCacheManager cachePathForDropBoxPath:candidate.path] isEqualToString:path]) {
+        return candidate;
+      }
+    }
+    return nil;
+  }
+  NSUInteger index = [metadata.contents indexOfObjectPassingTest:^(id obj, NSUInteger idx, BOOL *stop) {
     if ([[DVCacheManager cachePathForDropBoxPath:[obj path]] isEqualToString:path]) {
       *stop = YES;
       return YES;
@@ -278,7 +400,7 @@ static NSArray *cacheRootComponents_;
     return NO;
   }];
   if (index != NSNotFound) {
-    return [metadata_.contents objectAtIndex:index];
+    return [metadata.contents objectAtIndex:index];
   }
   return nil;
 }
@@ -360,6 +482,24 @@ static NSArray *cacheRootComponents_;
 
 - (IBAction)cacheCopyOfDropBoxPath:(NSString *)path {
   
+  [self cacheCopyOfDropBoxPath:path parentSpan:kDVTraceNoSpan];
+}
+
+//
+//  PRIVATE: Ends the download span for |path|, if there is one.
+//
+
+- (void)endDownloadSpanForDropBoxPath:(NSString *)path {
+  
+  if (path == nil) {
+    return;
+  }
+  DVTraceEnd([[downloadSpans_ objectForKey:path] intValue]);
+  [downloadSpans_ removeObjectForKey:path];
+}
+
+- (void)cacheCopyOfDropBoxPath:(NSString *)path parentSpan:(DVTraceSpan)parent {
+  
   NSString *cachePath = [DVCacheManager cachePathForDropBoxPath:path];
   [self createContainingDirectoryForPath:cachePath];
   DVCacheState cacheState = [self cacheStateForPath:cachePath];
@@ -384,6 +524,16 @@ static NSArray *cacheRootComponents_;
       //  We need to get updated information from DropBox.
       //
       
+      if (DVTraceEnabled) {
+        if (downloadSpans_ == nil) {
+          downloadSpans_ = [[NSMutableDictionary alloc] init];
+        }
+        [self endDownloadSpanForDropBoxPath:path];
+        DVTraceSpan span = DVTraceBeginAsync([@"download " stringByAppendingString:[path lastPathComponent]],
+                                             kDVTraceNetwork,
+                                             parent);
+        [downloadSpans_ setObject:[NSNumber numberWithInt:span] forKey:path];
+      }
       [self.restClient loadFile:path intoPath:cachePath];
   }
 }
@@ -401,6 +551,8 @@ static NSArray *cacheRootComponents_;
 
 - (void)restClient:(DBRestClient *)client loadedFile:(NSString *)destPath {
   
+  [self endDownloadSpanForDropBoxPath:[DVCacheManager dropBoxPathForCachePath:destPath]];
+  
   //
   //  Try to update the last modified time of |destPath| to match the value in
   //  the DropBox metadata.
@@ -427,6 +579,8 @@ static NSArray *cacheRootComponents_;
 
 - (void)restClient:(DBRestClient *)client loadFileFailedWithError:(NSError *)error {
   
+  [self endDownloadSpanForDropBoxPath:[[error userInfo] objectForKey:@"path"]];
+  
   if ([delegate_ respondsToSelector:@selector(cacheManager:didFailCacheOfFile:)]) {
     NSString *path = [[error userInfo] objectForKey:@"sourcePath"];
     [delegate_ cacheManager:self didFailCacheOfFile:path];
@@ -436,43 +590,90 @@ static NSArray *cacheRootComponents_;
 #pragma mark Deleting files
 
 - (IBAction)deleteDropBoxPath:(NSString *)path {
+  [self deleteDropBoxPaths:[NSArray arrayWithObject:path]];
+}
+
+- (void)deleteDropBoxPaths:(NSArray *)paths {
   
-  //
-  //  Delete the local cached copy.
-  //
-  
-  NSString *cachePath = [DVCacheManager cachePathForDropBoxPath:path];
-  [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+  if ([paths count] == 0) {
+    return;
+  }
+  NSMutableArray *tombstones = [self tombstones];
+  for (NSString *path in paths) {
+    
+    //
+    //  Delete the local cached copy.
+    //
+    
+    NSString *cachePath = [DVCacheManager cachePathForDropBoxPath:path];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+    
+    //
+    //  Remember this on the tombstone list until we get confirmation that 
+    //  the DropBox copy was also deleted.
+    //
+    
+    if (![tombstones containsObject:path]) {
+      [tombstones addObject:path];
+    }
+    if (![queuedDeletes_ containsObject:path] && ![inFlightDeletes_ containsObject:path]) {
+      [queuedDeletes_ addObject:path];
+    }
+  }
+  [self saveTombstones];
   
   //
-  //  Remember this on the tombstone list until we get confirmation that 
-  //  the DropBox copy was also deleted.
+  //  And now try to delete the DropBox copies.
   //
   
-  [[self tombstones] addObject:path];
-  [self saveTombstones];
+  [self startQueuedDeletes];
+}
+
+//
+//  PRIVATE: Sends queued deletes to DropBox until there are
+//  |kDVCacheManagerMaxConcurrentDeletes| in flight.
+//
+
+- (void)startQueuedDeletes {
   
-  //
-  //  And now try to delete the DropBox copy.
-  //
+  while ([inFlightDeletes_ count] < kDVCacheManagerMaxConcurrentDeletes && [queuedDeletes_ count] > 0) {
+    NSString *path = [[[queuedDeletes_ objectAtIndex:0] retain] autorelease];
+    [queuedDeletes_ removeObjectAtIndex:0];
+    [inFlightDeletes_ addObject:path];
+    [self.restClient deletePath:path];
+  }
+}
+
+//
+//  PRIVATE: A delete is done, one way or another. Start the next one; if
+//  that was the last, save the tombstones and reload our metadata.
+//
+
+- (void)finishDeleteOfPath:(NSString *)path {
   
-  [self.restClient deletePath:path];
+  if (path != nil) {
+    [inFlightDeletes_ removeObject:path];
+  }
+  [self startQueuedDeletes];
+  if ([inFlightDeletes_ count] == 0) {
+    [self saveTombstones];
+    [self loadMetadata];
+  }
 }
 
 - (void)restClient:(DBRestClient *)client deletedPath:(NSString *)path {
   
   [[self tombstones] removeObject:path];
-  [self saveTombstones];
-  
-  //
-  //  Reload our metadata.
-  //
-  
-  [self loadMetadata];
+  [self finishDeleteOfPath:path];
 }
 
+//
+//  The delete failed. The tombstone stays, so the file stays hidden.
+//
+
 - (void)restClient:(DBRestClient *)client deletePathFailedWithError:(NSError *)error {
   
+  [self finishDeleteOfPath:[[error userInfo] objectForKey:@"path"]];
 }
 
 #pragma mark Uploading files
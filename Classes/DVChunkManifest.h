@@ -0,0 +1,111 @@
+//
+//  DVChunkManifest.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+//  Chunk sizes. Chunk boundaries fall where a rolling hash of the last few
+//  bytes has its low bits clear, so about one in |kDVChunkAverageLength|
+//  positions is a boundary, and a boundary depends only on the bytes near it.
+//
+
+#define kDVChunkMinimumLength     (2 * 1024)
+#define kDVChunkAverageLength     (8 * 1024)
+#define kDVChunkMaximumLength     (64 * 1024)
+
+//
+//  A file kept as a directory of encrypted chunks plus a manifest listing
+//  them in order, so an edit only makes new chunks around the bytes that
+//  changed.
+//
+//  The file is cut where its content says to, not at fixed offsets, so
+//  inserting or deleting text moves the chunks after it without changing
+//  them. Each chunk is encrypted on its own with the file's key and a random
+//  16 byte ID as the IV, and stored in a file named for the ID in hex. The
+//  manifest gives each chunk's ID, length, and SHA-1, so unchanged chunks
+//  are recognized and reused, and every chunk is checked when it's read.
+//
+//  Chunks are never rewritten: a chunk with new contents gets a new ID. So
+//  a chunk that's been deleted is never wanted again under the same name.
+//
+//  Thread safe once created.
+//
+
+@interface DVChunkManifest : NSObject {
+
+@private
+  NSData *entries_;
+  NSArray *chunkNames_;
+}
+
+//
+//  Where the content-defined chunks of |data| are, as an array of NSValue
+//  ranges in order.
+//
+
++ (NSArray *)rangesOfChunksInData:(NSData *)data;
+
+//
+//  Reads a manifest from the decrypted |manifestData|. Returns |nil| if it
+//  isn't a manifest.
+//
+
+- (id)initWithManifestData:(NSData *)manifestData;
+
+//
+//  Chunks |data|, reusing the chunks of |previousManifest| that have the
+//  same contents and are still in |directory|, and writes the rest to
+//  |directory| encrypted with |key|. If |compressed|, each chunk is deflated
+//  before it's encrypted. Returns |nil| if a chunk can't be written.
+//
+
+- (id)initWithData:(NSData *)data
+  previousManifest:(DVChunkManifest *)previousManifest
+         directory:(NSString *)directory
+               key:(NSData *)key
+        compressed:(BOOL)compressed;
+
+//
+//  The manifest, for encrypting and storing alongside the chunks.
+//
+
+@property (nonatomic, readonly) NSData *manifestData;
+
+//
+//  The file names of the chunks, in order. A chunk used twice is listed
+//  twice.
+//
+
+@property (nonatomic, readonly) NSArray *chunkNames;
+
+//
+//  The names of the chunks that aren't in |directory|.
+//
+
+- (NSArray *)namesOfChunksMissingFromDirectory:(NSString *)directory;
+
+//
+//  Decrypts and joins the chunks in |directory|. Returns |nil| if any chunk
+//  is missing, or isn't what the manifest says it is.
+//
+
+- (NSData *)dataFromDirectory:(NSString *)directory key:(NSData *)key compressed:(BOOL)compressed;
+
+@end
@@ -0,0 +1,286 @@
+//
+//  DVChunkManifest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//  Manifest layout (integers big endian; manifests go from device to device
+//  through DropBox):
+//
+//    header        DVChunkManifestHeader
+//    entries       |count| x DVChunkEntry, in file order. The chunk's
+//                  cleartext is |length| bytes and hashes to |digest|; it's
+//                  stored in the file named for |identifier|, encrypted with
+//                  |identifier| as the IV.
+//
+
+#import <CommonCrypto/CommonCryptor.h>
+#import <CommonCrypto/CommonDigest.h>
+#import "DVChunkManifest.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSData+CompressionHelpers.h"
+
+#define kDVChunkManifestMagic       0x4456434D      // 'DVCM'
+#define kDVChunkManifestVersion     1
+
+//
+//  A boundary is where the top 13 bits of the rolling hash are clear, one
+//  position in |kDVChunkAverageLength|. The top bits depend on the last 32
+//  bytes; the bottom ones only on the last few.
+//
+
+#define kDVChunkBoundaryMask        0xFFF80000
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+} DVChunkManifestHeader;
+
+typedef struct {
+  uint8_t identifier[kCCBlockSizeAES128];
+  uint8_t digest[CC_SHA1_DIGEST_LENGTH];
+  uint32_t length;
+} DVChunkEntry;
+
+//
+//  The rolling hash's table: a random value for each byte value. Every
+//  client has to cut chunks in the same places, so it comes from a fixed
+//  seed.
+//
+
+static uint32_t gearTable_[256];
+
+@implementation DVChunkManifest
+
++ (void)initialize {
+
+  if (self == [DVChunkManifest class]) {
+    uint32_t state = 0x9E3779B9;
+    for (int i = 0; i < 256; i++) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      gearTable_[i] = state;
+    }
+  }
+}
+
++ (NSArray *)rangesOfChunksInData:(NSData *)data {
+
+  NSMutableArray *ranges = [NSMutableArray array];
+  const uint8_t *bytes = [data bytes];
+  NSUInteger length = [data length];
+  NSUInteger start = 0;
+  while (start < length) {
+    NSUInteger end = MIN(start + kDVChunkMaximumLength, length);
+    NSUInteger boundary = end;
+    uint32_t hash = 0;
+    for (NSUInteger i = start + kDVChunkMinimumLength; i < end; i++) {
+      hash = (hash << 1) + gearTable_[bytes[i]];
+      if ((hash & kDVChunkBoundaryMask) == 0) {
+        boundary = i + 1;
+        break;
+      }
+    }
+    [ranges addObject:[NSValue valueWithRange:NSMakeRange(start, boundary - start)]];
+    start = boundary;
+  }
+  return ranges;
+}
+
+- (id)initWithManifestData:(NSData *)manifestData {
+
+  if ((self = [super init]) != nil) {
+    DVChunkManifestHeader header;
+    if ([manifestData length] < sizeof(header)) {
+      [self release];
+      return nil;
+    }
+    [manifestData getBytes:&header length:sizeof(header)];
+    NSUInteger entriesLength = [manifestData length] - sizeof(header);
+    if (CFSwapInt32BigToHost(header.magic) != kDVChunkManifestMagic ||
+        CFSwapInt32BigToHost(header.version) != kDVChunkManifestVersion ||
+        entriesLength % sizeof(DVChunkEntry) != 0 ||
+        entriesLength / sizeof(DVChunkEntry) != CFSwapInt32BigToHost(header.count)) {
+      [self release];
+      return nil;
+    }
+    entries_ = [[manifestData subdataWithRange:NSMakeRange(sizeof(header), entriesLength)] retain];
+  }
+  return self;
+}
+
+- (id)initWithData:(NSData *)data
+  previousManifest:(DVChunkManifest *)previousManifest
+         directory:(NSString *)directory
+               key:(NSData *)key
+        compressed:(BOOL)compressed {
+
+  if ((self = [super init]) != nil) {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager createDirectoryAtPath:directory
+           withIntermediateDirectories:YES
+                            attributes:nil
+                                 error:NULL];
+
+    //
+    //  The entries we can reuse, keyed by digest.
+    //
+
+    NSMutableDictionary *reusableEntries = [NSMutableDictionary dictionary];
+    NSData *previousEntryData = (previousManifest != nil) ? previousManifest->entries_ : nil;
+    const DVChunkEntry *previousEntries = [previousEntryData bytes];
+    NSUInteger previousCount = [previousEntryData length] / sizeof(DVChunkEntry);
+    for (NSUInteger i = 0; i < previousCount; i++) {
+      [reusableEntries setObject:[NSData dataWithBytes:&previousEntries[i] length:sizeof(DVChunkEntry)]
+                          forKey:[NSData dataWithBytes:previousEntries[i].digest length:CC_SHA1_DIGEST_LENGTH]];
+    }
+
+    NSArray *ranges = [DVChunkManifest rangesOfChunksInData:data];
+    NSMutableData *entries = [NSMutableData dataWithCapacity:[ranges count] * sizeof(DVChunkEntry)];
+    for (NSValue *rangeValue in ranges) {
+      NSRange range = [rangeValue rangeValue];
+      NSData *chunk = [data subdataWithRange:range];
+      NSMutableData *digest = [NSMutableData dataWithLength:CC_SHA1_DIGEST_LENGTH];
+      CC_SHA1([chunk bytes], [chunk length], [digest mutableBytes]);
+
+      DVChunkEntry entry;
+      NSData *reusable = [reusableEntries objectForKey:digest];
+      if (reusable != nil) {
+        [reusable getBytes:&entry length:sizeof(entry)];
+        NSData *identifier = [NSData dataWithBytesNoCopy:entry.identifier
+                                                  length:sizeof(entry.identifier)
+                                            freeWhenDone:NO];
+        if (CFSwapInt32BigToHost(entry.length) == range.length &&
+            [fileManager fileExistsAtPath:[directory stringByAppendingPathComponent:[identifier hexString]]]) {
+          [entries appendBytes:&entry length:sizeof(entry)];
+          continue;
+        }
+      }
+
+      //
+      //  A new chunk, under a new ID.
+      //
+
+      NSData *identifier = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+      NSData *clearText = compressed ? [chunk zlibDeflate] : chunk;
+      NSData *cipherText = [clearText aesEncryptWithKey:key andIV:identifier];
+      if (identifier == nil ||
+          cipherText == nil ||
+          ![cipherText writeToFile:[directory stringByAppendingPathComponent:[identifier hexString]]
+                        atomically:YES]) {
+        [self release];
+        return nil;
+      }
+      [identifier getBytes:entry.identifier length:sizeof(entry.identifier)];
+      [digest getBytes:entry.digest length:sizeof(entry.digest)];
+      entry.length = CFSwapInt32HostToBig(range.length);
+      [entries appendBytes:&entry length:sizeof(entry)];
+      [reusableEntries setObject:[NSData dataWithBytes:&entry length:sizeof(entry)] forKey:digest];
+    }
+    entries_ = [entries copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [entries_ release];
+  [chunkNames_ release];
+  [super dealloc];
+}
+
+- (NSData *)manifestData {
+
+  DVChunkManifestHeader header;
+  header.magic = CFSwapInt32HostToBig(kDVChunkManifestMagic);
+  header.version = CFSwapInt32HostToBig(kDVChunkManifestVersion);
+  header.count = CFSwapInt32HostToBig([entries_ length] / sizeof(DVChunkEntry));
+  NSMutableData *manifestData = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+  [manifestData appendData:entries_];
+  return manifestData;
+}
+
+- (NSArray *)chunkNames {
+
+  @synchronized (self) {
+    if (chunkNames_ == nil) {
+      const DVChunkEntry *entries = [entries_ bytes];
+      NSUInteger count = [entries_ length] / sizeof(DVChunkEntry);
+      NSMutableArray *chunkNames = [NSMutableArray arrayWithCapacity:count];
+      for (NSUInteger i = 0; i < count; i++) {
+        NSData *identifier = [NSData dataWithBytesNoCopy:(void *)entries[i].identifier
+                                                  length:sizeof(entries[i].identifier)
+                                            freeWhenDone:NO];
+        [chunkNames addObject:[identifier hexString]];
+      }
+      chunkNames_ = [chunkNames copy];
+    }
+  }
+  return chunkNames_;
+}
+
+- (NSArray *)namesOfChunksMissingFromDirectory:(NSString *)directory {
+
+  NSMutableArray *missingNames = [NSMutableArray array];
+  NSMutableSet *checkedNames = [NSMutableSet set];
+  for (NSString *name in self.chunkNames) {
+    if ([checkedNames containsObject:name]) {
+      continue;
+    }
+    [checkedNames addObject:name];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:[directory stringByAppendingPathComponent:name]]) {
+      [missingNames addObject:name];
+    }
+  }
+  return missingNames;
+}
+
+- (NSData *)dataFromDirectory:(NSString *)directory key:(NSData *)key compressed:(BOOL)compressed {
+
+  const DVChunkEntry *entries = [entries_ bytes];
+  NSArray *chunkNames = self.chunkNames;
+  NSMutableData *data = [NSMutableData data];
+  NSMutableData *digest = [NSMutableData dataWithLength:CC_SHA1_DIGEST_LENGTH];
+  for (NSUInteger i = 0; i < [chunkNames count]; i++) {
+    NSData *cipherText = [NSData dataWithContentsOfFile:[directory stringByAppendingPathComponent:[chunkNames objectAtIndex:i]]];
+    NSData *identifier = [NSData dataWithBytesNoCopy:(void *)entries[i].identifier
+                                              length:sizeof(entries[i].identifier)
+                                        freeWhenDone:NO];
+    NSData *chunk = [cipherText aesDecryptWithKey:key andIV:identifier];
+    if (compressed) {
+      chunk = [chunk zlibInflate];
+    }
+    if (chunk == nil || [chunk length] != CFSwapInt32BigToHost(entries[i].length)) {
+      _GTMDevLog(@"%s -- chunk %@ is missing or the wrong length",
+                 __PRETTY_FUNCTION__,
+                 [chunkNames objectAtIndex:i]);
+      return nil;
+    }
+    CC_SHA1([chunk bytes], [chunk length], [digest mutableBytes]);
+    if (memcmp([digest bytes], entries[i].digest, CC_SHA1_DIGEST_LENGTH) != 0) {
+      _GTMDevLog(@"%s -- chunk %@ doesn't match its digest",
+                 __PRETTY_FUNCTION__,
+                 [chunkNames objectAtIndex:i]);
+      return nil;
+    }
+    [data appendData:chunk];
+  }
+  return data;
+}
+
+@end
@@ -0,0 +1,155 @@
+//
+//  DVKeyStore.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/13/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreData/CoreData.h>
+
+//
+//  Does the heavy |kDVKeyEntity| writes -- reconciling against DropBox
+//  metadata and decrypting key files -- on a worker context that shares the
+//  main context's persistent store coordinator. The worker context is only
+//  ever touched from a private serial queue.
+//
+//  Saves are coalesced: the worker saves every |kDVKeyStoreSaveBatchSize|
+//  changes, and once more when the queue runs dry. Each save is merged into
+//  the main context on the main thread as a single batch, so a
+//  |NSFetchedResultsController| on the main context sees a handful of
+//  updates rather than one per key.
+//
+//  Reconciling never turns rows into managed objects: it compares key names
+//  from a dictionary fetch, and deletes by object ID. Jobs that do need the
+//  objects fault them in |kDVKeyStoreFetchBatchSize| rows at a time.
+//
+//  All methods must be called on the main thread. Completion blocks are run
+//  on the main thread.
+//
+
+#define kDVKeyStoreSaveBatchSize    25
+#define kDVKeyStoreFetchBatchSize   100
+
+@interface DVKeyStore : NSObject {
+
+@private
+  NSManagedObjectContext *mainContext_;
+  NSManagedObjectContext *workerContext_;
+  dispatch_queue_t queue_;
+  NSUInteger unsavedChanges_;
+  BOOL savePending_;
+  volatile int32_t pendingMainThreadBlocks_;
+  volatile int32_t wipeGeneration_;
+  NSMutableArray *requestedKeyNames_;
+  NSString *requestPassword_;
+  int32_t requestGeneration_;
+  NSMutableSet *inFlightKeyNames_;
+}
+
+//
+//  Creates a key store writing on behalf of |mainContext|. |mainContext| gets
+//  a merge policy where its own unsaved changes win over merged ones.
+//
+
+- (id)initWithMainContext:(NSManagedObjectContext *)mainContext;
+
+//
+//  The context the worker's changes are merged into.
+//
+
+@property (nonatomic, readonly) NSManagedObjectContext *mainContext;
+
+//
+//  Brings the store into line with a DropBox listing. |keyEntries| holds one
+//  dictionary per |.key| file, with |kDVKeyName| and, if known, the
+//  |kDVHumanReadableSize| and |kDVLastModifiedDate| of its data file. Keys
+//  not in the list are deleted, along with their cached files.
+//
+//  |completion| gets the names of the keys that were added, or |nil| and the
+//  error if the store could not be read.
+//
+
+- (void)reconcileKeyEntries:(NSArray *)keyEntries
+                 completion:(void (^)(NSArray *addedKeyNames, NSError *error))completion;
+
+//
+//  Decrypts the key file at |cachePath| with |password| and stores the key,
+//  IV, file name, and compression flag on the matching key objects.
+//
+
+- (void)decryptKeyFile:(NSString *)cachePath withPassword:(NSString *)password;
+
+//
+//  Decrypts a single key for display, ahead of every key requested before
+//  it, and saves as soon as it's done so its row updates straight away. Asking
+//  again for a key that's still waiting moves it back to the front; asking
+//  for one that's already being decrypted does nothing. Nothing happens if
+//  the key file isn't in the cache yet, or the key is already decrypted.
+//
+//  The newest request goes first because it's for a row that just scrolled
+//  into view.
+//
+
+- (void)requestDecryptionOfKeyName:(NSString *)keyName withPassword:(NSString *)password;
+
+//
+//  Decrypts every key whose key file is in the cache, and that isn't decrypted
+//  already.
+//
+
+- (void)decryptAllKeysWithPassword:(NSString *)password;
+
+//
+//  Throws away the decrypted key, IV, and file name of every key, and any
+//  decryption requests still waiting. The main context is cleared before
+//  this returns. Decryption that was asked for before this and hasn't
+//  finished is dropped, and nothing it decrypted reaches the main context.
+//
+
+- (void)forgetDecryptedKeys;
+
+//
+//  The decrypted key, IV, and file name of every key the main context has
+//  them for, keyed by key name. Each value is a dictionary with |kDVKey|,
+//  |kDVIV|, |kDVFileName|, and |kDVCompressed|.
+//
+
+- (NSDictionary *)decryptedKeyValues;
+
+//
+//  Puts back values from |decryptedKeyValues| without decrypting anything,
+//  ahead of any decryption requested after this. Keys that are gone are
+//  skipped. The values are copied before this returns, so they may point
+//  into memory that's wiped right after.
+//
+
+- (void)restoreDecryptedKeyValues:(NSDictionary *)decryptedKeyValues;
+
+//
+//  Deletes every key, along with its cached files.
+//
+
+- (void)removeAllKeys;
+
+//
+//  Blocks until everything queued so far has been saved and merged into
+//  |mainContext|, and its completion blocks have run.
+//
+
+- (void)waitUntilIdle;
+
+@end
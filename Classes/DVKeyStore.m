@@ -0,0 +1,684 @@
+//
+//  DVKeyStore.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/13/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <libkern/OSAtomic.h>
+#import "DVKeyStore.h"
+#import "DVCacheManager.h"
+#import "DVVaultIndex.h"
+#import "KeyFileDecryptor.h"
+#import "DVTrace.h"
+
+//
+//  The attributes that hold decrypted key material. They're transient, so
+//  they never reach the store.
+//
+
+#define kDVKeyStoreTransientKeys    [NSArray arrayWithObjects:kDVKey, kDVIV, kDVFileName, kDVCompressed, nil]
+
+//
+//  A copy of a decrypted value that has bytes of its own. Plain |copy| would
+//  just retain data or a string that points into someone else's buffer.
+//
+
+static id DVKeyStoreCopyOfValue(id value) {
+
+  if ([value isKindOfClass:[NSData class]]) {
+    return [NSData dataWithBytes:[value bytes] length:[value length]];
+  }
+  if ([value isKindOfClass:[NSString class]]) {
+    return [NSString stringWithString:[[value mutableCopy] autorelease]];
+  }
+  return value;
+}
+
+//
+//  Private methods. Everything here other than |runOnMainThread:| and
+//  |forgetDecryptedKeysInContext:| runs on |queue_|.
+//
+
+@interface DVKeyStore ()
+- (void)runOnMainThread:(dispatch_block_t)block;
+- (void)noteChanges:(NSUInteger)count;
+- (void)saveWorkerContext;
+- (NSFetchRequest *)fetchRequestWithPredicate:(NSPredicate *)predicate;
+- (NSArray *)fetchKeysWithPredicate:(NSPredicate *)predicate error:(NSError **)error;
+- (NSArray *)fetchKeyNamesWithPredicate:(NSPredicate *)predicate error:(NSError **)error;
+- (NSArray *)fetchKeyIDsWithPredicate:(NSPredicate *)predicate error:(NSError **)error;
+- (NSUInteger)forgetDecryptedKeysInContext:(NSManagedObjectContext *)context;
+- (BOOL)isCurrentWipeGeneration:(int32_t)generation;
+- (void)decryptNextRequestedKey;
+- (void)removeCachedFilesForKeyName:(NSString *)keyName;
+- (void)setDecryptor:(KeyFileDecryptor *)decryptor forObject:(NSManagedObject *)object;
+@end
+
+
+@implementation DVKeyStore
+
+@synthesize mainContext = mainContext_;
+
+- (id)initWithMainContext:(NSManagedObjectContext *)mainContext {
+
+  if ((self = [super init]) != nil) {
+    mainContext_ = [mainContext retain];
+    [mainContext_ setMergePolicy:NSMergeByPropertyObjectTrumpMergePolicy];
+    queue_ = dispatch_queue_create("org.brians-brain.dropvault.keystore", NULL);
+    requestedKeyNames_ = [[NSMutableArray alloc] init];
+    inFlightKeyNames_ = [[NSMutableSet alloc] init];
+
+    //
+    //  The worker context is created on the queue, as well as only being
+    //  used there.
+    //
+
+    dispatch_sync(queue_, ^{
+      workerContext_ = [[NSManagedObjectContext alloc] init];
+      [workerContext_ setPersistentStoreCoordinator:[mainContext persistentStoreCoordinator]];
+      [workerContext_ setMergePolicy:NSMergeByPropertyObjectTrumpMergePolicy];
+    });
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(workerContextDidSave:)
+                                                 name:NSManagedObjectContextDidSaveNotification
+                                               object:workerContext_];
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(mainContextDidSave:)
+                                                 name:NSManagedObjectContextDidSaveNotification
+                                               object:mainContext_];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [mainContext_ release];
+  [workerContext_ release];
+  [requestedKeyNames_ release];
+  [requestPassword_ release];
+  [inFlightKeyNames_ release];
+  dispatch_release(queue_);
+  [super dealloc];
+}
+
+#pragma mark -
+#pragma mark Merging
+
+//
+//  PRIVATE: Runs |block| on the main thread, keeping count so |waitUntilIdle|
+//  knows when it's done.
+//
+
+- (void)runOnMainThread:(dispatch_block_t)block {
+
+  OSAtomicIncrement32Barrier(&pendingMainThreadBlocks_);
+  dispatch_async(dispatch_get_main_queue(), ^{
+    block();
+    OSAtomicDecrement32Barrier(&pendingMainThreadBlocks_);
+  });
+}
+
+//
+//  PRIVATE: The worker saved. Merge the whole save into the main context in
+//  one go.
+//
+//  The merge doesn't carry transient attributes across, so the decrypted
+//  values are collected here, while we're still on the queue, and set on the
+//  main context's copies afterwards -- unless the keys were forgotten in
+//  between, which would make them stale.
+//
+
+- (void)workerContextDidSave:(NSNotification *)notification {
+
+  int32_t generation = wipeGeneration_;
+  NSMutableDictionary *transientValues = [NSMutableDictionary dictionary];
+  NSDictionary *userInfo = [notification userInfo];
+  NSMutableSet *objects = [NSMutableSet setWithSet:[userInfo objectForKey:NSUpdatedObjectsKey]];
+  [objects unionSet:[userInfo objectForKey:NSInsertedObjectsKey]];
+  for (NSManagedObject *object in objects) {
+    [transientValues setObject:[object dictionaryWithValuesForKeys:kDVKeyStoreTransientKeys]
+                        forKey:[object objectID]];
+  }
+  [self runOnMainThread:^{
+    [mainContext_ mergeChangesFromContextDidSaveNotification:notification];
+    if (![self isCurrentWipeGeneration:generation]) {
+      return;
+    }
+    [transientValues enumerateKeysAndObjectsUsingBlock:^(id objectID, id values, BOOL *stop) {
+      [[mainContext_ objectWithID:objectID] setValuesForKeysWithDictionary:values];
+    }];
+  }];
+}
+
+//
+//  PRIVATE: The main context saved (say, the user deleted a row). Keep the
+//  worker from working with stale objects.
+//
+
+- (void)mainContextDidSave:(NSNotification *)notification {
+
+  dispatch_async(queue_, ^{
+    [workerContext_ mergeChangesFromContextDidSaveNotification:notification];
+  });
+}
+
+//
+//  PRIVATE: Counts changes to the worker context. Saves right away once there
+//  is a full batch; otherwise, makes sure there's a save queued behind
+//  whatever work is already waiting, so back-to-back jobs share one save.
+//
+
+- (void)noteChanges:(NSUInteger)count {
+
+  unsavedChanges_ += count;
+  if (unsavedChanges_ >= kDVKeyStoreSaveBatchSize) {
+    [self saveWorkerContext];
+  } else if (unsavedChanges_ > 0 && !savePending_) {
+    savePending_ = YES;
+    dispatch_async(queue_, ^{
+      savePending_ = NO;
+      [self saveWorkerContext];
+    });
+  }
+}
+
+- (void)saveWorkerContext {
+
+  unsavedChanges_ = 0;
+  if (![workerContext_ hasChanges]) {
+    return;
+  }
+  NSError *error = nil;
+  if (![workerContext_ save:&error]) {
+    _GTMDevLog(@"%s -- unable to save worker context: %@ (%@)",
+               __PRETTY_FUNCTION__,
+               error,
+               [error userInfo]);
+    [workerContext_ rollback];
+  }
+}
+
+#pragma mark -
+#pragma mark Worker helpers
+
+- (NSFetchRequest *)fetchRequestWithPredicate:(NSPredicate *)predicate {
+
+  NSFetchRequest *fetchRequest = [[[NSFetchRequest alloc] init] autorelease];
+  [fetchRequest setEntity:[NSEntityDescription entityForName:kDVKeyEntity
+                                      inManagedObjectContext:workerContext_]];
+  [fetchRequest setPredicate:predicate];
+  return fetchRequest;
+}
+
+//
+//  PRIVATE: Fetches whole objects, |kDVKeyStoreFetchBatchSize| rows at a time,
+//  so walking a large vault doesn't pull every row into memory at once.
+//
+
+- (NSArray *)fetchKeysWithPredicate:(NSPredicate *)predicate error:(NSError **)error {
+
+  NSFetchRequest *fetchRequest = [self fetchRequestWithPredicate:predicate];
+  [fetchRequest setFetchBatchSize:kDVKeyStoreFetchBatchSize];
+  return [workerContext_ executeFetchRequest:fetchRequest error:error];
+}
+
+//
+//  PRIVATE: Fetches just the |kDVKeyName| of each matching key, without
+//  creating any managed objects. This only sees saved rows, so any pending
+//  changes are saved first.
+//
+
+- (NSArray *)fetchKeyNamesWithPredicate:(NSPredicate *)predicate error:(NSError **)error {
+
+  [self saveWorkerContext];
+  NSFetchRequest *fetchRequest = [self fetchRequestWithPredicate:predicate];
+  NSPropertyDescription *keyName = [[[fetchRequest entity] propertiesByName] objectForKey:kDVKeyName];
+  [fetchRequest setResultType:NSDictionaryResultType];
+  [fetchRequest setPropertiesToFetch:[NSArray arrayWithObject:keyName]];
+  NSArray *rows = [workerContext_ executeFetchRequest:fetchRequest error:error];
+  if (rows == nil) {
+    return nil;
+  }
+  NSMutableArray *keyNames = [NSMutableArray arrayWithCapacity:[rows count]];
+  for (NSDictionary *row in rows) {
+    NSString *name = [row objectForKey:kDVKeyName];
+    if (name != nil) {
+      [keyNames addObject:name];
+    }
+  }
+  return keyNames;
+}
+
+//
+//  PRIVATE: Fetches only the object IDs of matching keys.
+//
+
+- (NSArray *)fetchKeyIDsWithPredicate:(NSPredicate *)predicate error:(NSError **)error {
+
+  [self saveWorkerContext];
+  NSFetchRequest *fetchRequest = [self fetchRequestWithPredicate:predicate];
+  [fetchRequest setResultType:NSManagedObjectIDResultType];
+  return [workerContext_ executeFetchRequest:fetchRequest error:error];
+}
+
+//
+//  PRIVATE: Clears the decrypted values from every object |context| has in
+//  memory, and returns how many it changed. Transient values only live on
+//  registered objects, so there's no need to fetch anything, and faults can
+//  be skipped.
+//
+
+- (NSUInteger)forgetDecryptedKeysInContext:(NSManagedObjectContext *)context {
+
+  NSUInteger count = 0;
+  for (NSManagedObject *object in [context registeredObjects]) {
+    if ([object isFault] || [object isDeleted]) {
+      continue;
+    }
+    if ([object valueForKey:kDVFileName] || [object valueForKey:kDVKey] || [object valueForKey:kDVIV]) {
+      [object setValue:nil forKey:kDVFileName];
+      [object setValue:nil forKey:kDVKey];
+      [object setValue:nil forKey:kDVIV];
+      [object setValue:nil forKey:kDVCompressed];
+      count++;
+    }
+  }
+  return count;
+}
+
+//
+//  PRIVATE: Whether the keys haven't been forgotten since |generation| was
+//  read. Jobs read it when they're queued, and drop what they decrypted if
+//  it's gone stale.
+//
+
+- (BOOL)isCurrentWipeGeneration:(int32_t)generation {
+
+  OSMemoryBarrier();
+  return generation == wipeGeneration_;
+}
+
+//
+//  PRIVATE: Removes the cached |.key| and |.dat| files for a key.
+//
+
+- (void)removeCachedFilesForKeyName:(NSString *)keyName {
+
+  NSFileManager *fileManager = [[[NSFileManager alloc] init] autorelease];
+  NSString *fileName = [DVCacheManager cachePathForDropBoxPath:keyName];
+  [fileManager removeItemAtPath:fileName error:nil];
+  [fileManager removeItemAtPath:[DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:fileName]
+                          error:nil];
+}
+
+- (void)setDecryptor:(KeyFileDecryptor *)decryptor forObject:(NSManagedObject *)object {
+
+  [object setValue:decryptor.key forKey:kDVKey];
+  [object setValue:decryptor.iv forKey:kDVIV];
+  [object setValue:decryptor.fileName forKey:kDVFileName];
+  [object setValue:[NSNumber numberWithBool:decryptor.compressed] forKey:kDVCompressed];
+  [self noteChanges:1];
+}
+
+#pragma mark -
+#pragma mark Jobs
+
+- (void)reconcileKeyEntries:(NSArray *)keyEntries
+                 completion:(void (^)(NSArray *, NSError *))completion {
+
+  dispatch_async(queue_, ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    DVTraceSpan span = DVTraceBegin(@"reconcile", kDVTraceCoreData);
+    NSError *error = nil;
+    NSArray *storedKeyNames = [self fetchKeyNamesWithPredicate:nil error:&error];
+    NSMutableArray *addedKeyNames = nil;
+    if (storedKeyNames != nil) {
+
+      NSMutableSet *knownKeyNames = [NSMutableSet setWithArray:storedKeyNames];
+
+      //
+      //  Add objects for new keys...
+      //
+
+      NSMutableSet *listedKeyNames = [NSMutableSet setWithCapacity:[keyEntries count]];
+      addedKeyNames = [NSMutableArray array];
+      for (NSDictionary *entry in keyEntries) {
+        NSString *keyName = [entry objectForKey:kDVKeyName];
+        [listedKeyNames addObject:keyName];
+        if ([knownKeyNames containsObject:keyName]) {
+          continue;
+        }
+        NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:kDVKeyEntity
+                                                                inManagedObjectContext:workerContext_];
+        [object setValue:keyName forKey:kDVKeyName];
+        [object setValue:[entry objectForKey:kDVHumanReadableSize] forKey:kDVHumanReadableSize];
+        [object setValue:[entry objectForKey:kDVLastModifiedDate] forKey:kDVLastModifiedDate];
+        [knownKeyNames addObject:keyName];
+        [addedKeyNames addObject:keyName];
+        [self noteChanges:1];
+      }
+
+      //
+      //  ...and delete the ones that are gone from DropBox. Usually there are
+      //  none, and when there are, only their IDs are fetched.
+      //
+
+      NSMutableSet *goneKeyNames = [NSMutableSet setWithArray:storedKeyNames];
+      [goneKeyNames minusSet:listedKeyNames];
+      if ([goneKeyNames count] > 0) {
+        NSPredicate *predicate = [NSPredicate predicateWithFormat:@"(KeyName IN %@)", goneKeyNames];
+        for (NSManagedObjectID *objectID in [self fetchKeyIDsWithPredicate:predicate error:NULL]) {
+          [workerContext_ deleteObject:[workerContext_ objectWithID:objectID]];
+          [self noteChanges:1];
+        }
+        for (NSString *keyName in goneKeyNames) {
+          [self removeCachedFilesForKeyName:keyName];
+        }
+      }
+    }
+    DVTraceEnd(span);
+    [self runOnMainThread:^{
+      completion(addedKeyNames, (addedKeyNames == nil) ? error : nil);
+    }];
+    [pool drain];
+  });
+}
+
+- (void)decryptKeyFile:(NSString *)cachePath withPassword:(NSString *)password {
+
+  int32_t generation = wipeGeneration_;
+  dispatch_async(queue_, ^{
+    if (![self isCurrentWipeGeneration:generation]) {
+      return;
+    }
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSData *keyData = [NSData dataWithContentsOfFile:cachePath];
+    KeyFileDecryptor *decryptor = nil;
+    if ([keyData length] > 0) {
+      DVTraceSpan span = DVTraceBegin([@"unlock " stringByAppendingString:[cachePath lastPathComponent]], kDVTraceCrypto);
+      decryptor = [KeyFileDecryptor decryptorWithData:keyData andPassword:password];
+      DVTraceEnd(span);
+    }
+    if (decryptor != nil && [self isCurrentWipeGeneration:generation]) {
+      NSString *fileName = [[cachePath lowercaseString] lastPathComponent];
+      NSPredicate *predicate = [NSPredicate predicateWithFormat:@"(KeyName ENDSWITH[c] %@)", fileName];
+      for (NSManagedObject *object in [self fetchKeysWithPredicate:predicate error:NULL]) {
+        NSString *keyName = [object valueForKey:kDVKeyName];
+        if ([[[keyName lowercaseString] lastPathComponent] isEqual:fileName]) {
+          [self setDecryptor:decryptor forObject:object];
+        }
+      }
+    }
+    [pool drain];
+  });
+}
+
+//
+//  |requestedKeyNames_| is a stack: the last name is the next one to decrypt.
+//  It's shared between the main thread and the queue, so it's only touched
+//  while holding its lock. |inFlightKeyNames_| is only touched on the main
+//  thread; it holds every name that's waiting or being decrypted.
+//
+
+- (void)requestDecryptionOfKeyName:(NSString *)keyName withPassword:(NSString *)password {
+
+  if (keyName == nil) {
+    return;
+  }
+  if ([inFlightKeyNames_ containsObject:keyName]) {
+    @synchronized(requestedKeyNames_) {
+      NSUInteger index = [requestedKeyNames_ indexOfObject:keyName];
+      if (index != NSNotFound) {
+        [requestedKeyNames_ removeObjectAtIndex:index];
+        [requestedKeyNames_ addObject:keyName];
+      }
+    }
+    return;
+  }
+  [inFlightKeyNames_ addObject:keyName];
+  @synchronized(requestedKeyNames_) {
+    [requestedKeyNames_ addObject:keyName];
+    [requestPassword_ autorelease];
+    requestPassword_ = [password copy];
+    requestGeneration_ = wipeGeneration_;
+  }
+
+  //
+  //  One block per request, but each block takes whatever is on top of the
+  //  stack when it runs, not the name it was queued for.
+  //
+
+  dispatch_async(queue_, ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [self decryptNextRequestedKey];
+    [pool drain];
+  });
+}
+
+//
+//  PRIVATE: Pops the newest request and decrypts it.
+//
+
+- (void)decryptNextRequestedKey {
+
+  NSString *keyName = nil;
+  NSString *password = nil;
+  int32_t generation;
+  @synchronized(requestedKeyNames_) {
+    keyName = [[[requestedKeyNames_ lastObject] retain] autorelease];
+    password = [[requestPassword_ retain] autorelease];
+    generation = requestGeneration_;
+    if (keyName != nil) {
+      [requestedKeyNames_ removeLastObject];
+    }
+  }
+  if (keyName == nil) {
+    return;
+  }
+  NSPredicate *predicate = [NSPredicate predicateWithFormat:@"(KeyName == %@)", keyName];
+  NSManagedObject *object = [[self fetchKeysWithPredicate:predicate error:NULL] lastObject];
+  if (object != nil && [object valueForKey:kDVFileName] == nil) {
+    NSData *keyData = [NSData dataWithContentsOfFile:[DVCacheManager cachePathForDropBoxPath:keyName]];
+    if ([keyData length] > 0) {
+      DVTraceSpan span = DVTraceBegin([@"unlock " stringByAppendingString:[keyName lastPathComponent]], kDVTraceCrypto);
+      KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyData andPassword:password];
+      DVTraceEnd(span);
+      if (decryptor != nil && [self isCurrentWipeGeneration:generation]) {
+        [self setDecryptor:decryptor forObject:object];
+
+        //
+        //  Decrypting took far longer than a save will, so don't make the row
+        //  wait for a batch to fill up.
+        //
+
+        [self saveWorkerContext];
+      }
+    }
+  }
+  [self runOnMainThread:^{
+    if ([self isCurrentWipeGeneration:generation]) {
+      [inFlightKeyNames_ removeObject:keyName];
+    }
+  }];
+}
+
+- (void)decryptAllKeysWithPassword:(NSString *)password {
+
+  int32_t generation = wipeGeneration_;
+  dispatch_async(queue_, ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSManagedObject *object in [self fetchKeysWithPredicate:nil error:NULL]) {
+      if (![self isCurrentWipeGeneration:generation]) {
+        break;
+      }
+      if ([[object valueForKey:kDVFileName] length] > 0) {
+        continue;
+      }
+      NSAutoreleasePool *innerPool = [[NSAutoreleasePool alloc] init];
+      NSString *keyName = [DVCacheManager cachePathForDropBoxPath:[object valueForKey:kDVKeyName]];
+      NSData *keyData = [NSData dataWithContentsOfFile:keyName];
+      if ([keyData length] > 0) {
+        DVTraceSpan span = DVTraceBegin([@"unlock " stringByAppendingString:[keyName lastPathComponent]], kDVTraceCrypto);
+        KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyData
+                                                              andPassword:password];
+        DVTraceEnd(span);
+        if (decryptor != nil && [self isCurrentWipeGeneration:generation]) {
+          [self setDecryptor:decryptor forObject:object];
+        }
+      }
+      [innerPool drain];
+    }
+    [pool drain];
+  });
+}
+
+- (void)forgetDecryptedKeys {
+
+  //
+  //  Clear the main context right away, so nothing decrypted is on screen a
+  //  moment longer than it has to be. Bumping the generation stops jobs
+  //  queued before now from decrypting anything more, and stops saves they
+  //  already made from copying their values over.
+  //
+  //  The worker follows once those jobs are done. Objects they decrypted may
+  //  already be gone from its context, so it can't be sure of finding them;
+  //  instead it clears the main context once more, after every merge queued
+  //  before it.
+  //
+
+  OSAtomicIncrement32Barrier(&wipeGeneration_);
+  @synchronized(requestedKeyNames_) {
+    [requestedKeyNames_ removeAllObjects];
+    [requestPassword_ release];
+    requestPassword_ = nil;
+  }
+  [inFlightKeyNames_ removeAllObjects];
+  [self forgetDecryptedKeysInContext:mainContext_];
+  dispatch_async(queue_, ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [self noteChanges:[self forgetDecryptedKeysInContext:workerContext_]];
+    [self saveWorkerContext];
+    [self runOnMainThread:^{
+      [self forgetDecryptedKeysInContext:mainContext_];
+    }];
+    [pool drain];
+  });
+}
+
+- (NSDictionary *)decryptedKeyValues {
+
+  NSMutableDictionary *decryptedKeyValues = [NSMutableDictionary dictionary];
+  for (NSManagedObject *object in [mainContext_ registeredObjects]) {
+    if ([object isFault] || [object isDeleted]) {
+      continue;
+    }
+    NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:
+                                   [object dictionaryWithValuesForKeys:kDVKeyStoreTransientKeys]];
+    
+    //
+    //  Values restored from before the compression flag was kept don't
+    //  have one to give back.
+    //
+    
+    if ([values objectForKey:kDVCompressed] == [NSNull null]) {
+      [values removeObjectForKey:kDVCompressed];
+    }
+    if ([[values allKeysForObject:[NSNull null]] count] == 0) {
+      [decryptedKeyValues setObject:values forKey:[object valueForKey:kDVKeyName]];
+    }
+  }
+  return decryptedKeyValues;
+}
+
+- (void)restoreDecryptedKeyValues:(NSDictionary *)decryptedKeyValues {
+
+  if ([decryptedKeyValues count] == 0) {
+    return;
+  }
+  NSMutableDictionary *copies = [NSMutableDictionary dictionaryWithCapacity:[decryptedKeyValues count]];
+  for (NSString *keyName in decryptedKeyValues) {
+    NSDictionary *values = [decryptedKeyValues objectForKey:keyName];
+    NSMutableDictionary *valueCopies = [NSMutableDictionary dictionaryWithCapacity:[values count]];
+    for (NSString *valueKey in values) {
+      [valueCopies setObject:DVKeyStoreCopyOfValue([values objectForKey:valueKey]) forKey:valueKey];
+    }
+    [copies setObject:valueCopies forKey:keyName];
+  }
+  decryptedKeyValues = copies;
+  int32_t generation = wipeGeneration_;
+  dispatch_async(queue_, ^{
+    if (![self isCurrentWipeGeneration:generation]) {
+      return;
+    }
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"(KeyName IN %@)", [decryptedKeyValues allKeys]];
+    for (NSManagedObject *object in [self fetchKeysWithPredicate:predicate error:NULL]) {
+      [object setValuesForKeysWithDictionary:[decryptedKeyValues objectForKey:[object valueForKey:kDVKeyName]]];
+    }
+
+    //
+    //  Every row is waiting on this, so save it in one go rather than in
+    //  batches.
+    //
+
+    [self saveWorkerContext];
+    [pool drain];
+  });
+}
+
+- (void)removeAllKeys {
+
+  dispatch_async(queue_, ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSString *keyName in [self fetchKeyNamesWithPredicate:nil error:NULL]) {
+      [self removeCachedFilesForKeyName:keyName];
+    }
+    for (NSManagedObjectID *objectID in [self fetchKeyIDsWithPredicate:nil error:NULL]) {
+      [workerContext_ deleteObject:[workerContext_ objectWithID:objectID]];
+      [self noteChanges:1];
+    }
+    [pool drain];
+  });
+}
+
+#pragma mark -
+#pragma mark Waiting
+
+- (void)waitUntilIdle {
+
+  __block BOOL busy = YES;
+  while (busy) {
+
+    //
+    //  A job may have queued a save behind us, so go round until there's
+    //  nothing pending, then let the main-thread blocks run. Those may queue
+    //  more work in turn.
+    //
+
+    dispatch_sync(queue_, ^{
+      busy = savePending_;
+    });
+    while (pendingMainThreadBlocks_ > 0) {
+      [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                               beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+      busy = YES;
+    }
+  }
+}
+
+@end
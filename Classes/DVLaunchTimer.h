@@ -0,0 +1,84 @@
+//
+//  DVLaunchTimer.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/15/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+//
+//  Keys of each phase dictionary returned by |+phases|.
+//
+
+#define kDVLaunchPhaseName        @"name"
+#define kDVLaunchPhaseSeconds     @"seconds"
+
+//
+//  Records named markers along the launch path, timed from when the process
+//  started (not from the first marker), so the time the system spends before
+//  |main| shows up too. Markers are kept for the life of the process and can
+//  be written out as a plist for comparison between builds.
+//
+//  Safe to call from any thread, but meant for the main thread during launch.
+//
+
+@interface DVLaunchTimer : NSObject {
+
+}
+
+//
+//  Records that the launch got as far as |phase|.
+//
+
++ (void)markPhase:(NSString *)phase;
+
+//
+//  The phases marked so far, in order. Each is a dictionary with the phase
+//  name under |kDVLaunchPhaseName| and the seconds since the process
+//  started under |kDVLaunchPhaseSeconds|.
+//
+
++ (NSArray *)phases;
+
+//
+//  One line per phase, with the time since the process started and since
+//  the previous phase, in milliseconds.
+//
+
++ (NSString *)report;
+
+//
+//  Writes |phases| to |path| as a plist. Returns |NO| if it can't.
+//
+
++ (BOOL)writePhasesToFile:(NSString *)path;
+
+//
+//  Where the application writes its launch phases: |launch-phases.plist| in
+//  the caches directory.
+//
+
++ (NSString *)defaultPhasesPath;
+
+//
+//  Forgets every phase. For benchmarks that simulate more than one launch.
+//
+
++ (void)reset;
+
+@end
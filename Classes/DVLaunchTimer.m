@@ -0,0 +1,107 @@
+//
+//  DVLaunchTimer.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/15/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <sys/sysctl.h>
+#import "DVLaunchTimer.h"
+
+static NSMutableArray *phases_;
+
+//
+//  When the process started, as a |CFAbsoluteTime|. Falls back to the first
+//  time it's asked for if the kernel won't say.
+//
+
+static CFAbsoluteTime DVProcessStartTime(void) {
+
+  static CFAbsoluteTime startTime;
+  static dispatch_once_t once;
+  dispatch_once(&once, ^{
+    struct kinfo_proc info;
+    size_t length = sizeof(info);
+    int mib[] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+    if (sysctl(mib, sizeof(mib) / sizeof(mib[0]), &info, &length, NULL, 0) == 0 && length > 0) {
+      struct timeval started = info.kp_proc.p_starttime;
+      startTime = started.tv_sec + started.tv_usec / 1e6 - kCFAbsoluteTimeIntervalSince1970;
+    } else {
+      startTime = CFAbsoluteTimeGetCurrent();
+    }
+  });
+  return startTime;
+}
+
+@implementation DVLaunchTimer
+
++ (void)markPhase:(NSString *)phase {
+
+  CFAbsoluteTime seconds = CFAbsoluteTimeGetCurrent() - DVProcessStartTime();
+  NSDictionary *record = [NSDictionary dictionaryWithObjectsAndKeys:
+                          phase, kDVLaunchPhaseName,
+                          [NSNumber numberWithDouble:seconds], kDVLaunchPhaseSeconds,
+                          nil];
+  @synchronized(self) {
+    if (phases_ == nil) {
+      phases_ = [[NSMutableArray alloc] init];
+    }
+    [phases_ addObject:record];
+  }
+}
+
++ (NSArray *)phases {
+
+  @synchronized(self) {
+    return [NSArray arrayWithArray:phases_];
+  }
+}
+
++ (NSString *)report {
+
+  NSMutableString *report = [NSMutableString string];
+  double previous = 0;
+  for (NSDictionary *phase in [self phases]) {
+    double seconds = [[phase objectForKey:kDVLaunchPhaseSeconds] doubleValue];
+    [report appendFormat:@"%8.1f ms (+%6.1f) %@\n",
+     seconds * 1000,
+     (seconds - previous) * 1000,
+     [phase objectForKey:kDVLaunchPhaseName]];
+    previous = seconds;
+  }
+  return report;
+}
+
++ (BOOL)writePhasesToFile:(NSString *)path {
+
+  return [[self phases] writeToFile:path atomically:YES];
+}
+
++ (NSString *)defaultPhasesPath {
+
+  NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+  return [caches stringByAppendingPathComponent:@"launch-phases.plist"];
+}
+
++ (void)reset {
+
+  @synchronized(self) {
+    [phases_ removeAllObjects];
+  }
+}
+
+@end
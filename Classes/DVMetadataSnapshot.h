@@ -0,0 +1,126 @@
+//
+//  DVMetadataSnapshot.h
+//  DropVault
+//
+//  A compact, versioned binary snapshot of a |DBMetadata| directory listing.
+//  The snapshot is memory-mapped when opened and individual entries are only
+//  decoded when somebody asks for them, so opening a snapshot costs the same
+//  no matter how many files are in the vault.
+//
+//  Created by Brian Dewey on 7/2/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+#import "DropboxSDK.h"
+
+//
+//  The current version of the snapshot file format. Files with any other
+//  version are rejected when opened.
+//
+
+#define kDVMetadataSnapshotVersion      1
+
+@interface DVMetadataSnapshot : NSObject {
+  @private
+  NSData *data_;
+  const void *header_;
+  const void *records_;
+  const uint32_t *stringOffsets_;
+  const char *stringData_;
+  const uint32_t *pathIndex_;
+  NSString **strings_;
+}
+
+//
+//  The number of entries in the |contents| of the root metadata.
+//
+
+@property (nonatomic, readonly) NSUInteger count;
+
+//
+//  The hash of the root metadata at the time the snapshot was written.
+//
+
+@property (nonatomic, readonly) NSString *rootHash;
+
+//
+//  Writes |metadata| to |path|. Entries are streamed to a temporary file that
+//  replaces |path| when complete, so a partially written snapshot is never
+//  visible. Returns |NO| if |metadata| is nil or the file can't be written.
+//
+
++ (BOOL)writeMetadata:(DBMetadata *)metadata toFile:(NSString *)path;
+
+//
+//  Opens the snapshot stored at |path|. Returns |nil| if the file doesn't
+//  exist or isn't a valid snapshot.
+//
+
++ (DVMetadataSnapshot *)snapshotWithContentsOfFile:(NSString *)path;
+
+//
+//  Designated initializer. |data| is usually mapped from disk. Returns |nil|
+//  if |data| is not a valid snapshot.
+//
+
+- (id)initWithData:(NSData *)data;
+
+//
+//  Creates a |DBMetadata| object for the root of the snapshot. Its |contents|
+//  array decodes each entry the first time it is accessed.
+//
+
+- (DBMetadata *)rootMetadata;
+
+//
+//  Decodes the entry at |index| in the root |contents|. Each call returns a
+//  new object; callers that want to reuse entries should hold on to them.
+//
+
+- (DBMetadata *)metadataAtIndex:(NSUInteger)index;
+
+//
+//  Finds the entry in the root |contents| whose path is exactly |path|. This
+//  is a binary search over the path index, so it does not decode any entries.
+//  Returns |NSNotFound| if there is no such entry.
+//
+
+- (NSUInteger)indexOfMetadataWithPath:(NSString *)path;
+
+@end
+
+//
+//  The |contents| array of a snapshot-backed |DBMetadata|. Entries are
+//  decoded on first access and then remembered. Like the rest of the metadata
+//  this is meant to be used from a single thread.
+//
+
+@interface DVMetadataSnapshotContents : NSArray {
+  @private
+  DVMetadataSnapshot *snapshot_;
+  NSUInteger count_;
+  id *entries_;
+}
+
+//
+//  The snapshot that backs this array.
+//
+
+@property (nonatomic, readonly) DVMetadataSnapshot *snapshot;
+
+- (id)initWithSnapshot:(DVMetadataSnapshot *)snapshot;
+
+@end
@@ -0,0 +1,570 @@
+//
+//  DVMetadataSnapshot.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/2/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//  File layout (all integers in native byte order; the snapshot never leaves
+//  the device, and a byte-swapped file fails the magic number check):
+//
+//    header        DVMetadataSnapshotHeader
+//    records       |recordCount| x DVMetadataSnapshotRecord. Record 0 is the
+//                  root; record i + 1 is |contents| entry i.
+//    path index    (|recordCount| - 1) x uint32_t. Entry indexes sorted by
+//                  the UTF-8 bytes of their path, for binary search.
+//    string offs   (|stringCount| + 1) x uint32_t. String i is the bytes in
+//                  [offs[i], offs[i + 1]) of the string data.
+//    string data   UTF-8 bytes of every distinct string, not NUL terminated.
+//
+
+#import "DVMetadataSnapshot.h"
+
+#define kDVMetadataSnapshotMagic        0x44564D53      // 'DVMS'
+
+//
+//  String index for a nil string.
+//
+
+#define kDVNoString                     0xFFFFFFFF
+
+//
+//  How many records we buffer before writing them to disk.
+//
+
+#define kDVRecordsPerWrite              1024
+
+enum {
+  kDVRecordThumbnailExists  = 1 << 0,
+  kDVRecordIsDirectory      = 1 << 1,
+  kDVRecordIsDeleted        = 1 << 2,
+  kDVRecordHasModifiedDate  = 1 << 3,
+  kDVRecordHasContents      = 1 << 4
+};
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t recordCount;
+  uint32_t stringCount;
+  uint32_t recordsOffset;
+  uint32_t pathIndexOffset;
+  uint32_t stringOffsetsOffset;
+  uint32_t stringDataOffset;
+  uint32_t stringDataLength;
+  uint32_t reserved;
+} DVMetadataSnapshotHeader;
+
+typedef struct {
+  int64_t totalBytes;
+  int64_t revision;
+  double lastModified;
+  uint32_t path;
+  uint32_t hash;
+  uint32_t humanReadableSize;
+  uint32_t root;
+  uint32_t icon;
+  uint32_t flags;
+} DVMetadataSnapshotRecord;
+
+//
+//  Used to sort the path index when writing.
+//
+
+typedef struct {
+  const char *bytes;
+  uint32_t length;
+  uint32_t index;
+} DVPathSortEntry;
+
+static int ComparePathBytes(const char *a, uint32_t aLength, const char *b, uint32_t bLength) {
+  int result = memcmp(a, b, MIN(aLength, bLength));
+  if (result == 0) {
+    result = (aLength < bLength) ? -1 : ((aLength > bLength) ? 1 : 0);
+  }
+  return result;
+}
+
+static int ComparePathSortEntries(const void *a, const void *b) {
+  const DVPathSortEntry *lhs = a;
+  const DVPathSortEntry *rhs = b;
+  return ComparePathBytes(lhs->bytes, lhs->length, rhs->bytes, rhs->length);
+}
+
+#pragma mark -
+#pragma mark Writing
+
+//
+//  State kept while streaming a snapshot to disk. Strings are de-duplicated
+//  as they are added, so repeated values like |root| and |icon| are only
+//  stored once.
+//
+
+typedef struct {
+  NSMutableDictionary *stringIndexes;
+  NSMutableData *stringOffsets;
+  NSMutableData *stringData;
+  NSMutableData *pathIndexes;
+} DVSnapshotWriter;
+
+static uint32_t WriterAddString(DVSnapshotWriter *writer, NSString *string) {
+
+  if (string == nil) {
+    return kDVNoString;
+  }
+  NSNumber *existing = [writer->stringIndexes objectForKey:string];
+  if (existing != nil) {
+    return [existing unsignedIntValue];
+  }
+  uint32_t index = (uint32_t)[writer->stringIndexes count];
+  uint32_t offset = (uint32_t)[writer->stringData length];
+  [writer->stringOffsets appendBytes:&offset length:sizeof(offset)];
+  const char *bytes = [string UTF8String];
+  [writer->stringData appendBytes:bytes length:strlen(bytes)];
+  [writer->stringIndexes setObject:[NSNumber numberWithUnsignedInt:index] forKey:string];
+  return index;
+}
+
+static void WriterFillRecord(DVSnapshotWriter *writer,
+                             DBMetadata *metadata,
+                             DVMetadataSnapshotRecord *record) {
+
+  memset(record, 0, sizeof(*record));
+  record->totalBytes = metadata.totalBytes;
+  record->revision = metadata.revision;
+  record->path = WriterAddString(writer, metadata.path);
+  record->hash = WriterAddString(writer, metadata.hash);
+  record->humanReadableSize = WriterAddString(writer, metadata.humanReadableSize);
+  record->root = WriterAddString(writer, metadata.root);
+  record->icon = WriterAddString(writer, metadata.icon);
+  if (metadata.thumbnailExists) {
+    record->flags |= kDVRecordThumbnailExists;
+  }
+  if (metadata.isDirectory) {
+    record->flags |= kDVRecordIsDirectory;
+  }
+  if (metadata.isDeleted) {
+    record->flags |= kDVRecordIsDeleted;
+  }
+  if (metadata.lastModifiedDate != nil) {
+    record->flags |= kDVRecordHasModifiedDate;
+    record->lastModified = [metadata.lastModifiedDate timeIntervalSince1970];
+  }
+  if (metadata.contents != nil) {
+    record->flags |= kDVRecordHasContents;
+  }
+}
+
+//
+//  Builds the path index: the entry indexes sorted by path.
+//
+
+static NSData *WriterCreatePathIndex(DVSnapshotWriter *writer, NSData *entryPaths) {
+
+  NSUInteger count = [entryPaths length] / sizeof(uint32_t);
+  const uint32_t *paths = [entryPaths bytes];
+  const uint32_t *offsets = [writer->stringOffsets bytes];
+  const char *stringData = [writer->stringData bytes];
+  uint32_t stringCount = (uint32_t)[writer->stringIndexes count];
+  DVPathSortEntry *entries = malloc(MAX(count, 1) * sizeof(DVPathSortEntry));
+
+  for (NSUInteger i = 0; i < count; i++) {
+    entries[i].index = (uint32_t)i;
+    if (paths[i] == kDVNoString) {
+      entries[i].bytes = "";
+      entries[i].length = 0;
+    } else {
+      uint32_t end = (paths[i] + 1 < stringCount) ? offsets[paths[i] + 1] : (uint32_t)[writer->stringData length];
+      entries[i].bytes = stringData + offsets[paths[i]];
+      entries[i].length = end - offsets[paths[i]];
+    }
+  }
+  qsort(entries, count, sizeof(DVPathSortEntry), ComparePathSortEntries);
+  NSMutableData *pathIndex = [[NSMutableData alloc] initWithLength:count * sizeof(uint32_t)];
+  uint32_t *indexes = [pathIndex mutableBytes];
+  for (NSUInteger i = 0; i < count; i++) {
+    indexes[i] = entries[i].index;
+  }
+  free(entries);
+  return pathIndex;
+}
+
+@interface DBMetadata (DVMetadataSnapshot)
+
+- (id)initWithSnapshot:(DVMetadataSnapshot *)snapshot
+                record:(const DVMetadataSnapshotRecord *)record
+              contents:(NSArray *)contents;
+
+@end
+
+@interface DVMetadataSnapshot ()
+
+- (const DVMetadataSnapshotRecord *)recordAtIndex:(NSUInteger)index;
+- (NSString *)stringAtIndex:(uint32_t)index;
+
+@end
+
+
+@implementation DVMetadataSnapshot
+
+//
+//  Writes |metadata| to disk. Records are written in batches as they are
+//  produced; only the string table and path index are held in memory until
+//  the end.
+//
+
++ (BOOL)writeMetadata:(DBMetadata *)metadata toFile:(NSString *)path {
+
+  if (metadata == nil) {
+    return NO;
+  }
+  NSString *tempPath = [path stringByAppendingPathExtension:@"tmp"];
+  FILE *file = fopen([tempPath fileSystemRepresentation], "wb");
+  if (file == NULL) {
+    return NO;
+  }
+
+  NSArray *contents = metadata.contents;
+  NSUInteger entryCount = [contents count];
+  DVSnapshotWriter writer;
+  writer.stringIndexes = [[NSMutableDictionary alloc] init];
+  writer.stringOffsets = [[NSMutableData alloc] init];
+  writer.stringData = [[NSMutableData alloc] init];
+  NSMutableData *entryPaths = [[NSMutableData alloc] initWithCapacity:entryCount * sizeof(uint32_t)];
+
+  DVMetadataSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  BOOL success = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+  //
+  //  Stream the records. Record 0 is the root.
+  //
+
+  DVMetadataSnapshotRecord *buffer = malloc(kDVRecordsPerWrite * sizeof(DVMetadataSnapshotRecord));
+  WriterFillRecord(&writer, metadata, &buffer[0]);
+  NSUInteger buffered = 1;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSUInteger i = 0; success && i < entryCount; i++) {
+    DVMetadataSnapshotRecord *record = &buffer[buffered++];
+    WriterFillRecord(&writer, [contents objectAtIndex:i], record);
+    [entryPaths appendBytes:&record->path length:sizeof(record->path)];
+    if (buffered == kDVRecordsPerWrite) {
+      success = (fwrite(buffer, sizeof(DVMetadataSnapshotRecord), buffered, file) == buffered);
+      buffered = 0;
+      [pool drain];
+      pool = [[NSAutoreleasePool alloc] init];
+    }
+  }
+  [pool drain];
+  if (success && buffered > 0) {
+    success = (fwrite(buffer, sizeof(DVMetadataSnapshotRecord), buffered, file) == buffered);
+  }
+  free(buffer);
+
+  //
+  //  Now the path index and the string table.
+  //
+
+  uint32_t stringCount = (uint32_t)[writer.stringIndexes count];
+  uint32_t stringDataLength = (uint32_t)[writer.stringData length];
+  NSData *pathIndex = WriterCreatePathIndex(&writer, entryPaths);
+  [writer.stringOffsets appendBytes:&stringDataLength length:sizeof(stringDataLength)];
+
+  header.magic = kDVMetadataSnapshotMagic;
+  header.version = kDVMetadataSnapshotVersion;
+  header.recordSize = sizeof(DVMetadataSnapshotRecord);
+  header.recordCount = (uint32_t)(entryCount + 1);
+  header.stringCount = stringCount;
+  header.recordsOffset = sizeof(DVMetadataSnapshotHeader);
+  header.pathIndexOffset = header.recordsOffset + header.recordCount * sizeof(DVMetadataSnapshotRecord);
+  header.stringOffsetsOffset = header.pathIndexOffset + (uint32_t)[pathIndex length];
+  header.stringDataOffset = header.stringOffsetsOffset + (uint32_t)[writer.stringOffsets length];
+  header.stringDataLength = stringDataLength;
+
+  success = success &&
+    (fwrite([pathIndex bytes], 1, [pathIndex length], file) == [pathIndex length]) &&
+    (fwrite([writer.stringOffsets bytes], 1, [writer.stringOffsets length], file) == [writer.stringOffsets length]) &&
+    (fwrite([writer.stringData bytes], 1, stringDataLength, file) == stringDataLength) &&
+    (fseek(file, 0, SEEK_SET) == 0) &&
+    (fwrite(&header, sizeof(header), 1, file) == 1);
+  success = (fclose(file) == 0) && success;
+
+  [pathIndex release];
+  [entryPaths release];
+  [writer.stringIndexes release];
+  [writer.stringOffsets release];
+  [writer.stringData release];
+
+  if (success) {
+    success = (rename([tempPath fileSystemRepresentation], [path fileSystemRepresentation]) == 0);
+  }
+  if (!success) {
+    unlink([tempPath fileSystemRepresentation]);
+  }
+  return success;
+}
+
+#pragma mark -
+#pragma mark Reading
+
++ (DVMetadataSnapshot *)snapshotWithContentsOfFile:(NSString *)path {
+
+  NSData *data = [NSData dataWithContentsOfFile:path
+                                        options:NSDataReadingMapped
+                                          error:NULL];
+  if (data == nil) {
+    return nil;
+  }
+  return [[[DVMetadataSnapshot alloc] initWithData:data] autorelease];
+}
+
+//
+//  Checks that the header describes a file that fits inside |data|. This is
+//  constant time; individual strings and records are checked as they are
+//  decoded.
+//
+
+- (id)initWithData:(NSData *)data {
+
+  if ((self = [super init]) != nil) {
+
+    const DVMetadataSnapshotHeader *header = [data bytes];
+    uint64_t length = [data length];
+    if (length < sizeof(DVMetadataSnapshotHeader) ||
+        header->magic != kDVMetadataSnapshotMagic ||
+        header->version != kDVMetadataSnapshotVersion ||
+        header->recordSize != sizeof(DVMetadataSnapshotRecord) ||
+        header->recordCount == 0 ||
+        (header->recordsOffset % sizeof(uint64_t)) != 0 ||
+        (header->pathIndexOffset % sizeof(uint32_t)) != 0 ||
+        (header->stringOffsetsOffset % sizeof(uint32_t)) != 0 ||
+        (uint64_t)header->recordsOffset + (uint64_t)header->recordCount * sizeof(DVMetadataSnapshotRecord) > length ||
+        (uint64_t)header->pathIndexOffset + (uint64_t)(header->recordCount - 1) * sizeof(uint32_t) > length ||
+        (uint64_t)header->stringOffsetsOffset + ((uint64_t)header->stringCount + 1) * sizeof(uint32_t) > length ||
+        (uint64_t)header->stringDataOffset + header->stringDataLength > length) {
+
+      _GTMDevLog(@"%s -- rejecting invalid metadata snapshot", __PRETTY_FUNCTION__);
+      [self release];
+      return nil;
+    }
+
+    data_ = [data retain];
+    header_ = header;
+    records_ = (const char *)header + header->recordsOffset;
+    pathIndex_ = (const uint32_t *)((const char *)header + header->pathIndexOffset);
+    stringOffsets_ = (const uint32_t *)((const char *)header + header->stringOffsetsOffset);
+    stringData_ = (const char *)header + header->stringDataOffset;
+    strings_ = calloc(MAX(header->stringCount, 1), sizeof(NSString *));
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  if (strings_ != NULL) {
+    uint32_t stringCount = ((const DVMetadataSnapshotHeader *)header_)->stringCount;
+    for (uint32_t i = 0; i < stringCount; i++) {
+      [strings_[i] release];
+    }
+    free(strings_);
+  }
+  [data_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)count {
+  return ((const DVMetadataSnapshotHeader *)header_)->recordCount - 1;
+}
+
+- (NSString *)rootHash {
+  return [self stringAtIndex:[self recordAtIndex:0]->hash];
+}
+
+//
+//  PRIVATE: Gets record |index|, where 0 is the root.
+//
+
+- (const DVMetadataSnapshotRecord *)recordAtIndex:(NSUInteger)index {
+  return (const DVMetadataSnapshotRecord *)records_ + index;
+}
+
+//
+//  PRIVATE: Gets a string from the string table. Strings are created the
+//  first time they are asked for and shared after that. Returns |nil| for
+//  |kDVNoString| or for a string that doesn't fit in the file.
+//
+
+- (NSString *)stringAtIndex:(uint32_t)index {
+
+  const DVMetadataSnapshotHeader *header = header_;
+  if (index >= header->stringCount) {
+    return nil;
+  }
+  if (strings_[index] == nil) {
+    uint32_t start = stringOffsets_[index];
+    uint32_t end = stringOffsets_[index + 1];
+    if (start > end || end > header->stringDataLength) {
+      return nil;
+    }
+    strings_[index] = [[NSString alloc] initWithBytes:stringData_ + start
+                                               length:end - start
+                                             encoding:NSUTF8StringEncoding];
+  }
+  return strings_[index];
+}
+
+- (DBMetadata *)rootMetadata {
+
+  const DVMetadataSnapshotRecord *record = [self recordAtIndex:0];
+  DVMetadataSnapshotContents *contents = nil;
+  if ((record->flags & kDVRecordHasContents) != 0) {
+    contents = [[[DVMetadataSnapshotContents alloc] initWithSnapshot:self] autorelease];
+  }
+  return [[[DBMetadata alloc] initWithSnapshot:self record:record contents:contents] autorelease];
+}
+
+- (DBMetadata *)metadataAtIndex:(NSUInteger)index {
+
+  if (index >= [self count]) {
+    [NSException raise:NSRangeException
+                format:@"Index %u beyond bounds of snapshot with %u entries", index, [self count]];
+  }
+  return [[[DBMetadata alloc] initWithSnapshot:self
+                                        record:[self recordAtIndex:index + 1]
+                                      contents:nil] autorelease];
+}
+
+//
+//  Binary search over the path index, comparing raw UTF-8 bytes so nothing
+//  gets decoded along the way.
+//
+
+- (NSUInteger)indexOfMetadataWithPath:(NSString *)path {
+
+  if (path == nil) {
+    return NSNotFound;
+  }
+  const DVMetadataSnapshotHeader *header = header_;
+  const char *target = [path UTF8String];
+  uint32_t targetLength = (uint32_t)strlen(target);
+  NSUInteger count = [self count];
+  NSUInteger low = 0;
+  NSUInteger high = count;
+
+  while (low < high) {
+    NSUInteger mid = low + (high - low) / 2;
+    uint32_t entry = pathIndex_[mid];
+    if (entry >= count) {
+      return NSNotFound;
+    }
+    uint32_t stringIndex = [self recordAtIndex:entry + 1]->path;
+    const char *bytes = "";
+    uint32_t length = 0;
+    if (stringIndex < header->stringCount) {
+      uint32_t start = stringOffsets_[stringIndex];
+      uint32_t end = stringOffsets_[stringIndex + 1];
+      if (start > end || end > header->stringDataLength) {
+        return NSNotFound;
+      }
+      bytes = stringData_ + start;
+      length = end - start;
+    }
+    int comparison = ComparePathBytes(bytes, length, target, targetLength);
+    if (comparison == 0) {
+      return entry;
+    } else if (comparison < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NSNotFound;
+}
+
+@end
+
+#pragma mark -
+
+@implementation DVMetadataSnapshotContents
+
+@synthesize snapshot = snapshot_;
+
+- (id)initWithSnapshot:(DVMetadataSnapshot *)snapshot {
+
+  if ((self = [super init]) != nil) {
+    snapshot_ = [snapshot retain];
+    count_ = [snapshot count];
+    entries_ = calloc(MAX(count_, 1), sizeof(id));
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  for (NSUInteger i = 0; i < count_; i++) {
+    [entries_[i] release];
+  }
+  free(entries_);
+  [snapshot_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)count {
+  return count_;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+
+  if (index >= count_) {
+    [NSException raise:NSRangeException
+                format:@"Index %u beyond bounds [0 .. %u]", index, count_];
+  }
+  if (entries_[index] == nil) {
+    entries_[index] = [[snapshot_ metadataAtIndex:index] retain];
+  }
+  return entries_[index];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DBMetadata (DVMetadataSnapshot)
+
+- (id)initWithSnapshot:(DVMetadataSnapshot *)snapshot
+                record:(const DVMetadataSnapshotRecord *)record
+              contents:(NSArray *)theContents {
+
+  if ((self = [super init]) != nil) {
+    thumbnailExists = (record->flags & kDVRecordThumbnailExists) != 0;
+    totalBytes = record->totalBytes;
+    if ((record->flags & kDVRecordHasModifiedDate) != 0) {
+      lastModifiedDate = [[NSDate alloc] initWithTimeIntervalSince1970:record->lastModified];
+    }
+    path = [[snapshot stringAtIndex:record->path] retain];
+    isDirectory = (record->flags & kDVRecordIsDirectory) != 0;
+    contents = [theContents retain];
+    hash = [[snapshot stringAtIndex:record->hash] retain];
+    humanReadableSize = [[snapshot stringAtIndex:record->humanReadableSize] retain];
+    root = [[snapshot stringAtIndex:record->root] retain];
+    icon = [[snapshot stringAtIndex:record->icon] retain];
+    revision = record->revision;
+    isDeleted = (record->flags & kDVRecordIsDeleted) != 0;
+  }
+  return self;
+}
+
+@end
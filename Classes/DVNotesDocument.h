@@ -0,0 +1,243 @@
+//
+//  DVNotesDocument.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/20/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+@class DVCacheManager;
+@class DVChunkManifest;
+@class KeyFileDecryptor;
+@protocol DVNotesDocumentDelegate;
+
+//
+//  How long to wait after the last edit before saving.
+//
+
+#define kDVNotesSaveDelay         (2.0)
+
+//
+//  The notes attached to one vault entry, kept decrypted in memory while the
+//  entry is open. The notes live in the entry's sidecar files: a key file
+//  with the AES key and IV for the notes, and the encrypted notes text.
+//
+//  The sidecar key is decrypted once, the first time it's needed, and reused
+//  for every load and save after that. If there is no sidecar key yet, one is
+//  made on the first save and uploaded once along with the notes. A sidecar
+//  key that's there but won't decrypt is never replaced; saves fail instead,
+//  and tell the delegate.
+//
+//  Setting |text| schedules a save |saveDelay| seconds later; more edits in
+//  that window push the save back. Saves encrypt and write the notes off the
+//  main thread, and upload only the notes data file, and only if the text
+//  changed since the last save. While an upload is in flight, the next one
+//  waits for it, so each save doesn't start an upload of its own.
+//
+//  Chunked notes keep the text in a directory of chunks next to the
+//  sidecars, and the notes data file is just the encrypted manifest (see
+//  |DVChunkManifest|). A save writes and uploads only the chunks that
+//  changed, and then the manifest; reading fetches only the chunks that
+//  aren't in the cache yet.
+//
+//  All methods must be called on the main thread.
+//
+
+@interface DVNotesDocument : NSObject {
+
+@private
+  NSString *notesDataPath_;
+  NSString *notesKeyPath_;
+  NSString *notesChunksPath_;
+  NSString *password_;
+  DVCacheManager *cacheManager_;
+  KeyFileDecryptor *decryptor_;
+  NSString *text_;
+  NSString *savedText_;
+  NSString *editingText_;
+  NSTimeInterval saveDelay_;
+  BOOL synchronousSaves_;
+  BOOL compressesNewNotes_;
+  BOOL chunksNewNotes_;
+  BOOL keyNeedsUpload_;
+  BOOL uploading_;
+  BOOL uploadPending_;
+  DVChunkManifest *lastManifest_;
+  NSArray *writtenChunkNames_;
+  NSMutableSet *uploadedChunkNames_;
+  NSMutableSet *chunkUploads_;
+  BOOL chunkUploadFailed_;
+  dispatch_queue_t queue_;
+  id<DVNotesDocumentDelegate> delegate_;
+}
+
+//
+//  Creates the notes for the vault entry whose cached data file is
+//  |cacheDataPath|. |password| unlocks the sidecar key, and |cacheManager|
+//  uploads the sidecar files.
+//
+
+- (id)initWithCacheDataPath:(NSString *)cacheDataPath
+                   password:(NSString *)password
+               cacheManager:(DVCacheManager *)cacheManager;
+
+//
+//  The cache paths of the sidecar files.
+//
+
+@property (nonatomic, readonly) NSString *notesDataPath;
+@property (nonatomic, readonly) NSString *notesKeyPath;
+
+//
+//  The cache path of the directory that holds the chunks of chunked notes.
+//
+
+@property (nonatomic, readonly) NSString *notesChunksPath;
+
+//
+//  Told when a save fails.
+//
+
+@property (nonatomic, assign) id<DVNotesDocumentDelegate> delegate;
+
+//
+//  The notes. Decrypted from the cached notes file the first time it's read,
+//  or the empty string if there are no notes yet. Setting it schedules a save.
+//
+//  |nil| while the notes file is cached but can't be read yet: its key isn't
+//  cached or won't decrypt, or some of its chunks aren't cached. Until it can
+//  be read, setting |text| does nothing, and neither does |save|, so notes
+//  that haven't loaded are never saved over.
+//
+
+@property (nonatomic, copy) NSString *text;
+
+//
+//  YES once |text| has been read.
+//
+
+@property (nonatomic, readonly, getter=isLoaded) BOOL loaded;
+
+//
+//  YES if |text| has changed since it was last saved.
+//
+
+@property (nonatomic, readonly) BOOL hasUnsavedChanges;
+
+//
+//  How long to wait after the last edit before saving. Defaults to
+//  |kDVNotesSaveDelay|.
+//
+
+@property (nonatomic, assign) NSTimeInterval saveDelay;
+
+//
+//  If YES, saves encrypt, write, and start their uploads before |save|
+//  returns. Defaults to NO; set it for unit tests.
+//
+
+@property (nonatomic, assign) BOOL synchronousSaves;
+
+//
+//  If YES, a sidecar key made by the first save says the notes are
+//  compressed, and they're compressed before they're encrypted from then on.
+//  Notes that already have a key keep doing what it says. Defaults to NO,
+//  because DropVault clients that predate compression can't read compressed
+//  notes.
+//
+
+@property (nonatomic, assign) BOOL compressesNewNotes;
+
+//
+//  If YES, a sidecar key made by the first save says the notes are chunked,
+//  and they're saved as chunks from then on. Defaults to NO, for the same
+//  reason as |compressesNewNotes|.
+//
+
+@property (nonatomic, assign) BOOL chunksNewNotes;
+
+//
+//  YES if |cachePath| is one of the notes' files: a sidecar, or a chunk.
+//
+
+- (BOOL)isNotesFile:(NSString *)cachePath;
+
+//
+//  For chunked notes, asks the cache manager for every chunk the cached
+//  manifest lists that isn't in the cache yet.
+//
+
+- (void)cacheMissingChunks;
+
+//
+//  Remembers |text|, so |cancelEditing| can go back to it.
+//
+
+- (void)beginEditing;
+
+//
+//  Puts back the text from |beginEditing|, and saves it if any edits since
+//  then were saved.
+//
+
+- (void)cancelEditing;
+
+//
+//  Saves now, if there's anything to save, rather than waiting for the
+//  scheduled save.
+//
+
+- (void)save;
+
+//
+//  A newer copy of the notes arrived in the cache. Throws away the decrypted
+//  text, so it's read again next time, unless there are unsaved changes.
+//
+
+- (void)reload;
+
+//
+//  Tells the notes that |cacheManager| finished an upload of |dropBoxPath|,
+//  so a waiting upload can go.
+//
+
+- (void)didFinishUploadOfFile:(NSString *)dropBoxPath;
+
+//
+//  Tells the notes that an upload of |dropBoxPath| failed. A waiting upload
+//  can go, but if it was a chunk, the manifest that needs it doesn't. The
+//  path can also be the file's cache path, which is what failed uploads
+//  report. A |nil| path means an upload of an unknown file failed.
+//
+
+- (void)didFailUploadOfFile:(NSString *)dropBoxPath;
+
+@end
+
+//
+//  Defines the messages sent to the DVNotesDocumentDelegate.
+//
+
+@protocol DVNotesDocumentDelegate
+
+//
+//  The notes couldn't be saved, because their sidecar key won't decrypt with
+//  the password. The changes are still unsaved.
+//
+
+- (void)notesDocumentDidFailToSave:(DVNotesDocument *)document;
+@end
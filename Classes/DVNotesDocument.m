@@ -0,0 +1,503 @@
+//
+//  DVNotesDocument.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/20/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVNotesDocument.h"
+#import "DVCacheManager.h"
+#import "DVChunkManifest.h"
+#import "DVVaultIndex.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSData+CompressionHelpers.h"
+#import "DVTrace.h"
+
+//
+//  The clear file name stored in a new sidecar key.
+//
+
+#define kDVNotesFileName          @"notes.txt"
+
+@interface DVNotesDocument ()
+@property (nonatomic, copy) NSString *savedText;
+@property (nonatomic, copy) NSString *editingText;
+- (KeyFileDecryptor *)decryptor;
+- (KeyFileDecryptor *)createDecryptor;
+- (NSData *)dataFromManifestData:(NSData *)manifestData decryptor:(KeyFileDecryptor *)decryptor;
+- (void)cacheChunksMissingFromManifest:(DVChunkManifest *)manifest;
+- (void)uploadNotes;
+- (void)uploadNextPart;
+- (void)finishUploadOfFile:(NSString *)dropBoxPath succeeded:(BOOL)succeeded;
+@end
+
+
+@implementation DVNotesDocument
+
+@synthesize notesDataPath = notesDataPath_;
+@synthesize notesKeyPath = notesKeyPath_;
+@synthesize notesChunksPath = notesChunksPath_;
+@synthesize saveDelay = saveDelay_;
+@synthesize synchronousSaves = synchronousSaves_;
+@synthesize compressesNewNotes = compressesNewNotes_;
+@synthesize chunksNewNotes = chunksNewNotes_;
+@synthesize delegate = delegate_;
+@synthesize savedText = savedText_;
+@synthesize editingText = editingText_;
+
+- (id)initWithCacheDataPath:(NSString *)cacheDataPath
+                   password:(NSString *)password
+               cacheManager:(DVCacheManager *)cacheManager {
+
+  if ((self = [super init]) != nil) {
+    notesDataPath_ = [[DVVaultIndex pathForKind:DVVaultEntryKindDataSidecar
+                                companionOfPath:cacheDataPath] copy];
+    notesKeyPath_ = [[DVVaultIndex pathForKind:DVVaultEntryKindKeySidecar
+                               companionOfPath:cacheDataPath] copy];
+    notesChunksPath_ = [[[notesDataPath_ stringByDeletingPathExtension]
+                         stringByAppendingPathExtension:@"chunks"] copy];
+    password_ = [password copy];
+    cacheManager_ = [cacheManager retain];
+    saveDelay_ = kDVNotesSaveDelay;
+    uploadedChunkNames_ = [[NSMutableSet alloc] init];
+    chunkUploads_ = [[NSMutableSet alloc] init];
+    queue_ = dispatch_queue_create("org.brians-brain.dropvault.notes", NULL);
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [notesDataPath_ release];
+  [notesKeyPath_ release];
+  [notesChunksPath_ release];
+  [password_ release];
+  [cacheManager_ release];
+  [decryptor_ release];
+  [text_ release];
+  [savedText_ release];
+  [editingText_ release];
+  [lastManifest_ release];
+  [writtenChunkNames_ release];
+  [uploadedChunkNames_ release];
+  [chunkUploads_ release];
+  dispatch_release(queue_);
+  [super dealloc];
+}
+
+#pragma mark -
+#pragma mark Sidecar key
+
+//
+//  PRIVATE: Gets the sidecar key, decrypting it the first time. Returns |nil|
+//  if there is no sidecar key in the cache.
+//
+
+- (KeyFileDecryptor *)decryptor {
+
+  if (decryptor_ == nil) {
+    NSData *keyData = [NSData dataWithContentsOfFile:notesKeyPath_];
+    if (keyData != nil) {
+      DVTraceSpan span = DVTraceBegin(@"unlock notes key", kDVTraceCrypto);
+      decryptor_ = [[KeyFileDecryptor decryptorWithData:keyData andPassword:password_] retain];
+      DVTraceEnd(span);
+    }
+  }
+  return decryptor_;
+}
+
+//
+//  PRIVATE: Makes a new sidecar key, writes it to the cache, and remembers
+//  that it needs uploading.
+//
+
+- (KeyFileDecryptor *)createDecryptor {
+
+  _GTMDevAssert(decryptor_ == nil, @"Should not replace a sidecar key");
+  decryptor_ = [[KeyFileDecryptor alloc] init];
+  decryptor_.key = [NSData dataWithRandomBytes:kCCKeySizeAES128];
+  decryptor_.iv = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+  decryptor_.fileName = kDVNotesFileName;
+  decryptor_.password = password_;
+  decryptor_.compressed = compressesNewNotes_;
+  decryptor_.chunked = chunksNewNotes_;
+  [[decryptor_ encryptedBlob] writeToFile:notesKeyPath_ atomically:YES];
+  keyNeedsUpload_ = YES;
+  return decryptor_;
+}
+
+#pragma mark -
+#pragma mark Text
+
+- (NSString *)text {
+
+  if (text_ == nil) {
+    NSString *text = nil;
+    NSMutableData *cipherData = [NSMutableData dataWithContentsOfFile:notesDataPath_];
+    KeyFileDecryptor *decryptor = (cipherData != nil) ? [self decryptor] : nil;
+    if (cipherData == nil) {
+      text = @"";
+    } else if (decryptor != nil) {
+      [cipherData aesDecryptInPlaceWithKey:decryptor.key andIV:decryptor.iv];
+      NSData *clearData = nil;
+      if (decryptor.chunked) {
+        clearData = [self dataFromManifestData:cipherData decryptor:decryptor];
+      } else {
+        clearData = decryptor.compressed ? [cipherData zlibInflate] : cipherData;
+      }
+      if (clearData != nil) {
+        text = [[[NSString alloc] initWithData:clearData encoding:NSUTF8StringEncoding] autorelease];
+      }
+    }
+    if (text == nil) {
+      _GTMDevLog(@"%s -- can't read %@ yet", __PRETTY_FUNCTION__, notesDataPath_);
+      return nil;
+    }
+    text_ = [text copy];
+    self.savedText = text_;
+  }
+  return text_;
+}
+
+- (BOOL)isLoaded {
+  return self.text != nil;
+}
+
+//
+//  Sets the text and pushes the scheduled save back. The saved text gets
+//  loaded first, so there's something to compare against; if it can't be,
+//  the new text is dropped.
+//
+
+- (void)setText:(NSString *)text {
+
+  if (self.text == nil) {
+    return;
+  }
+  if (text_ != text) {
+    [text_ release];
+    text_ = [(text != nil ? text : @"") copy];
+  }
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(save)
+                                             object:nil];
+  if ([self hasUnsavedChanges]) {
+    [self performSelector:@selector(save) withObject:nil afterDelay:saveDelay_];
+  }
+}
+
+- (BOOL)hasUnsavedChanges {
+  return text_ != nil && ![text_ isEqualToString:savedText_];
+}
+
+- (void)beginEditing {
+  self.editingText = self.text;
+}
+
+- (void)cancelEditing {
+
+  if (editingText_ != nil) {
+    self.text = editingText_;
+    self.editingText = nil;
+  }
+  [self save];
+}
+
+- (void)reload {
+
+  if ([self hasUnsavedChanges] || editingText_ != nil) {
+    return;
+  }
+  [text_ release];
+  text_ = nil;
+  if (!keyNeedsUpload_) {
+    [decryptor_ release];
+    decryptor_ = nil;
+  }
+}
+
+#pragma mark -
+#pragma mark Chunks
+
+- (BOOL)isNotesFile:(NSString *)cachePath {
+
+  return [cachePath isEqualToString:notesDataPath_] ||
+    [cachePath isEqualToString:notesKeyPath_] ||
+    [[cachePath stringByDeletingLastPathComponent] isEqualToString:notesChunksPath_];
+}
+
+//
+//  PRIVATE: Joins the chunks of a decrypted manifest, and remembers the
+//  manifest, so the next save can reuse its chunks. Returns |nil|, and asks
+//  for the missing chunks, if they aren't all cached.
+//
+//  DropBox gets a manifest only after it has all of its chunks, so if the
+//  cached manifest is the one DropBox has, so are its chunks.
+//
+
+- (NSData *)dataFromManifestData:(NSData *)manifestData decryptor:(KeyFileDecryptor *)decryptor {
+
+  DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithManifestData:manifestData] autorelease];
+  if (manifest == nil) {
+    return nil;
+  }
+  NSData *clearData = [manifest dataFromDirectory:notesChunksPath_
+                                              key:decryptor.key
+                                       compressed:decryptor.compressed];
+  if (clearData == nil) {
+    [self cacheChunksMissingFromManifest:manifest];
+    return nil;
+  }
+  [writtenChunkNames_ release];
+  writtenChunkNames_ = [manifest.chunkNames retain];
+  if ([cacheManager_ cacheStateForPath:notesDataPath_] == DVCacheStateEquivalent) {
+    [uploadedChunkNames_ addObjectsFromArray:manifest.chunkNames];
+  }
+  if (synchronousSaves_) {
+    [lastManifest_ release];
+    lastManifest_ = [manifest retain];
+  } else {
+    dispatch_async(queue_, ^(void) {
+      [lastManifest_ release];
+      lastManifest_ = [manifest retain];
+    });
+  }
+  return clearData;
+}
+
+//
+//  PRIVATE: Asks the cache manager for the chunks of |manifest| that aren't
+//  in the cache.
+//
+
+- (void)cacheChunksMissingFromManifest:(DVChunkManifest *)manifest {
+
+  for (NSString *name in [manifest namesOfChunksMissingFromDirectory:notesChunksPath_]) {
+    NSString *chunkPath = [notesChunksPath_ stringByAppendingPathComponent:name];
+    [cacheManager_ cacheCopyOfDropBoxPath:[DVCacheManager dropBoxPathForCachePath:chunkPath]];
+  }
+}
+
+- (void)cacheMissingChunks {
+
+  KeyFileDecryptor *decryptor = [self decryptor];
+  if (!decryptor.chunked) {
+    return;
+  }
+  NSMutableData *manifestData = [NSMutableData dataWithContentsOfFile:notesDataPath_];
+  [manifestData aesDecryptInPlaceWithKey:decryptor.key andIV:decryptor.iv];
+  [self cacheChunksMissingFromManifest:[[[DVChunkManifest alloc] initWithManifestData:manifestData] autorelease]];
+}
+
+#pragma mark -
+#pragma mark Saving
+
+- (void)save {
+
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(save)
+                                             object:nil];
+
+  //
+  //  Notes that haven't loaded have no |text_|, and so nothing to save.
+  //
+
+  if (![self hasUnsavedChanges]) {
+    return;
+  }
+  KeyFileDecryptor *decryptor = [self decryptor];
+  if (decryptor == nil) {
+
+    //
+    //  Only make a key if there isn't one. Replacing one that won't decrypt
+    //  would lose every other copy of the notes.
+    //
+
+    if ([[NSFileManager defaultManager] fileExistsAtPath:notesKeyPath_]) {
+      _GTMDevLog(@"%s -- can't unlock %@", __PRETTY_FUNCTION__, notesKeyPath_);
+      [delegate_ notesDocumentDidFailToSave:self];
+      return;
+    }
+    decryptor = [self createDecryptor];
+  }
+  NSData *key = decryptor.key;
+  NSData *iv = decryptor.iv;
+  BOOL compressed = decryptor.compressed;
+  BOOL chunked = decryptor.chunked;
+  NSString *text = [[text_ copy] autorelease];
+  NSString *notesDataPath = notesDataPath_;
+  NSString *notesChunksPath = notesChunksPath_;
+  __block NSArray *chunkNames = nil;
+  self.savedText = text;
+  BOOL uploadKey = keyNeedsUpload_;
+  keyNeedsUpload_ = NO;
+
+  dispatch_block_t write = ^(void) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    DVTraceSpan span = DVTraceBegin(@"save notes", kDVTraceCrypto);
+    NSData *clearData = [text dataUsingEncoding:NSUTF8StringEncoding];
+    if (chunked) {
+
+      //
+      //  Write the chunks that changed, and save the manifest in place of
+      //  the notes. If the chunks can't be written, keep the last manifest.
+      //
+
+      DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithData:clearData
+                                                        previousManifest:lastManifest_
+                                                               directory:notesChunksPath
+                                                                     key:key
+                                                              compressed:compressed] autorelease];
+      if (manifest != nil) {
+        [lastManifest_ release];
+        lastManifest_ = [manifest retain];
+        chunkNames = [manifest.chunkNames retain];
+      }
+      clearData = manifest.manifestData;
+    } else if (compressed) {
+      clearData = [clearData zlibDeflate];
+    }
+    if (clearData != nil) {
+      NSMutableData *cipherData = [NSMutableData dataWithData:clearData];
+      [cipherData aesEncryptInPlaceWithKey:key andIV:iv];
+      [cipherData writeToFile:notesDataPath atomically:YES];
+    }
+    DVTraceEnd(span);
+    [pool drain];
+  };
+  dispatch_block_t upload = ^(void) {
+    if (chunkNames != nil) {
+      [writtenChunkNames_ release];
+      writtenChunkNames_ = chunkNames;
+    }
+    if (uploadKey) {
+      [cacheManager_ uploadCacheToDropBoxPath:[DVCacheManager dropBoxPathForCachePath:notesKeyPath_]];
+    }
+    [self uploadNotes];
+  };
+
+  if (synchronousSaves_) {
+    write();
+    upload();
+  } else {
+    dispatch_async(queue_, ^(void) {
+      write();
+      dispatch_async(dispatch_get_main_queue(), upload);
+    });
+  }
+}
+
+//
+//  PRIVATE: Uploads the notes, unless an upload of them is already in
+//  flight; then it goes when that one finishes, and picks up whatever was
+//  saved in between.
+//
+
+- (void)uploadNotes {
+
+  if (uploading_) {
+    uploadPending_ = YES;
+    return;
+  }
+  uploading_ = YES;
+  uploadPending_ = NO;
+  [self uploadNextPart];
+}
+
+//
+//  PRIVATE: Uploads the chunks the saved manifest lists that DropBox doesn't
+//  have yet, all at once. When there are none left, uploads the notes data
+//  file, so DropBox never has a manifest without its chunks.
+//
+
+- (void)uploadNextPart {
+
+  NSMutableArray *chunkPaths = [NSMutableArray array];
+  for (NSString *name in writtenChunkNames_) {
+    NSString *chunkPath = [DVCacheManager dropBoxPathForCachePath:[notesChunksPath_ stringByAppendingPathComponent:name]];
+    if (![uploadedChunkNames_ containsObject:name] && ![chunkPaths containsObject:chunkPath]) {
+      [chunkPaths addObject:chunkPath];
+    }
+  }
+  if ([chunkPaths count] > 0) {
+    _GTMDevLog(@"%s -- uploading %u chunks", __PRETTY_FUNCTION__, [chunkPaths count]);
+    [chunkUploads_ addObjectsFromArray:chunkPaths];
+    for (NSString *chunkPath in chunkPaths) {
+      [cacheManager_ uploadCacheToDropBoxPath:chunkPath];
+    }
+    return;
+  }
+  _GTMDevLog(@"%s -- uploading %@", __PRETTY_FUNCTION__, notesDataPath_);
+  [cacheManager_ uploadCacheToDropBoxPath:[DVCacheManager dropBoxPathForCachePath:notesDataPath_]];
+}
+
+- (void)didFinishUploadOfFile:(NSString *)dropBoxPath {
+  [self finishUploadOfFile:dropBoxPath succeeded:YES];
+}
+
+- (void)didFailUploadOfFile:(NSString *)dropBoxPath {
+  [self finishUploadOfFile:dropBoxPath succeeded:NO];
+}
+
+//
+//  PRIVATE: An upload is done. When the last chunk is up, the manifest goes;
+//  if any of them failed, it waits for the next save. |dropBoxPath| may be
+//  the cache path, when it comes from a failed |DBRestClient| upload.
+//
+
+- (void)finishUploadOfFile:(NSString *)dropBoxPath succeeded:(BOOL)succeeded {
+
+  if (!uploading_) {
+    return;
+  }
+  if (dropBoxPath != nil) {
+    dropBoxPath = [DVCacheManager dropBoxPathForCachePath:dropBoxPath];
+  }
+  if ([chunkUploads_ count] > 0) {
+    if (dropBoxPath == nil) {
+      [chunkUploads_ removeAllObjects];
+      chunkUploadFailed_ = YES;
+    } else if ([chunkUploads_ containsObject:dropBoxPath]) {
+      [chunkUploads_ removeObject:dropBoxPath];
+      if (succeeded) {
+        [uploadedChunkNames_ addObject:[dropBoxPath lastPathComponent]];
+      } else {
+        chunkUploadFailed_ = YES;
+      }
+    } else {
+      return;
+    }
+    if ([chunkUploads_ count] > 0) {
+      return;
+    }
+    if (!chunkUploadFailed_) {
+      [self uploadNextPart];
+      return;
+    }
+    chunkUploadFailed_ = NO;
+  } else if (dropBoxPath != nil &&
+             ![dropBoxPath isEqualToString:[DVCacheManager dropBoxPathForCachePath:notesDataPath_]]) {
+    return;
+  }
+  uploading_ = NO;
+  if (uploadPending_) {
+    [self uploadNotes];
+  }
+}
+
+@end
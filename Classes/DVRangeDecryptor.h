@@ -0,0 +1,82 @@
+//
+//  DVRangeDecryptor.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/22/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+//
+//  Decrypts any byte range of a file encrypted the way DropVault encrypts
+//  documents (AES128, CBC, PKCS7 padding) without decrypting what comes
+//  before it. In CBC mode, each block only needs the ciphertext block in front
+//  of it as its IV, so a range costs the same to decrypt wherever it is in
+//  the file.
+//
+//  This lets a viewer that reads a document out of order -- a PDF, say, whose
+//  cross reference table is at the end -- show part of it long before the
+//  whole file would have decrypted.
+//
+//  Thread safe.
+//
+
+@interface DVRangeDecryptor : NSObject {
+
+@private
+  NSFileHandle *inputHandle_;
+  NSData *key_;
+  NSData *iv_;
+  unsigned long long length_;
+  unsigned long long bytesDecrypted_;
+}
+
+//
+//  Opens the encrypted file at |path|. Returns nil if it can't be read, or
+//  it isn't something |key| and |iv| encrypted.
+//
+
+- (id)initWithFile:(NSString *)path key:(NSData *)key iv:(NSData *)iv;
+
+//
+//  The length of the cleartext.
+//
+
+@property (nonatomic, readonly) unsigned long long length;
+
+//
+//  How many bytes have been decrypted so far, for every range asked for.
+//
+
+@property (nonatomic, readonly) unsigned long long bytesDecrypted;
+
+//
+//  Decrypts up to |count| bytes starting at |offset| into |buffer|, and
+//  returns how many bytes it decrypted. That's fewer than |count| only at the
+//  end of the file, or if the file can't be read.
+//
+
+- (size_t)getBytes:(void *)buffer atOffset:(unsigned long long)offset count:(size_t)count;
+
+//
+//  Makes a data provider that decrypts only the bytes it's asked for. The
+//  provider keeps the decryptor. The caller must release the provider.
+//
+
+- (CGDataProviderRef)newDataProvider;
+
+@end
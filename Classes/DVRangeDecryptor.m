@@ -0,0 +1,198 @@
+//
+//  DVRangeDecryptor.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/22/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVRangeDecryptor.h"
+
+@interface DVRangeDecryptor ()
+- (BOOL)readCipherBlocksAtOffset:(unsigned long long)offset
+                          length:(size_t)length
+                        intoData:(NSMutableData *)data;
+- (BOOL)readPadding;
+@end
+
+#pragma mark -
+#pragma mark Data provider callbacks
+
+static size_t DVRangeDecryptorGetBytes(void *info, void *buffer, off_t position, size_t count) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  size_t copied = [(DVRangeDecryptor *)info getBytes:buffer atOffset:position count:count];
+  [pool drain];
+  return copied;
+}
+
+static void DVRangeDecryptorReleaseInfo(void *info) {
+  [(DVRangeDecryptor *)info release];
+}
+
+
+@implementation DVRangeDecryptor
+
+@synthesize length = length_;
+
+- (id)initWithFile:(NSString *)path key:(NSData *)key iv:(NSData *)iv {
+
+  if ((self = [super init]) != nil) {
+    inputHandle_ = [[NSFileHandle fileHandleForReadingAtPath:path] retain];
+    key_ = [key copy];
+    iv_ = [iv copy];
+    if (inputHandle_ == nil || [iv_ length] != kCCBlockSizeAES128 || ![self readPadding]) {
+      [self release];
+      return nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [inputHandle_ closeFile];
+  [inputHandle_ release];
+  [key_ release];
+  [iv_ release];
+  [super dealloc];
+}
+
+- (unsigned long long)bytesDecrypted {
+
+  unsigned long long bytesDecrypted;
+  @synchronized(self) {
+    bytesDecrypted = bytesDecrypted_;
+  }
+  return bytesDecrypted;
+}
+
+//
+//  PRIVATE: Reads whole cipher blocks, plus the block in front of them to use
+//  as the IV, into |data|. The first block's IV is |iv_|. |offset| and
+//  |length| must be multiples of the block size.
+//
+
+- (BOOL)readCipherBlocksAtOffset:(unsigned long long)offset
+                          length:(size_t)length
+                        intoData:(NSMutableData *)data {
+
+  [data setLength:0];
+  if (offset == 0) {
+    [data appendData:iv_];
+    [inputHandle_ seekToFileOffset:0];
+    [data appendData:[inputHandle_ readDataOfLength:length]];
+  } else {
+    [inputHandle_ seekToFileOffset:offset - kCCBlockSizeAES128];
+    [data appendData:[inputHandle_ readDataOfLength:length + kCCBlockSizeAES128]];
+  }
+  return [data length] == length + kCCBlockSizeAES128;
+}
+
+//
+//  PRIVATE: Works out the cleartext length from the padding in the last
+//  block. Returns NO if the padding is bad, which is what the wrong key
+//  looks like.
+//
+
+- (BOOL)readPadding {
+
+  unsigned long long cipherLength = [inputHandle_ seekToEndOfFile];
+  if (cipherLength == 0 || cipherLength % kCCBlockSizeAES128 != 0) {
+    return NO;
+  }
+  NSMutableData *blocks = [NSMutableData data];
+  if (![self readCipherBlocksAtOffset:cipherLength - kCCBlockSizeAES128
+                               length:kCCBlockSizeAES128
+                             intoData:blocks]) {
+    return NO;
+  }
+  unsigned char last[kCCBlockSizeAES128];
+  size_t moved;
+  CCCryptorStatus status = CCCrypt(kCCDecrypt,
+                                   kCCAlgorithmAES128,
+                                   0,
+                                   [key_ bytes],
+                                   [key_ length],
+                                   [blocks bytes],
+                                   [blocks bytes] + kCCBlockSizeAES128,
+                                   kCCBlockSizeAES128,
+                                   last,
+                                   sizeof(last),
+                                   &moved);
+  unsigned char padding = last[kCCBlockSizeAES128 - 1];
+  if (status != kCCSuccess || padding == 0 || padding > kCCBlockSizeAES128) {
+    return NO;
+  }
+  for (NSUInteger i = kCCBlockSizeAES128 - padding; i < kCCBlockSizeAES128; i++) {
+    if (last[i] != padding) {
+      return NO;
+    }
+  }
+  length_ = cipherLength - padding;
+  return YES;
+}
+
+- (size_t)getBytes:(void *)buffer atOffset:(unsigned long long)offset count:(size_t)count {
+
+  if (offset >= length_) {
+    return 0;
+  }
+  count = (size_t)MIN((unsigned long long)count, length_ - offset);
+  unsigned long long firstBlock = offset - offset % kCCBlockSizeAES128;
+  unsigned long long end = offset + count;
+  unsigned long long lastBlock = end + (kCCBlockSizeAES128 - end % kCCBlockSizeAES128) % kCCBlockSizeAES128;
+  size_t blockLength = (size_t)(lastBlock - firstBlock);
+
+  NSMutableData *blocks = [NSMutableData dataWithCapacity:blockLength + kCCBlockSizeAES128];
+  NSMutableData *clearText = [NSMutableData dataWithLength:blockLength];
+  size_t moved = 0;
+  @synchronized(self) {
+    if (![self readCipherBlocksAtOffset:firstBlock length:blockLength intoData:blocks]) {
+      return 0;
+    }
+    bytesDecrypted_ += blockLength;
+  }
+  CCCryptorStatus status = CCCrypt(kCCDecrypt,
+                                   kCCAlgorithmAES128,
+                                   0,
+                                   [key_ bytes],
+                                   [key_ length],
+                                   [blocks bytes],
+                                   [blocks bytes] + kCCBlockSizeAES128,
+                                   blockLength,
+                                   [clearText mutableBytes],
+                                   blockLength,
+                                   &moved);
+  if (status != kCCSuccess || moved != blockLength) {
+    return 0;
+  }
+  memcpy(buffer, [clearText bytes] + (offset - firstBlock), count);
+  return count;
+}
+
+- (CGDataProviderRef)newDataProvider {
+
+  CGDataProviderDirectCallbacks callbacks = {
+    0,
+    NULL,
+    NULL,
+    DVRangeDecryptorGetBytes,
+    DVRangeDecryptorReleaseInfo
+  };
+  return CGDataProviderCreateDirect([self retain], (off_t)length_, &callbacks);
+}
+
+@end
@@ -30,6 +30,9 @@
 #define kDVErrorShow                NSLocalizedString(@"Could not show file", @"UIWebView load failed message")
 #define kDVErrorDecrypt             NSLocalizedString(@"Could not decrypt file", @"Decrypt error message")
 #define kDVErrorDelete              NSLocalizedString(@"Could not delete file", @"Delete error message")
+#define kDVErrorSaveNotes           NSLocalizedString(@"Could not save notes", @"Notes save error message")
 #define kDVErrorLoadMetadataFailed  NSLocalizedString(@"Could not connect to DropBox", @"Load metadata failed")
 #define kDVErrorCoreDataUnexpected  NSLocalizedString(@"Could not load internal database", @"Core Data failed")
+#define kDVStringDelete             NSLocalizedString(@"Delete", @"Delete button text")
+#define kDVStringDeleteCount        NSLocalizedString(@"Delete (%u)", @"Delete button text with the number of checked rows")
 #define kDVStringNotesTitle         NSLocalizedString(@"Notes", @"Title string for notes")
\ No newline at end of file
@@ -24,7 +24,7 @@
 
 @protocol DVTextEditDelegate;
 
-@interface DVTextEditController : UIViewController {
+@interface DVTextEditController : UIViewController <UITextViewDelegate> {
     
   @private
   UITextView *textView_;
@@ -55,5 +55,13 @@
 @protocol DVTextEditDelegate
 - (void)textEditControllerDidCancel:(DVTextEditController *)controller;
 - (void)textEditControllerDidFinish:(DVTextEditController *)controller;
+
+@optional
+
+//
+//  The user changed the text.
+//
+
+- (void)textEditControllerDidChange:(DVTextEditController *)controller;
 @end
 
@@ -60,6 +60,7 @@
 - (void)viewDidLoad {
   
   [super viewDidLoad];
+  self.textView.delegate = self;
 }
 
 - (void)viewDidUnload {
@@ -95,4 +96,16 @@
   [delegate_ textEditControllerDidFinish:self];
 }
 
+#pragma mark - UITextViewDelegate
+
+//
+//  Someone typed. Let the delegate know, if it cares.
+//
+
+- (void)textViewDidChange:(UITextView *)textView {
+  if ([(id)delegate_ respondsToSelector:@selector(textEditControllerDidChange:)]) {
+    [delegate_ textEditControllerDidChange:self];
+  }
+}
+
 @end
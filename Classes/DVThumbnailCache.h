@@ -0,0 +1,157 @@
+//
+//  DVThumbnailCache.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/21/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <UIKit/UIKit.h>
+
+//
+//  The longest side of a thumbnail, in pixels. Twice the list's 48 point
+//  icons, so they're sharp on a Retina display.
+//
+
+#define kDVThumbnailSize          96
+
+//
+//  Makes and keeps small previews of vault documents, so the document list
+//  can show them without decrypting whole documents.
+//
+//  A thumbnail is made once, from the decrypted document, the first time the
+//  document is opened. It's encrypted with the document's own key, and a
+//  fresh IV that's stored in front of it, and kept in the thumbnail
+//  directory under the name of the document's key file. It never leaves the
+//  device: other DropVault clients wouldn't know what to do with it. The
+//  thumbnail's name also holds the revision of the data file it was made
+//  from, if that's known, so it can be dropped when the document changes.
+//
+//  Thumbnails are made one at a time on a low priority queue, so they never
+//  get in the way of opening the document itself. Images and PDFs get
+//  thumbnails; everything else keeps its icon.
+//
+//  All methods must be called on the main thread. Completion blocks are run
+//  on the main thread.
+//
+
+@interface DVThumbnailCache : NSObject {
+
+@private
+  NSString *directory_;
+  dispatch_queue_t queue_;
+  NSCache *images_;
+  NSMutableDictionary *thumbnailNames_;
+  NSMutableDictionary *revisions_;
+  NSMutableSet *pendingKeyNames_;
+  NSMutableSet *loadingKeyNames_;
+  NSUInteger imageGeneration_;
+}
+
+//
+//  Creates a cache keeping its thumbnails in |directory|.
+//
+
+- (id)initWithDirectory:(NSString *)directory;
+
+//
+//  Where the thumbnails go by default: |Thumbnails| in the caches directory.
+//
+
++ (NSString *)defaultDirectory;
+
+//
+//  YES if documents named |fileName| can have thumbnails.
+//
+
++ (BOOL)canMakeThumbnailForFileName:(NSString *)fileName;
+
+//
+//  Draws |page| on white, as large as fits in |size| pixels. The caller must
+//  release the image.
+//
+
++ (CGImageRef)newImageOfPDFPage:(CGPDFPageRef)page fittingSize:(CGSize)size;
+
+@property (nonatomic, readonly) NSString *directory;
+
+//
+//  YES if there's a thumbnail for the document whose key file is |keyName|.
+//  The thumbnail directory is listed once, so this doesn't touch the disk.
+//
+
+- (BOOL)hasThumbnailForKeyName:(NSString *)keyName;
+
+//
+//  Makes a thumbnail for the document whose key file is |keyName| from its
+//  decrypted copy at |path|, and encrypts it with |key|. Does nothing if
+//  there already is one, or one is being made, or the document can't have
+//  one. |completion| gets whether a new thumbnail was made.
+//
+
+- (void)makeThumbnailForKeyName:(NSString *)keyName
+                       fromFile:(NSString *)path
+                        withKey:(NSData *)key
+                     completion:(void (^)(BOOL made))completion;
+
+//
+//  The decrypted thumbnail for |keyName| if it's already in memory, or |nil|.
+//  This never touches the disk, so it's safe to call while drawing a row.
+//
+
+- (UIImage *)cachedThumbnailForKeyName:(NSString *)keyName;
+
+//
+//  Reads the thumbnail for the document whose key file is |keyName| and
+//  decrypts it with |key| on the thumbnail queue, then calls |completion| on
+//  the main thread with it, or |nil| if there isn't one or it can't be read.
+//  Decrypted thumbnails are kept in memory until memory runs low, or until
+//  |forgetDecryptedImages|; a read that was still going then is dropped, and
+//  its |completion| isn't called. Asking again while a read is going does
+//  nothing.
+//
+
+- (void)loadThumbnailForKeyName:(NSString *)keyName
+                        withKey:(NSData *)key
+                     completion:(void (^)(UIImage *thumbnail))completion;
+
+//
+//  Tells the cache the current revisions of data files, as |NSNumber|s keyed
+//  by the name of their key files. Thumbnails made from any other revision
+//  are thrown away, and new thumbnails are marked with these.
+//
+
+- (void)updateRevisions:(NSDictionary *)revisions;
+
+//
+//  Throws away every decrypted thumbnail kept in memory. The encrypted ones
+//  on disk stay.
+//
+
+- (void)forgetDecryptedImages;
+
+//
+//  Throws away the thumbnail for |keyName|.
+//
+
+- (void)removeThumbnailForKeyName:(NSString *)keyName;
+
+//
+//  Throws away every thumbnail.
+//
+
+- (void)removeAllThumbnails;
+
+@end
@@ -0,0 +1,392 @@
+//
+//  DVThumbnailCache.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/21/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVThumbnailCache.h"
+#import "NSData+EncryptionHelpers.h"
+#import "DVTrace.h"
+
+#define kDVThumbnailExtension     @"thumb"
+#define kDVThumbnailQuality       (0.7)
+
+//
+//  Image types |UIImage| can read.
+//
+
+#define kDVThumbnailImageTypes    [NSSet setWithObjects:@"png", @"jpg", @"jpeg", @"gif", @"tif", @"tiff", @"bmp", nil]
+
+@interface DVThumbnailCache ()
+- (NSString *)baseNameForKeyName:(NSString *)keyName;
+- (NSString *)currentFileNameForKeyName:(NSString *)keyName;
+- (NSString *)pathForKeyName:(NSString *)keyName;
+- (NSMutableDictionary *)thumbnailNames;
++ (CGImageRef)newThumbnailOfFile:(NSString *)path;
++ (UIImage *)thumbnailAtPath:(NSString *)path withKey:(NSData *)key;
+@end
+
+
+@implementation DVThumbnailCache
+
+@synthesize directory = directory_;
+
+- (id)initWithDirectory:(NSString *)directory {
+
+  if ((self = [super init]) != nil) {
+    directory_ = [directory copy];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory_
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+    queue_ = dispatch_queue_create("org.brians-brain.dropvault.thumbnails", NULL);
+    dispatch_set_target_queue(queue_, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+    images_ = [[NSCache alloc] init];
+    revisions_ = [[NSMutableDictionary alloc] init];
+    pendingKeyNames_ = [[NSMutableSet alloc] init];
+    loadingKeyNames_ = [[NSMutableSet alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [directory_ release];
+  dispatch_release(queue_);
+  [images_ release];
+  [thumbnailNames_ release];
+  [revisions_ release];
+  [pendingKeyNames_ release];
+  [loadingKeyNames_ release];
+  [super dealloc];
+}
+
++ (NSString *)defaultDirectory {
+
+  NSArray *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+  return [[paths objectAtIndex:0] stringByAppendingPathComponent:@"Thumbnails"];
+}
+
++ (BOOL)canMakeThumbnailForFileName:(NSString *)fileName {
+
+  NSString *extension = [[fileName pathExtension] lowercaseString];
+  return [extension isEqualToString:@"pdf"] || [kDVThumbnailImageTypes containsObject:extension];
+}
+
+//
+//  PRIVATE: The key file's name, without its extension.
+//
+
+- (NSString *)baseNameForKeyName:(NSString *)keyName {
+  return [[keyName lastPathComponent] stringByDeletingPathExtension];
+}
+
+//
+//  PRIVATE: The name a thumbnail of the current revision of |keyName|'s
+//  document gets: the base name, the revision if it's known, and
+//  |kDVThumbnailExtension|.
+//
+
+- (NSString *)currentFileNameForKeyName:(NSString *)keyName {
+
+  NSString *name = [self baseNameForKeyName:keyName];
+  NSNumber *revision = [revisions_ objectForKey:keyName];
+  if (revision != nil) {
+    name = [name stringByAppendingFormat:@".%lld", [revision longLongValue]];
+  }
+  return [name stringByAppendingPathExtension:kDVThumbnailExtension];
+}
+
+//
+//  PRIVATE: Where the thumbnail for |keyName| is, or goes if there isn't one.
+//
+
+- (NSString *)pathForKeyName:(NSString *)keyName {
+
+  NSString *name = [[self thumbnailNames] objectForKey:[self baseNameForKeyName:keyName]];
+  if (name == nil) {
+    name = [self currentFileNameForKeyName:keyName];
+  }
+  return [directory_ stringByAppendingPathComponent:name];
+}
+
+//
+//  PRIVATE: The names of the files in the thumbnail directory, keyed by the
+//  base name of their key files. Listed the first time they're needed.
+//
+
+- (NSMutableDictionary *)thumbnailNames {
+
+  if (thumbnailNames_ == nil) {
+    NSArray *names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory_ error:NULL];
+    thumbnailNames_ = [[NSMutableDictionary alloc] initWithCapacity:[names count]];
+    for (NSString *name in names) {
+      if (![[name pathExtension] isEqualToString:kDVThumbnailExtension]) {
+        continue;
+      }
+      NSString *baseName = [name stringByDeletingPathExtension];
+      NSString *revision = [baseName pathExtension];
+      if ([revision length] > 0 &&
+          [revision rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location == NSNotFound) {
+        baseName = [baseName stringByDeletingPathExtension];
+      }
+      [thumbnailNames_ setObject:name forKey:baseName];
+    }
+  }
+  return thumbnailNames_;
+}
+
+- (BOOL)hasThumbnailForKeyName:(NSString *)keyName {
+  return [[self thumbnailNames] objectForKey:[self baseNameForKeyName:keyName]] != nil;
+}
+
+#pragma mark -
+#pragma mark Making thumbnails
+
++ (CGImageRef)newImageOfPDFPage:(CGPDFPageRef)page fittingSize:(CGSize)size {
+
+  CGRect box = CGPDFPageGetBoxRect(page, kCGPDFCropBox);
+  CGFloat scale = MIN(size.width / MAX(box.size.width, 1.0), size.height / MAX(box.size.height, 1.0));
+  size_t width = MAX(1, (size_t)round(box.size.width * scale));
+  size_t height = MAX(1, (size_t)round(box.size.height * scale));
+  CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(NULL,
+                                               width,
+                                               height,
+                                               8,
+                                               width * 4,
+                                               colorSpace,
+                                               kCGImageAlphaPremultipliedLast);
+  CGColorSpaceRelease(colorSpace);
+
+  //
+  //  PDF pages have no background of their own.
+  //
+
+  CGContextSetRGBFillColor(context, 1.0, 1.0, 1.0, 1.0);
+  CGContextFillRect(context, CGRectMake(0, 0, width, height));
+  CGContextScaleCTM(context, scale, scale);
+  CGContextTranslateCTM(context, -box.origin.x, -box.origin.y);
+  CGContextDrawPDFPage(context, page);
+  CGImageRef image = CGBitmapContextCreateImage(context);
+  CGContextRelease(context);
+  return image;
+}
+
+//
+//  PRIVATE: Draws the first page of a PDF, or an image, scaled to fit in
+//  |kDVThumbnailSize| pixels. Returns |NULL| if the file can't be read. The
+//  caller must release the image.
+//
+
++ (CGImageRef)newThumbnailOfFile:(NSString *)path {
+
+  if ([[[path pathExtension] lowercaseString] isEqualToString:@"pdf"]) {
+    CGPDFDocumentRef document = CGPDFDocumentCreateWithURL((CFURLRef)[NSURL fileURLWithPath:path]);
+    CGPDFPageRef page = (document != NULL) ? CGPDFDocumentGetPage(document, 1) : NULL;
+    CGImageRef thumbnail = NULL;
+    if (page != NULL) {
+      thumbnail = [self newImageOfPDFPage:page fittingSize:CGSizeMake(kDVThumbnailSize, kDVThumbnailSize)];
+    }
+    CGPDFDocumentRelease(document);
+    return thumbnail;
+  }
+
+  CGImageRef image = CGImageRetain([[UIImage imageWithContentsOfFile:path] CGImage]);
+  if (image == NULL) {
+    return NULL;
+  }
+  CGFloat scale = MIN(1.0, kDVThumbnailSize / (CGFloat)MAX(MAX(CGImageGetWidth(image), CGImageGetHeight(image)), 1));
+  size_t width = MAX(1, (size_t)round(CGImageGetWidth(image) * scale));
+  size_t height = MAX(1, (size_t)round(CGImageGetHeight(image) * scale));
+  CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(NULL,
+                                               width,
+                                               height,
+                                               8,
+                                               width * 4,
+                                               colorSpace,
+                                               kCGImageAlphaPremultipliedLast);
+  CGColorSpaceRelease(colorSpace);
+  CGContextSetInterpolationQuality(context, kCGInterpolationHigh);
+  CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+  CGImageRef thumbnail = CGBitmapContextCreateImage(context);
+  CGContextRelease(context);
+  CGImageRelease(image);
+  return thumbnail;
+}
+
+- (void)makeThumbnailForKeyName:(NSString *)keyName
+                       fromFile:(NSString *)path
+                        withKey:(NSData *)key
+                     completion:(void (^)(BOOL))completion {
+
+  if (keyName == nil ||
+      key == nil ||
+      ![DVThumbnailCache canMakeThumbnailForFileName:path] ||
+      [pendingKeyNames_ containsObject:keyName] ||
+      [self hasThumbnailForKeyName:keyName]) {
+    if (completion != nil) {
+      completion(NO);
+    }
+    return;
+  }
+  [pendingKeyNames_ addObject:keyName];
+  NSString *thumbnailPath = [directory_ stringByAppendingPathComponent:[self currentFileNameForKeyName:keyName]];
+  path = [[path copy] autorelease];
+  keyName = [[keyName copy] autorelease];
+  dispatch_async(queue_, ^(void) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    DVTraceSpan span = DVTraceBegin(@"thumbnail", kDVTraceCrypto);
+    BOOL made = NO;
+    CGImageRef thumbnail = [DVThumbnailCache newThumbnailOfFile:path];
+    if (thumbnail != NULL) {
+      NSData *jpeg = UIImageJPEGRepresentation([UIImage imageWithCGImage:thumbnail], kDVThumbnailQuality);
+      NSData *iv = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+      NSMutableData *blob = [NSMutableData dataWithData:iv];
+      [blob appendData:[jpeg aesEncryptWithKey:key andIV:iv]];
+      made = [blob writeToFile:thumbnailPath atomically:YES];
+      CGImageRelease(thumbnail);
+    }
+    DVTraceEnd(span);
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
+      [pendingKeyNames_ removeObject:keyName];
+      if (made) {
+        [[self thumbnailNames] setObject:[thumbnailPath lastPathComponent]
+                                  forKey:[self baseNameForKeyName:keyName]];
+      }
+      if (completion != nil) {
+        completion(made);
+      }
+    });
+    [pool drain];
+  });
+}
+
+#pragma mark -
+#pragma mark Reading thumbnails
+
+- (UIImage *)cachedThumbnailForKeyName:(NSString *)keyName {
+  return [images_ objectForKey:keyName];
+}
+
+//
+//  PRIVATE: Decrypts the thumbnail stored at |path| with |key|. Runs on the
+//  thumbnail queue.
+//
+
++ (UIImage *)thumbnailAtPath:(NSString *)path withKey:(NSData *)key {
+
+  NSData *blob = [NSData dataWithContentsOfFile:path];
+  if ([blob length] <= kCCBlockSizeAES128) {
+    return nil;
+  }
+  NSData *iv = [blob subdataWithRange:NSMakeRange(0, kCCBlockSizeAES128)];
+  NSMutableData *jpeg = [NSMutableData dataWithData:
+                         [blob subdataWithRange:NSMakeRange(kCCBlockSizeAES128, [blob length] - kCCBlockSizeAES128)]];
+  [jpeg aesDecryptInPlaceWithKey:key andIV:iv];
+
+  //
+  //  Thumbnails are drawn at twice the size they're shown at.
+  //
+
+  CGImageRef cgImage = [[UIImage imageWithData:jpeg] CGImage];
+  if (cgImage == NULL) {
+    return nil;
+  }
+  return [UIImage imageWithCGImage:cgImage scale:2.0 orientation:UIImageOrientationUp];
+}
+
+- (void)loadThumbnailForKeyName:(NSString *)keyName
+                        withKey:(NSData *)key
+                     completion:(void (^)(UIImage *))completion {
+
+  UIImage *image = [images_ objectForKey:keyName];
+  if (image != nil || key == nil || ![self hasThumbnailForKeyName:keyName]) {
+    if (completion != nil) {
+      completion(image);
+    }
+    return;
+  }
+  if ([loadingKeyNames_ containsObject:keyName]) {
+    return;
+  }
+  [loadingKeyNames_ addObject:keyName];
+  NSString *path = [self pathForKeyName:keyName];
+  NSUInteger generation = imageGeneration_;
+  keyName = [[keyName copy] autorelease];
+  dispatch_async(queue_, ^(void) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    DVTraceSpan span = DVTraceBegin(@"load thumbnail", kDVTraceCrypto);
+    UIImage *thumbnail = [[DVThumbnailCache thumbnailAtPath:path withKey:key] retain];
+    DVTraceEnd(span);
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
+      [loadingKeyNames_ removeObject:keyName];
+      if (generation == imageGeneration_) {
+        if (thumbnail != nil) {
+          [images_ setObject:thumbnail forKey:keyName];
+        }
+        if (completion != nil) {
+          completion(thumbnail);
+        }
+      }
+      [thumbnail release];
+    });
+    [pool drain];
+  });
+}
+
+#pragma mark -
+#pragma mark Removing thumbnails
+
+- (void)updateRevisions:(NSDictionary *)revisions {
+
+  [revisions_ addEntriesFromDictionary:revisions];
+  NSMutableDictionary *thumbnailNames = [self thumbnailNames];
+  for (NSString *keyName in revisions) {
+    NSString *name = [thumbnailNames objectForKey:[self baseNameForKeyName:keyName]];
+    if (name != nil && ![name isEqualToString:[self currentFileNameForKeyName:keyName]]) {
+      [self removeThumbnailForKeyName:keyName];
+    }
+  }
+}
+
+- (void)forgetDecryptedImages {
+  imageGeneration_++;
+  [images_ removeAllObjects];
+}
+
+- (void)removeThumbnailForKeyName:(NSString *)keyName {
+
+  [images_ removeObjectForKey:keyName];
+  [[NSFileManager defaultManager] removeItemAtPath:[self pathForKeyName:keyName] error:NULL];
+  [[self thumbnailNames] removeObjectForKey:[self baseNameForKeyName:keyName]];
+}
+
+- (void)removeAllThumbnails {
+
+  [images_ removeAllObjects];
+  [[self thumbnailNames] removeAllObjects];
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+  [[NSFileManager defaultManager] createDirectoryAtPath:directory_
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+}
+
+@end
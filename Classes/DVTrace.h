@@ -0,0 +1,140 @@
+//
+//  DVTrace.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/17/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+//
+//  The user default that turns tracing on when the application launches.
+//
+
+#define kDVTraceEnabledKey  @"DVTraceEnabled"
+
+//
+//  Names for the stages of the pipeline, used as span categories.
+//
+
+#define kDVTraceNetwork     @"network"
+#define kDVTraceParse       @"parse"
+#define kDVTraceCoreData    @"coredata"
+#define kDVTraceCrypto      @"crypto"
+#define kDVTraceUI          @"ui"
+
+//
+//  Identifies a span. |kDVTraceNoSpan| is what you get when tracing is off,
+//  and can be passed anywhere a span is expected.
+//
+
+typedef int32_t DVTraceSpan;
+
+#define kDVTraceNoSpan      0
+
+//
+//  The most events kept. Anything past this is dropped, so leaving tracing
+//  on can't grow memory without bound.
+//
+
+#define kDVTraceMaxEvents   100000
+
+//
+//  Whether tracing is on. Read it through the macros below, which check it
+//  before doing anything else; set it with |+[DVTrace setEnabled:]|.
+//
+
+extern BOOL DVTraceEnabled;
+
+//
+//  Records nested spans of work, and exports them in the Chrome trace event
+//  format (load the file in chrome://tracing), so something like opening a
+//  document can be looked at as one timeline.
+//
+//  There are two kinds of span:
+//
+//  - A scoped span covers work done in one go on one thread, and must end on
+//    that thread before anything begun outside it does. Scoped spans nest
+//    inside whichever scoped span the thread is already in.
+//
+//  - An asynchronous span can end anywhere, any time (a network request, say).
+//    It nests under the |parent| it's given, and nothing nests under it
+//    unless it's passed as a parent.
+//
+//  Use the macros, not the class methods, so a disabled trace costs one test
+//  of |DVTraceEnabled|. Thread safe.
+//
+
+#define DVTraceBegin(name, category) \
+  (DVTraceEnabled ? [DVTrace beginSpan:(name) category:(category)] : kDVTraceNoSpan)
+
+#define DVTraceBeginAsync(name, category, parent) \
+  (DVTraceEnabled ? [DVTrace beginAsyncSpan:(name) category:(category) parent:(parent)] : kDVTraceNoSpan)
+
+#define DVTraceEnd(span) \
+  do { if ((span) != kDVTraceNoSpan) { [DVTrace endSpan:(span)]; } } while (0)
+
+@interface DVTrace : NSObject {
+
+}
+
+//
+//  Turns tracing on or off. Turning it on doesn't clear what was recorded
+//  before.
+//
+
++ (void)setEnabled:(BOOL)enabled;
+
++ (DVTraceSpan)beginSpan:(NSString *)name category:(NSString *)category;
+
++ (DVTraceSpan)beginAsyncSpan:(NSString *)name
+                     category:(NSString *)category
+                       parent:(DVTraceSpan)parent;
+
+//
+//  Ends |span|. Ending a span that isn't open does nothing.
+//
+
++ (void)endSpan:(DVTraceSpan)span;
+
+//
+//  Every event recorded so far, as Chrome trace event dictionaries.
+//
+
++ (NSArray *)events;
+
+//
+//  Writes |events| to |path| as a Chrome trace file. Returns |NO| if it
+//  can't.
+//
+
++ (BOOL)writeTraceToFile:(NSString *)path;
+
+//
+//  Where the application writes its trace: |trace.json| in the caches
+//  directory.
+//
+
++ (NSString *)defaultTracePath;
+
+//
+//  Forgets every event and open span.
+//
+
++ (void)reset;
+
+@end
@@ -0,0 +1,222 @@
+//
+//  DVTrace.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/17/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import "DVTrace.h"
+#import "NSObject+SBJSON.h"
+
+//
+//  Every event goes in one category, and the stage goes in its arguments:
+//  Chrome only nests asynchronous events that share a category and an ID.
+//
+
+#define kDVTraceEventCategory   @"dropvault"
+#define kDVTraceStackKey        @"DVTraceStack"
+
+BOOL DVTraceEnabled = NO;
+
+static NSMutableArray *events_;
+static NSMutableDictionary *openSpans_;
+static CFAbsoluteTime epoch_;
+static volatile int32_t lastSpan_;
+
+//
+//  A span that has begun and not ended.
+//
+
+@interface DVTraceOpenSpan : NSObject {
+@public
+  NSString *name_;
+  DVTraceSpan root_;
+  BOOL scoped_;
+}
+@end
+
+@implementation DVTraceOpenSpan
+
+- (void)dealloc {
+  [name_ release];
+  [super dealloc];
+}
+
+@end
+
+@interface DVTrace ()
++ (DVTraceSpan)beginSpan:(NSString *)name
+                category:(NSString *)category
+                  parent:(DVTraceSpan)parent
+                  scoped:(BOOL)scoped;
++ (void)addEventWithPhase:(NSString *)phase
+                     name:(NSString *)name
+                     root:(DVTraceSpan)root
+                     args:(NSDictionary *)args;
+@end
+
+@implementation DVTrace
+
++ (void)initialize {
+
+  if (self == [DVTrace class]) {
+    events_ = [[NSMutableArray alloc] init];
+    openSpans_ = [[NSMutableDictionary alloc] init];
+    epoch_ = CFAbsoluteTimeGetCurrent();
+  }
+}
+
++ (void)setEnabled:(BOOL)enabled {
+
+  DVTraceEnabled = enabled;
+}
+
+//
+//  PRIVATE: Records one event. Times are microseconds since the trace
+//  started; the thread is the Mach thread number, which is what Instruments
+//  and the debugger show.
+//
+
++ (void)addEventWithPhase:(NSString *)phase
+                     name:(NSString *)name
+                     root:(DVTraceSpan)root
+                     args:(NSDictionary *)args {
+
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+  NSMutableDictionary *event = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                phase, @"ph",
+                                name, @"name",
+                                kDVTraceEventCategory, @"cat",
+                                [NSString stringWithFormat:@"0x%x", root], @"id",
+                                [NSNumber numberWithInt:getpid()], @"pid",
+                                [NSNumber numberWithUnsignedInt:pthread_mach_thread_np(pthread_self())], @"tid",
+                                nil];
+  if (args != nil) {
+    [event setObject:args forKey:@"args"];
+  }
+  @synchronized(self) {
+    if ([events_ count] < kDVTraceMaxEvents) {
+      [event setObject:[NSNumber numberWithDouble:(now - epoch_) * 1e6] forKey:@"ts"];
+      [events_ addObject:event];
+    }
+  }
+}
+
++ (DVTraceSpan)beginSpan:(NSString *)name
+                category:(NSString *)category
+                  parent:(DVTraceSpan)parent
+                  scoped:(BOOL)scoped {
+
+  NSMutableArray *stack = nil;
+  if (scoped) {
+    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
+    stack = [threadDictionary objectForKey:kDVTraceStackKey];
+    if (stack == nil) {
+      stack = [NSMutableArray array];
+      [threadDictionary setObject:stack forKey:kDVTraceStackKey];
+    }
+    if (parent == kDVTraceNoSpan) {
+      parent = [[stack lastObject] intValue];
+    }
+  }
+
+  DVTraceSpan span = OSAtomicIncrement32Barrier(&lastSpan_);
+  DVTraceOpenSpan *openSpan = [[[DVTraceOpenSpan alloc] init] autorelease];
+  openSpan->name_ = [name copy];
+  openSpan->root_ = span;
+  openSpan->scoped_ = scoped;
+  @synchronized(self) {
+    if (parent != kDVTraceNoSpan) {
+      DVTraceOpenSpan *parentSpan = [openSpans_ objectForKey:[NSNumber numberWithInt:parent]];
+      if (parentSpan != nil) {
+        openSpan->root_ = parentSpan->root_;
+      }
+    }
+    [openSpans_ setObject:openSpan forKey:[NSNumber numberWithInt:span]];
+  }
+  [stack addObject:[NSNumber numberWithInt:span]];
+  [self addEventWithPhase:@"b"
+                     name:name
+                     root:openSpan->root_
+                     args:[NSDictionary dictionaryWithObject:category forKey:@"stage"]];
+  return span;
+}
+
++ (DVTraceSpan)beginSpan:(NSString *)name category:(NSString *)category {
+
+  return [self beginSpan:name category:category parent:kDVTraceNoSpan scoped:YES];
+}
+
++ (DVTraceSpan)beginAsyncSpan:(NSString *)name
+                     category:(NSString *)category
+                       parent:(DVTraceSpan)parent {
+
+  return [self beginSpan:name category:category parent:parent scoped:NO];
+}
+
++ (void)endSpan:(DVTraceSpan)span {
+
+  NSNumber *key = [NSNumber numberWithInt:span];
+  DVTraceOpenSpan *openSpan = nil;
+  @synchronized(self) {
+    openSpan = [[[openSpans_ objectForKey:key] retain] autorelease];
+    [openSpans_ removeObjectForKey:key];
+  }
+  if (openSpan == nil) {
+    return;
+  }
+  if (openSpan->scoped_) {
+    [[[[NSThread currentThread] threadDictionary] objectForKey:kDVTraceStackKey] removeObject:key];
+  }
+  [self addEventWithPhase:@"e" name:openSpan->name_ root:openSpan->root_ args:nil];
+}
+
++ (NSArray *)events {
+
+  @synchronized(self) {
+    return [NSArray arrayWithArray:events_];
+  }
+}
+
++ (BOOL)writeTraceToFile:(NSString *)path {
+
+  NSDictionary *trace = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [self events], @"traceEvents",
+                         @"ms", @"displayTimeUnit",
+                         nil];
+  NSData *data = [[trace JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+  return [data writeToFile:path atomically:YES];
+}
+
++ (NSString *)defaultTracePath {
+
+  NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+  return [caches stringByAppendingPathComponent:@"trace.json"];
+}
+
++ (void)reset {
+
+  @synchronized(self) {
+    [events_ removeAllObjects];
+    [openSpans_ removeAllObjects];
+    epoch_ = CFAbsoluteTimeGetCurrent();
+  }
+}
+
+@end
@@ -0,0 +1,270 @@
+//
+//  DVVaultCrypto.c
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "DVVaultCrypto.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonHMAC.h>
+#define kDVVaultDigestLength        CC_SHA1_DIGEST_LENGTH
+#else
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+#define kDVVaultDigestLength        SHA_DIGEST_LENGTH
+#endif
+
+//
+//  How many times the HMAC is applied for each block of derived bytes.
+//
+
+#define kDVVaultIterations          1000
+
+struct DVVaultCryptor {
+#ifdef __APPLE__
+  CCCryptorRef cryptor;
+#else
+  EVP_CIPHER_CTX *context;
+#endif
+};
+
+static void DVVaultHmac(const void *password,
+                        size_t passwordLength,
+                        const void *data,
+                        size_t dataLength,
+                        unsigned char mac[kDVVaultDigestLength]) {
+
+#ifdef __APPLE__
+  CCHmac(kCCHmacAlgSHA1, password, passwordLength, data, dataLength, mac);
+#else
+  HMAC(EVP_sha1(), password, (int)passwordLength, data, dataLength, mac, NULL);
+#endif
+}
+
+void DVVaultDeriveBytes(const void *password,
+                        size_t passwordLength,
+                        const void *salt,
+                        size_t saltLength,
+                        void *bytes,
+                        size_t length) {
+
+  //
+  //  The salt gets 4 bytes on the end that change for each block.
+  //
+
+  size_t countedSaltLength = saltLength + 4;
+  unsigned char *countedSalt = calloc(countedSaltLength, 1);
+  memcpy(countedSalt, salt, saltLength);
+
+  unsigned char mac[kDVVaultDigestLength];
+  unsigned char block[kDVVaultDigestLength];
+  unsigned char *output = bytes;
+  unsigned char blockCount = 0;
+  size_t generatedBytes = 0;
+
+  while (generatedBytes < length) {
+
+    //
+    //  Each time through this loop, I need to update the very last byte
+    //  of the salt buffer. (If I implemented the full RFC2898 algorithm,
+    //  then I'd be ready to twiddle the last 4 bytes. I don't.)
+    //
+
+    blockCount++;
+    countedSalt[countedSaltLength - 1] = blockCount;
+
+    //
+    //  The first iteration hashes the salt; each one after hashes the
+    //  previous iteration's output.
+    //
+
+    DVVaultHmac(password, passwordLength, countedSalt, countedSaltLength, mac);
+    memcpy(block, mac, kDVVaultDigestLength);
+    for (int iteration = 1; iteration < kDVVaultIterations; iteration++) {
+      DVVaultHmac(password, passwordLength, mac, kDVVaultDigestLength, mac);
+      for (int i = 0; i < kDVVaultDigestLength; i++) {
+        block[i] ^= mac[i];
+      }
+    }
+
+    size_t bytesToCopy = length - generatedBytes;
+    if (bytesToCopy > kDVVaultDigestLength) {
+      bytesToCopy = kDVVaultDigestLength;
+    }
+    memcpy(output + generatedBytes, block, bytesToCopy);
+    generatedBytes += bytesToCopy;
+  }
+  free(countedSalt);
+}
+
+void DVVaultDeriveKeyAndIV(const void *password,
+                           size_t passwordLength,
+                           const void *salt,
+                           size_t saltLength,
+                           unsigned char key[kDVVaultKeyLength],
+                           unsigned char iv[kDVVaultIVLength]) {
+
+  unsigned char buffer[kDVVaultKeyLength + kDVVaultIVLength];
+  DVVaultDeriveBytes(password, passwordLength, salt, saltLength, buffer, sizeof(buffer));
+  memcpy(key, buffer, kDVVaultKeyLength);
+  memcpy(iv, buffer + kDVVaultKeyLength, kDVVaultIVLength);
+}
+
+size_t DVVaultEncryptedLength(size_t length) {
+  return (length / kDVVaultBlockLength + 1) * kDVVaultBlockLength;
+}
+
+//
+//  PRIVATE: The payload is the key, the IV, the name, and the options if
+//  there are any.
+//
+
+static size_t DVVaultPayloadLength(size_t fileNameLength, unsigned char options) {
+  return kDVVaultKeyLength + kDVVaultIVLength + fileNameLength + (options != 0 ? 2 : 0);
+}
+
+size_t DVVaultKeyFileLength(size_t fileNameLength, unsigned char options) {
+  return kDVVaultSaltLength + DVVaultEncryptedLength(DVVaultPayloadLength(fileNameLength, options));
+}
+
+bool DVVaultWriteKeyFile(const void *password,
+                         size_t passwordLength,
+                         const unsigned char salt[kDVVaultSaltLength],
+                         const unsigned char key[kDVVaultKeyLength],
+                         const unsigned char iv[kDVVaultIVLength],
+                         const char *fileName,
+                         size_t fileNameLength,
+                         unsigned char options,
+                         void *keyFile) {
+
+  unsigned char *output = keyFile;
+  memcpy(output, salt, kDVVaultSaltLength);
+  unsigned char keyFileKey[kDVVaultKeyLength];
+  unsigned char keyFileIV[kDVVaultIVLength];
+  DVVaultDeriveKeyAndIV(password, passwordLength, salt, kDVVaultSaltLength, keyFileKey, keyFileIV);
+
+  size_t payloadLength = DVVaultPayloadLength(fileNameLength, options);
+  unsigned char *payload = malloc(payloadLength);
+  if (payload == NULL) {
+    return false;
+  }
+  memcpy(payload, key, kDVVaultKeyLength);
+  memcpy(payload + kDVVaultKeyLength, iv, kDVVaultIVLength);
+  memcpy(payload + kDVVaultKeyLength + kDVVaultIVLength, fileName, fileNameLength);
+  if (options != 0) {
+    payload[payloadLength - 2] = 0;
+    payload[payloadLength - 1] = options;
+  }
+
+  bool succeeded = false;
+  DVVaultCryptor *cryptor = DVVaultCryptorCreate(keyFileKey, keyFileIV);
+  if (cryptor != NULL) {
+    size_t updateLength = 0;
+    size_t finalLength = 0;
+    unsigned char *encrypted = output + kDVVaultSaltLength;
+    succeeded = DVVaultCryptorUpdate(cryptor, payload, payloadLength, encrypted, &updateLength) &&
+                DVVaultCryptorFinal(cryptor, encrypted + updateLength, &finalLength);
+    DVVaultCryptorRelease(cryptor);
+  }
+  free(payload);
+  return succeeded;
+}
+
+DVVaultCryptor *DVVaultCryptorCreate(const unsigned char key[kDVVaultKeyLength],
+                                     const unsigned char iv[kDVVaultIVLength]) {
+
+  DVVaultCryptor *cryptor = calloc(1, sizeof(DVVaultCryptor));
+  if (cryptor == NULL) {
+    return NULL;
+  }
+#ifdef __APPLE__
+  CCCryptorStatus status = CCCryptorCreate(kCCEncrypt,
+                                           kCCAlgorithmAES128,
+                                           kCCOptionPKCS7Padding,
+                                           key,
+                                           kDVVaultKeyLength,
+                                           iv,
+                                           &cryptor->cryptor);
+  if (status != kCCSuccess) {
+    free(cryptor);
+    return NULL;
+  }
+#else
+  cryptor->context = EVP_CIPHER_CTX_new();
+  if (cryptor->context == NULL ||
+      EVP_EncryptInit_ex(cryptor->context, EVP_aes_128_cbc(), NULL, key, iv) != 1) {
+    DVVaultCryptorRelease(cryptor);
+    return NULL;
+  }
+#endif
+  return cryptor;
+}
+
+bool DVVaultCryptorUpdate(DVVaultCryptor *cryptor,
+                          const void *input,
+                          size_t inputLength,
+                          void *output,
+                          size_t *outputLength) {
+
+#ifdef __APPLE__
+  return CCCryptorUpdate(cryptor->cryptor,
+                         input,
+                         inputLength,
+                         output,
+                         inputLength + kDVVaultBlockLength,
+                         outputLength) == kCCSuccess;
+#else
+  int length = 0;
+  if (EVP_EncryptUpdate(cryptor->context, output, &length, input, (int)inputLength) != 1) {
+    return false;
+  }
+  *outputLength = length;
+  return true;
+#endif
+}
+
+bool DVVaultCryptorFinal(DVVaultCryptor *cryptor, void *output, size_t *outputLength) {
+
+#ifdef __APPLE__
+  return CCCryptorFinal(cryptor->cryptor, output, kDVVaultBlockLength, outputLength) == kCCSuccess;
+#else
+  int length = 0;
+  if (EVP_EncryptFinal_ex(cryptor->context, output, &length) != 1) {
+    return false;
+  }
+  *outputLength = length;
+  return true;
+#endif
+}
+
+void DVVaultCryptorRelease(DVVaultCryptor *cryptor) {
+
+  if (cryptor == NULL) {
+    return;
+  }
+#ifdef __APPLE__
+  CCCryptorRelease(cryptor->cryptor);
+#else
+  EVP_CIPHER_CTX_free(cryptor->context);
+#endif
+  free(cryptor);
+}
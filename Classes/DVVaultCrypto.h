@@ -0,0 +1,137 @@
+//
+//  DVVaultCrypto.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef DVVaultCrypto_h
+#define DVVaultCrypto_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+//  The crypto of the vault file formats, in plain C so it can be shared by
+//  the app and by tools that run where there's no Foundation. It uses
+//  CommonCrypto on Apple platforms, and OpenSSL's libcrypto everywhere else.
+//
+//  A key file is |kDVVaultSaltLength| bytes of random salt, then a payload
+//  encrypted with a key and IV derived from the password and the salt. The
+//  payload is the data file's key, its IV, and its UTF-8 file name. It can
+//  end with options, set off from the name by a null byte: one byte of
+//  |kKeyFileOption| flags. Clients that don't know about options stop the
+//  name at the null byte and never see them.
+//
+//  A data file is its contents encrypted with the key and IV in its key
+//  file. All encryption is AES128-CBC with PKCS7 padding.
+//
+
+#define kDVVaultKeyLength           16
+#define kDVVaultIVLength            16
+#define kDVVaultBlockLength         16
+#define kDVVaultSaltLength          8
+
+//
+//  The data file was compressed into a zlib stream before it was encrypted.
+//
+
+#define kKeyFileOptionCompressed    (0x01)
+
+//
+//  The data file is a |DVChunkManifest|, encrypted, and the data itself is
+//  in the chunks it lists.
+//
+
+#define kKeyFileOptionChunked       (0x02)
+
+//
+//  Fills |bytes| with |length| bytes derived from |password| and |salt| with
+//  RFC2898, using HMAC-SHA1 and 1000 iterations. Only the last byte of the
+//  block counter is ever set, which matches the full algorithm for the first
+//  255 blocks.
+//
+
+void DVVaultDeriveBytes(const void *password,
+                        size_t passwordLength,
+                        const void *salt,
+                        size_t saltLength,
+                        void *bytes,
+                        size_t length);
+
+//
+//  Derives the key and IV that encrypt a key file's payload.
+//
+
+void DVVaultDeriveKeyAndIV(const void *password,
+                           size_t passwordLength,
+                           const void *salt,
+                           size_t saltLength,
+                           unsigned char key[kDVVaultKeyLength],
+                           unsigned char iv[kDVVaultIVLength]);
+
+//
+//  The length of the encrypted form of |length| bytes.
+//
+
+size_t DVVaultEncryptedLength(size_t length);
+
+//
+//  The length of a key file for a file name |fileNameLength| bytes long.
+//
+
+size_t DVVaultKeyFileLength(size_t fileNameLength, unsigned char options);
+
+//
+//  Writes the key file for a data file encrypted with |key| and |iv| into
+//  |keyFile|, which must hold |DVVaultKeyFileLength| bytes. |fileName| is
+//  UTF-8, and must not hold a null byte. Returns false if encryption fails.
+//
+
+bool DVVaultWriteKeyFile(const void *password,
+                         size_t passwordLength,
+                         const unsigned char salt[kDVVaultSaltLength],
+                         const unsigned char key[kDVVaultKeyLength],
+                         const unsigned char iv[kDVVaultIVLength],
+                         const char *fileName,
+                         size_t fileNameLength,
+                         unsigned char options,
+                         void *keyFile);
+
+//
+//  Encrypts a stream a piece at a time, so a data file never has to be in
+//  memory all at once. Each update writes at most its input length plus
+//  |kDVVaultBlockLength| bytes, and the final call at most
+//  |kDVVaultBlockLength|. A cryptor must only be used by one thread at a
+//  time.
+//
+
+typedef struct DVVaultCryptor DVVaultCryptor;
+
+DVVaultCryptor *DVVaultCryptorCreate(const unsigned char key[kDVVaultKeyLength],
+                                     const unsigned char iv[kDVVaultIVLength]);
+
+bool DVVaultCryptorUpdate(DVVaultCryptor *cryptor,
+                          const void *input,
+                          size_t inputLength,
+                          void *output,
+                          size_t *outputLength);
+
+bool DVVaultCryptorFinal(DVVaultCryptor *cryptor, void *output, size_t *outputLength);
+
+void DVVaultCryptorRelease(DVVaultCryptor *cryptor);
+
+#endif
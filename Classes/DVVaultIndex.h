@@ -0,0 +1,128 @@
+//
+//  DVVaultIndex.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/14/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+#import "DropboxSDK.h"
+
+//
+//  The kinds of file that make up a vault entry. For a base path of
+//  |/StrongBox/foo|, they are |foo.key|, |foo.dat|, |foo-sidecar.key|, and
+//  |foo-sidecar.dat|. The sidecars hold the entry's encrypted notes.
+//
+
+typedef enum {
+  DVVaultEntryKindKey,
+  DVVaultEntryKindData,
+  DVVaultEntryKindKeySidecar,
+  DVVaultEntryKindDataSidecar,
+  DVVaultEntryKindCount,
+
+  //
+  //  Anything else in the directory.
+  //
+
+  DVVaultEntryKindOther = DVVaultEntryKindCount
+} DVVaultEntryKind;
+
+//
+//  The files in a listing that belong to one vault entry.
+//
+
+@interface DVVaultItem : NSObject {
+
+@private
+  NSString *basePath_;
+  DBMetadata *metadata_[DVVaultEntryKindCount];
+}
+
+//
+//  The path the entry's files are named after, without extension or sidecar
+//  suffix.
+//
+
+@property (nonatomic, readonly) NSString *basePath;
+
+//
+//  The listing's metadata for the file of |kind| -- including its size and
+//  revision -- or |nil| if the listing doesn't have one.
+//
+
+- (DBMetadata *)metadataForKind:(DVVaultEntryKind)kind;
+
+//
+//  The path of the file of |kind|, whether or not it exists.
+//
+
+- (NSString *)pathForKind:(DVVaultEntryKind)kind;
+
+@end
+
+//
+//  Classifies every entry of a DropBox listing in a single pass and pairs
+//  each key with its data file and sidecars, so the companions of any file
+//  are a dictionary lookup away. Built once per listing; see
+//  |DVCacheManager::vaultIndex|.
+//
+
+@interface DVVaultIndex : NSObject {
+
+@private
+  NSMutableDictionary *itemsByBasePath_;
+  NSMutableArray *keyedItems_;
+}
+
+//
+//  Works out what kind of vault file |path| is, and, if |basePath| isn't
+//  |NULL|, the base path it's named after. Only looks at the name.
+//
+
++ (DVVaultEntryKind)kindOfPath:(NSString *)path basePath:(NSString **)basePath;
+
+//
+//  The path of the |kind| companion of |path|: for |kind| of
+//  |DVVaultEntryKindData|, |/StrongBox/foo.key| gives |/StrongBox/foo.dat|.
+//  Works on DropBox and cache paths alike. Returns |nil| if |path| isn't a
+//  vault file.
+//
+
++ (NSString *)pathForKind:(DVVaultEntryKind)kind companionOfPath:(NSString *)path;
+
+//
+//  Indexes the |contents| of |metadata|.
+//
+
+- (id)initWithMetadata:(DBMetadata *)metadata;
+
+//
+//  The items that have a key file, in listing order. Sidecar keys don't
+//  count; only these are shown to the user.
+//
+
+@property (nonatomic, readonly) NSArray *keyedItems;
+
+//
+//  The item that the DropBox file |path| belongs to, or |nil| if the listing
+//  has none of its files.
+//
+
+- (DVVaultItem *)itemForPath:(NSString *)path;
+
+@end
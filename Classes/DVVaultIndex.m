@@ -0,0 +1,190 @@
+//
+//  DVVaultIndex.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/14/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "DVVaultIndex.h"
+
+#define kDVVaultSidecarSuffix     @"-sidecar"
+#define kDVVaultKeyExtension      @"key"
+#define kDVVaultDataExtension     @"dat"
+
+//
+//  Private methods for |DVVaultIndex| to fill in items as it goes.
+//
+
+@interface DVVaultItem ()
+- (id)initWithBasePath:(NSString *)basePath;
+- (void)setMetadata:(DBMetadata *)metadata forKind:(DVVaultEntryKind)kind;
+@end
+
+
+@implementation DVVaultItem
+
+@synthesize basePath = basePath_;
+
+- (id)initWithBasePath:(NSString *)basePath {
+
+  if ((self = [super init]) != nil) {
+    basePath_ = [basePath copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [basePath_ release];
+  for (NSUInteger i = 0; i < DVVaultEntryKindCount; i++) {
+    [metadata_[i] release];
+  }
+  [super dealloc];
+}
+
+- (DBMetadata *)metadataForKind:(DVVaultEntryKind)kind {
+
+  return (kind < DVVaultEntryKindCount) ? metadata_[kind] : nil;
+}
+
+- (void)setMetadata:(DBMetadata *)metadata forKind:(DVVaultEntryKind)kind {
+
+  [metadata_[kind] autorelease];
+  metadata_[kind] = [metadata retain];
+}
+
+- (NSString *)pathForKind:(DVVaultEntryKind)kind {
+
+  switch (kind) {
+    case DVVaultEntryKindKey:
+      return [basePath_ stringByAppendingPathExtension:kDVVaultKeyExtension];
+    case DVVaultEntryKindData:
+      return [basePath_ stringByAppendingPathExtension:kDVVaultDataExtension];
+    case DVVaultEntryKindKeySidecar:
+      return [[basePath_ stringByAppendingString:kDVVaultSidecarSuffix]
+              stringByAppendingPathExtension:kDVVaultKeyExtension];
+    case DVVaultEntryKindDataSidecar:
+      return [[basePath_ stringByAppendingString:kDVVaultSidecarSuffix]
+              stringByAppendingPathExtension:kDVVaultDataExtension];
+    default:
+      return nil;
+  }
+}
+
+- (NSString *)description {
+
+  return [NSString stringWithFormat:@"<DVVaultItem %@: key %d, data %d, sidecars %d/%d>",
+          basePath_,
+          metadata_[DVVaultEntryKindKey] != nil,
+          metadata_[DVVaultEntryKindData] != nil,
+          metadata_[DVVaultEntryKindKeySidecar] != nil,
+          metadata_[DVVaultEntryKindDataSidecar] != nil];
+}
+
+@end
+
+
+@implementation DVVaultIndex
+
+@synthesize keyedItems = keyedItems_;
+
++ (DVVaultEntryKind)kindOfPath:(NSString *)path basePath:(NSString **)basePath {
+
+  NSString *extension = [path pathExtension];
+  BOOL isKey = [extension isEqualToString:kDVVaultKeyExtension];
+  if (!isKey && ![extension isEqualToString:kDVVaultDataExtension]) {
+    return DVVaultEntryKindOther;
+  }
+
+  //
+  //  Everything up to the dot, and then whatever is left once a sidecar
+  //  suffix is taken off.
+  //
+
+  NSString *stem = [path stringByDeletingPathExtension];
+  BOOL isSidecar = [stem hasSuffix:kDVVaultSidecarSuffix];
+  if (isSidecar) {
+    stem = [stem substringToIndex:[stem length] - [kDVVaultSidecarSuffix length]];
+  }
+  if ([[stem lastPathComponent] length] == 0) {
+    return DVVaultEntryKindOther;
+  }
+  if (basePath != NULL) {
+    *basePath = stem;
+  }
+  if (isSidecar) {
+    return isKey ? DVVaultEntryKindKeySidecar : DVVaultEntryKindDataSidecar;
+  }
+  return isKey ? DVVaultEntryKindKey : DVVaultEntryKindData;
+}
+
++ (NSString *)pathForKind:(DVVaultEntryKind)kind companionOfPath:(NSString *)path {
+
+  NSString *basePath = nil;
+  if ([self kindOfPath:path basePath:&basePath] == DVVaultEntryKindOther) {
+    return nil;
+  }
+  DVVaultItem *item = [[[DVVaultItem alloc] initWithBasePath:basePath] autorelease];
+  return [item pathForKind:kind];
+}
+
+- (id)initWithMetadata:(DBMetadata *)metadata {
+
+  if ((self = [super init]) != nil) {
+    NSArray *contents = metadata.contents;
+    itemsByBasePath_ = [[NSMutableDictionary alloc] initWithCapacity:[contents count] / 2];
+    keyedItems_ = [[NSMutableArray alloc] init];
+    for (DBMetadata *child in contents) {
+      if (child.isDirectory || child.isDeleted) {
+        continue;
+      }
+      NSString *basePath = nil;
+      DVVaultEntryKind kind = [DVVaultIndex kindOfPath:child.path basePath:&basePath];
+      if (kind == DVVaultEntryKindOther) {
+        continue;
+      }
+      DVVaultItem *item = [itemsByBasePath_ objectForKey:basePath];
+      if (item == nil) {
+        item = [[[DVVaultItem alloc] initWithBasePath:basePath] autorelease];
+        [itemsByBasePath_ setObject:item forKey:basePath];
+      }
+      if (kind == DVVaultEntryKindKey && [item metadataForKind:kind] == nil) {
+        [keyedItems_ addObject:item];
+      }
+      [item setMetadata:child forKind:kind];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [itemsByBasePath_ release];
+  [keyedItems_ release];
+  [super dealloc];
+}
+
+- (DVVaultItem *)itemForPath:(NSString *)path {
+
+  NSString *basePath = nil;
+  if ([DVVaultIndex kindOfPath:path basePath:&basePath] == DVVaultEntryKindOther) {
+    return nil;
+  }
+  return [itemsByBasePath_ objectForKey:basePath];
+}
+
+@end
@@ -0,0 +1,93 @@
+//
+//  DVVaultSession.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/16/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <Foundation/Foundation.h>
+
+//
+//  The user default holding how many seconds an unlocked vault survives in
+//  the background. Zero (the default) turns sessions off: everything
+//  decrypted is thrown away as soon as the application leaves the
+//  foreground.
+//
+
+#define kDVVaultSessionGracePeriodKey   @"DVVaultSessionGracePeriod"
+
+//
+//  Holds the decrypted key, IV, and file name of each key while the
+//  application is in the background, so coming back within the grace period
+//  doesn't mean running the key derivation for every key file again. The
+//  password itself isn't kept: anything that needs it after a resume asks
+//  for it again.
+//
+//  Everything secret lives in one buffer, locked into memory so it is never
+//  paged out, and zeroed when the session is wiped or released. Key names
+//  aren't secret (they're in the store) and are kept as ordinary objects.
+//
+
+@interface DVVaultSession : NSObject {
+
+@private
+  unsigned char *buffer_;
+  size_t length_;
+  BOOL locked_;
+  NSArray *keyNames_;
+  size_t *valueLengths_;
+  CFAbsoluteTime expiration_;
+}
+
+//
+//  The grace period from |kDVVaultSessionGracePeriodKey|.
+//
+
++ (NSTimeInterval)gracePeriod;
+
+//
+//  Copies |decryptedKeyValues| into the session's buffer. It maps key names
+//  to dictionaries with |kDVKey|, |kDVIV|, and |kDVFileName|; entries
+//  missing any of them are left out. |kDVCompressed| is kept if it's there.
+//  The session expires |gracePeriod| seconds from now.
+//
+
+- (id)initWithDecryptedKeyValues:(NSDictionary *)decryptedKeyValues
+                     gracePeriod:(NSTimeInterval)gracePeriod;
+
+//
+//  YES once the grace period is over, or the session has been wiped.
+//
+
+@property (nonatomic, readonly, getter=isExpired) BOOL expired;
+
+//
+//  Calls |block| with the decrypted values the session was created with, in
+//  the same form; they're empty once the session is wiped. The keys, IVs,
+//  and file names point straight into the session's buffer, so |block| must
+//  copy whatever it keeps, and must not keep them past the next |wipe|.
+//
+
+- (void)useDecryptedKeyValues:(void (^)(NSDictionary *decryptedKeyValues))block;
+
+//
+//  Zeroes and releases the buffer. The session is expired from then on.
+//
+
+- (void)wipe;
+
+@end
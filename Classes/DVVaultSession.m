@@ -0,0 +1,192 @@
+//
+//  DVVaultSession.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/16/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import <errno.h>
+#import <sys/mman.h>
+#import "DVVaultSession.h"
+
+//
+//  Each key takes four lengths in |valueLengths_|, one for each of these.
+//  The compression flag is one byte, or none if the values didn't have one.
+//
+
+#define kDVVaultSessionValueKeys    [NSArray arrayWithObjects:kDVKey, kDVIV, kDVFileName, kDVCompressed, nil]
+#define kDVVaultSessionValueCount   4
+
+//
+//  Zeroes |length| bytes at |bytes| through a volatile pointer, so the
+//  compiler can't decide the stores are dead and drop them.
+//
+
+static void DVZeroBytes(void *bytes, size_t length) {
+
+  volatile unsigned char *p = bytes;
+  while (length--) {
+    *p++ = 0;
+  }
+}
+
+//
+//  The bytes of a key value: the data itself, a file name as UTF-8, or a
+//  flag as one byte.
+//
+
+static NSData *DVBytesOfValue(id value) {
+
+  if ([value isKindOfClass:[NSString class]]) {
+    return [value dataUsingEncoding:NSUTF8StringEncoding];
+  }
+  if ([value isKindOfClass:[NSNumber class]]) {
+    unsigned char flag = [value boolValue] ? 1 : 0;
+    return [NSData dataWithBytes:&flag length:sizeof(flag)];
+  }
+  return value;
+}
+
+@implementation DVVaultSession
+
++ (NSTimeInterval)gracePeriod {
+
+  return [[NSUserDefaults standardUserDefaults] doubleForKey:kDVVaultSessionGracePeriodKey];
+}
+
+- (id)initWithDecryptedKeyValues:(NSDictionary *)decryptedKeyValues
+                     gracePeriod:(NSTimeInterval)gracePeriod {
+
+  if ((self = [super init]) != nil) {
+    NSArray *valueKeys = kDVVaultSessionValueKeys;
+    NSMutableArray *keyNames = [NSMutableArray arrayWithCapacity:[decryptedKeyValues count]];
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:[decryptedKeyValues count] * kDVVaultSessionValueCount];
+    length_ = 0;
+    for (NSString *keyName in decryptedKeyValues) {
+      NSDictionary *keyValues = [decryptedKeyValues objectForKey:keyName];
+      NSMutableArray *bytes = [NSMutableArray arrayWithCapacity:kDVVaultSessionValueCount];
+      for (NSString *valueKey in valueKeys) {
+        NSData *valueBytes = DVBytesOfValue([keyValues objectForKey:valueKey]);
+        if (valueBytes == nil && [valueKey isEqualToString:kDVCompressed]) {
+          valueBytes = [NSData data];
+        }
+        if (valueBytes == nil) {
+          break;
+        }
+        [bytes addObject:valueBytes];
+      }
+      if ([bytes count] < kDVVaultSessionValueCount) {
+        continue;
+      }
+      [keyNames addObject:keyName];
+      [values addObjectsFromArray:bytes];
+    }
+
+    //
+    //  Lay out each key's values in the order of |keyNames_|.
+    //
+
+    keyNames_ = [keyNames copy];
+    valueLengths_ = malloc(MAX([values count], 1) * sizeof(size_t));
+    for (NSUInteger i = 0; i < [values count]; i++) {
+      valueLengths_[i] = [[values objectAtIndex:i] length];
+      length_ += valueLengths_[i];
+    }
+    buffer_ = malloc(MAX(length_, 1));
+    locked_ = (mlock(buffer_, MAX(length_, 1)) == 0);
+    if (!locked_) {
+      _GTMDevLog(@"%s -- unable to lock %lu bytes (errno %d)",
+                 __PRETTY_FUNCTION__,
+                 (unsigned long)length_,
+                 errno);
+    }
+    unsigned char *p = buffer_;
+    for (NSUInteger i = 0; i < [values count]; i++) {
+      [[values objectAtIndex:i] getBytes:p length:valueLengths_[i]];
+      p += valueLengths_[i];
+    }
+    expiration_ = CFAbsoluteTimeGetCurrent() + gracePeriod;
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [self wipe];
+  [super dealloc];
+}
+
+- (BOOL)isExpired {
+
+  return buffer_ == NULL || CFAbsoluteTimeGetCurrent() >= expiration_;
+}
+
+- (void)useDecryptedKeyValues:(void (^)(NSDictionary *decryptedKeyValues))block {
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSMutableDictionary *decryptedKeyValues = [NSMutableDictionary dictionaryWithCapacity:[keyNames_ count]];
+  unsigned char *p = buffer_;
+  size_t *lengths = valueLengths_;
+  for (NSString *keyName in keyNames_) {
+    NSData *key = [NSData dataWithBytesNoCopy:p length:lengths[0] freeWhenDone:NO];
+    p += lengths[0];
+    NSData *iv = [NSData dataWithBytesNoCopy:p length:lengths[1] freeWhenDone:NO];
+    p += lengths[1];
+    NSString *fileName = [[[NSString alloc] initWithBytesNoCopy:p
+                                                         length:lengths[2]
+                                                       encoding:NSUTF8StringEncoding
+                                                   freeWhenDone:NO] autorelease];
+    p += lengths[2];
+    NSMutableDictionary *values = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                   key, kDVKey,
+                                   iv, kDVIV,
+                                   fileName, kDVFileName,
+                                   nil];
+    if (lengths[3] > 0) {
+      [values setObject:[NSNumber numberWithBool:(*p != 0)] forKey:kDVCompressed];
+    }
+    p += lengths[3];
+    lengths += kDVVaultSessionValueCount;
+    [decryptedKeyValues setObject:values forKey:keyName];
+  }
+  block(decryptedKeyValues);
+
+  //
+  //  Let go of everything pointing into the buffer before returning.
+  //
+
+  [pool drain];
+}
+
+- (void)wipe {
+
+  if (buffer_ == NULL) {
+    return;
+  }
+  DVZeroBytes(buffer_, MAX(length_, 1));
+  if (locked_) {
+    munlock(buffer_, MAX(length_, 1));
+  }
+  free(buffer_);
+  buffer_ = NULL;
+  free(valueLengths_);
+  valueLengths_ = NULL;
+  [keyNames_ release];
+  keyNames_ = nil;
+}
+
+@end
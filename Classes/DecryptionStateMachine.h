@@ -20,9 +20,10 @@
 
 #import <Foundation/Foundation.h>
 #import <CommonCrypto/CommonCryptor.h>
+#include <zlib.h>
 
 //
-//  The chunk size for decryption.
+//  The default chunk size for decryption.
 //
 
 #define kDecryptionStateMachineBlockSize    (2048)
@@ -44,6 +45,11 @@
   
   unsigned long long totalDecrypted_;
   CCCryptorRef cryptor_;
+  NSUInteger blockSize_;
+  BOOL compressed_;
+  z_stream *inflater_;
+  NSMutableData *inflatedBuffer_;
+  BOOL inflaterDidEnd_;
 }
 
 @property (nonatomic, assign) id<DecryptionStateMachineDelegate> delegate;
@@ -53,6 +59,22 @@
 @property (nonatomic, retain) NSNumber *fileLength;
 @property (nonatomic, retain) NSMutableData *outputBuffer;
 
+//
+//  How many bytes are decrypted between progress messages. Defaults to
+//  |kDecryptionStateMachineBlockSize|. Set it before calling |decryptFile:|.
+//
+
+@property (nonatomic, assign) NSUInteger blockSize;
+
+//
+//  If YES, the cleartext is a zlib stream, and what's written to
+//  |outputFilePath| is what it inflates to. It's inflated as it's decrypted,
+//  a block at a time, so it's never all in memory. Decryption fails if it
+//  doesn't inflate. Defaults to NO. Set it before calling |decryptFile:|.
+//
+
+@property (nonatomic, assign) BOOL compressed;
+
 //
 //  Decrypts the file at |inputFilePath| and puts the cleartext at |outputFilePath|
 //  using |key| and |iv|. The only decryption algorithm is AES128.
@@ -21,11 +21,26 @@
 #import "DecryptionStateMachine.h"
 #import "NSData+EncryptionHelpers.h"
 
+@interface DecryptionStateMachine ()
+- (BOOL)writeClearText:(NSData *)clearText;
+- (void)closeFiles;
+@end
+
 @implementation DecryptionStateMachine
 
 @synthesize delegate = delegate_, outputFilePath = outputFilePath_;
 @synthesize inputHandle = inputHandle_, outputHandle = outputHandle_;
 @synthesize fileLength = fileLength_, outputBuffer = outputBuffer_;
+@synthesize blockSize = blockSize_;
+@synthesize compressed = compressed_;
+
+- (id)init {
+  self = [super init];
+  if (self != nil) {
+    blockSize_ = kDecryptionStateMachineBlockSize;
+  }
+  return self;
+}
 
 - (void)dealloc {
   [outputFilePath_ release];
@@ -33,21 +48,86 @@
   [outputHandle_ release];
   [fileLength_ release];
   [outputBuffer_ release];
+  [inflatedBuffer_ release];
   [super dealloc];
 }
 
 //
-//  Decrypts a single |kDecryptionStateMachineBlockSize| byte block of data.
+//  PRIVATE: Writes decrypted bytes to |outputHandle_|, inflating them first
+//  if the file is compressed. Returns NO if they don't inflate, or there's
+//  anything after the end of the zlib stream.
+//
+
+- (BOOL)writeClearText:(NSData *)clearText {
+  if (inflater_ == NULL) {
+    [outputHandle_ writeData:clearText];
+    return YES;
+  }
+  if ([clearText length] == 0) {
+    return YES;
+  }
+  if (inflaterDidEnd_) {
+    return NO;
+  }
+  inflater_->next_in = (Bytef *)[clearText bytes];
+  inflater_->avail_in = [clearText length];
+  int status;
+  do {
+    inflater_->next_out = [inflatedBuffer_ mutableBytes];
+    inflater_->avail_out = [inflatedBuffer_ length];
+    status = inflate(inflater_, Z_NO_FLUSH);
+    NSUInteger inflated = [inflatedBuffer_ length] - inflater_->avail_out;
+    if (inflated > 0) {
+      [outputHandle_ writeData:[NSData dataWithBytesNoCopy:[inflatedBuffer_ mutableBytes]
+                                                    length:inflated
+                                              freeWhenDone:NO]];
+    }
+  } while (status == Z_OK && (inflater_->avail_in > 0 || inflater_->avail_out == 0));
+  if (status == Z_STREAM_END) {
+    inflaterDidEnd_ = YES;
+    return inflater_->avail_in == 0;
+  }
+  
+  //
+  //  |Z_BUF_ERROR| just means it wants the next block.
+  //
+  
+  if (status != Z_OK && status != Z_BUF_ERROR) {
+    _GTMDevLog(@"%s -- inflate error %d", __PRETTY_FUNCTION__, status);
+    return NO;
+  }
+  return YES;
+}
+
+//
+//  PRIVATE: Lets go of the cryptor, the inflater, and both files.
+//
+
+- (void)closeFiles {
+  CCCryptorRelease(cryptor_);
+  cryptor_ = NULL;
+  self.outputBuffer = nil;
+  if (inflater_ != NULL) {
+    inflateEnd(inflater_);
+    free(inflater_);
+    inflater_ = NULL;
+  }
+  [inputHandle_ closeFile];
+  [outputHandle_ closeFile];
+}
+
+//
+//  Decrypts a single |blockSize| byte block of data.
 //
 
 - (void)decryptBlock {
   size_t moved, bytesRead;
   
   CCCryptorStatus status;
-  NSData *inputData = [inputHandle_ readDataOfLength:kDecryptionStateMachineBlockSize];
+  NSData *inputData = [inputHandle_ readDataOfLength:blockSize_];
   bytesRead = [inputData length];
   if (bytesRead > 0) {
-    [outputBuffer_ setLength:kDecryptionStateMachineBlockSize];
+    [outputBuffer_ setLength:blockSize_ + kCCBlockSizeAES128];
     status = CCCryptorUpdate(cryptor_, 
                              [inputData bytes], 
                              [inputData length], 
@@ -63,7 +143,11 @@
     if (moved != [outputBuffer_ length]) {
       [outputBuffer_ setLength:moved];
     }
-    [outputHandle_ writeData:outputBuffer_];
+    if (![self writeClearText:outputBuffer_]) {
+      [self closeFiles];
+      [delegate_ decryptionStateMachineDidFail:self];
+      return;
+    }
     totalDecrypted_ += bytesRead;
     [delegate_ decryptionStateMachine:self 
                       didDecryptBytes:totalDecrypted_ 
@@ -77,7 +161,7 @@
                  afterDelay:0.0];
     }
   } else {
-    [outputBuffer_ setLength:kDecryptionStateMachineBlockSize];
+    [outputBuffer_ setLength:blockSize_ + kCCBlockSizeAES128];
     status = CCCryptorFinal(cryptor_, 
                             [outputBuffer_ mutableBytes], 
                             [outputBuffer_ length], 
@@ -85,16 +169,31 @@
     _GTMDevLog(@"%s -- CCCryptorFinal status %d", 
                __PRETTY_FUNCTION__, 
                status);
-    if (moved) {
+    
+    //
+    //  Bad padding at the end means the key or the file is wrong.
+    //
+    
+    BOOL succeeded = NO;
+    if (status == kCCSuccess) {
       [outputBuffer_ setLength:moved];
-      [outputHandle_ writeData:outputBuffer_];
+      succeeded = [self writeClearText:outputBuffer_];
     }
     
-    CCCryptorRelease(cryptor_);
-    [outputBuffer_ release];
-    [inputHandle_ closeFile];
-    [outputHandle_ closeFile];
-    [delegate_ decryptionStateMachineDidFinish:self];
+    //
+    //  A compressed file has to have inflated all the way to the end of its
+    //  stream; otherwise it was cut short.
+    //
+    
+    if (inflater_ != NULL && !inflaterDidEnd_) {
+      succeeded = NO;
+    }
+    [self closeFiles];
+    if (succeeded) {
+      [delegate_ decryptionStateMachineDidFinish:self];
+    } else {
+      [delegate_ decryptionStateMachineDidFail:self];
+    }
   }
 }
 
@@ -151,14 +250,36 @@
   self.fileLength = [fileAttributes valueForKey:@"NSFileSize"];
   totalDecrypted_ = 0;
   
-  self.outputBuffer = [[NSMutableData alloc] initWithLength:kDecryptionStateMachineBlockSize];
-  CCCryptorCreate(kCCDecrypt, 
-                  kCCAlgorithmAES128, 
-                  kCCOptionPKCS7Padding, 
-                  [key bytes], 
-                  [key length], 
-                  [iv bytes], 
-                  &cryptor_);
+  self.outputBuffer = [NSMutableData dataWithLength:blockSize_ + kCCBlockSizeAES128];
+  CCCryptorStatus cryptorStatus = CCCryptorCreate(kCCDecrypt, 
+                                                 kCCAlgorithmAES128, 
+                                                 kCCOptionPKCS7Padding, 
+                                                 [key bytes], 
+                                                 [key length], 
+                                                 [iv bytes], 
+                                                 &cryptor_);
+  if (cryptorStatus != kCCSuccess) {
+    _GTMDevLog(@"%s -- CCCryptorCreate status %d", __PRETTY_FUNCTION__, cryptorStatus);
+    cryptor_ = NULL;
+    [self closeFiles];
+    [delegate_ decryptionStateMachineDidFail:self];
+    return;
+  }
+  if (compressed_) {
+    inflater_ = calloc(1, sizeof(z_stream));
+    int inflateStatus = (inflater_ == NULL) ? Z_MEM_ERROR : inflateInit(inflater_);
+    if (inflateStatus != Z_OK) {
+      _GTMDevLog(@"%s -- inflateInit status %d", __PRETTY_FUNCTION__, inflateStatus);
+      free(inflater_);
+      inflater_ = NULL;
+      [self closeFiles];
+      [delegate_ decryptionStateMachineDidFail:self];
+      return;
+    }
+    inflaterDidEnd_ = NO;
+    [inflatedBuffer_ release];
+    inflatedBuffer_ = [[NSMutableData alloc] initWithLength:4 * blockSize_];
+  }
   
   if ([delegate_ respondsToSelector:@selector(decryptionStateMachine:willQueueAction:)]) {
     [delegate_ decryptionStateMachine:self willQueueAction:@selector(decryptBlock)];
@@ -26,6 +26,8 @@
 #import "DVErrorHandler.h"
 #import "DVTextEditController.h"
 #import "DVCacheManager.h"
+#import "DVVaultSession.h"
+#import "DVNotesDocument.h"
 
 @class RootViewController;
 
@@ -37,6 +39,7 @@ PasswordControllerDelegate,
 UIDocumentInteractionControllerDelegate,
 DecryptionStateMachineDelegate,
 DVTextEditDelegate,
+DVNotesDocumentDelegate,
 DVCacheManagerDelegate> {
   
 @private
@@ -46,10 +49,15 @@ DVCacheManagerDelegate> {
   DBSession *dbSession_;
   DVCacheManager *cacheManager_;
   NSString *cacheDataPath_;
+  DVNotesDocument *notesDocument_;
   NSString *password_;
   UIDocumentInteractionController *docIC_;
   DVErrorHandler *errorHandler_;
   BOOL synchronousDecryption_;
+  DVTraceSpan openSpan_;
+  DVTraceSpan stageSpan_;
+  UIImageView *firstPageView_;
+  BOOL awaitingFirstPage_;
   
   UIToolbar *toolbar_;
   UIBarButtonItem *linkOrUnlinkButton_;
@@ -100,6 +108,13 @@ DVCacheManagerDelegate> {
 
 @property (nonatomic, copy) NSString *cacheDataPath;
 
+//
+//  The notes for |cacheDataPath|, created the first time they're needed and
+//  kept until the detail item changes.
+//
+
+@property (nonatomic, readonly) DVNotesDocument *notesDocument;
+
 //
 //  The DropVault password, used to decrypt keys.
 //
@@ -164,6 +179,14 @@ DVCacheManagerDelegate> {
 
 - (IBAction)presentPasswordController;
 
+//
+//  Passes |session| on to |rootViewController|, without asking for the
+//  password or decrypting any key files. The password stays unset until
+//  something needs it, such as saving notes.
+//
+
+- (void)resumeSession:(DVVaultSession *)session;
+
 //
 //  Updates the toolbar to show a progress bar with a label. When the progress
 //  bar is shown on the toolbar, you can update it by manipulating |progressView|.
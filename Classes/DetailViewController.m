@@ -26,7 +26,8 @@
 #import "PasswordController.h"
 #import <CommonCrypto/CommonCryptor.h>
 #import "DVTextEditController.h"
-#import "KeyFileDecryptor.h"
+#import "DVRangeDecryptor.h"
+#import "DVThumbnailCache.h"
 
 //
 //  Private declarations...
@@ -42,6 +43,11 @@
 
 - (void)showPageFromBundle:(NSString *)pageFileName;
 - (void)configureView;
+- (void)endOpenSpan;
+- (void)beginStage:(NSString *)stage category:(NSString *)category;
+- (void)showFirstPageOfFile:(NSString *)cipherPath withKey:(NSData *)key iv:(NSData *)iv;
+- (void)hideFirstPage;
+- (void)showNotesInEditor:(DVTextEditController *)editor;
 - (void)showProgressItem:(NSString *)label;
 - (void)hideProgressItem;
 - (void)presentPasswordController;
@@ -123,12 +129,45 @@
   self.detailDescriptionLabel.text = kProgramName;
 }
 
+//
+//  PRIVATE: Ends the trace of the document being opened, and whichever stage
+//  of opening it was in.
+//
+
+- (void)endOpenSpan {
+  DVTraceEnd(stageSpan_);
+  DVTraceEnd(openSpan_);
+  stageSpan_ = kDVTraceNoSpan;
+  openSpan_ = kDVTraceNoSpan;
+}
+
+//
+//  PRIVATE: Moves the trace of the document being opened on to its next
+//  stage.
+//
+
+- (void)beginStage:(NSString *)stage category:(NSString *)category {
+  DVTraceEnd(stageSpan_);
+  stageSpan_ = DVTraceBeginAsync(stage, category, openSpan_);
+}
+
 //
 //  Updates the view when |detailItem_| changes.
 //
 
 - (void)configureView {
   
+  [self endOpenSpan];
+  [self hideFirstPage];
+  
+  //
+  //  Save the old item's notes before letting them go.
+  //
+  
+  [notesDocument_ save];
+  [notesDocument_ release];
+  notesDocument_ = nil;
+  
   //
   //  If |detailItem_| is not valid, show the fishbowl.
   //
@@ -143,19 +182,34 @@
   //
   
   NSString *keyName = [self.detailItem valueForKey:kDVKeyName];
-  NSString *cipherName = [[keyName stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"];
+  NSString *cipherName = [DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:keyName];
   _GTMDevLog(@"%s -- looking for cipher data in %@", __PRETTY_FUNCTION__, cipherName);
 
+  //
+  //  Trace the open under the key's name; the file name is secret.
+  //
+  
+  openSpan_ = DVTraceBeginAsync([@"open " stringByAppendingString:[keyName lastPathComponent]],
+                                kDVTraceUI,
+                                kDVTraceNoSpan);
   [self showProgressItem:kDVStringDownloading];
   cacheDataPath_ = [[DVCacheManager cachePathForDropBoxPath:cipherName] retain];
-  [self.cacheManager cacheCopyOfDropBoxPath:cipherName];
+  [self.cacheManager cacheCopyOfDropBoxPath:cipherName parentSpan:openSpan_];
   
   //
-  //  Now, cache the notes files.
+  //  Now, cache the notes files -- but only the ones the listing says exist.
+  //  Without a listing, ask for both and let the missing ones fail.
   //
   
-  [self.cacheManager cacheCopyOfDropBoxPath:[keyName stringAsSidecarPath]];
-  [self.cacheManager cacheCopyOfDropBoxPath:[cipherName stringAsSidecarPath]];
+  DVVaultItem *item = [self.cacheManager.vaultIndex itemForPath:keyName];
+  DVVaultEntryKind sidecarKinds[] = { DVVaultEntryKindKeySidecar, DVVaultEntryKindDataSidecar };
+  for (NSUInteger i = 0; i < sizeof(sidecarKinds) / sizeof(sidecarKinds[0]); i++) {
+    if (item == nil || [item metadataForKind:sidecarKinds[i]] != nil) {
+      [self.cacheManager cacheCopyOfDropBoxPath:[DVVaultIndex pathForKind:sidecarKinds[i]
+                                                          companionOfPath:keyName]
+                                     parentSpan:openSpan_];
+    }
+  }
 }
 
 #pragma mark -
@@ -204,6 +258,81 @@
   [self.toolbar setItems:items animated:NO];
 }
 
+#pragma mark -
+#pragma mark First page
+
+//
+//  PRIVATE: Draws the first page of the PDF encrypted in |cipherPath| on a
+//  background queue, and shows it over |webView_| until the whole document
+//  is ready. Only the bytes the page needs get decrypted -- the trailer, the
+//  cross reference table, and the page's own objects -- so how long this
+//  takes depends on the page, not on the size of the file.
+//
+
+- (void)showFirstPageOfFile:(NSString *)cipherPath withKey:(NSData *)key iv:(NSData *)iv {
+  DVRangeDecryptor *decryptor = [[[DVRangeDecryptor alloc] initWithFile:cipherPath key:key iv:iv] autorelease];
+  if (decryptor == nil) {
+    return;
+  }
+  CGFloat scale = [[UIScreen mainScreen] scale];
+  CGSize size = CGSizeMake(webView_.bounds.size.width * scale, webView_.bounds.size.height * scale);
+  NSString *path = [[cipherPath copy] autorelease];
+  DVTraceSpan span = DVTraceBeginAsync(@"first page", kDVTraceCrypto, openSpan_);
+  awaitingFirstPage_ = YES;
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(void) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    CGDataProviderRef provider = [decryptor newDataProvider];
+    CGPDFDocumentRef document = CGPDFDocumentCreateWithProvider(provider);
+    CGDataProviderRelease(provider);
+    CGPDFPageRef page = NULL;
+    if (document != NULL && CGPDFDocumentIsUnlocked(document)) {
+      page = CGPDFDocumentGetPage(document, 1);
+    }
+    CGImageRef cgImage = (page != NULL) ? [DVThumbnailCache newImageOfPDFPage:page fittingSize:size] : NULL;
+    CGPDFDocumentRelease(document);
+    UIImage *image = nil;
+    if (cgImage != NULL) {
+      image = [UIImage imageWithCGImage:cgImage scale:scale orientation:UIImageOrientationUp];
+      CGImageRelease(cgImage);
+    }
+    _GTMDevLog(@"%s -- decrypted %llu of %llu bytes for the first page",
+               __PRETTY_FUNCTION__,
+               decryptor.bytesDecrypted,
+               decryptor.length);
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
+      DVTraceEnd(span);
+      
+      //
+      //  Too late if the document has loaded, or a different one's open.
+      //
+      
+      if (image == nil || !awaitingFirstPage_ || ![cacheDataPath_ isEqualToString:path]) {
+        return;
+      }
+      awaitingFirstPage_ = NO;
+      firstPageView_ = [[UIImageView alloc] initWithFrame:webView_.frame];
+      firstPageView_.autoresizingMask = webView_.autoresizingMask;
+      firstPageView_.contentMode = UIViewContentModeScaleAspectFit;
+      firstPageView_.backgroundColor = [UIColor grayColor];
+      firstPageView_.image = image;
+      [webView_.superview insertSubview:firstPageView_ aboveSubview:webView_];
+    });
+    [pool drain];
+  });
+}
+
+//
+//  PRIVATE: Takes away the first page, or stops it being shown if it isn't
+//  ready yet.
+//
+
+- (void)hideFirstPage {
+  awaitingFirstPage_ = NO;
+  [firstPageView_ removeFromSuperview];
+  [firstPageView_ release];
+  firstPageView_ = nil;
+}
+
 #pragma mark -
 #pragma mark Notes
 
@@ -222,97 +351,34 @@
 }
 
 //
-//  PRIVATE: Gets the decrypted content from the cached notes file, or the
-//  empty string if there is no cached notes file.
+//  Gets the notes for |cacheDataPath|, creating them if need be.
 //
 
-- (NSString *)getCurrentNotes {
-  
-  NSString *notesData = [self.cacheDataPath stringAsSidecarPath];
-  NSString *notesKey  = [[[self.cacheDataPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"key"] stringAsSidecarPath];
-  KeyFileDecryptor *kfd;
-  NSData *keyData = [NSData dataWithContentsOfFile:notesKey];
-  if (keyData != nil) {
-    
-    //
-    //  Need to decrypt the key.
-    //
-    
-    kfd = [KeyFileDecryptor decryptorWithData:keyData andPassword:self.password];
-    
-  } else {
-    
-    //
-    //  Need to make a key for the notes file.
-    //
-    
-    kfd = [[KeyFileDecryptor alloc] init];
-    kfd.key = [NSData dataWithRandomBytes:kCCKeySizeAES128];
-    kfd.iv  = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
-    kfd.fileName = @"notes.txt";
-    kfd.password = self.password;
-    [[kfd encryptedBlob] writeToFile:notesKey atomically:YES];
+- (DVNotesDocument *)notesDocument {
+  if (notesDocument_ == nil && cacheDataPath_ != nil) {
+    notesDocument_ = [[DVNotesDocument alloc] initWithCacheDataPath:cacheDataPath_
+                                                           password:self.password
+                                                       cacheManager:self.cacheManager];
+    notesDocument_.delegate = self;
   }
-  NSMutableData *cipherData = [NSMutableData dataWithContentsOfFile:notesData];
-  [cipherData aesDecryptInPlaceWithKey:kfd.key andIV:kfd.iv];
-  return [[[NSString alloc] initWithData:cipherData encoding:NSUTF8StringEncoding] autorelease];
+  return notesDocument_;
 }
 
 //
-//  PRIVATE: Encrypts notes, saves them, and sends them up to DropBox.
+//  Show the notes UI.
 //
 
-- (void)saveCurrentNotes:(NSString *)notes {
-  
-  NSString *notesData = [self.cacheDataPath stringAsSidecarPath];
-  NSString *notesKey  = [[[self.cacheDataPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"key"] stringAsSidecarPath];
-  KeyFileDecryptor *kfd;
-  NSData *keyData = [NSData dataWithContentsOfFile:notesKey];
-  if (keyData != nil) {
-    
-    //
-    //  Need to decrypt the key.
-    //
-    
-    kfd = [KeyFileDecryptor decryptorWithData:keyData andPassword:self.password];
-    
-  } else {
-    
-    //
-    //  Need to make a key for the notes file.
-    //
-    
-    _GTMDevAssert(NO, @"Shouldn't get here");
-    kfd = [[KeyFileDecryptor alloc] init];
-    kfd.key = [NSData dataWithRandomBytes:kCCKeySizeAES128];
-    kfd.iv  = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
-    kfd.fileName = @"notes.txt";
-    kfd.password = self.password;
-    [[kfd encryptedBlob] writeToFile:notesKey atomically:YES];
-  }
-  
-  NSData *clearData = [notes dataUsingEncoding:NSUTF8StringEncoding];
-  NSData *cipherData = [clearData aesEncryptWithKey:kfd.key andIV:kfd.iv];
-  [cipherData writeToFile:notesData atomically:YES];
+- (IBAction)presentNotes:(id)sender {
   
   //
-  //  Push to DropBox.
+  //  After a resumed session, the notes can't be saved until we have the
+  //  password again.
   //
   
-  _GTMDevLog(@"%s -- uploading %@ and %@",
-             __PRETTY_FUNCTION__,
-             notesKey,
-             notesData);
-  [self.cacheManager uploadCacheToDropBoxPath:[DVCacheManager dropBoxPathForCachePath:notesData]];
-  [self.cacheManager uploadCacheToDropBoxPath:[DVCacheManager dropBoxPathForCachePath:notesKey]];
-}
-
-
-//
-//  Show the notes UI.
-//
-
-- (IBAction)presentNotes:(id)sender {
+  if (password_ == nil) {
+    [self presentPasswordController];
+    return;
+  }
   UINavigationController *editNavigator = [self textEditor];
   DVTextEditController *editor = (DVTextEditController *)editNavigator.topViewController;
   
@@ -324,21 +390,52 @@
   //
   
   [editor view];
-  editor.textView.text = [self getCurrentNotes];
+  [self showNotesInEditor:editor];
   [self.rootViewController presentModalViewController:editNavigator animated:YES];
 }
 
+//
+//  PRIVATE: Puts the notes in |editor|. Until they've loaded, the editor is
+//  read-only, so nothing typed there can be saved over them.
+//
+
+- (void)showNotesInEditor:(DVTextEditController *)editor {
+  
+  NSString *text = self.notesDocument.text;
+  editor.textView.editable = (text != nil);
+  if (text != nil) {
+    [self.notesDocument beginEditing];
+    editor.textView.text = text;
+  } else {
+    editor.textView.text = @"";
+  }
+}
+
 - (void)textEditControllerDidCancel:(DVTextEditController *)controller {
+  [self.notesDocument cancelEditing];
   [self.rootViewController dismissModalViewControllerAnimated:YES];
 }
 
+//
+//  Edits are saved as the user types; the save waits for a pause.
+//
+
+- (void)textEditControllerDidChange:(DVTextEditController *)controller {
+  self.notesDocument.text = controller.textView.text;
+}
+
 - (void)textEditControllerDidFinish:(DVTextEditController *)controller {
   UINavigationController *nav = (UINavigationController *)self.rootViewController.modalViewController;
   DVTextEditController *editor = (DVTextEditController *)[nav topViewController];
-  [self saveCurrentNotes:editor.textView.text];
+  self.notesDocument.text = editor.textView.text;
+  [self.notesDocument save];
   [self.rootViewController dismissModalViewControllerAnimated:YES];
 }
 
+- (void)notesDocumentDidFailToSave:(DVNotesDocument *)document {
+  [self.errorHandler displayMessage:kDVErrorSaveNotes forError:nil];
+}
+
 #pragma mark -
 #pragma mark WebViewDelegate methods
 
@@ -347,6 +444,8 @@
 //
 
 -(void)webView:(UIWebView *)webView didFailLoadWithError:(NSError *)error {
+  [self endOpenSpan];
+  [self hideFirstPage];
   [self.errorHandler displayMessage:kDVErrorShow forError:error];
 }
 
@@ -356,6 +455,8 @@
 //
 
 -(void)webViewDidFinishLoad:(UIWebView *)webView {
+  [self endOpenSpan];
+  [self hideFirstPage];
   if (self.detailItem != nil && [self.detailItem valueForKey:kDVFileName] != nil) {
     NSMutableString *fileName = [NSMutableString stringWithString:[self.detailItem valueForKey:kDVFileName]];
     if ([fileName length] > 50) {
@@ -395,15 +496,25 @@
 
 //
 //  Decryption finished. Load the document into |self.webView|, hide the
-//  progress indicator, and release the decryption state machine.
+//  progress indicator, and release the decryption state machine. A first page
+//  that's showing stays until the web view has the document; one that isn't
+//  ready yet is no longer wanted.
 //
 
 -(void)decryptionStateMachineDidFinish:(DecryptionStateMachine *)stateMachine {
   _GTMDevLog(@"%s", __PRETTY_FUNCTION__);
+  awaitingFirstPage_ = NO;
   NSURL *url = [NSURL fileURLWithPath:stateMachine.outputFilePath];
   NSURLRequest *request = [NSURLRequest requestWithURL:url];
+  [self beginStage:@"web view load" category:kDVTraceUI];
   [self.webView loadRequest:request];
   [self hideProgressItem];
+  
+  //
+  //  Now that there's a decrypted copy, the list can get a preview of it.
+  //
+  
+  [self.rootViewController makeThumbnailForObject:self.detailItem fromFile:stateMachine.outputFilePath];
   [stateMachine release];
 }
 
@@ -413,6 +524,8 @@
 
 -(void)decryptionStateMachineDidFail:(DecryptionStateMachine *)stateMachine {
   _GTMDevLog(@"%s", __PRETTY_FUNCTION__);
+  [self endOpenSpan];
+  [self hideFirstPage];
   [self.errorHandler displayMessage:kDVErrorDecrypt forError:nil];
   [self hideProgressItem];
   [stateMachine release];
@@ -463,6 +576,25 @@
 
 - (void)cacheManager:(DVCacheManager *)cacheManager didCacheCopyOfFile:(NSString *)destPath {
   
+  if ([notesDocument_ isNotesFile:destPath]) {
+    [notesDocument_ reload];
+    if ([destPath isEqualToString:notesDocument_.notesDataPath]) {
+      [notesDocument_ cacheMissingChunks];
+    }
+    
+    //
+    //  If the notes are up but hadn't loaded, they may have now.
+    //
+    
+    UIViewController *modal = self.rootViewController.modalViewController;
+    if ([modal isKindOfClass:[UINavigationController class]]) {
+      DVTextEditController *editor = (DVTextEditController *)[(UINavigationController *)modal topViewController];
+      if ([editor isKindOfClass:[DVTextEditController class]] && !editor.textView.editable) {
+        [self showNotesInEditor:editor];
+      }
+    }
+    return;
+  }
   if (![cacheDataPath_ isEqualToString:destPath]) {
     return;
   }
@@ -481,8 +613,20 @@
   //  Note the object is released by the delegate.
   //
   
+  [self beginStage:@"decrypt" category:kDVTraceCrypto];
+  
+  //
+  //  A compressed file can only be read from the start, so there's no
+  //  skipping ahead to its first page.
+  //
+  
+  BOOL compressed = [[self.detailItem valueForKey:kDVCompressed] boolValue];
+  if (!compressed && [[[fileName pathExtension] lowercaseString] isEqualToString:@"pdf"]) {
+    [self showFirstPageOfFile:destPath withKey:key iv:iv];
+  }
   DecryptionStateMachine *stateMachine = [[DecryptionStateMachine alloc] init];
   stateMachine.delegate = self;
+  stateMachine.compressed = compressed;
   [stateMachine decryptFile:destPath toPath:fileName withKey:key andIV:iv];
 }
 
@@ -504,10 +648,23 @@
 - (void) cacheManager:(DVCacheManager *)cacheManager didFailCacheOfFile:(NSString *)path {
 
   if ([self.cacheDataPath isEqualToString:path]) {
+    [self endOpenSpan];
     [self.errorHandler displayMessage:kDVErrorDownload forError:nil];
   }
 }
 
+//
+//  Uploads only come from the notes. Let them know when one is done.
+//
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didUploadFile:(NSString *)path {
+  [notesDocument_ didFinishUploadOfFile:path];
+}
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didFailUploadOfFile:(NSString *)path {
+  [notesDocument_ didFailUploadOfFile:path];
+}
+
 #pragma mark -
 #pragma mark Login interactions
 
@@ -583,11 +740,25 @@
 }
 
 -(void)setPassword:(NSString *)pw {
+  
+  //
+  //  Notes opened without a password can't be read or saved; open them again
+  //  with this one.
+  //
+  
+  if (password_ == nil && [pw length] > 0) {
+    [notesDocument_ release];
+    notesDocument_ = nil;
+  }
   [password_ autorelease];
   password_ = [pw copy];
   self.rootViewController.password = password_;
 }
 
+- (void)resumeSession:(DVVaultSession *)session {
+  [self.rootViewController resumeSession:session];
+}
+
 //
 //  Shows the controller for getting the user's password.
 //
@@ -715,6 +886,7 @@
   self.detailDescriptionLabel = nil;
   self.popoverController = nil;
   self.notesButton = nil;
+  [self hideFirstPage];
 }
 
 
@@ -739,6 +911,9 @@
   [dbSession_ release];
   [cacheManager_ release];
   [cacheDataPath_ release];
+  notesDocument_.delegate = nil;
+  [notesDocument_ save];
+  [notesDocument_ release];
   [password_ release];
   [docIC_ release];
   [errorHandler_ release];
@@ -754,6 +929,7 @@
   [actionItem_ release];
   [popoverController_ release];
   [notesButton_ release];
+  [firstPageView_ release];
   
   [super dealloc];
 }	
@@ -27,6 +27,7 @@
 
 @class RootViewController;
 @class DetailViewController;
+@class DVVaultSession;
 
 @interface DropboxPrototypeAppDelegate : NSObject <UIApplicationDelegate> {
   
@@ -38,6 +39,8 @@
   NSManagedObjectContext *managedObjectContext_;
   NSManagedObjectModel *managedObjectModel_;
   NSPersistentStoreCoordinator *persistentStoreCoordinator_;
+  DVVaultSession *vaultSession_;
+  UIBackgroundTaskIdentifier vaultSessionTask_;
 }
 
 @property (nonatomic, retain) IBOutlet UIWindow *window;
@@ -27,10 +27,23 @@
 
 #import "RootViewController.h"
 #import "DetailViewController.h"
+#import "DVLaunchTimer.h"
+#import "DVVaultSession.h"
+#import "DVTrace.h"
 
 #include "DropVaultKeys.h"
 
 
+//
+//  Private methods. Method comments below.
+//
+
+@interface DropboxPrototypeAppDelegate ()
+- (void)beginVaultSessionForApplication:(UIApplication *)application;
+- (void)endVaultSession;
+@end
+
+
 @implementation DropboxPrototypeAppDelegate
 
 @synthesize window = window_;
@@ -46,6 +59,7 @@
 - (void)awakeFromNib {
   // Pass the managed object context to the root view controller.
   self.rootViewController.managedObjectContext = self.managedObjectContext; 
+  [DVLaunchTimer markPhase:@"core data ready"];
 }
 
 
@@ -54,38 +68,119 @@ didFinishLaunchingWithOptions:(NSDictionary *)launchOptions {
   
   // Override point for customization after app launch.
   
+  [DVLaunchTimer markPhase:@"did finish launching"];
+  [DVTrace setEnabled:[[NSUserDefaults standardUserDefaults] boolForKey:kDVTraceEnabledKey]];
   DBSession *session = [[[DBSession alloc] initWithConsumerKey:DROPVAULT_CONSUMER_KEY
                                                 consumerSecret:DROPVAULT_API_SECRET] autorelease];
   [DBSession setSharedSession:session];
+  [DVLaunchTimer markPhase:@"dropbox session"];
   
   // Add the split view controller's view to the window and display.
   [self.window addSubview:self.splitViewController.view];
   [self.window makeKeyAndVisible];
+  [DVLaunchTimer markPhase:@"window visible"];
+  
+  //
+  //  The first frame is drawn when control gets back to the run loop. Mark
+  //  it there, and save the launch phases so they can be pulled off a device
+  //  and compared between builds.
+  //
+  
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [DVLaunchTimer markPhase:@"first frame"];
+    [DVLaunchTimer writePhasesToFile:[DVLaunchTimer defaultPhasesPath]];
+    _GTMDevLog(@"%s -- launch phases:\n%@", __PRETTY_FUNCTION__, [DVLaunchTimer report]);
+  });
   
   return YES;
 }
 
 //
-//  When we leave the active state, throw away all decrypted information.
+//  PRIVATE: If sessions are turned on, keeps the decrypted keys (but not the
+//  password) in a |DVVaultSession| for the grace period. Nothing of ours
+//  runs while we're suspended, so we ask for background time to wipe the
+//  session when it expires; if the system wants that time back sooner, we
+//  wipe it then.
+//
+
+- (void)beginVaultSessionForApplication:(UIApplication *)application {
+  
+  [self endVaultSession];
+  NSTimeInterval gracePeriod = [DVVaultSession gracePeriod];
+  if (gracePeriod <= 0) {
+    return;
+  }
+  NSDictionary *decryptedKeyValues = [self.rootViewController.keyStore decryptedKeyValues];
+  if ([decryptedKeyValues count] == 0) {
+    return;
+  }
+  vaultSession_ = [[DVVaultSession alloc] initWithDecryptedKeyValues:decryptedKeyValues
+                                                         gracePeriod:gracePeriod];
+  vaultSessionTask_ = [application beginBackgroundTaskWithExpirationHandler:^{
+    [self endVaultSession];
+  }];
+  DVVaultSession *session = vaultSession_;
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(gracePeriod * NSEC_PER_SEC)), 
+                 dispatch_get_main_queue(), 
+                 ^{
+                   if (vaultSession_ == session) {
+                     [self endVaultSession];
+                   }
+                 });
+}
+
+//
+//  PRIVATE: Wipes the vault session, if there is one, and gives back its
+//  background time.
+//
+
+- (void)endVaultSession {
+  
+  [vaultSession_ wipe];
+  [vaultSession_ release];
+  vaultSession_ = nil;
+  if (vaultSessionTask_ != UIBackgroundTaskInvalid) {
+    [[UIApplication sharedApplication] endBackgroundTask:vaultSessionTask_];
+    vaultSessionTask_ = UIBackgroundTaskInvalid;
+  }
+}
+
+//
+//  When we leave the active state, throw away all decrypted information. If
+//  vault sessions are on, the decrypted keys are first put away in a
+//  session, so coming back soon doesn't mean decrypting everything again.
+//  If tracing is on, this is also when the trace is saved.
 //
 
 - (void)applicationDidEnterBackground:(UIApplication *)application {
+  if (DVTraceEnabled) {
+    [DVTrace writeTraceToFile:[DVTrace defaultTracePath]];
+  }
+  [self beginVaultSessionForApplication:application];
   self.rootViewController.password = nil;
   self.detailViewController.password = nil;
   self.detailViewController.detailItem = nil;
 }
 
 //
-//  When we become foreground, we've forgotten our password. Prompt.
+//  When we become foreground, pick up where we left off if the vault session
+//  is still good; the password is asked for later, if something needs it.
+//  Otherwise, we've forgotten everything. Prompt. On a cold launch the root
+//  view has already scheduled a refresh; this doesn't add a second one.
 //
 
 - (void)applicationDidBecomeActive:(UIApplication *)application {
-  [self.rootViewController performSelector:@selector(lookForNewDropBoxFiles) 
-                                withObject:nil 
-                                afterDelay:0];
-  [self.detailViewController performSelector:@selector(presentPasswordController) 
-                                  withObject:nil
-                                  afterDelay:0];
+  BOOL resumed = (vaultSession_ != nil && !vaultSession_.expired);
+  if (resumed) {
+    [self.detailViewController resumeSession:vaultSession_];
+  }
+  [self endVaultSession];
+  [self.rootViewController scheduleLookForNewDropBoxFiles];
+  if (!resumed) {
+    [self.detailViewController performSelector:@selector(presentPasswordController) 
+                                    withObject:nil
+                                    afterDelay:0];
+  }
 }
 
 
@@ -94,6 +189,7 @@ didFinishLaunchingWithOptions:(NSDictionary *)launchOptions {
  */
 - (void)applicationWillTerminate:(UIApplication *)application {
   
+  [self endVaultSession];
   NSError *error = nil;
   NSManagedObjectContext *managedObjectContext = self.managedObjectContext;
   if (managedObjectContext != nil) {
@@ -153,51 +249,42 @@ didFinishLaunchingWithOptions:(NSDictionary *)launchOptions {
  */
 - (NSPersistentStoreCoordinator *)persistentStoreCoordinator {
   
-  BOOL didRetry = NO;
   if (persistentStoreCoordinator_ != nil) {
     return persistentStoreCoordinator_;
   }
   
   NSURL *storeURL = [[self applicationDocumentsDirectory] URLByAppendingPathComponent:@"DropboxPrototype.sqlite"];
   
+  //
+  //  Stores written by an older version of the model (say, from before
+  //  |KeyName| was indexed) are brought up to date with a lightweight
+  //  migration, so the key list survives an upgrade.
+  //
+  
+  NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithBool:YES], NSMigratePersistentStoresAutomaticallyOption,
+                           [NSNumber numberWithBool:YES], NSInferMappingModelAutomaticallyOption,
+                           nil];
   NSError *error = nil;
   persistentStoreCoordinator_ = [[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:[self managedObjectModel]];
-retry:
-  if (![persistentStoreCoordinator_ addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:nil error:&error]) {
-    /*
-     Replace this implementation with code to handle the error appropriately.
-     
-     abort() causes the application to generate a crash log and terminate. You should not use this function in a shipping application, although it may be useful during development. If it is not possible to recover from the error, display an alert panel that instructs the user to quit the application by pressing the Home button.
-     
-     Typical reasons for an error here include:
-     * The persistent store is not accessible;
-     * The schema for the persistent store is incompatible with current managed object model.
-     Check the error message to determine what the actual problem was.
-     
-     
-     If the persistent store is not accessible, there is typically something wrong with the file path. Often, a file URL is pointing into the application's resources directory instead of a writeable directory.
-     
-     If you encounter schema incompatibility errors during development, you can reduce their frequency by:
-     * Simply deleting the existing store:
-     [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil]
-     
-     * Performing automatic lightweight migration by passing the following dictionary as the options parameter: 
-     [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES],NSMigratePersistentStoresAutomaticallyOption, [NSNumber numberWithBool:YES], NSInferMappingModelAutomaticallyOption, nil];
-     
-     Lightweight migration will only work for a limited set of schema changes; consult "Core Data Model Versioning and Data Migration Programming Guide" for details.
-     
-     */
+  if ([persistentStoreCoordinator_ addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:options error:&error]) {
+    return persistentStoreCoordinator_;
+  }
+  _GTMDevLog(@"%s -- unable to open or migrate store: %@ (%@)",
+             __PRETTY_FUNCTION__,
+             error,
+             [error userInfo]);
+  
+  //
+  //  Everything in the store can be rebuilt from DropBox, so if it can't be
+  //  migrated (or is corrupt), start over with an empty one rather than
+  //  refusing to launch.
+  //
+  
+  [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil];
+  error = nil;
+  if (![persistentStoreCoordinator_ addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:options error:&error]) {
     NSLog(@"Unresolved error %@, %@", error, [error userInfo]);
-    
-    //
-    //  Development code only.
-    //
-    
-    if (!didRetry) {
-      [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil];
-      didRetry = YES;
-      goto retry;
-    }
     abort();
   }    
   
@@ -235,6 +322,7 @@ retry:
   [managedObjectContext_ release];
   [managedObjectModel_ release];
   [persistentStoreCoordinator_ release];
+  [vaultSession_ release];
   
   
   [super dealloc];
@@ -19,12 +19,16 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "DVVaultCrypto.h"
 
 //
 //  Given a password, this class can decrypt a DropVault key file and get
 //  the AES encryption key, IV, and filename associated with a DropVault data
 //  file.
 //
+//  The key file format, and its |kKeyFileOption| flags, are described in
+//  DVVaultCrypto.h.
+//
 
 @interface KeyFileDecryptor : NSObject {
   
@@ -33,6 +37,8 @@
   NSData *iv_;
   NSString *fileName_;
   NSString *password_;
+  BOOL compressed_;
+  BOOL chunked_;
 }
 
 @property (nonatomic, retain) NSData *key;
@@ -40,6 +46,18 @@
 @property (nonatomic, copy) NSString *fileName;
 @property (nonatomic, copy) NSString *password;
 
+//
+//  YES if the data file is compressed under its encryption. Defaults to NO.
+//
+
+@property (nonatomic, assign) BOOL compressed;
+
+//
+//  YES if the data file is a chunk manifest. Defaults to NO.
+//
+
+@property (nonatomic, assign) BOOL chunked;
+
 //
 //  Decrypts key file data with a password and creates a new KeyFileDescriptor
 //  object with the decrypted key, initialization vector, and clear file name.
@@ -54,4 +72,13 @@
 
 - (NSData *)encryptedBlob;
 
+//
+//  Generates the encrypted blob format of the key data with a particular
+//  |salt| rather than a random one. |salt| must be 8 bytes long.
+//  Only for generating repeatable test data; real key files need a random
+//  salt.
+//
+
+- (NSData *)encryptedBlobWithSalt:(NSData *)salt;
+
 @end
@@ -28,11 +28,12 @@
 //  files.
 // 
 
-#define kSaltBytes          8
+#define kSaltBytes          kDVVaultSaltLength
 
 @implementation KeyFileDecryptor
 
 @synthesize key = key_, iv = iv_, fileName = fileName_, password = password_;
+@synthesize compressed = compressed_, chunked = chunked_;
 
 - (void)dealloc {
   [key_ release];
@@ -57,6 +58,9 @@
   //  The |salt| is the first 8 bytes of |keyData|.
   //
   
+  if ([keyData length] < kSaltBytes) {
+    return nil;
+  }
   NSMutableData *salt = [[[NSMutableData alloc] initWithLength:kSaltBytes] autorelease];
   [keyData getBytes:[salt mutableBytes] range:NSMakeRange(0, kSaltBytes)];
   
@@ -89,9 +93,10 @@
   //
   
   NSData *clearText = [cipherText aesDecryptWithKey:key andIV:iv];
-  if (!clearText) {
+  NSUInteger fileNameOffset = kCCKeySizeAES128+kCCBlockSizeAES128;
+  if (!clearText || [clearText length] < fileNameOffset) {
     //
-    //  Unable to decrypt key.
+    //  Unable to decrypt key, or too short to hold the key and IV.
     //
     
     return nil;
@@ -117,15 +122,23 @@
   decryptor.iv = fileIv;
   
   //
-  //  Extract the file name
+  //  Extract the file name, and any options after it.
   //
   
-  int fileNameOffset = kCCKeySizeAES128+kCCBlockSizeAES128;
-  NSMutableData *fileNameBytes = [NSMutableData dataWithLength:[clearText length]-fileNameOffset];
-  [fileNameBytes increaseLengthBy:1];  // add room for the null byte
-  [clearText getBytes:[fileNameBytes mutableBytes] 
-                range:NSMakeRange(fileNameOffset, [clearText length]-fileNameOffset)];
-  NSString *fileName = [NSString stringWithUTF8String:[fileNameBytes mutableBytes]];
+  const char *fileNameBytes = (const char *)[clearText bytes] + fileNameOffset;
+  NSUInteger fileNameLength = [clearText length] - fileNameOffset;
+  const char *terminator = memchr(fileNameBytes, 0, fileNameLength);
+  if (terminator != NULL) {
+    NSUInteger optionsLength = fileNameLength - (terminator - fileNameBytes) - 1;
+    if (optionsLength > 0) {
+      decryptor.compressed = (terminator[1] & kKeyFileOptionCompressed) != 0;
+      decryptor.chunked = (terminator[1] & kKeyFileOptionChunked) != 0;
+    }
+    fileNameLength = terminator - fileNameBytes;
+  }
+  NSString *fileName = [[[NSString alloc] initWithBytes:fileNameBytes
+                                                 length:fileNameLength
+                                               encoding:NSUTF8StringEncoding] autorelease];
   decryptor.fileName = fileName;
   
   return decryptor;
@@ -136,40 +149,42 @@
 //
 
 - (NSData *)encryptedBlob {
-  NSUInteger targetCapacity = [self.fileName length] + kCCKeySizeAES128 + kCCBlockSizeAES128 + kSaltBytes;
-  NSMutableData *blob = [NSMutableData dataWithCapacity:targetCapacity];
-  
-  //
-  //  Start by creating a random salt. Put it at the start of the blob, and 
-  //  then generate the encryption key & iv.
-  //
-  
-  NSData *salt = [NSData dataWithRandomBytes:kSaltBytes];
-  _GTMDevAssert([blob length] == 0, @"Blob should start empty");
-  [blob appendData:salt];
-  NSMutableData *blobKey = [NSMutableData dataWithCapacity:kCCKeySizeAES128];
-  NSMutableData *blobIV  = [NSMutableData dataWithCapacity:kCCBlockSizeAES128];
-  [Rfc2898DeriveBytes deriveKey:blobKey 
-                          andIV:blobIV 
-                   fromPassword:self.password 
-                        andSalt:salt];
-  
-  //
-  //  Next, build a payload buffer and encrypt it.
-  //
-  
-  NSMutableData *payload = [NSMutableData dataWithCapacity:targetCapacity-kSaltBytes];
-  [payload appendData:self.key];
-  [payload appendData:self.iv];
+  return [self encryptedBlobWithSalt:[NSData dataWithRandomBytes:kSaltBytes]];
+}
+
+//
+//  Return the current |KeyFileDecryptor| as an encrypted blob, using |salt|
+//  to derive the blob's key & iv.
+//
+
+- (NSData *)encryptedBlobWithSalt:(NSData *)salt {
+  _GTMDevAssert([salt length] == kSaltBytes, @"Salt must be %d bytes", kSaltBytes);
+  _GTMDevAssert([self.key length] == kDVVaultKeyLength, @"Key must be %d bytes", kDVVaultKeyLength);
+  _GTMDevAssert([self.iv length] == kDVVaultIVLength, @"IV must be %d bytes", kDVVaultIVLength);
   const char *fileNameString = [self.fileName UTF8String];
-  [payload appendBytes:fileNameString length:strlen(fileNameString)];
-  [payload aesEncryptInPlaceWithKey:blobKey andIV:blobIV];
-  
-  //
-  //  Append the payload to the blob.
-  //
-  
-  [blob appendData:payload];
+  size_t fileNameLength = strlen(fileNameString);
+  unsigned char options = (self.compressed ? kKeyFileOptionCompressed : 0) | (self.chunked ? kKeyFileOptionChunked : 0);
+  NSMutableData *blob = [NSMutableData dataWithLength:DVVaultKeyFileLength(fileNameLength, options)];
+  
+  //
+  //  The key file is built by the same code as the command line encryptor's,
+  //  so the two can't drift apart.
+  //
+  
+  const char *passwordString = [self.password UTF8String];
+  BOOL succeeded = DVVaultWriteKeyFile(passwordString,
+                                       strlen(passwordString),
+                                       [salt bytes],
+                                       [self.key bytes],
+                                       [self.iv bytes],
+                                       fileNameString,
+                                       fileNameLength,
+                                       options,
+                                       [blob mutableBytes]);
+  _GTMDevAssert(succeeded, @"Key file encryption failed");
+  if (!succeeded) {
+    return nil;
+  }
   return blob;
 }
 
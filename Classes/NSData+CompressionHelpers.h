@@ -0,0 +1,40 @@
+//
+//  NSData+CompressionHelpers.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@interface NSData (CompressionHelpers)
+
+//
+//  Compresses the buffer into a zlib stream (DEFLATE with the zlib header
+//  and checksum). Returns |nil| if there's an error.
+//
+
+- (NSData *)zlibDeflate;
+
+//
+//  Decompresses a zlib stream. Returns |nil| if the buffer isn't one whole,
+//  intact stream.
+//
+
+- (NSData *)zlibInflate;
+
+@end
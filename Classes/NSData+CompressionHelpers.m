@@ -0,0 +1,85 @@
+//
+//  NSData+CompressionHelpers.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "NSData+CompressionHelpers.h"
+#include <zlib.h>
+
+@implementation NSData (CompressionHelpers)
+
+- (NSData *)zlibDeflate {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    return nil;
+  }
+  
+  //
+  //  |deflateBound| is big enough to deflate everything in one call.
+  //
+  
+  NSMutableData *buffer = [NSMutableData dataWithLength:deflateBound(&stream, [self length])];
+  stream.next_in = (Bytef *)[self bytes];
+  stream.avail_in = [self length];
+  stream.next_out = [buffer mutableBytes];
+  stream.avail_out = [buffer length];
+  int status = deflate(&stream, Z_FINISH);
+  [buffer setLength:stream.total_out];
+  deflateEnd(&stream);
+  _GTMDevLog(@"%s -- deflate status %d, %u bytes to %u",
+             __PRETTY_FUNCTION__,
+             status,
+             [self length],
+             [buffer length]);
+  return (status == Z_STREAM_END) ? buffer : nil;
+}
+
+- (NSData *)zlibInflate {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK) {
+    return nil;
+  }
+  NSMutableData *buffer = [NSMutableData dataWithLength:MAX([self length] * 4, 1024)];
+  stream.next_in = (Bytef *)[self bytes];
+  stream.avail_in = [self length];
+  int status = Z_OK;
+  while (status == Z_OK) {
+    if (stream.total_out == [buffer length]) {
+      [buffer increaseLengthBy:[buffer length]];
+    }
+    stream.next_out = (Bytef *)[buffer mutableBytes] + stream.total_out;
+    stream.avail_out = [buffer length] - stream.total_out;
+    status = inflate(&stream, Z_NO_FLUSH);
+  }
+  [buffer setLength:stream.total_out];
+  inflateEnd(&stream);
+  
+  //
+  //  Anything but the end of the stream, with nothing left over, means the
+  //  input was truncated or isn't zlib at all.
+  //
+  
+  if (status != Z_STREAM_END || stream.avail_in != 0) {
+    return nil;
+  }
+  return buffer;
+}
+
+@end
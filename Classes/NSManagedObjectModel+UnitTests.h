@@ -18,4 +18,14 @@
 
 + (NSManagedObjectContext *) inMemoryMOCFromBundle:(NSBundle *)appBundle;
 
+//
+//  Creates a managed object context on a SQLite store at |storeURL|, using
+//  |model| and the same lightweight migration options as the application.
+//  Unlike the in-memory store, this one uses the model's indexes, so it's the
+//  one to benchmark against. Returns |nil| if the store can't be opened.
+//
+
++ (NSManagedObjectContext *)sqliteMOCWithModel:(NSManagedObjectModel *)model
+                                      storeURL:(NSURL *)storeURL;
+
 @end
@@ -40,4 +40,19 @@
   return context;
 }
 
++ (NSManagedObjectContext *)sqliteMOCWithModel:(NSManagedObjectModel *)model
+                                      storeURL:(NSURL *)storeURL {
+
+  NSPersistentStoreCoordinator *coordinator = [[[NSPersistentStoreCoordinator alloc] initWithManagedObjectModel:model] autorelease];
+  NSDictionary *options = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES], NSMigratePersistentStoresAutomaticallyOption, [NSNumber numberWithBool:YES], NSInferMappingModelAutomaticallyOption, nil];
+  NSError *addStoreError = nil;
+  if (![coordinator addPersistentStoreWithType:NSSQLiteStoreType configuration:nil URL:storeURL options:options error:&addStoreError]) {
+    NSLog(@"Error setting up SQLite store for unit test: %@", addStoreError);
+    return nil;
+  }
+  NSManagedObjectContext *context = [[[NSManagedObjectContext alloc] init] autorelease];
+  [context setPersistentStoreCoordinator:coordinator];
+  return context;
+}
+
 @end
@@ -19,9 +19,9 @@
 //
 
 #import "Rfc2898DeriveBytes.h"
-#import "NSData+EncryptionHelpers.h"
+#import "DVTrace.h"
+#import "DVVaultCrypto.h"
 #import <CommonCrypto/CommonCryptor.h>
-#import <CommonCrypto/CommonHMAC.h>
 
 @implementation Rfc2898DeriveBytes
 
@@ -38,82 +38,21 @@
   //
   
   const char *passPhraseBytes = [password UTF8String];
-  int passPhraseLength = strlen(passPhraseBytes);
-  
-  //
-  //  Copy the salt into a mutable buffer. We need to append 4 bytes
-  //  onto the end that we change through each iteration of the algorithm.
-  //
-  
-  NSMutableData *mSalt = [[[NSMutableData alloc] initWithData:salt] autorelease];
-  [mSalt increaseLengthBy:4];
-  
-  //
-  //  Other buffers & counters used for executing RFC2898.
-  //
-  
-  unsigned char mac[CC_SHA1_DIGEST_LENGTH];
-  unsigned char outputBytes[CC_SHA1_DIGEST_LENGTH];
-  unsigned char U[CC_SHA1_DIGEST_LENGTH];
-  const int iterations = 1000;
-  int i;
-  int generatedBytes = 0;
-  unsigned char blockCount = 0;
-  
-  while (generatedBytes < [deriveBytes length]) {
-    bzero(mac, CC_SHA1_DIGEST_LENGTH);
-    bzero(outputBytes, CC_SHA1_DIGEST_LENGTH);
-    bzero(U, CC_SHA1_DIGEST_LENGTH);
-    
-    //
-    //  Each time through this loop, I need to update the very last byte
-    //  of the salt buffer. (If I implemented the full RFC2898 algorithm,
-    //  then I'd be ready to twiddle the last 4 bytes. I don't.)
-    //
-    
-    blockCount++;
-    unsigned char *mSaltBytes = (unsigned char *)[mSalt mutableBytes];
-    mSaltBytes[[mSalt length]-1] = blockCount;
-    _GTMDevLog(@"%s -- salt is %@", __PRETTY_FUNCTION__, [mSalt hexString]);
-    
-    memcpy(U, [mSalt bytes], [mSalt length]);
-    
-    //
-    //  First iteration. I have to split these apart because the data length
-    //  is different between the first iteration (12 bytes) and each subsequent
-    //  iteration (20 bytes).
-    //
-    
-    CCHmac(kCCHmacAlgSHA1, passPhraseBytes, passPhraseLength, [mSalt bytes], [mSalt length], mac);
-    for (i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
-      outputBytes[i] ^= mac[i];
-      U[i] = mac[i];
-    }
-    
-    //
-    //  All subsequent iterations.
-    //
-    
-    for (int iteration = 1; iteration < iterations; iteration++) {
-      CCHmac(kCCHmacAlgSHA1, passPhraseBytes, passPhraseLength, U, CC_SHA1_DIGEST_LENGTH, mac);
-      for (i = 0; i < CC_SHA1_DIGEST_LENGTH; i++) {
-        outputBytes[i] ^= mac[i];
-        U[i] = mac[i];
-      }
-    }
-    
-    int bytesNeeded = [deriveBytes length] - generatedBytes;
-    int bytesToCopy = MIN(bytesNeeded, CC_SHA1_DIGEST_LENGTH);
-    [deriveBytes replaceBytesInRange:NSMakeRange(generatedBytes, bytesToCopy) withBytes:outputBytes];
-    generatedBytes += bytesToCopy;
-  }
+  DVVaultDeriveBytes(passPhraseBytes,
+                     strlen(passPhraseBytes),
+                     [salt bytes],
+                     [salt length],
+                     [deriveBytes mutableBytes],
+                     [deriveBytes length]);
 }
 
 +(void)deriveKey:(NSMutableData *)key andIV:(NSMutableData *)iv
     fromPassword:(NSString *)password andSalt:(NSData *)salt {
   
   NSMutableData *buffer = [[[NSMutableData alloc] initWithLength:(kCCKeySizeAES128+kCCBlockSizeAES128)] autorelease];
+  DVTraceSpan span = DVTraceBegin(@"PBKDF2", kDVTraceCrypto);
   [Rfc2898DeriveBytes deriveBytes:buffer fromPassword:password andSalt:salt];
+  DVTraceEnd(span);
   
   //
   //  Copy the bytes for the key
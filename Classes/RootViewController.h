@@ -23,6 +23,9 @@
 #import "DropboxSDK.h"
 #import "DVErrorHandler.h"
 #import "DVCacheManager.h"
+#import "DVKeyStore.h"
+#import "DVVaultSession.h"
+#import "DVThumbnailCache.h"
 
 
 @class DetailViewController;
@@ -45,6 +48,15 @@ DVCacheManagerDelegate> {
   NSString *password_;
   DVErrorHandler *errorHandler_;
   DVCacheManager *cacheManager_;
+  DVKeyStore *keyStore_;
+  DVThumbnailCache *thumbnailCache_;
+  NSCache *detailTextCache_;
+  NSDateFormatter *dateFormatter_;
+  NSMutableSet *selectedKeyNames_;
+  UIBarButtonItem *deleteSelectedItem_;
+  NSManagedObject *pendingDetailItem_;
+  BOOL multiSelecting_;
+  BOOL swipeDeleting_;
 }
 
 #pragma mark -
@@ -98,6 +110,21 @@ DVCacheManagerDelegate> {
 
 @property (nonatomic, retain) DVCacheManager *cacheManager;
 
+//
+//  Does reconciliation and key decryption off the main thread, merging the
+//  results into |managedObjectContext|. Created from |managedObjectContext|
+//  when first needed.
+//
+
+@property (nonatomic, readonly) DVKeyStore *keyStore;
+
+//
+//  The previews shown in place of file icons. Created in
+//  |+[DVThumbnailCache defaultDirectory]| when first needed.
+//
+
+@property (nonatomic, readonly) DVThumbnailCache *thumbnailCache;
+
 #pragma mark -
 #pragma mark Methods
 
@@ -107,12 +134,51 @@ DVCacheManagerDelegate> {
 
 -(IBAction)lookForNewDropBoxFiles;
 
+//
+//  Looks for new key files on the next pass through the run loop, so the
+//  request doesn't hold up whatever is on screen now. Asking again before
+//  then still makes a single request.
+//
+
+- (void)scheduleLookForNewDropBoxFiles;
+
+//
+//  Takes the decrypted keys back from |session|, which was made when the
+//  application went into the background. Unlike setting |password|, this
+//  doesn't decrypt any key files. The password stays unset: keys listed for
+//  the first time after this, or selected before they're decrypted, ask the
+//  |detailViewController| to prompt for it.
+//
+
+- (void)resumeSession:(DVVaultSession *)session;
+
 //
 //  Forgets all files currently in DropBox.
 //
 
 -(IBAction)forgetAllDropBoxFiles;
 
+//
+//  Makes a thumbnail for |object|, a |kDVKeyEntity| object, from its
+//  decrypted document at |path|, and shows it in the list when it's done.
+//  Does nothing if |object| already has one.
+//
+
+- (void)makeThumbnailForObject:(NSManagedObject *)object fromFile:(NSString *)path;
+
+//
+//  Deletes |objects|, which are |kDVKeyEntity| objects, along with their
+//  key and data files in DropBox, as a single batch.
+//
+
+- (void)deleteObjects:(NSArray *)objects;
+
+//
+//  Deletes the rows checked in editing mode, and leaves editing mode.
+//
+
+- (IBAction)deleteSelectedObjects;
+
 //
 //  Get all of the |kDVKeyEntity| objects that match an predicate.
 //  If there is an error, returns |nil| and sets |error|.
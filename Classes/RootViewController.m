@@ -23,7 +23,7 @@
 #import "NSData+EncryptionHelpers.h"
 #import "Rfc2898DeriveBytes.h"
 #import "NSString+FileSystemHelper.h"
-#import "KeyFileDecryptor.h"
+#import "DVLaunchTimer.h"
 
 /*
  This template does not ensure user interface consistency during editing 
@@ -42,28 +42,10 @@
 static NSDictionary *extensionToIcon_;
 
 //
-//  Private category on NSString for testing if a path is a key file.
+//  How many rows are faulted in at once: a little more than a screenful.
 //
 
-@interface NSString (RootViewController)
-- (BOOL)isKeyFile;
-@end
-
-@implementation NSString (RootViewController)
-
-//
-//  Determines if a path is a key file. Key files end in |.key|, but NOT
-//  |-sidecar.key|. In the latter case, it's a key file for a sidecar -- this
-//  will be an encrypted text file that's *about* something else.
-//
-
-- (BOOL)isKeyFile {
-
-  NSPredicate *matcher = [NSPredicate predicateWithFormat:@"(SELF like '*.key') AND NOT (SELF like '*-sidecar.key')"];
-  return [matcher evaluateWithObject:self];
-}
-
-@end
+#define kDVRootFetchBatchSize   20
 
 //
 //  Private methods. Method comments below.
@@ -72,8 +54,10 @@ static NSDictionary *extensionToIcon_;
 @interface RootViewController ()
 - (void)configureCell:(UITableViewCell *)cell 
           atIndexPath:(NSIndexPath *)indexPath;
-- (void)decryptKeyData:(NSData *)keyData 
-        selectedObject:(NSManagedObject *)selectedObject;
+- (NSMutableSet *)selectedKeyNames;
+- (UIBarButtonItem *)deleteSelectedItem;
+- (void)updateDeleteSelectedItem;
+- (void)showThumbnail:(UIImage *)thumbnail forKeyName:(NSString *)keyName;
 @end
 
 
@@ -82,7 +66,6 @@ static NSDictionary *extensionToIcon_;
 
 @synthesize detailViewController = detailViewController_;
 @synthesize fetchedResultsController = fetchedResultsController_;
-@synthesize managedObjectContext = managedObjectContext_;
 @synthesize password = password_;
 @synthesize errorHandler = errorHandler_;
 @synthesize cacheManager = cacheManager_;
@@ -97,6 +80,8 @@ static NSDictionary *extensionToIcon_;
   self.clearsSelectionOnViewWillAppear = NO;
   self.contentSizeForViewInPopover = CGSizeMake(320.0, 600.0);
   self.tableView.rowHeight = 55;
+  self.tableView.allowsSelectionDuringEditing = YES;
+  self.navigationItem.leftBarButtonItem = self.editButtonItem;
   
   NSError *error = nil;
   if (![self.fetchedResultsController performFetch:&error]) {
@@ -105,8 +90,9 @@ static NSDictionary *extensionToIcon_;
   }
   if ([self.dbSession isLinked]) {
     
-    [self lookForNewDropBoxFiles];
+    [self scheduleLookForNewDropBoxFiles];
   }
+  [DVLaunchTimer markPhase:@"root view loaded"];
 }
 
 
@@ -159,31 +145,40 @@ static NSDictionary *extensionToIcon_;
   if ([fileName length] == 0 && [self.password length] > 0) {
     
     //
-    //  We don't have the filename yet, but we do have the password. Decrypt and
-    //  try again.
+    //  We don't have the filename yet, but we do have the password. Show the
+    //  placeholder and have the key store decrypt in the background; the
+    //  fetched results controller reconfigures this cell when it's done.
     //
     
-    NSString *keyName = [DVCacheManager cachePathForDropBoxPath:[managedObject valueForKey:kDVKeyName]];
-    _GTMDevLog(@"%s -- looking for key data in %@", __PRETTY_FUNCTION__, keyName);
-    NSData *keyData = [[[NSData alloc] initWithContentsOfFile:keyName] autorelease];
-    if (keyData && [keyData length] > 0) {
-      [self decryptKeyData:keyData selectedObject:managedObject];
-    }
-    fileName = [managedObject valueForKey:kDVFileName];
+    [self.keyStore requestDecryptionOfKeyName:[managedObject valueForKey:kDVKeyName]
+                                 withPassword:self.password];
   }
   
   if ([fileName length] > 0) {
     
     cell.textLabel.text = fileName;
-    NSString *detail = [NSString stringWithFormat:@"%@ %@",
-                        [NSDateFormatter localizedStringFromDate:[managedObject valueForKey:kDVLastModifiedDate] 
-                                                       dateStyle:NSDateFormatterShortStyle 
-                                                       timeStyle:NSDateFormatterNoStyle],
-                        [managedObject valueForKey:kDVHumanReadableSize]
-                        ];
-    cell.detailTextLabel.text = detail;
-    NSString *iconName = [self iconNameForFileName:fileName];
-    cell.imageView.image = [UIImage imageNamed:iconName];
+    cell.detailTextLabel.text = [self detailTextForObject:managedObject];
+    NSString *keyName = [managedObject valueForKey:kDVKeyName];
+    UIImage *thumbnail = [self.thumbnailCache cachedThumbnailForKeyName:keyName];
+    if (thumbnail != nil) {
+      cell.imageView.image = thumbnail;
+    } else {
+      
+      //
+      //  Show the icon now, and swap in the thumbnail once it's been read and
+      //  decrypted off the main thread.
+      //
+      
+      NSString *iconName = [self iconNameForFileName:fileName];
+      cell.imageView.image = [UIImage imageNamed:iconName];
+      if ([self.thumbnailCache hasThumbnailForKeyName:keyName]) {
+        [self.thumbnailCache loadThumbnailForKeyName:keyName
+                                             withKey:[managedObject valueForKey:kDVKey]
+                                          completion:^(UIImage *loaded) {
+                                            [self showThumbnail:loaded forKeyName:keyName];
+                                          }];
+      }
+    }
     
   } else {
     
@@ -191,6 +186,36 @@ static NSDictionary *extensionToIcon_;
     cell.detailTextLabel.text = @"";
     cell.imageView.image = [UIImage imageNamed:@"54-lock.png"];
   }
+  if (multiSelecting_ && [selectedKeyNames_ containsObject:[managedObject valueForKey:kDVKeyName]]) {
+    cell.accessoryType = UITableViewCellAccessoryCheckmark;
+  } else {
+    cell.accessoryType = UITableViewCellAccessoryNone;
+  }
+}
+
+//
+//  PRIVATE: The "date size" line under a file name. Formatting dates is slow
+//  enough to show up while scrolling, so each object's text is built once,
+//  with one formatter, and kept until the object changes.
+//
+
+- (NSString *)detailTextForObject:(NSManagedObject *)managedObject {
+  
+  if (detailTextCache_ == nil) {
+    detailTextCache_ = [[NSCache alloc] init];
+    dateFormatter_ = [[NSDateFormatter alloc] init];
+    [dateFormatter_ setDateStyle:NSDateFormatterShortStyle];
+    [dateFormatter_ setTimeStyle:NSDateFormatterNoStyle];
+  }
+  NSString *detail = [detailTextCache_ objectForKey:[managedObject objectID]];
+  if (detail == nil) {
+    NSDate *date = [managedObject valueForKey:kDVLastModifiedDate];
+    detail = [NSString stringWithFormat:@"%@ %@",
+              (date != nil) ? [dateFormatter_ stringFromDate:date] : @"",
+              [managedObject valueForKey:kDVHumanReadableSize]];
+    [detailTextCache_ setObject:detail forKey:[managedObject objectID]];
+  }
+  return detail;
 }
 
 #pragma mark Error Handler
@@ -234,22 +259,97 @@ static NSDictionary *extensionToIcon_;
   return cacheManager_;
 }
 
--(IBAction)lookForNewDropBoxFiles {
-  [self.cacheManager loadMetadata];
+#pragma mark Core Data
+
+- (NSManagedObjectContext *)managedObjectContext {
+  return managedObjectContext_;
 }
 
 //
-//  Removes a single DropBox file.
+//  Sets the main context. The key store writes on behalf of a particular
+//  context, so a new context gets a new key store.
 //
 
-- (IBAction)removeDropBoxObject:(NSManagedObject *)object 
-                    fromContext:(NSManagedObjectContext *) context {
+- (void)setManagedObjectContext:(NSManagedObjectContext *)managedObjectContext {
+  if (managedObjectContext == managedObjectContext_) {
+    return;
+  }
+  [keyStore_ release];
+  keyStore_ = nil;
+  [managedObjectContext_ release];
+  managedObjectContext_ = [managedObjectContext retain];
+}
+
+- (DVKeyStore *)keyStore {
+  if (keyStore_ == nil && managedObjectContext_ != nil) {
+    keyStore_ = [[DVKeyStore alloc] initWithMainContext:managedObjectContext_];
+  }
+  return keyStore_;
+}
+
+- (DVThumbnailCache *)thumbnailCache {
+  if (thumbnailCache_ == nil) {
+    thumbnailCache_ = [[DVThumbnailCache alloc] initWithDirectory:[DVThumbnailCache defaultDirectory]];
+  }
+  return thumbnailCache_;
+}
+
+//
+//  When the thumbnail is ready, redraw the row if it's on screen.
+//
+
+- (void)makeThumbnailForObject:(NSManagedObject *)object fromFile:(NSString *)path {
+  
+  [self.thumbnailCache makeThumbnailForKeyName:[object valueForKey:kDVKeyName]
+                                      fromFile:path
+                                       withKey:[object valueForKey:kDVKey]
+                                    completion:^(BOOL made) {
+                                      if (!made) {
+                                        return;
+                                      }
+                                      NSIndexPath *indexPath = [self.fetchedResultsController indexPathForObject:object];
+                                      UITableViewCell *cell = (indexPath != nil) ? [self.tableView cellForRowAtIndexPath:indexPath] : nil;
+                                      if (cell != nil) {
+                                        [self configureCell:cell atIndexPath:indexPath];
+                                      }
+                                    }];
+}
+
+//
+//  PRIVATE: Puts |thumbnail| in the row for |keyName|, if that row is still on
+//  screen and still shows that document.
+//
+
+- (void)showThumbnail:(UIImage *)thumbnail forKeyName:(NSString *)keyName {
   
-  NSString *fileName = [DVCacheManager cachePathForDropBoxPath:[object valueForKey:kDVKeyName]];
-  [[NSFileManager defaultManager] removeItemAtPath:fileName error:nil];
-  [[NSFileManager defaultManager] removeItemAtPath:[[fileName stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"]
-                                             error:nil];
-  [context deleteObject:object];
+  if (thumbnail == nil) {
+    return;
+  }
+  for (NSIndexPath *indexPath in [self.tableView indexPathsForVisibleRows]) {
+    NSManagedObject *object = [self.fetchedResultsController objectAtIndexPath:indexPath];
+    if (![[object valueForKey:kDVKeyName] isEqualToString:keyName] ||
+        [[object valueForKey:kDVFileName] length] == 0) {
+      continue;
+    }
+    UITableViewCell *cell = [self.tableView cellForRowAtIndexPath:indexPath];
+    cell.imageView.image = thumbnail;
+    [cell setNeedsLayout];
+  }
+}
+
+#pragma mark DropBox actions
+
+-(IBAction)lookForNewDropBoxFiles {
+  [self.cacheManager loadMetadata];
+}
+
+- (void)scheduleLookForNewDropBoxFiles {
+  [NSObject cancelPreviousPerformRequestsWithTarget:self 
+                                           selector:@selector(lookForNewDropBoxFiles) 
+                                             object:nil];
+  [self performSelector:@selector(lookForNewDropBoxFiles) 
+             withObject:nil 
+             afterDelay:0];
 }
 
 //
@@ -258,15 +358,8 @@ static NSDictionary *extensionToIcon_;
 //
 
 -(IBAction)forgetAllDropBoxFiles {
-  NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
-  for (NSManagedObject *object in [self.fetchedResultsController fetchedObjects]) {
-    [self removeDropBoxObject:object fromContext:context];
-  }
-  NSError *error = nil;
-  if (![context save:&error]) {
-    
-    [self.errorHandler displayMessage:kDVErrorCoreDataUnexpected forError:error];
-  }
+  [self.keyStore removeAllKeys];
+  [self.thumbnailCache removeAllThumbnails];
 }
 
 //
@@ -289,108 +382,56 @@ static NSDictionary *extensionToIcon_;
   NSFetchRequest *fetchRequest = [[[NSFetchRequest alloc] init] autorelease];
   [fetchRequest setEntity:entity];
   [fetchRequest setPredicate:predicate];
+  [fetchRequest setFetchBatchSize:[[self.fetchedResultsController fetchRequest] fetchBatchSize]];
   NSArray *objects = [context executeFetchRequest:fetchRequest error:error];
   return objects;
 }
 
-//
-//  Create a new |kDVKeyEntity| object.
-//
-
-- (NSManagedObject *)createNewKeyObject {
-  NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
-  NSEntityDescription *entity = [[self.fetchedResultsController fetchRequest] entity];
-  NSManagedObject *newManagedObject = [NSEntityDescription insertNewObjectForEntityForName:[entity name] 
-                                                                    inManagedObjectContext:context];
-  return newManagedObject;
-}
-
-//
-//  Create a |kDVKeyEntity| object for the corresponding DropBox metadata.
-//
-
-- (void)createEntryForStrongBoxKey:(DBMetadata *)keyMetadata {
-  
-  NSError *error;
-  NSPredicate *predicate = [NSPredicate predicateWithFormat:@"(KeyName = %@)", keyMetadata.path];
-  NSArray *objects = [self fetchObjectsForPredicate:predicate error:&error];
-  if (objects == nil) {
-    
-    [self.errorHandler displayMessage:kDVErrorCoreDataUnexpected forError:error];
-    return;
-  }
-  if ([objects count] > 0) {
-    return;
-  }
-  NSManagedObject *newManagedObject = [self createNewKeyObject];
-  
-  // If appropriate, configure the new managed object.
-  [newManagedObject setValue:keyMetadata.path forKey:kDVKeyName];
-  NSString *dataPath = [[keyMetadata.path stringByDeletingPathExtension] 
-                        stringByAppendingPathExtension:@"dat"];
-  DBMetadata *dataMetadata = [self.cacheManager metadataForPath:[DVCacheManager cachePathForDropBoxPath:dataPath]];
-  if (dataMetadata != nil) {
-    [newManagedObject setValue:dataMetadata.humanReadableSize forKey:kDVHumanReadableSize];
-    [newManagedObject setValue:dataMetadata.lastModifiedDate forKey:kDVLastModifiedDate];
-  }
-  
-  // Save the context.
-  if (![self.fetchedResultsController.managedObjectContext save:&error]) {
-    /*
-     Replace this implementation with code to handle the error appropriately.
-     
-     abort() causes the application to generate a crash log and terminate. You should not use this function in a shipping application, although it may be useful during development. If it is not possible to recover from the error, display an alert panel that instructs the user to quit the application by pressing the Home button.
-     */
-    _GTMDevLog(@"Unresolved error %@, %@", error, [error userInfo]);
-    abort();
-  }
-  
-  //
-  //  And then get the key data.
-  //
-  
-  [self.cacheManager cacheCopyOfDropBoxPath:keyMetadata.path];
-}
-
 //
 //  We've received metadata from DropBox. We need to bring our internal state 
 //  into sync with what's on DropBox. That means adding objects for any new
 //  DropBox |.key| files and removing objects for any files that no longer
-//  exist on DropBox.
+//  exist on DropBox. The key store does the Core Data work in the background;
+//  all we do here is gather what it needs from the metadata, and start
+//  fetching the key data for any new keys once it's done.
 //
 
 - (void)cacheManagerDidLoadMetadata:(DVCacheManager *)cacheManager {
   
-  //
-  //  This is the add path. we add an object for any |.key| file and remember
-  //  all of the names.
-  //
-  
-  NSMutableSet *keyNames = [[[NSMutableSet alloc] init] autorelease];
-  for (DBMetadata *child in cacheManager.metadata.contents) {
-    if ([child.path isKeyFile]) {
-      [self createEntryForStrongBoxKey:child];
-      [keyNames addObject:child.path];
+  NSArray *items = cacheManager.vaultIndex.keyedItems;
+  NSMutableArray *keyEntries = [NSMutableArray arrayWithCapacity:[items count]];
+  NSMutableDictionary *revisions = [NSMutableDictionary dictionaryWithCapacity:[items count]];
+  for (DVVaultItem *item in items) {
+    NSString *keyName = [item metadataForKind:DVVaultEntryKindKey].path;
+    NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObject:keyName
+                                                                    forKey:kDVKeyName];
+    DBMetadata *dataMetadata = [item metadataForKind:DVVaultEntryKindData];
+    if (dataMetadata != nil) {
+      [entry setValue:dataMetadata.humanReadableSize forKey:kDVHumanReadableSize];
+      [entry setValue:dataMetadata.lastModifiedDate forKey:kDVLastModifiedDate];
+      [revisions setObject:[NSNumber numberWithLongLong:dataMetadata.revision] forKey:keyName];
     }
+    [keyEntries addObject:entry];
   }
+  [self.thumbnailCache updateRevisions:revisions];
   
-  //
-  //  Now, pass through each object and delete any objects that do not have
-  //  matching names in |keyNames|.
-  //
-  
-  NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
-  NSArray *objects = [self fetchObjectsForPredicate:nil error:nil];
-  for (NSManagedObject *object in objects) {
-    NSString *keyName = [object valueForKey:kDVKeyName];
-    _GTMDevLog(@"%s -- looking for %@ in %@", __PRETTY_FUNCTION__,
-               keyName, keyNames);
-    if (![keyNames containsObject:keyName]) {
-      [self removeDropBoxObject:object fromContext:context];
+  [self.keyStore reconcileKeyEntries:keyEntries completion:^(NSArray *addedKeyNames, NSError *error) {
+    if (addedKeyNames == nil) {
+      [self.errorHandler displayMessage:kDVErrorCoreDataUnexpected forError:error];
+      return;
     }
-  }
-  NSError *error;
-  [context save:&error];
+    for (NSString *keyName in addedKeyNames) {
+      [self.cacheManager cacheCopyOfDropBoxPath:keyName];
+    }
+    
+    //
+    //  After a resumed session there's no password for the new keys yet.
+    //
+    
+    if ([addedKeyNames count] > 0 && [self.password length] == 0) {
+      [self.detailViewController presentPasswordController];
+    }
+  }];
 }
 
 - (void)cacheManagerLoadMetadataFailed:(DVCacheManager *)cacheManager {
@@ -411,13 +452,8 @@ static NSDictionary *extensionToIcon_;
 - (void)cacheManager:(DVCacheManager *)cacheManager didCacheCopyOfFile:(NSString *)destPath {
 
   _GTMDevLog(@"%s -- successfully loaded %@", __PRETTY_FUNCTION__, destPath);
-  NSData *keyData = [[NSFileManager defaultManager] contentsAtPath:destPath];
-  for (NSManagedObject *managedObject in [self fetchObjectsForPredicate:nil error:nil]) {
-    NSString *keyName = [managedObject valueForKey:kDVKeyName];
-    if ([[[keyName lowercaseString] lastPathComponent] isEqual:[[destPath lowercaseString] lastPathComponent]]) {
-      [self decryptKeyData:keyData selectedObject:managedObject];
-      [self.fetchedResultsController.managedObjectContext save:nil];
-    }
+  if (password_) {
+    [self.keyStore decryptKeyFile:destPath withPassword:password_];
   }
 }
 
@@ -433,78 +469,38 @@ static NSDictionary *extensionToIcon_;
 //
 //  Sets the decryption password. Importantly, if we have already loaded |.key|
 //  files from DropBox, then we go and decrypt the key information for every
-//  key we know about and then refresh our table view.
+//  key we know about. That happens in the background; the table view picks up
+//  the results as the key store merges them in.
 //
 
 -(void)setPassword:(NSString *)pw {
   [password_ autorelease];
   password_ = [pw copy];
   
-  for (NSManagedObject *object in [self fetchObjectsForPredicate:nil error:nil]) {
-    if (password_ && [password_ length] > 0) {
-      
-      //
-      //  We were just given a password, so try to decrypt keys.
-      //
-      
-      NSString *keyName = [DVCacheManager cachePathForDropBoxPath:[object valueForKey:kDVKeyName]];
-      _GTMDevLog(@"%s -- looking for key data in %@", __PRETTY_FUNCTION__, keyName);
-      NSData *keyData = [[[NSData alloc] initWithContentsOfFile:keyName] autorelease];
-      if (keyData && [keyData length] > 0) {
-        [self decryptKeyData:keyData selectedObject:object];
-      }
-      
-    } else {
-      
-      //
-      //  We just lost our password. Throw away decrypted information.
-      //
-      
-      [object setValue:nil forKey:kDVFileName];
-      [object setValue:nil forKey:kDVKey];
-      [object setValue:nil forKey:kDVIV];
-    }
+  if (password_ && [password_ length] > 0) {
+    
+    //
+    //  We were just given a password, so try to decrypt keys.
+    //
+    
+    [self.keyStore decryptAllKeysWithPassword:password_];
+    
+  } else {
+    
+    //
+    //  We just lost our password. Throw away decrypted information.
+    //
+    
+    [self.keyStore forgetDecryptedKeys];
+    [self.thumbnailCache forgetDecryptedImages];
   }
   [self.tableView reloadData];
 }
 
-//
-//  Decrypts the ciphertext |keyData| that was in one of the |.key| files stored
-//  in DropBox. Stores the decrypted |key|, |iv|, and |fileName| as attributes
-//  of |selectedObject| for use later in the application.
-//
-//  If |password_| is not set prior to receiving this message, then the routine
-//  does nothing.
-//
-
-- (void)decryptKeyData:(NSData *)keyData selectedObject:(NSManagedObject *)selectedObject  {
-  if (!password_) {
-    return;
-  }
-  KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyData 
-                                                        andPassword:password_];
-  if (decryptor == nil) {
-    return;
-  }
-  [selectedObject setValue:decryptor.key forKey:@"Key"];
-  [selectedObject setValue:decryptor.iv forKey:@"InitializationVector"];
-  [selectedObject setValue:decryptor.fileName forKey:kDVFileName];
-  
-  NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
-  NSError *error;
-  @try {
-    
-    if (![context save:&error]) {
-      [self.errorHandler displayMessage:kDVErrorCoreDataUnexpected forError:error];
-    }
-    
-  }
-  @catch (NSException * e) {
-    _GTMDevLog(@"%s -- unexpected exception %@ (%@)", 
-               __PRETTY_FUNCTION__, 
-               e,
-               [[e callStackSymbols] description]);
-  }
+- (void)resumeSession:(DVVaultSession *)session {
+  [session useDecryptedKeyValues:^(NSDictionary *decryptedKeyValues) {
+    [self.keyStore restoreDecryptedKeyValues:decryptedKeyValues];
+  }];
 }
 
 #pragma mark -
@@ -546,37 +542,45 @@ static NSDictionary *extensionToIcon_;
   
   if (editingStyle == UITableViewCellEditingStyleDelete) {
     
-    //
-    // Delete the managed object and DropBox files.
-    //
-    
     NSManagedObject *objectToDelete = [self.fetchedResultsController objectAtIndexPath:indexPath];
-    NSString *keyPath = [objectToDelete valueForKey:kDVKeyName];
-    NSString *datPath = [[keyPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"];
-    [self.cacheManager deleteDropBoxPath:keyPath];
-    [self.cacheManager deleteDropBoxPath:datPath];
-
-    if (self.detailViewController.detailItem == objectToDelete) {
-      self.detailViewController.detailItem = nil;
-    }
-    
-    NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
-    [context deleteObject:objectToDelete];
-    
-    NSError *error;
-    @try {
-      
-      if (![context save:&error]) {
-        [self.errorHandler displayMessage:kDVErrorDelete forError:error];
-      }
-      
-    }
-    @catch (NSException * e) {
-      [self.errorHandler displayMessage:kDVErrorDelete forError:nil];
-    }
+    [self deleteObjects:[NSArray arrayWithObject:objectToDelete]];
   }   
 }
 
+//
+//  After the Edit button, rows get checkmarks rather than delete buttons.
+//  Swiping a row still deletes just that row.
+//
+
+- (UITableViewCellEditingStyle)tableView:(UITableView *)tableView editingStyleForRowAtIndexPath:(NSIndexPath *)indexPath {
+  return multiSelecting_ ? UITableViewCellEditingStyleNone : UITableViewCellEditingStyleDelete;
+}
+
+//
+//  Swiping a row puts the controller in editing mode too. Note the swipe so
+//  |setEditing:animated:| leaves multiple selection alone.
+//
+
+- (void)tableView:(UITableView *)tableView willBeginEditingRowAtIndexPath:(NSIndexPath *)indexPath {
+  
+  swipeDeleting_ = YES;
+  if ([UITableViewController instancesRespondToSelector:_cmd]) {
+    [super tableView:tableView willBeginEditingRowAtIndexPath:indexPath];
+  }
+}
+
+- (void)tableView:(UITableView *)tableView didEndEditingRowAtIndexPath:(NSIndexPath *)indexPath {
+  
+  if ([UITableViewController instancesRespondToSelector:_cmd]) {
+    [super tableView:tableView didEndEditingRowAtIndexPath:indexPath];
+  }
+  swipeDeleting_ = NO;
+}
+
+- (BOOL)tableView:(UITableView *)tableView shouldIndentWhileEditingRowAtIndexPath:(NSIndexPath *)indexPath {
+  return NO;
+}
+
 
 - (BOOL)tableView:(UITableView *)tableView canMoveRowAtIndexPath:(NSIndexPath *)indexPath {
   // The table view should not be re-orderable.
@@ -589,24 +593,156 @@ static NSDictionary *extensionToIcon_;
 
 - (void)tableView:(UITableView *)aTableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
   
-  // Set the detail item in the detail view controller.
   NSManagedObject *selectedObject = [self.fetchedResultsController objectAtIndexPath:indexPath];
-  NSString *destPath = [[selectedObject valueForKey:kDVKeyName] lastPathComponent];
-  _GTMDevLog(@"%s -- looking for %@", __PRETTY_FUNCTION__, destPath);
-  NSData *keyData = [[NSFileManager defaultManager] contentsAtPath:destPath];
-  if (keyData) {
-    
-    [self decryptKeyData:keyData selectedObject: selectedObject];
+  if (multiSelecting_) {
     
-  } else {
+    //
+    //  Check or uncheck the row for deletion.
+    //
     
-    _GTMDevLog(@"%s -- unable to load data", __PRETTY_FUNCTION__);
+    NSString *keyName = [selectedObject valueForKey:kDVKeyName];
+    if ([self.selectedKeyNames containsObject:keyName]) {
+      [self.selectedKeyNames removeObject:keyName];
+    } else {
+      [self.selectedKeyNames addObject:keyName];
+    }
+    [aTableView deselectRowAtIndexPath:indexPath animated:YES];
+    [self configureCell:[aTableView cellForRowAtIndexPath:indexPath] atIndexPath:indexPath];
+    [self updateDeleteSelectedItem];
+    return;
   }
   
+  //
+  //  If the key isn't decrypted yet, move it to the front of the key store's
+  //  queue. The detail view is shown again when it's done.
+  //
+  
+  [pendingDetailItem_ release];
+  pendingDetailItem_ = nil;
+  if ([[selectedObject valueForKey:kDVFileName] length] == 0) {
+    pendingDetailItem_ = [selectedObject retain];
+    if ([self.password length] > 0) {
+      [self.keyStore requestDecryptionOfKeyName:[selectedObject valueForKey:kDVKeyName]
+                                   withPassword:self.password];
+    } else {
+      [self.detailViewController presentPasswordController];
+    }
+  }
   self.detailViewController.detailItem = selectedObject;    
 }
 
 
+#pragma mark -
+#pragma mark Deleting
+
+//
+//  PRIVATE: The key names of the rows checked in editing mode.
+//
+
+- (NSMutableSet *)selectedKeyNames {
+  if (selectedKeyNames_ == nil) {
+    selectedKeyNames_ = [[NSMutableSet alloc] init];
+  }
+  return selectedKeyNames_;
+}
+
+//
+//  PRIVATE: The Delete button shown in editing mode.
+//
+
+- (UIBarButtonItem *)deleteSelectedItem {
+  if (deleteSelectedItem_ == nil) {
+    deleteSelectedItem_ = [[UIBarButtonItem alloc] initWithTitle:kDVStringDelete
+                                                           style:UIBarButtonItemStyleBordered
+                                                          target:self
+                                                          action:@selector(deleteSelectedObjects)];
+  }
+  return deleteSelectedItem_;
+}
+
+//
+//  PRIVATE: Shows how many rows the Delete button will delete.
+//
+
+- (void)updateDeleteSelectedItem {
+  NSUInteger count = [selectedKeyNames_ count];
+  self.deleteSelectedItem.title = (count > 0) ? [NSString stringWithFormat:kDVStringDeleteCount, count] : kDVStringDelete;
+  self.deleteSelectedItem.enabled = (count > 0);
+}
+
+//
+//  Entering or leaving editing mode from the Edit button starts with nothing
+//  checked. A swipe to delete doesn't change multiple selection.
+//
+
+- (void)setEditing:(BOOL)editing animated:(BOOL)animated {
+  
+  [super setEditing:editing animated:animated];
+  if (swipeDeleting_) {
+    return;
+  }
+  multiSelecting_ = editing;
+  [selectedKeyNames_ removeAllObjects];
+  [self updateDeleteSelectedItem];
+  [self.navigationItem setRightBarButtonItem:(editing ? self.deleteSelectedItem : nil) animated:animated];
+  for (NSIndexPath *indexPath in [self.tableView indexPathsForVisibleRows]) {
+    [self configureCell:[self.tableView cellForRowAtIndexPath:indexPath] atIndexPath:indexPath];
+  }
+}
+
+- (void)deleteObjects:(NSArray *)objects {
+  
+  if ([objects count] == 0) {
+    return;
+  }
+  
+  //
+  //  Delete the managed objects, and send the DropBox files off to be 
+  //  deleted in one batch.
+  //
+  
+  NSManagedObjectContext *context = [self.fetchedResultsController managedObjectContext];
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity:2 * [objects count]];
+  for (NSManagedObject *objectToDelete in objects) {
+    NSString *keyPath = [objectToDelete valueForKey:kDVKeyName];
+    [paths addObject:keyPath];
+    [paths addObject:[DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:keyPath]];
+    if (self.detailViewController.detailItem == objectToDelete) {
+      self.detailViewController.detailItem = nil;
+    }
+    [self.thumbnailCache removeThumbnailForKeyName:keyPath];
+    [context deleteObject:objectToDelete];
+  }
+  [self.cacheManager deleteDropBoxPaths:paths];
+  
+  NSError *error;
+  @try {
+    
+    if (![context save:&error]) {
+      [self.errorHandler displayMessage:kDVErrorDelete forError:error];
+    }
+    
+  }
+  @catch (NSException * e) {
+    [self.errorHandler displayMessage:kDVErrorDelete forError:nil];
+  }
+}
+
+- (IBAction)deleteSelectedObjects {
+  
+  if ([selectedKeyNames_ count] > 0) {
+    NSPredicate *predicate = [NSPredicate predicateWithFormat:@"%K IN %@", kDVKeyName, selectedKeyNames_];
+    NSError *error = nil;
+    NSArray *objects = [self fetchObjectsForPredicate:predicate error:&error];
+    if (objects == nil) {
+      [self.errorHandler displayMessage:kDVErrorDelete forError:error];
+    }
+    [self deleteObjects:objects];
+  }
+  [self setEditing:NO animated:YES];
+}
+
+
 #pragma mark -
 #pragma mark Fetched results controller
 
@@ -626,8 +762,13 @@ static NSDictionary *extensionToIcon_;
                                             inManagedObjectContext:managedObjectContext_];
   [fetchRequest setEntity:entity];
   
-  // Set the batch size to a suitable number.
-  [fetchRequest setFetchBatchSize:20];
+  //
+  //  Only a screenful of rows is faulted in at a time, and the sort runs off
+  //  the |KeyName| index, so the first page shows up just as fast in a vault
+  //  of 50,000 keys as one of 50.
+  //
+  
+  [fetchRequest setFetchBatchSize:kDVRootFetchBatchSize];
   
   // Edit the sort key as appropriate.
   NSSortDescriptor *sortDescriptor = [[NSSortDescriptor alloc] initWithKey:kDVKeyName 
@@ -700,7 +841,26 @@ static NSDictionary *extensionToIcon_;
       break;
       
     case NSFetchedResultsChangeUpdate:
-      if (indexPath != nil) {
+      [detailTextCache_ removeObjectForKey:[anObject objectID]];
+      if (anObject == pendingDetailItem_ && [[anObject valueForKey:kDVFileName] length] > 0) {
+        
+        //
+        //  The key selected before it was decrypted is ready now.
+        //
+        
+        [pendingDetailItem_ autorelease];
+        pendingDetailItem_ = nil;
+        if (self.detailViewController.detailItem == anObject) {
+          self.detailViewController.detailItem = nil;
+          self.detailViewController.detailItem = anObject;
+        }
+      }
+      if ((indexPath != nil) && ([tableView cellForRowAtIndexPath:indexPath] != nil)) {
+        
+        //
+        //  Only visible rows get reconfigured; the rest would just queue up
+        //  decryption for cells nobody is looking at.
+        //
         
         [self configureCell:[tableView cellForRowAtIndexPath:indexPath] atIndexPath:indexPath];
       }
@@ -748,6 +908,13 @@ static NSDictionary *extensionToIcon_;
   [password_ release];
   [errorHandler_ release];
   [cacheManager_ release];
+  [keyStore_ release];
+  [thumbnailCache_ release];
+  [detailTextCache_ release];
+  [selectedKeyNames_ release];
+  [deleteSelectedItem_ release];
+  [pendingDetailItem_ release];
+  [dateFormatter_ release];
   
   [super dealloc];
 }
@@ -16,4 +16,5 @@ typedef enum {
     DBErrorGenericError = 1000,
     DBErrorFileNotFound,
     DBErrorInsufficientDiskSpace,
+    DBErrorInvalidResponse,
 } DBErrorCode;
@@ -24,6 +24,11 @@
 
 - (id)initWithDictionary:(NSDictionary*)dict;
 
+// Parses a date in the "EEE, dd MMM yyyy HH:mm:ss Z" format used by the API,
+// e.g. "Sat, 12 Mar 2011 20:58:00 -0800". Uses a fast fixed-layout parser and
+// only falls back to NSDateFormatter for input that doesn't match the layout.
++ (NSDate*)dateFromString:(NSString*)string;
+
 @property (nonatomic, readonly) BOOL thumbnailExists;
 @property (nonatomic, readonly) long long totalBytes;
 @property (nonatomic, readonly) NSDate* lastModifiedDate;
@@ -38,3 +43,8 @@
 @property (nonatomic, readonly) BOOL isDeleted;
 
 @end
+
+// The fixed-layout parser behind +dateFromString:. Reads exactly |length| bytes
+// (no NUL terminator needed) and returns NO, without touching |outInterval|, if
+// they aren't a valid date in the API's layout.
+BOOL DBMetadataParseDate(const char* bytes, size_t length, NSTimeInterval* outInterval);
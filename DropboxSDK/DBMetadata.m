@@ -8,6 +8,66 @@
 
 #import "DBMetadata.h"
 
+static inline BOOL DBParseDigits(const char* bytes, int count, int* outValue) {
+    int value = 0;
+    for (int i = 0; i < count; i++) {
+        if (bytes[i] < '0' || bytes[i] > '9') return NO;
+        value = value * 10 + (bytes[i] - '0');
+    }
+    *outValue = value;
+    return YES;
+}
+
+// Days from 1970-01-01 to the given proleptic Gregorian date.
+static int64_t DBDaysFromCivil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+BOOL DBMetadataParseDate(const char* bytes, size_t length, NSTimeInterval* outInterval) {
+    // "Sat, 12 Mar 2011 20:58:00 -0800"
+    //  0123456789012345678901234567890
+    static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static const int daysInMonth[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (length != 31 || bytes[3] != ',' || bytes[4] != ' ' || bytes[7] != ' ' ||
+        bytes[11] != ' ' || bytes[16] != ' ' || bytes[19] != ':' || bytes[22] != ':' ||
+        bytes[25] != ' ' || (bytes[26] != '+' && bytes[26] != '-')) {
+        return NO;
+    }
+
+    int month = 0;
+    while (month < 12 && strncmp(months + month * 3, bytes + 8, 3) != 0) {
+        month++;
+    }
+    if (month == 12) return NO;
+    month++;
+
+    int day, year, hour, minute, second, offsetHours, offsetMinutes;
+    if (!DBParseDigits(bytes + 5, 2, &day) || !DBParseDigits(bytes + 12, 4, &year) ||
+        !DBParseDigits(bytes + 17, 2, &hour) || !DBParseDigits(bytes + 20, 2, &minute) ||
+        !DBParseDigits(bytes + 23, 2, &second) || !DBParseDigits(bytes + 27, 2, &offsetHours) ||
+        !DBParseDigits(bytes + 29, 2, &offsetMinutes)) {
+        return NO;
+    }
+    BOOL isLeapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day < 1 || day > daysInMonth[month - 1] || (month == 2 && day == 29 && !isLeapYear) ||
+        hour > 23 || minute > 59 || second > 59 || offsetMinutes > 59) {
+        return NO;
+    }
+
+    int64_t offset = offsetHours * 3600 + offsetMinutes * 60;
+    if (bytes[26] == '-') offset = -offset;
+    int64_t seconds = DBDaysFromCivil(year, month, day) * 86400 +
+        hour * 3600 + minute * 60 + second - offset;
+    *outInterval = (NSTimeInterval)seconds;
+    return YES;
+}
+
 @implementation DBMetadata
 
 + (NSDateFormatter*)dateFormatter {
@@ -27,14 +87,25 @@
     return dateFormatter;
 }
 
++ (NSDate*)dateFromString:(NSString*)string {
+    if (string == nil) return nil;
+
+    char buffer[32];
+    NSTimeInterval interval;
+    if ([string getCString:buffer maxLength:sizeof(buffer) encoding:NSASCIIStringEncoding] &&
+        DBMetadataParseDate(buffer, strlen(buffer), &interval)) {
+        return [NSDate dateWithTimeIntervalSince1970:interval];
+    }
+    return [[DBMetadata dateFormatter] dateFromString:string];
+}
+
 - (id)initWithDictionary:(NSDictionary*)dict {
     if ((self = [super init])) {
         thumbnailExists = [[dict objectForKey:@"thumb_exists"] boolValue];
         totalBytes = [[dict objectForKey:@"bytes"] longLongValue];
 
         if ([dict objectForKey:@"modified"]) {
-            lastModifiedDate = 
-				[[[DBMetadata dateFormatter] dateFromString:[dict objectForKey:@"modified"]] retain];
+            lastModifiedDate = [[DBMetadata dateFromString:[dict objectForKey:@"modified"]] retain];
         }
 
         path = [[dict objectForKey:@"path"] retain];
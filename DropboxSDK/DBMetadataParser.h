@@ -0,0 +1,47 @@
+//
+//  DBMetadataParser.h
+//  DropboxSDK
+//
+//  Created by Brian Dewey on 7/6/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import "DBMetadata.h"
+
+/* DBMetadataParser builds DBMetadata straight from the bytes of a /metadata response. The JSON is
+   read as a stream of events (object start, key, string, number, ...) and each known key is bound
+   directly into the DBMetadata being built, so no intermediate NSDictionary/NSArray tree is ever
+   created. Values for unknown keys, including whole nested objects and arrays, are skipped without
+   allocating anything.
+
+   The input can be given all at once, or chunk by chunk as it arrives from the network with
+   appendData: followed by finish. Only a token cut off by the end of a chunk is kept between
+   chunks; the rest of each chunk is bound into the result and can be thrown away. */
+@interface DBMetadataParser : NSObject {
+    void* reader;
+    void* binder;
+    NSMutableData* pending;
+    BOOL started;
+    NSError* error;
+}
+
+/* Parses a complete response. Returns nil if |data| is not a JSON object. */
++ (DBMetadata*)metadataWithData:(NSData*)data;
+
+/* Parses the bytes of a complete response. Returns nil and sets |error| if they aren't a JSON
+   object. */
+- (DBMetadata*)parseBytes:(const char*)bytes length:(NSUInteger)length;
+
+/* Reads the next chunk of a response. Returns NO, and sets |error|, as soon as the input can't be
+   a JSON object; later chunks are then ignored. */
+- (BOOL)appendData:(NSData*)data;
+- (BOOL)appendBytes:(const char*)bytes length:(NSUInteger)length;
+
+/* Ends the response fed in with appendData: and returns its metadata, or nil if it wasn't a JSON
+   object. The parser can then be used again. */
+- (DBMetadata*)finish;
+
+/* Why the last parse failed, with a code from SBJsonBase.h in SBJSONErrorDomain. */
+@property (nonatomic, readonly) NSError* error;
+
+@end
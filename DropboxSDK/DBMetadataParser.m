@@ -0,0 +1,814 @@
+//
+//  DBMetadataParser.m
+//  DropboxSDK
+//
+//  Created by Brian Dewey on 7/6/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import "DBMetadataParser.h"
+#import "SBJsonBase.h"
+
+#define kDBJsonMaxDepth 512
+
+
+#pragma mark JSON reader
+
+/* A JSON reader that validates the input and reports what it finds as events, instead of building
+   objects. Nesting is tracked on an explicit stack rather than by recursion. */
+
+typedef enum {
+    DBJsonExpectValue,
+    DBJsonExpectValueOrEnd,
+    DBJsonExpectKey,
+    DBJsonExpectKeyOrEnd,
+    DBJsonExpectColon,
+    DBJsonExpectCommaOrEnd,
+    DBJsonExpectNothing
+} DBJsonExpect;
+
+typedef enum {
+    DBJsonLiteralTrue,
+    DBJsonLiteralFalse,
+    DBJsonLiteralNull
+} DBJsonLiteral;
+
+typedef struct {
+    void (*objectStart)(void* context);
+    void (*objectEnd)(void* context);
+    void (*arrayStart)(void* context);
+    void (*arrayEnd)(void* context);
+    void (*key)(void* context, const char* bytes, size_t length, BOOL escaped);
+    void (*string)(void* context, const char* bytes, size_t length, BOOL escaped);
+    void (*number)(void* context, const char* bytes, size_t length);
+    void (*literal)(void* context, DBJsonLiteral literal);
+} DBJsonCallbacks;
+
+typedef struct {
+    DBJsonCallbacks callbacks;
+    void* context;
+    DBJsonExpect expect;
+    NSUInteger depth;
+    char stack[kDBJsonMaxDepth];
+    NSUInteger errorCode;
+    const char* errorMessage;
+} DBJsonReader;
+
+static BOOL DBJsonFail(DBJsonReader* reader, NSUInteger code, const char* message) {
+    reader->errorCode = code;
+    reader->errorMessage = message;
+    return NO;
+}
+
+static inline BOOL DBJsonIsHex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline unsigned DBJsonHexValue(char c) {
+    if (c <= '9') return c - '0';
+    return (c | 0x20) - 'a' + 10;
+}
+
+/* Finds the end of the string starting after the opening quote at |c|. On success |*outEnd| is the
+   closing quote. */
+static BOOL DBJsonScanString(DBJsonReader* reader, const char* c, const char* end,
+        const char** outEnd, BOOL* outEscaped) {
+    BOOL escaped = NO;
+    while (c < end) {
+        unsigned char ch = *c;
+        if (ch == '"') {
+            *outEnd = c;
+            *outEscaped = escaped;
+            return YES;
+        } else if (ch == '\\') {
+            escaped = YES;
+            if (++c == end) break;
+            switch (*c) {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u':
+                    if (end - c < 5) return DBJsonFail(reader, EEOF, "Unexpected end of input in string");
+                    if (!DBJsonIsHex(c[1]) || !DBJsonIsHex(c[2]) || !DBJsonIsHex(c[3]) || !DBJsonIsHex(c[4])) {
+                        return DBJsonFail(reader, EUNICODE, "Broken unicode character");
+                    }
+                    c += 4;
+                    break;
+                default:
+                    return DBJsonFail(reader, EESCAPE, "Illegal escape sequence");
+            }
+        } else if (ch < 0x20) {
+            return DBJsonFail(reader, ECTRL, "Unescaped control character");
+        }
+        c++;
+    }
+    return DBJsonFail(reader, EEOF, "Unexpected end of input in string");
+}
+
+/* Finds the end of the number starting at |c|, following the JSON number grammar. */
+static BOOL DBJsonScanNumber(DBJsonReader* reader, const char* c, const char* end, const char** outEnd) {
+    if (c < end && *c == '-') c++;
+    if (c == end) return DBJsonFail(reader, EPARSENUM, "No digits after initial minus");
+    if (*c == '0') {
+        c++;
+        if (c < end && *c >= '0' && *c <= '9') return DBJsonFail(reader, EPARSENUM, "Leading zero is illegal in number");
+    } else if (*c >= '1' && *c <= '9') {
+        while (c < end && *c >= '0' && *c <= '9') c++;
+    } else {
+        return DBJsonFail(reader, EPARSENUM, "No digits after initial minus");
+    }
+    if (c < end && *c == '.') {
+        c++;
+        if (c == end || *c < '0' || *c > '9') return DBJsonFail(reader, EPARSENUM, "No digits after decimal point");
+        while (c < end && *c >= '0' && *c <= '9') c++;
+    }
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        if (c < end && (*c == '-' || *c == '+')) c++;
+        if (c == end || *c < '0' || *c > '9') return DBJsonFail(reader, EPARSENUM, "No digits after exponent");
+        while (c < end && *c >= '0' && *c <= '9') c++;
+    }
+    *outEnd = c;
+    return YES;
+}
+
+static inline void DBJsonAfterValue(DBJsonReader* reader) {
+    reader->expect = (reader->depth == 0) ? DBJsonExpectNothing : DBJsonExpectCommaOrEnd;
+}
+
+static inline BOOL DBJsonExpectsValue(DBJsonReader* reader) {
+    return reader->expect == DBJsonExpectValue || reader->expect == DBJsonExpectValueOrEnd;
+}
+
+static void DBJsonReaderReset(DBJsonReader* reader) {
+    reader->expect = DBJsonExpectValue;
+    reader->depth = 0;
+    reader->errorCode = 0;
+    reader->errorMessage = NULL;
+}
+
+/* A token that runs off the end of the input is only an error in the last chunk. Otherwise the
+   reader stops in front of it and reports where, so it can be read again once more input arrives. */
+static BOOL DBJsonSuspend(DBJsonReader* reader, const char* token, BOOL final, const char** outRest) {
+    if (final || reader->errorCode != EEOF) return NO;
+    reader->errorCode = 0;
+    reader->errorMessage = NULL;
+    *outRest = token;
+    return YES;
+}
+
+static inline BOOL DBJsonIsNumberChar(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+/* Reads the next chunk of a JSON document, sending events as it goes. The reader's state carries
+   over from one chunk to the next. Unless |final| is set, a token cut off by the end of the chunk is
+   left unread and |*outRest| points at its first byte; the caller passes it in again at the start of
+   the next chunk. */
+static BOOL DBJsonReaderRead(DBJsonReader* reader, const char* c, const char* end, BOOL final,
+        const char** outRest) {
+    DBJsonCallbacks* callbacks = &reader->callbacks;
+    void* context = reader->context;
+
+    for (;;) {
+        while (c < end && (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r')) c++;
+        if (c == end) break;
+
+        if (reader->expect == DBJsonExpectNothing) {
+            return DBJsonFail(reader, ETRAILGARBAGE, "Garbage after JSON");
+        }
+
+        switch (*c) {
+            case '{':
+            case '[':
+                if (!DBJsonExpectsValue(reader)) return DBJsonFail(reader, EPARSE, "Unexpected container");
+                if (reader->depth == kDBJsonMaxDepth) return DBJsonFail(reader, EDEPTH, "Nested too deep");
+                reader->stack[reader->depth++] = *c;
+                if (*c == '{') {
+                    callbacks->objectStart(context);
+                    reader->expect = DBJsonExpectKeyOrEnd;
+                } else {
+                    callbacks->arrayStart(context);
+                    reader->expect = DBJsonExpectValueOrEnd;
+                }
+                c++;
+                break;
+
+            case '}':
+                if (reader->depth == 0 || reader->stack[reader->depth - 1] != '{' ||
+                    (reader->expect != DBJsonExpectKeyOrEnd && reader->expect != DBJsonExpectCommaOrEnd)) {
+                    return DBJsonFail(reader, (reader->expect == DBJsonExpectKey) ? ETRAILCOMMA : EPARSE,
+                            "Unexpected end of object");
+                }
+                reader->depth--;
+                callbacks->objectEnd(context);
+                DBJsonAfterValue(reader);
+                c++;
+                break;
+
+            case ']':
+                if (reader->depth == 0 || reader->stack[reader->depth - 1] != '[' ||
+                    (reader->expect != DBJsonExpectValueOrEnd && reader->expect != DBJsonExpectCommaOrEnd)) {
+                    return DBJsonFail(reader, (reader->expect == DBJsonExpectValue) ? ETRAILCOMMA : EPARSE,
+                            "Unexpected end of array");
+                }
+                reader->depth--;
+                callbacks->arrayEnd(context);
+                DBJsonAfterValue(reader);
+                c++;
+                break;
+
+            case ':':
+                if (reader->expect != DBJsonExpectColon) return DBJsonFail(reader, EPARSE, "Unexpected ':'");
+                reader->expect = DBJsonExpectValue;
+                c++;
+                break;
+
+            case ',':
+                if (reader->expect != DBJsonExpectCommaOrEnd) return DBJsonFail(reader, EPARSE, "Unexpected ','");
+                reader->expect = (reader->stack[reader->depth - 1] == '{') ? DBJsonExpectKey : DBJsonExpectValue;
+                c++;
+                break;
+
+            case '"': {
+                const char* stringEnd;
+                BOOL escaped;
+                if (!DBJsonScanString(reader, c + 1, end, &stringEnd, &escaped)) {
+                    return DBJsonSuspend(reader, c, final, outRest);
+                }
+                if (reader->expect == DBJsonExpectKey || reader->expect == DBJsonExpectKeyOrEnd) {
+                    callbacks->key(context, c + 1, stringEnd - c - 1, escaped);
+                    reader->expect = DBJsonExpectColon;
+                } else if (DBJsonExpectsValue(reader)) {
+                    callbacks->string(context, c + 1, stringEnd - c - 1, escaped);
+                    DBJsonAfterValue(reader);
+                } else {
+                    return DBJsonFail(reader, EPARSE, "Unexpected string");
+                }
+                c = stringEnd + 1;
+                break;
+            }
+
+            case '-': case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9': {
+                const char* numberEnd;
+                if (!DBJsonExpectsValue(reader)) return DBJsonFail(reader, EPARSE, "Unexpected number");
+                if (!final) {
+                    /* The next chunk might carry on with more digits. */
+                    const char* q = c;
+                    while (q < end && DBJsonIsNumberChar(*q)) q++;
+                    if (q == end) {
+                        *outRest = c;
+                        return YES;
+                    }
+                }
+                if (!DBJsonScanNumber(reader, c, end, &numberEnd)) return NO;
+                callbacks->number(context, c, numberEnd - c);
+                DBJsonAfterValue(reader);
+                c = numberEnd;
+                break;
+            }
+
+            case 't':
+            case 'f':
+            case 'n': {
+                static const char* names[] = { "true", "false", "null" };
+                DBJsonLiteral literal = (*c == 't') ? DBJsonLiteralTrue :
+                    ((*c == 'f') ? DBJsonLiteralFalse : DBJsonLiteralNull);
+                size_t length = strlen(names[literal]);
+                if (!DBJsonExpectsValue(reader)) return DBJsonFail(reader, EPARSE, "Unexpected literal");
+                if ((size_t)(end - c) < length) {
+                    DBJsonFail(reader, EEOF, "Unexpected end of input");
+                    return DBJsonSuspend(reader, c, final, outRest);
+                }
+                if (memcmp(c, names[literal], length) != 0) return DBJsonFail(reader, EPARSE, "Unrecognised literal");
+                callbacks->literal(context, literal);
+                DBJsonAfterValue(reader);
+                c += length;
+                break;
+            }
+
+            default:
+                return DBJsonFail(reader, EPARSE, "Unrecognised leading character");
+        }
+    }
+
+    if (!final) {
+        *outRest = end;
+        return YES;
+    }
+    if (reader->expect != DBJsonExpectNothing) {
+        return DBJsonFail(reader, EEOF, "Unexpected end of input");
+    }
+    return YES;
+}
+
+/* Decodes the escapes in a string the reader has already validated. |buffer| must hold at least
+   |length| bytes, which is enough since no escape expands. Returns the decoded length. */
+static size_t DBJsonUnescape(const char* c, size_t length, char* buffer) {
+    const char* end = c + length;
+    char* out = buffer;
+    while (c < end) {
+        if (*c != '\\') {
+            *out++ = *c++;
+            continue;
+        }
+        c++;
+        switch (*c++) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                uint32_t unit = (DBJsonHexValue(c[0]) << 12) | (DBJsonHexValue(c[1]) << 8) |
+                    (DBJsonHexValue(c[2]) << 4) | DBJsonHexValue(c[3]);
+                c += 4;
+                if (unit >= 0xD800 && unit < 0xDC00 && end - c >= 6 && c[0] == '\\' && c[1] == 'u') {
+                    uint32_t low = (DBJsonHexValue(c[2]) << 12) | (DBJsonHexValue(c[3]) << 8) |
+                        (DBJsonHexValue(c[4]) << 4) | DBJsonHexValue(c[5]);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        c += 6;
+                    }
+                }
+                if (unit >= 0xD800 && unit < 0xE000) unit = 0xFFFD;
+                if (unit < 0x80) {
+                    *out++ = unit;
+                } else if (unit < 0x800) {
+                    *out++ = 0xC0 | (unit >> 6);
+                    *out++ = 0x80 | (unit & 0x3F);
+                } else if (unit < 0x10000) {
+                    *out++ = 0xE0 | (unit >> 12);
+                    *out++ = 0x80 | ((unit >> 6) & 0x3F);
+                    *out++ = 0x80 | (unit & 0x3F);
+                } else {
+                    *out++ = 0xF0 | (unit >> 18);
+                    *out++ = 0x80 | ((unit >> 12) & 0x3F);
+                    *out++ = 0x80 | ((unit >> 6) & 0x3F);
+                    *out++ = 0x80 | (unit & 0x3F);
+                }
+                break;
+            }
+            default: *out++ = c[-1]; break;
+        }
+    }
+    return out - buffer;
+}
+
+
+#pragma mark Binding to DBMetadata
+
+typedef enum {
+    DBMetadataKeyUnknown,
+    DBMetadataKeyThumbExists,
+    DBMetadataKeyBytes,
+    DBMetadataKeyModified,
+    DBMetadataKeyPath,
+    DBMetadataKeyIsDir,
+    DBMetadataKeyContents,
+    DBMetadataKeyHash,
+    DBMetadataKeySize,
+    DBMetadataKeyRoot,
+    DBMetadataKeyIcon,
+    DBMetadataKeyRevision,
+    DBMetadataKeyIsDeleted
+} DBMetadataKey;
+
+static DBMetadataKey DBMetadataKeyForBytes(const char* bytes, size_t length) {
+    static const struct { const char* name; DBMetadataKey key; } keys[] = {
+        { "thumb_exists", DBMetadataKeyThumbExists },
+        { "bytes", DBMetadataKeyBytes },
+        { "modified", DBMetadataKeyModified },
+        { "path", DBMetadataKeyPath },
+        { "is_dir", DBMetadataKeyIsDir },
+        { "contents", DBMetadataKeyContents },
+        { "hash", DBMetadataKeyHash },
+        { "size", DBMetadataKeySize },
+        { "root", DBMetadataKeyRoot },
+        { "icon", DBMetadataKeyIcon },
+        { "revision", DBMetadataKeyRevision },
+        { "is_deleted", DBMetadataKeyIsDeleted }
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strlen(keys[i].name) == length && memcmp(keys[i].name, bytes, length) == 0) {
+            return keys[i].key;
+        }
+    }
+    return DBMetadataKeyUnknown;
+}
+
+/* Write access to DBMetadata for the binder. These follow the conversions initWithDictionary:
+   applies to the same values. */
+@interface DBMetadata (DBMetadataParser)
+
+- (void)setParsedString:(NSString*)value forKey:(DBMetadataKey)key;
+- (void)setParsedLongLong:(long long)value forKey:(DBMetadataKey)key;
+- (void)setParsedBool:(BOOL)value forKey:(DBMetadataKey)key;
+- (void)setParsedDate:(NSDate*)value;
+- (void)setParsedContents:(NSArray*)value;
+
+@end
+
+@implementation DBMetadata (DBMetadataParser)
+
+- (void)setParsedString:(NSString*)value forKey:(DBMetadataKey)key {
+    NSString** field = NULL;
+    switch (key) {
+        case DBMetadataKeyPath: field = &path; break;
+        case DBMetadataKeyHash: field = &hash; break;
+        case DBMetadataKeySize: field = &humanReadableSize; break;
+        case DBMetadataKeyRoot: field = &root; break;
+        case DBMetadataKeyIcon: field = &icon; break;
+        default: return;
+    }
+    [*field release];
+    *field = [value retain];
+}
+
+- (void)setParsedLongLong:(long long)value forKey:(DBMetadataKey)key {
+    switch (key) {
+        case DBMetadataKeyBytes: totalBytes = value; break;
+        case DBMetadataKeyRevision: revision = value; break;
+        default: break;
+    }
+}
+
+- (void)setParsedBool:(BOOL)value forKey:(DBMetadataKey)key {
+    switch (key) {
+        case DBMetadataKeyThumbExists: thumbnailExists = value; break;
+        case DBMetadataKeyIsDir: isDirectory = value; break;
+        case DBMetadataKeyIsDeleted: isDeleted = value; break;
+        default: break;
+    }
+}
+
+- (void)setParsedDate:(NSDate*)value {
+    [lastModifiedDate release];
+    lastModifiedDate = [value retain];
+}
+
+- (void)setParsedContents:(NSArray*)value {
+    [contents release];
+    contents = [value retain];
+}
+
+@end
+
+typedef enum {
+    DBBinderFrameMetadata,
+    DBBinderFrameContents,
+    DBBinderFrameSkip
+} DBBinderFrameKind;
+
+typedef struct {
+    DBBinderFrameKind kind;
+    DBMetadata* metadata;
+    NSMutableArray* contents;
+    DBMetadataKey key;
+} DBBinderFrame;
+
+/* Follows the reader's events with a stack of what is being built: a DBMetadata object, the array
+   of its contents, or a value being skipped. */
+typedef struct {
+    DBBinderFrame frames[kDBJsonMaxDepth];
+    NSUInteger depth;
+    DBMetadata* result;
+    char* scratch;
+    size_t scratchSize;
+} DBMetadataBinder;
+
+static void DBBinderReset(DBMetadataBinder* binder) {
+    while (binder->depth > 0) {
+        DBBinderFrame* frame = &binder->frames[--binder->depth];
+        [frame->metadata release];
+        [frame->contents release];
+    }
+    [binder->result release];
+    binder->result = nil;
+}
+
+static DBBinderFrame* DBBinderTop(DBMetadataBinder* binder) {
+    return (binder->depth == 0) ? NULL : &binder->frames[binder->depth - 1];
+}
+
+static void DBBinderPush(DBMetadataBinder* binder, DBBinderFrameKind kind) {
+    DBBinderFrame* frame = &binder->frames[binder->depth++];
+    frame->kind = kind;
+    frame->metadata = (kind == DBBinderFrameMetadata) ? [[DBMetadata alloc] init] : nil;
+    frame->contents = (kind == DBBinderFrameContents) ? [[NSMutableArray alloc] init] : nil;
+    frame->key = DBMetadataKeyUnknown;
+}
+
+/* The decoded bytes of a string value; either the input itself or the unescaped scratch copy. */
+static const char* DBBinderStringBytes(DBMetadataBinder* binder, const char* bytes, size_t* length, BOOL escaped) {
+    if (!escaped) return bytes;
+    if (binder->scratchSize < *length) {
+        binder->scratchSize = MAX(*length, 256);
+        binder->scratch = realloc(binder->scratch, binder->scratchSize);
+    }
+    *length = DBJsonUnescape(bytes, *length, binder->scratch);
+    return binder->scratch;
+}
+
+/* The container events. The reader keeps the binder's depth equal to its own, so the stack can't
+   overflow. */
+
+static void DBBinderContainerStart(DBMetadataBinder* binder, BOOL isObject) {
+    DBBinderFrame* top = DBBinderTop(binder);
+    if (top == NULL) {
+        DBBinderPush(binder, isObject ? DBBinderFrameMetadata : DBBinderFrameSkip);
+    } else if (top->kind == DBBinderFrameMetadata && !isObject && top->key == DBMetadataKeyContents) {
+        DBBinderPush(binder, DBBinderFrameContents);
+    } else if (top->kind == DBBinderFrameContents && isObject) {
+        DBBinderPush(binder, DBBinderFrameMetadata);
+    } else {
+        DBBinderPush(binder, DBBinderFrameSkip);
+    }
+}
+
+static void DBBinderObjectStart(void* context) {
+    DBBinderContainerStart(context, YES);
+}
+
+static void DBBinderArrayStart(void* context) {
+    DBBinderContainerStart(context, NO);
+}
+
+static void DBBinderContainerEnd(void* context) {
+    DBMetadataBinder* binder = context;
+    DBBinderFrame frame = binder->frames[--binder->depth];
+    DBBinderFrame* parent = DBBinderTop(binder);
+
+    if (frame.kind == DBBinderFrameMetadata) {
+        if (parent == NULL) {
+            binder->result = frame.metadata;
+            return;
+        } else if (parent->kind == DBBinderFrameContents) {
+            [parent->contents addObject:frame.metadata];
+        }
+        [frame.metadata release];
+    } else if (frame.kind == DBBinderFrameContents) {
+        [parent->metadata setParsedContents:frame.contents];
+        [frame.contents release];
+    }
+}
+
+static void DBBinderKey(void* context, const char* bytes, size_t length, BOOL escaped) {
+    DBMetadataBinder* binder = context;
+    DBBinderFrame* top = DBBinderTop(binder);
+    if (top->kind != DBBinderFrameMetadata) return;
+    bytes = DBBinderStringBytes(binder, bytes, &length, escaped);
+    top->key = DBMetadataKeyForBytes(bytes, length);
+}
+
+/* Returns the frame a scalar should be bound into, or NULL if it isn't wanted. */
+static DBBinderFrame* DBBinderScalarTarget(DBMetadataBinder* binder) {
+    DBBinderFrame* top = DBBinderTop(binder);
+    if (top == NULL || top->kind != DBBinderFrameMetadata || top->key == DBMetadataKeyUnknown) return NULL;
+    return top;
+}
+
+static void DBBinderString(void* context, const char* bytes, size_t length, BOOL escaped) {
+    DBMetadataBinder* binder = context;
+    DBBinderFrame* top = DBBinderScalarTarget(binder);
+    if (top == NULL || top->key == DBMetadataKeyContents) return;
+
+    bytes = DBBinderStringBytes(binder, bytes, &length, escaped);
+    if (top->key == DBMetadataKeyModified) {
+        NSTimeInterval interval;
+        if (DBMetadataParseDate(bytes, length, &interval)) {
+            [top->metadata setParsedDate:[NSDate dateWithTimeIntervalSince1970:interval]];
+            return;
+        }
+    }
+
+    NSString* string = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    switch (top->key) {
+        case DBMetadataKeyModified:
+            [top->metadata setParsedDate:[DBMetadata dateFromString:string]];
+            break;
+        case DBMetadataKeyBytes:
+        case DBMetadataKeyRevision:
+            [top->metadata setParsedLongLong:[string longLongValue] forKey:top->key];
+            break;
+        case DBMetadataKeyThumbExists:
+        case DBMetadataKeyIsDir:
+        case DBMetadataKeyIsDeleted:
+            [top->metadata setParsedBool:[string boolValue] forKey:top->key];
+            break;
+        default:
+            [top->metadata setParsedString:string forKey:top->key];
+            break;
+    }
+    [string release];
+}
+
+static void DBBinderNumber(void* context, const char* bytes, size_t length) {
+    DBMetadataBinder* binder = context;
+    DBBinderFrame* top = DBBinderScalarTarget(binder);
+    if (top == NULL) return;
+
+    /* Integers are accumulated directly; anything with a fraction or exponent goes through strtod
+       and is truncated, like -[NSNumber longLongValue]. */
+    char buffer[64];
+    long long value = 0;
+    BOOL negative = (*bytes == '-');
+    size_t i = negative ? 1 : 0;
+    while (i < length && bytes[i] >= '0' && bytes[i] <= '9') {
+        value = value * 10 + (bytes[i++] - '0');
+    }
+    if (negative) value = -value;
+    if (i < length && length < sizeof(buffer)) {
+        memcpy(buffer, bytes, length);
+        buffer[length] = '\0';
+        value = (long long)strtod(buffer, NULL);
+    }
+
+    switch (top->key) {
+        case DBMetadataKeyBytes:
+        case DBMetadataKeyRevision:
+            [top->metadata setParsedLongLong:value forKey:top->key];
+            break;
+        case DBMetadataKeyThumbExists:
+        case DBMetadataKeyIsDir:
+        case DBMetadataKeyIsDeleted:
+            [top->metadata setParsedBool:(value != 0) forKey:top->key];
+            break;
+        default:
+            break;
+    }
+}
+
+static void DBBinderLiteral(void* context, DBJsonLiteral literal) {
+    DBMetadataBinder* binder = context;
+    DBBinderFrame* top = DBBinderScalarTarget(binder);
+    if (top == NULL || literal == DBJsonLiteralNull) return;
+
+    BOOL value = (literal == DBJsonLiteralTrue);
+    switch (top->key) {
+        case DBMetadataKeyBytes:
+        case DBMetadataKeyRevision:
+            [top->metadata setParsedLongLong:value forKey:top->key];
+            break;
+        default:
+            [top->metadata setParsedBool:value forKey:top->key];
+            break;
+    }
+}
+
+
+#pragma mark DBMetadataParser
+
+@implementation DBMetadataParser
+
++ (DBMetadata*)metadataWithData:(NSData*)data {
+    DBMetadataParser* parser = [[DBMetadataParser alloc] init];
+    DBMetadata* metadata = [parser parseBytes:[data bytes] length:[data length]];
+    if (metadata == nil) {
+        NSLog(@"DBMetadataParser failed: %@", [parser.error localizedDescription]);
+    }
+    [parser release];
+    return metadata;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        DBJsonReader* jsonReader = calloc(1, sizeof(DBJsonReader));
+        DBMetadataBinder* metadataBinder = calloc(1, sizeof(DBMetadataBinder));
+        jsonReader->callbacks.objectStart = DBBinderObjectStart;
+        jsonReader->callbacks.objectEnd = DBBinderContainerEnd;
+        jsonReader->callbacks.arrayStart = DBBinderArrayStart;
+        jsonReader->callbacks.arrayEnd = DBBinderContainerEnd;
+        jsonReader->callbacks.key = DBBinderKey;
+        jsonReader->callbacks.string = DBBinderString;
+        jsonReader->callbacks.number = DBBinderNumber;
+        jsonReader->callbacks.literal = DBBinderLiteral;
+        jsonReader->context = metadataBinder;
+        reader = jsonReader;
+        binder = metadataBinder;
+        pending = [NSMutableData new];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    DBMetadataBinder* metadataBinder = binder;
+    DBBinderReset(metadataBinder);
+    free(metadataBinder->scratch);
+    free(metadataBinder);
+    free(reader);
+    [pending release];
+    [error release];
+    [super dealloc];
+}
+
+@synthesize error;
+
+- (void)reset {
+    DBJsonReaderReset(reader);
+    DBBinderReset(binder);
+    [pending setLength:0];
+    [error release];
+    error = nil;
+}
+
+- (void)setErrorFromReader {
+    DBJsonReader* jsonReader = reader;
+    NSDictionary* info = [NSDictionary dictionaryWithObject:
+            [NSString stringWithUTF8String:jsonReader->errorMessage]
+            forKey:NSLocalizedDescriptionKey];
+    [error release];
+    error = [[NSError alloc] initWithDomain:SBJSONErrorDomain code:jsonReader->errorCode userInfo:info];
+}
+
+- (BOOL)appendBytes:(const char*)bytes length:(NSUInteger)length {
+    DBJsonReader* jsonReader = reader;
+    if (!started) {
+        [self reset];
+        started = YES;
+    }
+    if (jsonReader->errorCode != 0) {
+        return NO;
+    }
+
+    /* Put the end of the last chunk, if it stopped partway through a token, in front of this one. */
+    BOOL carried = ([pending length] > 0);
+    if (carried) {
+        [pending appendBytes:bytes length:length];
+        bytes = [pending bytes];
+        length = [pending length];
+    }
+
+    const char* rest;
+    NSAutoreleasePool* pool = [NSAutoreleasePool new];
+    BOOL success = DBJsonReaderRead(jsonReader, bytes, bytes + length, NO, &rest);
+    [pool drain];
+
+    if (!success) {
+        [self setErrorFromReader];
+        [pending setLength:0];
+        return NO;
+    }
+    NSUInteger consumed = rest - bytes;
+    if (carried) {
+        [pending replaceBytesInRange:NSMakeRange(0, consumed) withBytes:NULL length:0];
+    } else {
+        [pending appendBytes:rest length:length - consumed];
+    }
+    return YES;
+}
+
+- (BOOL)appendData:(NSData*)data {
+    return [self appendBytes:[data bytes] length:[data length]];
+}
+
+/* Reads the last of the input and hands back what was built. */
+- (DBMetadata*)finishWithBytes:(const char*)bytes length:(NSUInteger)length {
+    DBJsonReader* jsonReader = reader;
+    DBMetadataBinder* metadataBinder = binder;
+    started = NO;
+    if (jsonReader->errorCode != 0) {
+        DBJsonReaderReset(jsonReader);
+        DBBinderReset(metadataBinder);
+        return nil;
+    }
+
+    const char* rest;
+    NSAutoreleasePool* pool = [NSAutoreleasePool new];
+    BOOL success = DBJsonReaderRead(jsonReader, bytes, bytes + length, YES, &rest);
+    [pool drain];
+    [pending setLength:0];
+
+    if (!success) {
+        [self setErrorFromReader];
+        DBJsonReaderReset(jsonReader);
+        DBBinderReset(metadataBinder);
+        return nil;
+    }
+    DBJsonReaderReset(jsonReader);
+    if (metadataBinder->result == nil) {
+        NSDictionary* info = [NSDictionary dictionaryWithObject:@"Valid fragment, but not JSON object"
+                forKey:NSLocalizedDescriptionKey];
+        [error release];
+        error = [[NSError alloc] initWithDomain:SBJSONErrorDomain code:EFRAGMENT userInfo:info];
+        DBBinderReset(metadataBinder);
+        return nil;
+    }
+    DBMetadata* result = [metadataBinder->result autorelease];
+    metadataBinder->result = nil;
+    return result;
+}
+
+- (DBMetadata*)finish {
+    if (!started) {
+        [self reset];
+    }
+    return [self finishWithBytes:[pending bytes] length:[pending length]];
+}
+
+- (DBMetadata*)parseBytes:(const char*)bytes length:(NSUInteger)length {
+    [self reset];
+    return [self finishWithBytes:bytes length:length];
+}
+
+@end
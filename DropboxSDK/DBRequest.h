@@ -22,6 +22,7 @@
     SEL failureSelector;
     SEL downloadProgressSelector;
     SEL uploadProgressSelector;
+    SEL dataReceivedSelector;
     NSString* resultFilename;
     NSString* tempFilename;
     NSDictionary* userInfo;
@@ -47,6 +48,7 @@
 @property (nonatomic, assign) SEL failureSelector; // To send failure events to a different selector set this
 @property (nonatomic, assign) SEL downloadProgressSelector; // To receive download progress events set this
 @property (nonatomic, assign) SEL uploadProgressSelector; // To receive upload progress events set this
+@property (nonatomic, assign) SEL dataReceivedSelector; // To get a successful body as it arrives (request, data) instead of in resultData set this
 @property (nonatomic, retain) NSString* resultFilename; // The file to put the HTTP body in, otherwise body is stored in resultData
 @property (nonatomic, retain) NSDictionary* userInfo;
 
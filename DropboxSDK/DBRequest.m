@@ -49,6 +49,7 @@ static id networkRequestDelegate = nil;
 @synthesize failureSelector;
 @synthesize downloadProgressSelector;
 @synthesize uploadProgressSelector;
+@synthesize dataReceivedSelector;
 @synthesize userInfo;
 @synthesize request;
 @synthesize response;
@@ -65,7 +66,13 @@ static id networkRequestDelegate = nil;
 }
 
 - (NSObject*)resultJSON {
-    return [[self resultString] JSONValue];
+    SBJsonParser* jsonParser = [SBJsonParser new];
+    NSObject* resultJSON = [jsonParser objectWithData:resultData];
+    if (!resultJSON) {
+        NSLog(@"DBRequest#resultJSON failed. Error trace is: %@", [jsonParser errorTrace]);
+    }
+    [jsonParser release];
+    return resultJSON;
 } 
 
 - (NSInteger)statusCode {
@@ -129,6 +136,8 @@ static id networkRequestDelegate = nil;
             
             return;
         }
+    } else if (dataReceivedSelector && [self statusCode] == 200) {
+        [target performSelector:dataReceivedSelector withObject:self withObject:data];
     } else {
         if (resultData == nil) {
             resultData = [NSMutableData new];
@@ -157,7 +166,7 @@ static id networkRequestDelegate = nil;
         if ([resultString length] > 0) {
             @try {
                 SBJsonParser *jsonParser = [SBJsonParser new];
-                NSObject* resultJSON = [jsonParser objectWithString:resultString];
+                NSObject* resultJSON = [jsonParser objectWithData:resultData];
                 [jsonParser release];
                 
                 if ([resultJSON isKindOfClass:[NSDictionary class]]) {
@@ -23,6 +23,8 @@ extern NSString* kDBProtocolHTTPS;
     /* Map from path to the load request. Needs to be expanded to a general framework for cancelling
        requests. */
     NSMutableDictionary* loadRequests; 
+    /* Map from a metadata request to the parser reading its response as it arrives. */
+    NSMutableDictionary* metadataParsers;
     id<DBRestClientDelegate> delegate;
 }
 
@@ -44,6 +46,9 @@ extern NSString* kDBProtocolHTTPS;
 - (void)loadFile:(NSString *)path intoPath:(NSString *)destinationPath;
 - (void)cancelFileLoad:(NSString*)path;
 
+/* Cancels every outstanding request. The delegate hears nothing more about them. */
+- (void)cancelAllRequests;
+
 - (void)loadThumbnail:(NSString *)path ofSize:(NSString *)size intoPath:(NSString *)destinationPath;
 
 /* Uploads a file that will be named filename to the given root/path on the server. It will upload
@@ -85,6 +90,10 @@ extern NSString* kDBProtocolHTTPS;
 - (void)restClient:(DBRestClient*)client metadataUnchangedAtPath:(NSString*)path;
 - (void)restClient:(DBRestClient*)client loadMetadataFailedWithError:(NSError*)error; 
 // [error userInfo] contains the root and path of the call that failed
+- (void)restClient:(DBRestClient*)client parseMetadataStep:(NSString*)step usingBlock:(void (^)(void))block;
+// Called on a background queue for each step of parsing a metadata response. The delegate
+// must call block exactly once before returning; this lets it time the parse. It goes to the
+// delegate that was set when the step was queued, which is retained until the step is done.
 
 - (void)restClient:(DBRestClient*)client loadedAccountInfo:(DBAccountInfo*)info;
 - (void)restClient:(DBRestClient*)client loadAccountInfoFailedWithError:(NSError*)error; 
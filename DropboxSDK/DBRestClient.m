@@ -10,6 +10,7 @@
 #import "DBAccountInfo.h"
 #import "DBError.h"
 #import "DBMetadata.h"
+#import "DBMetadataParser.h"
 #import "DBRequest.h"
 #import "MPOAuthURLRequest.h"
 #import "MPURLRequestParameter.h"
@@ -34,9 +35,29 @@ NSString* kDBProtocolHTTPS = @"https";
 
 - (void)checkForAuthenticationFailure:(DBRequest*)request;
 
+// The delegate, if it wants to watch metadata parsing, or nil. Called on the main thread when a
+// step is queued, since the delegate isn't retained and may be gone by the time the step runs.
+- (id<DBRestClientDelegate>)metadataParseDelegate;
+
+// Runs a step of parsing a metadata response, through parseDelegate if it isn't nil
+- (void)parseMetadataStep:(NSString*)step withDelegate:(id<DBRestClientDelegate>)parseDelegate
+    usingBlock:(void (^)(void))block;
+
 @end
 
 
+/* Metadata responses are parsed on one serial queue, shared by every client, as their data
+   arrives. Each response's chunks are queued in order, so its parser sees them in order. */
+static dispatch_queue_t DBRestClientParseQueue() {
+    static dispatch_queue_t queue;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        queue = dispatch_queue_create("com.dropbox.DBRestClient.parse", NULL);
+    });
+    return queue;
+}
+
+
 @implementation DBRestClient
 
 - (id)initWithSession:(DBSession*)aSession {
@@ -49,20 +70,17 @@ NSString* kDBProtocolHTTPS = @"https";
         root = [aRoot retain];
         requests = [[NSMutableSet alloc] init];
         loadRequests = [[NSMutableDictionary alloc] init];
+        metadataParsers = [[NSMutableDictionary alloc] init];
     }
     return self;
 }
 
 
 - (void)dealloc {
-    for (DBRequest* request in requests) {
-        [request cancel];
-    }
+    [self cancelAllRequests];
     [requests release];
-    for (DBRequest* request in [loadRequests allValues]) {
-        [request cancel];
-    }
     [loadRequests release];
+    [metadataParsers release];
     [session release];
     [root release];
     [super dealloc];
@@ -128,6 +146,7 @@ NSString* kDBProtocolHTTPS = @"https";
          autorelease];
     
     request.userInfo = [NSDictionary dictionaryWithObjectsAndKeys:root, @"root", path, @"path", nil];
+    request.dataReceivedSelector = @selector(request:didReceiveMetadataData:);
 
     [requests addObject:request];
 }
@@ -138,8 +157,34 @@ NSString* kDBProtocolHTTPS = @"https";
 }
 
 
+- (void)request:(DBRequest*)request didReceiveMetadataData:(NSData*)data
+{
+    NSValue* key = [NSValue valueWithNonretainedObject:request];
+    DBMetadataParser* parser = [metadataParsers objectForKey:key];
+    if (parser == nil) {
+        parser = [[[DBMetadataParser alloc] init] autorelease];
+        [metadataParsers setObject:parser forKey:key];
+    }
+    
+    // The connection may reuse its buffer once we return.
+    NSData* chunk = [[data copy] autorelease];
+    id<DBRestClientDelegate> parseDelegate = [self metadataParseDelegate];
+    dispatch_async(DBRestClientParseQueue(), ^{
+        NSAutoreleasePool* pool = [NSAutoreleasePool new];
+        [self parseMetadataStep:@"parse metadata chunk" withDelegate:parseDelegate usingBlock:^{
+            [parser appendData:chunk];
+        }];
+        [pool drain];
+    });
+}
+
+
 - (void)requestDidLoadMetadata:(DBRequest*)request
 {
+    NSValue* key = [NSValue valueWithNonretainedObject:request];
+    DBMetadataParser* parser = [[[metadataParsers objectForKey:key] retain] autorelease];
+    [metadataParsers removeObjectForKey:key];
+
     if (request.statusCode == 304) {
         if ([delegate respondsToSelector:@selector(restClient:metadataUnchangedAtPath:)]) {
             NSString* path = [request.userInfo objectForKey:@"path"];
@@ -151,21 +196,53 @@ NSString* kDBProtocolHTTPS = @"https";
             [delegate restClient:self loadMetadataFailedWithError:request.error];
         }
     } else {
-        [self performSelectorInBackground:@selector(parseMetadataWithRequest:) withObject:request];
+        if (parser == nil) {
+            // An empty body never reached request:didReceiveMetadataData:
+            parser = [[[DBMetadataParser alloc] init] autorelease];
+        }
+        NSDictionary* userInfo = request.userInfo;
+        id<DBRestClientDelegate> parseDelegate = [self metadataParseDelegate];
+        dispatch_async(DBRestClientParseQueue(), ^{
+            NSAutoreleasePool* pool = [NSAutoreleasePool new];
+            __block DBMetadata* metadata = nil;
+            [self parseMetadataStep:@"finish metadata parse" withDelegate:parseDelegate usingBlock:^{
+                metadata = [[parser finish] retain];
+            }];
+            [metadata autorelease];
+            if (metadata) {
+                [self performSelectorOnMainThread:@selector(didParseMetadata:) withObject:metadata waitUntilDone:NO];
+            } else {
+                NSMutableDictionary* errorUserInfo = [NSMutableDictionary dictionaryWithDictionary:userInfo];
+                [errorUserInfo setObject:parser.error forKey:NSUnderlyingErrorKey];
+                NSError* error = [NSError errorWithDomain:DBErrorDomain code:DBErrorInvalidResponse
+                                                 userInfo:errorUserInfo];
+                [self performSelectorOnMainThread:@selector(didFailToParseMetadata:) withObject:error
+                                    waitUntilDone:NO];
+            }
+            [pool drain];
+        });
     }
 
     [requests removeObject:request];
 }
 
 
-- (void)parseMetadataWithRequest:(DBRequest*)request {
-    NSAutoreleasePool* pool = [NSAutoreleasePool new];
-    
-    NSDictionary* result = (NSDictionary*)[request resultJSON];
-    DBMetadata* metadata = [[[DBMetadata alloc] initWithDictionary:result] autorelease];
-    [self performSelectorOnMainThread:@selector(didParseMetadata:) withObject:metadata waitUntilDone:NO];
-    
-    [pool drain];
+- (id<DBRestClientDelegate>)metadataParseDelegate {
+    if ([delegate respondsToSelector:@selector(restClient:parseMetadataStep:usingBlock:)]) {
+        return delegate;
+    }
+    return nil;
+}
+
+
+- (void)parseMetadataStep:(NSString*)step withDelegate:(id<DBRestClientDelegate>)parseDelegate
+    usingBlock:(void (^)(void))block {
+    if (parseDelegate) {
+        // The block that called us retains parseDelegate until the step is done.
+        [parseDelegate restClient:self parseMetadataStep:step usingBlock:block];
+    } else {
+        block();
+    }
 }
 
 
@@ -176,6 +253,13 @@ NSString* kDBProtocolHTTPS = @"https";
 }
 
 
+- (void)didFailToParseMetadata:(NSError*)error {
+    if ([delegate respondsToSelector:@selector(restClient:loadMetadataFailedWithError:)]) {
+        [delegate restClient:self loadMetadataFailedWithError:error];
+    }
+}
+
+
 - (void)loadFile:(NSString *)path intoPath:(NSString *)destinationPath
 {
     NSString* fullPath = [NSString stringWithFormat:@"/files/%@%@", root, path];
@@ -205,6 +289,20 @@ NSString* kDBProtocolHTTPS = @"https";
 }
 
 
+- (void)cancelAllRequests {
+    for (DBRequest* request in requests) {
+        [request cancel];
+    }
+    [requests removeAllObjects];
+    for (DBRequest* request in [loadRequests allValues]) {
+        [request cancel];
+    }
+    [loadRequests removeAllObjects];
+    // A cancelled metadata request never finishes, so nothing else would remove its parser.
+    [metadataParsers removeAllObjects];
+}
+
+
 - (void)requestLoadProgress:(DBRequest*)request {
     if ([delegate respondsToSelector:@selector(restClient:loadProgress:forFile:)]) {
         [delegate restClient:self loadProgress:request.downloadProgress forFile:request.resultFilename];
@@ -443,13 +541,23 @@ DBErrorCode addFileUploadToRequest(NSMutableURLRequest *urlRequest, NSString *fi
     NSString* urlString = [NSString stringWithFormat:@"%@://%@/%@/files/%@%@", 
             kDBProtocolHTTPS, kDBDropboxAPIContentHost, kDBDropboxAPIVersion, root, escapedPath];
     NSURL* baseUrl = [NSURL URLWithString:urlString];
-    NSArray* params = [session.credentialStore oauthParameters];
-
     NSString *escapedFilename = [filename stringByReplacingOccurrencesOfString:@";" withString:@"-"];
 
-    NSString *signatureText = createFakeSignature(session, params, escapedFilename, baseUrl);
-
-    NSMutableURLRequest *urlRequest = createRealRequest(session, params, urlString, signatureText);
+    NSMutableURLRequest *urlRequest;
+    MPOAuthRequestSigner* signer = session.requestSigner;
+    if (signer) {
+        // The file name is signed, but goes in the multipart body rather than the query string
+        NSString* paramString = 
+            [signer parameterStringForMethod:@"POST" URL:baseUrl parameters:nil 
+                            signedParameters:[NSDictionary dictionaryWithObject:escapedFilename forKey:@"file"]];
+        NSURL* url = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@", urlString, paramString]];
+        urlRequest = [NSMutableURLRequest requestWithURL:url];
+        urlRequest.HTTPMethod = @"POST";
+    } else {
+        NSArray* params = [session.credentialStore oauthParameters];
+        NSString *signatureText = createFakeSignature(session, params, escapedFilename, baseUrl);
+        urlRequest = createRealRequest(session, params, urlString, signatureText);
+    }
    
     DBErrorCode errorCode = addFileUploadToRequest(urlRequest, escapedFilename, sourcePath);
     if(errorCode == DBErrorNone) {
@@ -774,6 +882,11 @@ DBErrorCode addFileUploadToRequest(NSMutableURLRequest *urlRequest, NSString *fi
                                         protocol, host, kDBDropboxAPIVersion, escapedPath];
     NSURL* url = [NSURL URLWithString:urlString];
     
+    MPOAuthRequestSigner* signer = session.requestSigner;
+    if (signer) {
+        return [signer URLRequestWithMethod:(method ? method : @"GET") URL:url parameters:params];
+    }
+    
     NSArray* paramList = [session.credentialStore oauthParameters];
     if ([params count] > 0) {
         NSArray* extraParams = [MPURLRequestParameter parametersFromDictionary:params];
@@ -7,6 +7,7 @@
 //
 
 #import "MPOAuthCredentialConcreteStore.h"
+#import "MPOAuthRequestSigner.h"
 
 extern NSString* kDBDropboxAPIHost;
 extern NSString* kDBDropboxAPIContentHost;
@@ -19,6 +20,7 @@ extern NSString* kDBDropboxAPIVersion;
     used, perferrably in the UIApplication delegate. */
 @interface DBSession : NSObject {
     MPOAuthCredentialConcreteStore* credentialStore;
+    MPOAuthRequestSigner* requestSigner;
     id<DBSessionDelegate> delegate;
 }
 
@@ -32,6 +34,8 @@ extern NSString* kDBDropboxAPIVersion;
 - (void)unlink;
 
 @property (nonatomic, readonly) MPOAuthCredentialConcreteStore* credentialStore;
+// Signs requests for the linked account; nil when unlinked or not using HMAC-SHA1
+@property (nonatomic, readonly) MPOAuthRequestSigner* requestSigner;
 @property (nonatomic, assign) id<DBSessionDelegate> delegate;
 
 @end
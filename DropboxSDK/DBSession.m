@@ -69,15 +69,30 @@ static NSString* kDBDropboxSavedCredentialsKey = @"kDBDropboxSavedCredentialsKey
 
 - (void)dealloc {
     [credentialStore release];
+    [requestSigner release];
     [super dealloc];
 }
 
 @synthesize credentialStore;
 @synthesize delegate;
 
+- (MPOAuthRequestSigner*)requestSigner {
+    if (requestSigner == nil && [self isLinked] &&
+        [credentialStore.signatureMethod isEqualToString:kMPOAuthSignatureMethodHMACSHA1]) {
+        requestSigner = [[MPOAuthRequestSigner alloc] 
+                         initWithConsumerKey:credentialStore.consumerKey 
+                         consumerSecret:credentialStore.consumerSecret 
+                         token:credentialStore.accessToken 
+                         tokenSecret:credentialStore.accessTokenSecret];
+    }
+    return requestSigner;
+}
+
 - (void)updateAccessToken:(NSString*)token accessTokenSecret:(NSString*)secret {
     credentialStore.accessToken = token;
     credentialStore.accessTokenSecret = secret;
+    [requestSigner release];
+    requestSigner = nil;
     NSDictionary* credentials = [NSDictionary dictionaryWithObjectsAndKeys:
         credentialStore.consumerKey, kMPOAuthCredentialConsumerKey,
         credentialStore.accessToken, kMPOAuthCredentialAccessToken,
@@ -93,6 +108,8 @@ static NSString* kDBDropboxSavedCredentialsKey = @"kDBDropboxSavedCredentialsKey
 - (void)unlink {
     credentialStore.accessToken = nil;
     credentialStore.accessTokenSecret = nil;
+    [requestSigner release];
+    requestSigner = nil;
     [self clearSavedCredentials];
 }
 
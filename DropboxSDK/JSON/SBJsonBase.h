@@ -44,7 +44,8 @@ enum {
     ETRAILCOMMA,
     ETRAILGARBAGE,
     EEOF,
-    EINPUT
+    EINPUT,
+    EOUTPUT
 };
 
 /**
@@ -56,32 +56,57 @@
  JSON is mapped to Objective-C types in the following way:
  
  @li Null -> NSNull
- @li String -> NSMutableString
+ @li String -> NSString
  @li Array -> NSMutableArray
  @li Object -> NSMutableDictionary
  @li Boolean -> NSNumber (initialised with -initWithBool:)
- @li Number -> NSDecimalNumber
+ @li Number -> NSNumber or NSDecimalNumber
  
  Since Objective-C doesn't have a dedicated class for boolean values, these turns into NSNumber
  instances. These are initialised with the -initWithBool: method, and 
  round-trip back to JSON properly. (They won't silently suddenly become 0 or 1; they'll be
  represented as 'true' and 'false' again.)
  
- JSON numbers turn into NSDecimalNumber instances,
- as we can thus avoid any loss of precision. (JSON allows ridiculously large numbers.)
+ Integers of up to 18 digits turn into NSNumber instances holding a long long, and numbers with a
+ fraction or exponent into NSNumber instances holding a double. Anything longer falls back to
+ NSDecimalNumber, so we avoid any loss of precision on really large integers. (JSON allows
+ ridiculously large numbers.)
+ 
+ The parser works directly on UTF-8 bytes. Input given as NSData or raw bytes is never copied, and
+ dictionary keys that repeat (within a document, or across documents parsed by the same instance)
+ share a single NSString.
  
  */
 @interface SBJsonParser : SBJsonBase <SBJsonParser> {
     
 @private
     const char *c;
+    const char *end;
+    void *internTable;
+    char *scratch;
+    NSUInteger scratchSize;
 }
 
+/**
+ @brief Return the object represented by the given UTF-8 data.
+ 
+ Like -objectWithString:, but reads the bytes of @p data directly.
+ */
+- (id)objectWithData:(NSData *)data;
+
+/**
+ @brief Return the object represented by @p length bytes of UTF-8 at @p bytes.
+ 
+ The bytes do not need to be NUL terminated.
+ */
+- (id)objectWithBytes:(const char *)bytes length:(NSUInteger)length;
+
 @end
 
 // don't use - exists for backwards compatibility with 2.1.x only. Will be removed in 2.3.
 @interface SBJsonParser (Private)
 - (id)fragmentWithString:(id)repr;
+- (id)fragmentWithBytes:(const char *)bytes length:(NSUInteger)length;
 @end
 
 
@@ -38,33 +38,90 @@
 - (BOOL)scanRestOfNull:(NSNull **)o;
 - (BOOL)scanRestOfFalse:(NSNumber **)o;
 - (BOOL)scanRestOfTrue:(NSNumber **)o;
-- (BOOL)scanRestOfString:(NSMutableString **)o;
+- (BOOL)scanRestOfString:(NSString **)o;
+- (BOOL)scanRestOfKey:(NSString **)o;
 
 // Cannot manage without looking at the first digit
 - (BOOL)scanNumber:(NSNumber **)o;
 
-- (BOOL)scanHexQuad:(unichar *)x;
-- (BOOL)scanUnicodeChar:(unichar *)x;
+- (BOOL)scanHexQuad:(uint32_t *)x;
+- (BOOL)scanUnicodeChar:(uint32_t *)x;
 
 - (BOOL)scanIsAtEnd;
 
 @end
 
-#define skipWhitespace(c) while (isspace(*c)) c++
-#define skipDigits(c) while (isdigit(*c)) c++
+// Interned keys are remembered in a small direct-mapped table.
+#define kInternSlots        64
+#define kInternMaxLength    24
 
+typedef struct {
+    NSUInteger length;
+    char bytes[kInternMaxLength];
+    NSString *key;
+} SBJsonInternSlot;
 
-@implementation SBJsonParser
+// Word-at-a-time helpers. A byte of the result has its high bit set if the corresponding byte of
+// |x| is zero (or, for SBLessThan, less than |n|). Bytes above the first match may give false
+// positives, which is fine as we only use these to decide whether to look at a word byte by byte.
+#define SBOnes      0x0101010101010101ULL
+#define SBHighs     0x8080808080808080ULL
+#define SBHasZero(x)        (((x) - SBOnes) & ~(x) & SBHighs)
+#define SBHasByte(x, b)     SBHasZero((x) ^ (SBOnes * (b)))
+#define SBHasLessThan(x, n) (((x) - SBOnes * (n)) & ~(x) & SBHighs)
+
+static BOOL isJsonSpace[256];
+
+#define skipDigits(c) while (c < end && *c >= '0' && *c <= '9') c++
+#define peek(c) ((c) < end ? *(c) : 0)
 
-static char ctrl[0x22];
+// Skips whitespace, eight spaces at a time for indented input.
+static inline const char *SBSkipWhitespace(const char *c, const char *end) {
+    while (end - c >= 8) {
+        uint64_t word;
+        memcpy(&word, c, sizeof(word));
+        if (word != SBOnes * ' ')
+            break;
+        c += 8;
+    }
+    while (c < end && isJsonSpace[(unsigned char)*c])
+        c++;
+    return c;
+}
 
+#define skipWhitespace(c) c = SBSkipWhitespace(c, end)
+
+// Finds the first '"', '\\' or control character at or after |c|, or |end|.
+static inline const char *SBScanStringChunk(const char *c, const char *end) {
+    while (end - c >= 8) {
+        uint64_t word;
+        memcpy(&word, c, sizeof(word));
+        if (SBHasByte(word, '"') | SBHasByte(word, '\\') | SBHasLessThan(word, 0x20))
+            break;
+        c += 8;
+    }
+    while (c < end && *c != '"' && *c != '\\' && (unsigned char)*c >= 0x20)
+        c++;
+    return c;
+}
+
+
+@implementation SBJsonParser
 
 + (void)initialize {
-    ctrl[0] = '\"';
-    ctrl[1] = '\\';
-    for (int i = 1; i < 0x20; i++)
-        ctrl[i+1] = i;
-    ctrl[0x21] = 0;    
+    isJsonSpace[' '] = isJsonSpace['\t'] = isJsonSpace['\n'] = YES;
+    isJsonSpace['\v'] = isJsonSpace['\f'] = isJsonSpace['\r'] = YES;
+}
+
+- (void)dealloc {
+    SBJsonInternSlot *slots = internTable;
+    if (slots) {
+        for (int i = 0; i < kInternSlots; i++)
+            [slots[i].key release];
+        free(slots);
+    }
+    free(scratch);
+    [super dealloc];
 }
 
 /**
@@ -72,15 +129,30 @@ static char ctrl[0x22];
  It should be removed in the next major version.
  */
 - (id)fragmentWithString:(id)repr {
+    if (!repr) {
+        [self clearErrorTrace];
+        [self addErrorWithCode:EINPUT description:@"Input was 'nil'"];
+        return nil;
+    }
+    
+    // Use the string's own UTF-8 buffer if it has one, to avoid the copy.
+    const char *bytes = CFStringGetCStringPtr((CFStringRef)repr, kCFStringEncodingUTF8);
+    if (!bytes)
+        bytes = [repr UTF8String];
+    return [self fragmentWithBytes:bytes length:strlen(bytes)];
+}
+
+- (id)fragmentWithBytes:(const char *)bytes length:(NSUInteger)length {
     [self clearErrorTrace];
     
-    if (!repr) {
+    if (!bytes) {
         [self addErrorWithCode:EINPUT description:@"Input was 'nil'"];
         return nil;
     }
     
     depth = 0;
-    c = [repr UTF8String];
+    c = bytes;
+    end = bytes + length;
     
     id o;
     if (![self scanValue:&o]) {
@@ -93,17 +165,15 @@ static char ctrl[0x22];
         return nil;
     }
         
-    NSAssert1(o, @"Should have a valid object from %@", repr);
+    NSAssert(o, @"Should have a valid object");
     return o;    
 }
 
-- (id)objectWithString:(NSString *)repr {
-
-    id o = [self fragmentWithString:repr];
+// Check that the object we've found is a valid JSON container.
+- (id)containerFromFragment:(id)o {
     if (!o)
         return nil;
     
-    // Check that the object we've found is a valid JSON container.
     if (![o isKindOfClass:[NSDictionary class]] && ![o isKindOfClass:[NSArray class]]) {
         [self addErrorWithCode:EFRAGMENT description:@"Valid fragment, but not JSON"];
         return nil;
@@ -112,6 +182,23 @@ static char ctrl[0x22];
     return o;
 }
 
+- (id)objectWithString:(NSString *)repr {
+    return [self containerFromFragment:[self fragmentWithString:repr]];
+}
+
+- (id)objectWithData:(NSData *)data {
+    if (!data) {
+        [self clearErrorTrace];
+        [self addErrorWithCode:EINPUT description:@"Input was 'nil'"];
+        return nil;
+    }
+    return [self objectWithBytes:[data length] ? [data bytes] : "" length:[data length]];
+}
+
+- (id)objectWithBytes:(const char *)bytes length:(NSUInteger)length {
+    return [self containerFromFragment:[self fragmentWithBytes:bytes length:length]];
+}
+
 /*
  In contrast to the public methods, it is an error to omit the error parameter here.
  */
@@ -119,6 +206,11 @@ static char ctrl[0x22];
 {
     skipWhitespace(c);
     
+    if (c >= end) {
+        [self addErrorWithCode:EEOF description:@"Unexpected end of string"];
+        return NO;
+    }
+    
     switch (*c++) {
         case '{':
             return [self scanRestOfDictionary:(NSMutableDictionary **)o];
@@ -127,7 +219,7 @@ static char ctrl[0x22];
             return [self scanRestOfArray:(NSMutableArray **)o];
             break;
         case '"':
-            return [self scanRestOfString:(NSMutableString **)o];
+            return [self scanRestOfString:(NSString **)o];
             break;
         case 'f':
             return [self scanRestOfFalse:(NSNumber **)o];
@@ -163,7 +255,7 @@ static char ctrl[0x22];
 
 - (BOOL)scanRestOfTrue:(NSNumber **)o
 {
-    if (!strncmp(c, "rue", 3)) {
+    if (end - c >= 3 && !strncmp(c, "rue", 3)) {
         c += 3;
         *o = [NSNumber numberWithBool:YES];
         return YES;
@@ -174,7 +266,7 @@ static char ctrl[0x22];
 
 - (BOOL)scanRestOfFalse:(NSNumber **)o
 {
-    if (!strncmp(c, "alse", 4)) {
+    if (end - c >= 4 && !strncmp(c, "alse", 4)) {
         c += 4;
         *o = [NSNumber numberWithBool:NO];
         return YES;
@@ -184,7 +276,7 @@ static char ctrl[0x22];
 }
 
 - (BOOL)scanRestOfNull:(NSNull **)o {
-    if (!strncmp(c, "ull", 3)) {
+    if (end - c >= 3 && !strncmp(c, "ull", 3)) {
         c += 3;
         *o = [NSNull null];
         return YES;
@@ -201,11 +293,11 @@ static char ctrl[0x22];
     
     *o = [NSMutableArray arrayWithCapacity:8];
     
-    for (; *c ;) {
+    for (; c < end ;) {
         id v;
         
         skipWhitespace(c);
-        if (*c == ']' && c++) {
+        if (peek(c) == ']' && c++) {
             depth--;
             return YES;
         }
@@ -218,9 +310,9 @@ static char ctrl[0x22];
         [*o addObject:v];
         
         skipWhitespace(c);
-        if (*c == ',' && c++) {
+        if (peek(c) == ',' && c++) {
             skipWhitespace(c);
-            if (*c == ']') {
+            if (peek(c) == ']') {
                 [self addErrorWithCode:ETRAILCOMMA description: @"Trailing comma disallowed in array"];
                 return NO;
             }
@@ -240,22 +332,22 @@ static char ctrl[0x22];
     
     *o = [NSMutableDictionary dictionaryWithCapacity:7];
     
-    for (; *c ;) {
+    for (; c < end ;) {
         id k, v;
         
         skipWhitespace(c);
-        if (*c == '}' && c++) {
+        if (peek(c) == '}' && c++) {
             depth--;
             return YES;
         }    
         
-        if (!(*c == '\"' && c++ && [self scanRestOfString:&k])) {
+        if (!(peek(c) == '\"' && c++ && [self scanRestOfKey:&k])) {
             [self addErrorWithCode:EPARSE description: @"Object key string expected"];
             return NO;
         }
         
         skipWhitespace(c);
-        if (*c != ':') {
+        if (peek(c) != ':') {
             [self addErrorWithCode:EPARSE description: @"Expected ':' separating key and value"];
             return NO;
         }
@@ -270,9 +362,9 @@ static char ctrl[0x22];
         [*o setObject:v forKey:k];
         
         skipWhitespace(c);
-        if (*c == ',' && c++) {
+        if (peek(c) == ',' && c++) {
             skipWhitespace(c);
-            if (*c == '}') {
+            if (peek(c) == '}') {
                 [self addErrorWithCode:ETRAILCOMMA description: @"Trailing comma disallowed in object"];
                 return NO;
             }
@@ -283,32 +375,80 @@ static char ctrl[0x22];
     return NO;
 }
 
-- (BOOL)scanRestOfString:(NSMutableString **)o 
+// Dictionary keys. Short keys without escapes are looked up in the intern table first, so the
+// "path", "bytes", ... of every entry in a listing share one string.
+- (BOOL)scanRestOfKey:(NSString **)o
 {
-    *o = [NSMutableString stringWithCapacity:16];
-    do {
-        // First see if there's a portion we can grab in one go. 
-        // Doing this caused a massive speedup on the long string.
-        size_t len = strcspn(c, ctrl);
-        if (len) {
-            // check for 
-            id t = [[NSString alloc] initWithBytesNoCopy:(char*)c
-                                                  length:len
-                                                encoding:NSUTF8StringEncoding
-                                            freeWhenDone:NO];
-            if (t) {
-                [*o appendString:t];
-                [t release];
-                c += len;
-            }
+    const char *start = c;
+    const char *stop = SBScanStringChunk(c, end);
+    NSUInteger length = stop - start;
+    if (stop == end || *stop != '"' || length > kInternMaxLength)
+        return [self scanRestOfString:o];
+    
+    if (!internTable)
+        internTable = calloc(kInternSlots, sizeof(SBJsonInternSlot));
+    
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)start[i]) * 16777619u;
+    
+    SBJsonInternSlot *slot = (SBJsonInternSlot *)internTable + (hash % kInternSlots);
+    if (slot->key && slot->length == length && !memcmp(slot->bytes, start, length)) {
+        *o = slot->key;
+        c = stop + 1;
+        return YES;
+    }
+    
+    if (![self scanRestOfString:o])
+        return NO;
+    [slot->key release];
+    slot->key = [*o retain];
+    slot->length = length;
+    memcpy(slot->bytes, start, length);
+    return YES;
+}
+
+// Makes room for |length| more bytes after the first |used| bytes of the scratch buffer.
+static inline void SBReserveScratch(SBJsonParser *parser, NSUInteger used, NSUInteger length) {
+    if (used + length > parser->scratchSize) {
+        parser->scratchSize = MAX(2 * parser->scratchSize, MAX(used + length, 256));
+        parser->scratch = realloc(parser->scratch, parser->scratchSize);
+    }
+}
+
+- (BOOL)scanRestOfString:(NSString **)o 
+{
+    // The common case: no escapes, so the string can be made from the input in one go.
+    const char *start = c;
+    c = SBScanStringChunk(c, end);
+    if (c < end && *c == '"') {
+        *o = [[[NSString alloc] initWithBytes:start length:c - start encoding:NSUTF8StringEncoding] autorelease];
+        if (!*o) {
+            [self addErrorWithCode:EUNICODE description:@"Invalid UTF-8 in string"];
+            return NO;
         }
-        
+        c++;
+        return YES;
+    }
+    
+    // Otherwise decode into the scratch buffer and make the string at the end.
+    NSUInteger used = c - start;
+    SBReserveScratch(self, 0, used);
+    memcpy(scratch, start, used);
+    
+    while (c < end) {
         if (*c == '"') {
             c++;
+            *o = [[[NSString alloc] initWithBytes:scratch length:used encoding:NSUTF8StringEncoding] autorelease];
+            if (!*o) {
+                [self addErrorWithCode:EUNICODE description:@"Invalid UTF-8 in string"];
+                return NO;
+            }
             return YES;
             
         } else if (*c == '\\') {
-            unichar uc = *++c;
+            uint32_t uc = (unsigned char)peek(++c);
             switch (uc) {
                 case '\\':
                 case '/':
@@ -329,30 +469,58 @@ static char ctrl[0x22];
                     }
                     c--; // hack.
                     break;
+                case 0:
+                    if (c >= end) {
+                        [self addErrorWithCode:EEOF description:@"Unexpected EOF while parsing string"];
+                        return NO;
+                    }
+                    // Fall through
                 default:
                     [self addErrorWithCode:EESCAPE description: [NSString stringWithFormat:@"Illegal escape sequence '0x%x'", uc]];
                     return NO;
                     break;
             }
-            CFStringAppendCharacters((CFMutableStringRef)*o, &uc, 1);
+            
+            SBReserveScratch(self, used, 4);
+            char *out = scratch + used;
+            if (uc < 0x80) {
+                *out++ = uc;
+            } else if (uc < 0x800) {
+                *out++ = 0xC0 | (uc >> 6);
+                *out++ = 0x80 | (uc & 0x3F);
+            } else if (uc < 0x10000) {
+                *out++ = 0xE0 | (uc >> 12);
+                *out++ = 0x80 | ((uc >> 6) & 0x3F);
+                *out++ = 0x80 | (uc & 0x3F);
+            } else {
+                *out++ = 0xF0 | (uc >> 18);
+                *out++ = 0x80 | ((uc >> 12) & 0x3F);
+                *out++ = 0x80 | ((uc >> 6) & 0x3F);
+                *out++ = 0x80 | (uc & 0x3F);
+            }
+            used = out - scratch;
             c++;
             
-        } else if (*c < 0x20) {
+        } else if ((unsigned char)*c < 0x20) {
             [self addErrorWithCode:ECTRL description: [NSString stringWithFormat:@"Unescaped control character '0x%x'", *c]];
             return NO;
             
         } else {
-            NSLog(@"should not be able to get here");
+            const char *chunk = c;
+            c = SBScanStringChunk(c, end);
+            SBReserveScratch(self, used, c - chunk);
+            memcpy(scratch + used, chunk, c - chunk);
+            used += c - chunk;
         }
-    } while (*c);
+    }
     
     [self addErrorWithCode:EEOF description:@"Unexpected EOF while parsing string"];
     return NO;
 }
 
-- (BOOL)scanUnicodeChar:(unichar *)x
+- (BOOL)scanUnicodeChar:(uint32_t *)x
 {
-    unichar hi, lo;
+    uint32_t hi, lo;
     
     if (![self scanHexQuad:&hi]) {
         [self addErrorWithCode:EUNICODE description: @"Missing hex quad"];
@@ -362,12 +530,12 @@ static char ctrl[0x22];
     if (hi >= 0xd800) {     // high surrogate char?
         if (hi < 0xdc00) {  // yes - expect a low char
             
-            if (!(*c == '\\' && ++c && *c == 'u' && ++c && [self scanHexQuad:&lo])) {
+            if (!(peek(c) == '\\' && ++c && peek(c) == 'u' && ++c && [self scanHexQuad:&lo])) {
                 [self addErrorWithCode:EUNICODE description: @"Missing low character in surrogate pair"];
                 return NO;
             }
             
-            if (lo < 0xdc00 || lo >= 0xdfff) {
+            if (lo < 0xdc00 || lo > 0xdfff) {
                 [self addErrorWithCode:EUNICODE description:@"Invalid low surrogate char"];
                 return NO;
             }
@@ -384,11 +552,11 @@ static char ctrl[0x22];
     return YES;
 }
 
-- (BOOL)scanHexQuad:(unichar *)x
+- (BOOL)scanHexQuad:(uint32_t *)x
 {
     *x = 0;
     for (int i = 0; i < 4; i++) {
-        unichar uc = *c;
+        char uc = peek(c);
         c++;
         int d = (uc >= '0' && uc <= '9')
         ? uc - '0' : (uc >= 'a' && uc <= 'f')
@@ -407,21 +575,22 @@ static char ctrl[0x22];
 - (BOOL)scanNumber:(NSNumber **)o
 {
     const char *ns = c;
+    BOOL isInteger = YES;
     
     // The logic to test for validity of the number formatting is relicensed
     // from JSON::XS with permission from its author Marc Lehmann.
     // (Available at the CPAN: http://search.cpan.org/dist/JSON-XS/ .)
     
-    if ('-' == *c)
+    if ('-' == peek(c))
         c++;
     
-    if ('0' == *c && c++) {        
-        if (isdigit(*c)) {
+    if ('0' == peek(c) && c++) {        
+        if (isdigit(peek(c))) {
             [self addErrorWithCode:EPARSENUM description: @"Leading 0 disallowed in number"];
             return NO;
         }
         
-    } else if (!isdigit(*c) && c != ns) {
+    } else if (!isdigit(peek(c)) && c != ns) {
         [self addErrorWithCode:EPARSENUM description: @"No digits after initial minus"];
         return NO;
         
@@ -430,9 +599,10 @@ static char ctrl[0x22];
     }
     
     // Fractional part
-    if ('.' == *c && c++) {
+    if ('.' == peek(c) && c++) {
+        isInteger = NO;
         
-        if (!isdigit(*c)) {
+        if (!isdigit(peek(c))) {
             [self addErrorWithCode:EPARSENUM description: @"No digits after decimal point"];
             return NO;
         }        
@@ -440,19 +610,42 @@ static char ctrl[0x22];
     }
     
     // Exponential part
-    if ('e' == *c || 'E' == *c) {
+    if ('e' == peek(c) || 'E' == peek(c)) {
+        isInteger = NO;
         c++;
         
-        if ('-' == *c || '+' == *c)
+        if ('-' == peek(c) || '+' == peek(c))
             c++;
         
-        if (!isdigit(*c)) {
+        if (!isdigit(peek(c))) {
             [self addErrorWithCode:EPARSENUM description: @"No digits after exponent"];
             return NO;
         }
         skipDigits(c);
     }
     
+    // Fast paths: up to 18 digits always fit in a long long, and anything with a fraction or
+    // exponent that strtod can represent becomes a double.
+    NSUInteger length = c - ns;
+    BOOL negative = (*ns == '-');
+    if (isInteger && length - negative <= 18) {
+        long long value = 0;
+        for (const char *d = ns + negative; d < c; d++)
+            value = value * 10 + (*d - '0');
+        *o = [NSNumber numberWithLongLong:negative ? -value : value];
+        return YES;
+    }
+    if (!isInteger && length < 64) {
+        char buffer[64];
+        memcpy(buffer, ns, length);
+        buffer[length] = '\0';
+        double value = strtod(buffer, NULL);
+        if (isfinite(value)) {
+            *o = [NSNumber numberWithDouble:value];
+            return YES;
+        }
+    }
+    
     id str = [[NSString alloc] initWithBytesNoCopy:(char*)ns
                                             length:c - ns
                                           encoding:NSUTF8StringEncoding
@@ -468,7 +661,7 @@ static char ctrl[0x22];
 - (BOOL)scanIsAtEnd
 {
     skipWhitespace(c);
-    return !*c;
+    return c >= end;
 }
 
 
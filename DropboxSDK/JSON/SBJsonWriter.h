@@ -97,6 +97,30 @@
     BOOL sortKeys, humanReadable;
 }
 
+/**
+ @brief Return the UTF-8 encoded JSON representation of the given object.
+ 
+ Like -stringWithObject:, but the output is never held as a string at all.
+ */
+- (NSData*)dataWithObject:(id)value;
+
+/**
+ @brief Write the JSON representation of the given object to a stream.
+ 
+ The output is written as UTF-8 in chunks as it is generated, so it is never held in memory in
+ full. @p stream must already be open. Returns NO if the object can't be represented, or if the
+ stream fails; in either case some output may already have been written.
+ */
+- (BOOL)writeObject:(id)value toStream:(NSOutputStream*)stream;
+
+/**
+ @brief Write the JSON representation of the given object to a file.
+ 
+ The output is streamed to a temporary file next to @p path, which replaces @p path only once
+ everything has been written.
+ */
+- (BOOL)writeObject:(id)value toFile:(NSString*)path;
+
 @end
 
 // don't use - exists for backwards compatibility. Will be removed in 2.3.
@@ -29,92 +29,207 @@
 
 #import "SBJsonWriter.h"
 
+// Where the output goes: a growable buffer of UTF-8 bytes, flushed to |stream| whenever it fills
+// up if there is one.
+typedef struct {
+    char *bytes;
+    NSUInteger length;
+    NSUInteger capacity;
+    NSOutputStream *stream;
+    BOOL failed;
+} SBJsonSink;
+
+#define kSinkStreamCapacity     (16 * 1024)
+
+static BOOL SBSinkFlush(SBJsonSink *sink) {
+    NSUInteger written = 0;
+    while (!sink->failed && written < sink->length) {
+        NSInteger result = [sink->stream write:(const uint8_t *)sink->bytes + written maxLength:sink->length - written];
+        if (result <= 0)
+            sink->failed = YES;
+        else
+            written += result;
+    }
+    sink->length = 0;
+    return !sink->failed;
+}
+
+static void SBSinkMakeRoom(SBJsonSink *sink, NSUInteger length) {
+    if (sink->stream && sink->length)
+        SBSinkFlush(sink);
+    if (sink->length + length > sink->capacity) {
+        sink->capacity = MAX(2 * sink->capacity, sink->length + length);
+        sink->bytes = realloc(sink->bytes, sink->capacity);
+    }
+}
+
+static inline void SBSinkAppend(SBJsonSink *sink, const void *bytes, NSUInteger length) {
+    if (sink->length + length > sink->capacity)
+        SBSinkMakeRoom(sink, length);
+    memcpy(sink->bytes + sink->length, bytes, length);
+    sink->length += length;
+}
+
+#define SBSinkAppendLiteral(sink, literal) SBSinkAppend(sink, literal, sizeof(literal) - 1)
+
+// For each byte, 0 if it goes out as it is, or the character after the backslash that escapes it.
+static char kEscapes[256];
+
+// A newline and enough spaces for the first few levels of indentation.
+#define kIndentLevels   32
+static char kIndent[1 + 2 * kIndentLevels];
+
 @interface SBJsonWriter ()
 
-- (BOOL)appendValue:(id)fragment into:(NSMutableString*)json;
-- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableString*)json;
-- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableString*)json;
-- (BOOL)appendString:(NSString*)fragment into:(NSMutableString*)json;
+- (BOOL)appendValue:(id)fragment into:(SBJsonSink *)sink;
+- (BOOL)appendArray:(NSArray*)fragment into:(SBJsonSink *)sink;
+- (BOOL)appendDictionary:(NSDictionary*)fragment into:(SBJsonSink *)sink;
+- (BOOL)appendString:(NSString*)fragment into:(SBJsonSink *)sink;
+- (BOOL)appendNumber:(NSNumber*)fragment into:(SBJsonSink *)sink;
 
-- (NSString*)indent;
+- (void)appendIndentInto:(SBJsonSink *)sink;
 
 @end
 
 @implementation SBJsonWriter
 
-static NSMutableCharacterSet *kEscapeChars;
-
 + (void)initialize {
-	kEscapeChars = [[NSMutableCharacterSet characterSetWithRange: NSMakeRange(0,32)] retain];
-	[kEscapeChars addCharactersInString: @"\"\\"];
+    for (int i = 0; i < 0x20; i++)
+        kEscapes[i] = 'u';
+    kEscapes['"'] = '"';
+    kEscapes['\\'] = '\\';
+    kEscapes['\t'] = 't';
+    kEscapes['\n'] = 'n';
+    kEscapes['\r'] = 'r';
+    kEscapes['\b'] = 'b';
+    kEscapes['\f'] = 'f';
+    
+    kIndent[0] = '\n';
+    memset(kIndent + 1, ' ', sizeof(kIndent) - 1);
 }
 
 
 @synthesize sortKeys;
 @synthesize humanReadable;
 
+// Writes |value| into |sink|. Fragments are only allowed if |allowFragment| is set.
+- (BOOL)appendObject:(id)value allowFragment:(BOOL)allowFragment into:(SBJsonSink *)sink {
+    [self clearErrorTrace];
+    depth = 0;
+    
+    if (!allowFragment && ![value isKindOfClass:[NSDictionary class]] && ![value isKindOfClass:[NSArray class]]) {
+        if ([value respondsToSelector:@selector(proxyForJson)]) {
+            if ([self appendObject:[value proxyForJson] allowFragment:NO into:sink])
+                return YES;
+        }
+        [self clearErrorTrace];
+        [self addErrorWithCode:EFRAGMENT description:@"Not valid type for JSON"];
+        return NO;
+    }
+    
+    if (![self appendValue:value into:sink])
+        return NO;
+    if (sink->stream)
+        SBSinkFlush(sink);
+    if (sink->failed) {
+        [self addErrorWithCode:EOUTPUT description:@"Failed writing to stream"];
+        return NO;
+    }
+    return YES;
+}
+
+- (NSData *)dataWithObject:(id)value allowFragment:(BOOL)allowFragment {
+    SBJsonSink sink = { NULL, 0, 0, nil, NO };
+    if (![self appendObject:value allowFragment:allowFragment into:&sink]) {
+        free(sink.bytes);
+        return nil;
+    }
+    if (!sink.bytes)
+        return [NSData data];
+    return [NSData dataWithBytesNoCopy:sink.bytes length:sink.length freeWhenDone:YES];
+}
+
+- (NSString *)stringWithData:(NSData *)data {
+    if (!data)
+        return nil;
+    return [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+}
+
 /**
  @deprecated This exists in order to provide fragment support in older APIs in one more version.
  It should be removed in the next major version.
  */
 - (NSString*)stringWithFragment:(id)value {
-    [self clearErrorTrace];
-    depth = 0;
-    NSMutableString *json = [NSMutableString stringWithCapacity:128];
-    
-    if ([self appendValue:value into:json])
-        return json;
-    
-    return nil;
+    return [self stringWithData:[self dataWithObject:value allowFragment:YES]];
 }
 
 
 - (NSString*)stringWithObject:(id)value {
+    return [self stringWithData:[self dataWithObject:value allowFragment:NO]];
+}
+
+- (NSData*)dataWithObject:(id)value {
+    return [self dataWithObject:value allowFragment:NO];
+}
+
+- (BOOL)writeObject:(id)value toStream:(NSOutputStream*)stream {
+    SBJsonSink sink = { malloc(kSinkStreamCapacity), 0, kSinkStreamCapacity, stream, NO };
+    BOOL success = [self appendObject:value allowFragment:NO into:&sink];
+    free(sink.bytes);
+    return success;
+}
+
+- (BOOL)writeObject:(id)value toFile:(NSString*)path {
+    NSString *tempPath = [path stringByAppendingPathExtension:@"tmp"];
+    NSOutputStream *stream = [NSOutputStream outputStreamToFileAtPath:tempPath append:NO];
+    [stream open];
+    BOOL success = [self writeObject:value toStream:stream];
+    [stream close];
     
-    if ([value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSArray class]]) {
-        return [self stringWithFragment:value];
-    }
-    
-    if ([value respondsToSelector:@selector(proxyForJson)]) {
-        NSString *tmp = [self stringWithObject:[value proxyForJson]];
-        if (tmp)
-            return tmp;
+    NSFileManager *fileManager = [[[NSFileManager alloc] init] autorelease];
+    if (success) {
+        [fileManager removeItemAtPath:path error:NULL];
+        success = [fileManager moveItemAtPath:tempPath toPath:path error:NULL];
+        if (!success)
+            [self addErrorWithCode:EOUTPUT description:[NSString stringWithFormat:@"Failed moving output to %@", path]];
     }
-        
-
-    [self clearErrorTrace];
-    [self addErrorWithCode:EFRAGMENT description:@"Not valid type for JSON"];
-    return nil;
+    if (!success)
+        [fileManager removeItemAtPath:tempPath error:NULL];
+    return success;
 }
 
 
-- (NSString*)indent {
-    return [@"\n" stringByPaddingToLength:1 + 2 * depth withString:@" " startingAtIndex:0];
+- (void)appendIndentInto:(SBJsonSink *)sink {
+    NSUInteger spaces = 2 * depth;
+    NSUInteger length = MIN(spaces, 2 * kIndentLevels);
+    SBSinkAppend(sink, kIndent, 1 + length);
+    for (spaces -= length; spaces > 0; spaces -= length) {
+        length = MIN(spaces, 2 * kIndentLevels);
+        SBSinkAppend(sink, kIndent + 1, length);
+    }
 }
 
-- (BOOL)appendValue:(id)fragment into:(NSMutableString*)json {
+- (BOOL)appendValue:(id)fragment into:(SBJsonSink *)sink {
     if ([fragment isKindOfClass:[NSDictionary class]]) {
-        if (![self appendDictionary:fragment into:json])
+        if (![self appendDictionary:fragment into:sink])
             return NO;
         
     } else if ([fragment isKindOfClass:[NSArray class]]) {
-        if (![self appendArray:fragment into:json])
+        if (![self appendArray:fragment into:sink])
             return NO;
         
     } else if ([fragment isKindOfClass:[NSString class]]) {
-        if (![self appendString:fragment into:json])
+        if (![self appendString:fragment into:sink])
             return NO;
         
     } else if ([fragment isKindOfClass:[NSNumber class]]) {
-        if ('c' == *[fragment objCType])
-            [json appendString:[fragment boolValue] ? @"true" : @"false"];
-        else
-            [json appendString:[fragment stringValue]];
+        if (![self appendNumber:fragment into:sink])
+            return NO;
         
     } else if ([fragment isKindOfClass:[NSNull class]]) {
-        [json appendString:@"null"];
+        SBSinkAppendLiteral(sink, "null");
     } else if ([fragment respondsToSelector:@selector(proxyForJson)]) {
-        [self appendValue:[fragment proxyForJson] into:json];
+        [self appendValue:[fragment proxyForJson] into:sink];
         
     } else {
         [self addErrorWithCode:EUNSUPPORTED description:[NSString stringWithFormat:@"JSON serialisation not supported for %@", [fragment class]]];
@@ -123,43 +238,42 @@ static NSMutableCharacterSet *kEscapeChars;
     return YES;
 }
 
-- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableString*)json {
+- (BOOL)appendArray:(NSArray*)fragment into:(SBJsonSink *)sink {
     if (maxDepth && ++depth > maxDepth) {
         [self addErrorWithCode:EDEPTH description: @"Nested too deep"];
         return NO;
     }
-    [json appendString:@"["];
+    SBSinkAppendLiteral(sink, "[");
     
     BOOL addComma = NO;    
     for (id value in fragment) {
         if (addComma)
-            [json appendString:@","];
+            SBSinkAppendLiteral(sink, ",");
         else
             addComma = YES;
         
         if ([self humanReadable])
-            [json appendString:[self indent]];
+            [self appendIndentInto:sink];
         
-        if (![self appendValue:value into:json]) {
+        if (![self appendValue:value into:sink]) {
             return NO;
         }
     }
     
     depth--;
     if ([self humanReadable] && [fragment count])
-        [json appendString:[self indent]];
-    [json appendString:@"]"];
+        [self appendIndentInto:sink];
+    SBSinkAppendLiteral(sink, "]");
     return YES;
 }
 
-- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableString*)json {
+- (BOOL)appendDictionary:(NSDictionary*)fragment into:(SBJsonSink *)sink {
     if (maxDepth && ++depth > maxDepth) {
         [self addErrorWithCode:EDEPTH description: @"Nested too deep"];
         return NO;
     }
-    [json appendString:@"{"];
+    SBSinkAppendLiteral(sink, "{");
     
-    NSString *colon = [self humanReadable] ? @" : " : @":";
     BOOL addComma = NO;
     NSArray *keys = [fragment allKeys];
     if (self.sortKeys)
@@ -167,23 +281,26 @@ static NSMutableCharacterSet *kEscapeChars;
     
     for (id value in keys) {
         if (addComma)
-            [json appendString:@","];
+            SBSinkAppendLiteral(sink, ",");
         else
             addComma = YES;
         
         if ([self humanReadable])
-            [json appendString:[self indent]];
+            [self appendIndentInto:sink];
         
         if (![value isKindOfClass:[NSString class]]) {
             [self addErrorWithCode:EUNSUPPORTED description: @"JSON object key must be string"];
             return NO;
         }
         
-        if (![self appendString:value into:json])
+        if (![self appendString:value into:sink])
             return NO;
         
-        [json appendString:colon];
-        if (![self appendValue:[fragment objectForKey:value] into:json]) {
+        if ([self humanReadable])
+            SBSinkAppendLiteral(sink, " : ");
+        else
+            SBSinkAppendLiteral(sink, ":");
+        if (![self appendValue:[fragment objectForKey:value] into:sink]) {
             [self addErrorWithCode:EUNSUPPORTED description:[NSString stringWithFormat:@"Unsupported value for key %@ in object", value]];
             return NO;
         }
@@ -191,45 +308,97 @@ static NSMutableCharacterSet *kEscapeChars;
     
     depth--;
     if ([self humanReadable] && [fragment count])
-        [json appendString:[self indent]];
-    [json appendString:@"}"];
+        [self appendIndentInto:sink];
+    SBSinkAppendLiteral(sink, "}");
     return YES;    
 }
 
-- (BOOL)appendString:(NSString*)fragment into:(NSMutableString*)json {
+// Escapes the UTF-8 in |bytes| into |sink|. Runs of bytes that need no escaping are copied at once.
+static void SBSinkAppendEscaped(SBJsonSink *sink, const unsigned char *bytes, NSUInteger length) {
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *end = bytes + length;
+    while (bytes < end) {
+        const unsigned char *run = bytes;
+        while (bytes < end && !kEscapes[*bytes])
+            bytes++;
+        if (bytes > run)
+            SBSinkAppend(sink, run, bytes - run);
+        if (bytes == end)
+            break;
+        
+        char escape = kEscapes[*bytes];
+        if (escape == 'u') {
+            char u[6] = { '\\', 'u', '0', '0', hex[*bytes >> 4], hex[*bytes & 0xf] };
+            SBSinkAppend(sink, u, sizeof(u));
+        } else {
+            char e[2] = { '\\', escape };
+            SBSinkAppend(sink, e, sizeof(e));
+        }
+        bytes++;
+    }
+}
+
+- (BOOL)appendString:(NSString*)fragment into:(SBJsonSink *)sink {
     
-    [json appendString:@"\""];
+    SBSinkAppendLiteral(sink, "\"");
     
-    NSRange esc = [fragment rangeOfCharacterFromSet:kEscapeChars];
-    if ( !esc.length ) {
-        // No special chars -- can just add the raw string:
-        [json appendString:fragment];
-        
+    // Use the string's own bytes if it already keeps them as ASCII, so one byte per character;
+    // otherwise convert it to UTF-8 first.
+    CFStringRef string = (CFStringRef)fragment;
+    const char *bytes = CFStringGetCStringPtr(string, kCFStringEncodingUTF8);
+    if (bytes) {
+        SBSinkAppendEscaped(sink, (const unsigned char *)bytes, CFStringGetLength(string));
     } else {
-        NSUInteger length = [fragment length];
-        for (NSUInteger i = 0; i < length; i++) {
-            unichar uc = [fragment characterAtIndex:i];
-            switch (uc) {
-                case '"':   [json appendString:@"\\\""];       break;
-                case '\\':  [json appendString:@"\\\\"];       break;
-                case '\t':  [json appendString:@"\\t"];        break;
-                case '\n':  [json appendString:@"\\n"];        break;
-                case '\r':  [json appendString:@"\\r"];        break;
-                case '\b':  [json appendString:@"\\b"];        break;
-                case '\f':  [json appendString:@"\\f"];        break;
-                default:    
-                    if (uc < 0x20) {
-                        [json appendFormat:@"\\u%04x", uc];
-                    } else {
-                        CFStringAppendCharacters((CFMutableStringRef)json, &uc, 1);
-                    }
-                    break;
-                    
-            }
-        }
+        CFIndex length = CFStringGetLength(string);
+        CFIndex maxLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+        char stackBuffer[256];
+        char *buffer = (maxLength <= (CFIndex)sizeof(stackBuffer)) ? stackBuffer : malloc(maxLength);
+        CFIndex used = 0;
+        CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, '?', NO,
+                         (UInt8 *)buffer, maxLength, &used);
+        SBSinkAppendEscaped(sink, (const unsigned char *)buffer, used);
+        if (buffer != stackBuffer)
+            free(buffer);
     }
     
-    [json appendString:@"\""];
+    SBSinkAppendLiteral(sink, "\"");
+    return YES;
+}
+
+- (BOOL)appendNumber:(NSNumber*)fragment into:(SBJsonSink *)sink {
+    char buffer[32];
+    int length;
+    switch (*[fragment objCType]) {
+        case 'c':
+            if ([fragment boolValue])
+                SBSinkAppendLiteral(sink, "true");
+            else
+                SBSinkAppendLiteral(sink, "false");
+            return YES;
+            
+        case 's':
+        case 'i':
+        case 'l':
+        case 'q':
+            length = snprintf(buffer, sizeof(buffer), "%lld", [fragment longLongValue]);
+            break;
+            
+        case 'C':
+        case 'S':
+        case 'I':
+        case 'L':
+        case 'Q':
+            length = snprintf(buffer, sizeof(buffer), "%llu", [fragment unsignedLongLongValue]);
+            break;
+            
+        default: {
+            // Floating point and decimal numbers keep the formatting -stringValue gives them.
+            const char *string = [[fragment stringValue] UTF8String];
+            SBSinkAppend(sink, string, strlen(string));
+            return YES;
+        }
+    }
+    SBSinkAppend(sink, buffer, length);
     return YES;
 }
 
@@ -148,11 +148,11 @@ NSString * const MPOAuthNotificationErrorHasOccurred		= @"MPOAuthNotificationErr
 	NSDictionary *foundParameters = nil;
 	NSInteger status = [(NSHTTPURLResponse *)[self.oauthResponse urlResponse] statusCode];
 	
-	if ([response length] > 5 && [[response substringToIndex:5] isEqualToString:@"oauth"]) {
+	if ([response length] > 5 && [response hasPrefix:@"oauth"]) {
 		foundParameters = [MPURLRequestParameter parameterDictionaryFromString:response];
 		self.oauthResponse.oauthParameters = foundParameters;
 		
-		if (status == 401 || ([response length] > 13 && [[response substringToIndex:13] isEqualToString:@"oauth_problem"])) {
+		if (status == 401 || ([response length] > 13 && [response hasPrefix:@"oauth_problem"])) {
 			NSString *aParameterValue = nil;
 			MPLog(@"oauthProblem = %@", foundParameters);
 			
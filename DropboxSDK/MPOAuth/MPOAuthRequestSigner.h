@@ -0,0 +1,50 @@
+//
+//  MPOAuthRequestSigner.h
+//  MPOAuthConnection
+//
+//  Created by Brian Dewey on 7/11/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CommonCrypto/CommonHMAC.h>
+
+//
+//  Signs requests with HMAC-SHA1 for one set of credentials. Everything that doesn't change from one
+//  request to the next -- the escaped consumer key and token, and the HMAC state after the signing
+//  key -- is worked out once, up front. Each signature is then built in a single pass: parameters
+//  are escaped once with a table of RFC 3986 unreserved characters, sorted once, and fed straight
+//  into a copy of the HMAC state without ever building the signature base string.
+//
+//  A signer is not thread safe; it reuses its buffers from one request to the next.
+//
+
+@interface MPOAuthRequestSigner : NSObject {
+@private
+	char			*_consumerKey;
+	char			*_token;
+	CCHmacContext	_keyContext;
+	char			*_buffer;
+	NSUInteger		_bufferLength;
+	NSUInteger		_bufferCapacity;
+}
+
+- (id)initWithConsumerKey:(NSString *)inConsumerKey consumerSecret:(NSString *)inConsumerSecret token:(NSString *)inToken tokenSecret:(NSString *)inTokenSecret;
+
+//
+//  Returns the signed parameter string -- the OAuth parameters, |inParameters|, and oauth_signature,
+//  escaped and joined with '&' -- for a request. |inSignedParameters| are included in the signature
+//  but not in the result, for parameters that travel elsewhere in the request (like an upload's
+//  file name). Either dictionary may be nil.
+//
+
+- (NSString *)parameterStringForMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters signedParameters:(NSDictionary *)inSignedParameters;
+
+//
+//  Returns a signed GET or POST request. GET parameters go in the query string, POST parameters in
+//  the body, as with -[MPOAuthURLRequest urlRequestSignedWithSecret:usingMethod:].
+//
+
+- (NSMutableURLRequest *)URLRequestWithMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters;
+
+@end
@@ -0,0 +1,317 @@
+//
+//  MPOAuthRequestSigner.m
+//  MPOAuthConnection
+//
+//  Created by Brian Dewey on 7/11/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import "MPOAuthRequestSigner.h"
+#import "NSURL+MPURLParameterAdditions.h"
+#import "MPDebug.h"
+
+#include "Base64Transcoder.h"
+
+#define kMPOAuthSignerStackParameters	16
+
+typedef struct {
+	const char	*name;
+	NSUInteger	nameLength;
+	const char	*value;
+	NSUInteger	valueLength;
+	NSUInteger	valueOffset;
+	BOOL		inBuffer;
+	BOOL		signedOnly;
+} MPOAuthSignerParameter;
+
+static BOOL kUnreserved[256];
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+// Percent-escapes everything but the RFC 3986 unreserved characters, like
+// -[NSString stringByAddingURIPercentEscapesUsingEncoding:]. |out| needs room for 3 * |inLength| bytes.
+static char *MPEscapeBytes(char *out, const unsigned char *in, NSUInteger inLength) {
+	for (NSUInteger i = 0; i < inLength; i++) {
+		unsigned char c = in[i];
+		if (kUnreserved[c]) {
+			*out++ = c;
+		} else {
+			*out++ = '%';
+			*out++ = kHexDigits[c >> 4];
+			*out++ = kHexDigits[c & 0xf];
+		}
+	}
+	return out;
+}
+
+// Feeds already escaped bytes to the HMAC, escaped a second time as the signature base string needs.
+// Only the '%'s from the first escaping aren't unreserved characters.
+static void MPHmacUpdateEscaped(CCHmacContext *context, const char *bytes, NSUInteger length) {
+	const char *run = bytes;
+	const char *end = bytes + length;
+	for (const char *c = bytes; c < end; c++) {
+		if (*c == '%') {
+			CCHmacUpdate(context, run, c - run);
+			CCHmacUpdate(context, "%25", 3);
+			run = c + 1;
+		}
+	}
+	CCHmacUpdate(context, run, end - run);
+}
+
+static int MPCompareBytes(const char *a, NSUInteger aLength, const char *b, NSUInteger bLength) {
+	int result = memcmp(a, b, MIN(aLength, bLength));
+	if (result == 0 && aLength != bLength) {
+		result = (aLength < bLength) ? -1 : 1;
+	}
+	return result;
+}
+
+static int MPCompareParameters(const void *a, const void *b) {
+	const MPOAuthSignerParameter *first = a;
+	const MPOAuthSignerParameter *second = b;
+	int result = MPCompareBytes(first->name, first->nameLength, second->name, second->nameLength);
+	if (result == 0) {
+		result = MPCompareBytes(first->value, first->valueLength, second->value, second->valueLength);
+	}
+	return result;
+}
+
+static inline MPOAuthSignerParameter MPMakeParameter(const char *inName, const char *inValue) {
+	MPOAuthSignerParameter parameter = { inName, strlen(inName), inValue, strlen(inValue), 0, NO, NO };
+	return parameter;
+}
+
+@interface MPOAuthRequestSigner ()
+- (void)reserveBufferLength:(NSUInteger)inLength;
+- (NSUInteger)appendEscapedString:(NSString *)inString;
+- (char *)copyEscapedString:(NSString *)inString;
+- (NSString *)parameterStringForMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters signedParameters:(NSDictionary *)inSignedParameters timestamp:(const char *)inTimestamp nonce:(const char *)inNonce;
+@end
+
+@implementation MPOAuthRequestSigner
+
++ (void)initialize {
+	for (int c = 0; c < 256; c++) {
+		kUnreserved[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+						 c == '-' || c == '.' || c == '_' || c == '~';
+	}
+}
+
+- (id)initWithConsumerKey:(NSString *)inConsumerKey consumerSecret:(NSString *)inConsumerSecret token:(NSString *)inToken tokenSecret:(NSString *)inTokenSecret {
+	if (self = [super init]) {
+		_consumerKey = [self copyEscapedString:inConsumerKey];
+		_token = inToken ? [self copyEscapedString:inToken] : NULL;
+
+		// The signing key is the escaped consumer secret and token secret, joined with '&'.
+		_bufferLength = 0;
+		[self appendEscapedString:inConsumerSecret];
+		[self reserveBufferLength:1];
+		_buffer[_bufferLength++] = '&';
+		[self appendEscapedString:inToken ? inTokenSecret : @""];
+		CCHmacInit(&_keyContext, kCCHmacAlgSHA1, _buffer, _bufferLength);
+		memset(_buffer, 0, _bufferLength);
+		_bufferLength = 0;
+	}
+	return self;
+}
+
+- (oneway void)dealloc {
+	free(_consumerKey);
+	free(_token);
+	free(_buffer);
+	memset(&_keyContext, 0, sizeof(_keyContext));
+
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (void)reserveBufferLength:(NSUInteger)inLength {
+	if (_bufferLength + inLength > _bufferCapacity) {
+		_bufferCapacity = MAX(2 * _bufferCapacity, MAX(_bufferLength + inLength, 1024));
+		_buffer = realloc(_buffer, _bufferCapacity);
+	}
+}
+
+// Appends the escaped UTF-8 of |inString| to the buffer, and returns where it starts.
+- (NSUInteger)appendEscapedString:(NSString *)inString {
+	NSUInteger offset = _bufferLength;
+	CFStringRef string = (CFStringRef)inString;
+	CFIndex length = CFStringGetLength(string);
+
+	// ASCII strings can be escaped straight from their own storage.
+	const char *bytes = CFStringGetCStringPtr(string, kCFStringEncodingUTF8);
+	if (bytes) {
+		[self reserveBufferLength:3 * length];
+		_bufferLength = MPEscapeBytes(_buffer + _bufferLength, (const unsigned char *)bytes, length) - _buffer;
+		return offset;
+	}
+
+	CFIndex maxLength = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+	char stackBytes[256];
+	char *utf8 = (maxLength <= (CFIndex)sizeof(stackBytes)) ? stackBytes : malloc(maxLength);
+	CFIndex used = 0;
+	CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, 0, NO, (UInt8 *)utf8, maxLength, &used);
+	[self reserveBufferLength:3 * used];
+	_bufferLength = MPEscapeBytes(_buffer + _bufferLength, (const unsigned char *)utf8, used) - _buffer;
+	if (utf8 != stackBytes) {
+		free(utf8);
+	}
+	return offset;
+}
+
+- (char *)copyEscapedString:(NSString *)inString {
+	_bufferLength = 0;
+	[self appendEscapedString:inString];
+	char *copy = malloc(_bufferLength + 1);
+	memcpy(copy, _buffer, _bufferLength);
+	copy[_bufferLength] = '\0';
+	_bufferLength = 0;
+	return copy;
+}
+
+#pragma mark -
+
+- (NSString *)parameterStringForMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters signedParameters:(NSDictionary *)inSignedParameters {
+	char timestamp[16];
+	snprintf(timestamp, sizeof(timestamp), "%d", (int)[[NSDate date] timeIntervalSince1970]);
+
+	char nonce[33];
+	for (int i = 0; i < 4; i++) {
+		snprintf(nonce + 8 * i, 9, "%08X", arc4random());
+	}
+
+	return [self parameterStringForMethod:inMethod URL:inURL parameters:inParameters signedParameters:inSignedParameters timestamp:timestamp nonce:nonce];
+}
+
+- (NSString *)parameterStringForMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters signedParameters:(NSDictionary *)inSignedParameters timestamp:(const char *)inTimestamp nonce:(const char *)inNonce {
+	NSUInteger count = 6 + [inParameters count] + [inSignedParameters count];
+	MPOAuthSignerParameter stackParameters[kMPOAuthSignerStackParameters];
+	MPOAuthSignerParameter *parameters = (count <= kMPOAuthSignerStackParameters) ? stackParameters : malloc(count * sizeof(MPOAuthSignerParameter));
+	NSUInteger parameterCount = 0;
+
+	parameters[parameterCount++] = MPMakeParameter("oauth_consumer_key", _consumerKey);
+	if (_token) {
+		parameters[parameterCount++] = MPMakeParameter("oauth_token", _token);
+	}
+	parameters[parameterCount++] = MPMakeParameter("oauth_signature_method", "HMAC-SHA1");
+	parameters[parameterCount++] = MPMakeParameter("oauth_timestamp", inTimestamp);
+	parameters[parameterCount++] = MPMakeParameter("oauth_nonce", inNonce);
+	parameters[parameterCount++] = MPMakeParameter("oauth_version", "1.0");
+
+	// Escape the request's own parameters into the buffer, each name just ahead of its value. The
+	// buffer may move as it grows, so only offsets are kept until everything is in.
+	_bufferLength = 0;
+	NSUInteger urlOffset = [self appendEscapedString:[inURL absoluteNormalizedString]];
+	NSUInteger urlLength = _bufferLength - urlOffset;
+	for (NSDictionary *dictionary in [NSArray arrayWithObjects:inParameters ? inParameters : [NSDictionary dictionary], inSignedParameters, nil]) {
+		for (NSString *name in dictionary) {
+			MPOAuthSignerParameter *parameter = &parameters[parameterCount++];
+			parameter->nameLength = _bufferLength - [self appendEscapedString:name];
+			parameter->valueOffset = [self appendEscapedString:[dictionary objectForKey:name]];
+			parameter->valueLength = _bufferLength - parameter->valueOffset;
+			parameter->inBuffer = YES;
+			parameter->signedOnly = (dictionary == inSignedParameters);
+		}
+	}
+	for (NSUInteger i = 0; i < parameterCount; i++) {
+		if (parameters[i].inBuffer) {
+			parameters[i].name = _buffer + parameters[i].valueOffset - parameters[i].nameLength;
+			parameters[i].value = _buffer + parameters[i].valueOffset;
+		}
+	}
+	qsort(parameters, parameterCount, sizeof(MPOAuthSignerParameter), MPCompareParameters);
+
+	// The signature base string is METHOD&URL&PARAMETERS, each escaped, where PARAMETERS are the
+	// escaped, sorted parameters joined with '=' and '&'.
+	CCHmacContext context = _keyContext;
+	const char *method = [inMethod UTF8String];
+	CCHmacUpdate(&context, method, strlen(method));
+	CCHmacUpdate(&context, "&", 1);
+	MPHmacUpdateEscaped(&context, _buffer + urlOffset, urlLength);
+	CCHmacUpdate(&context, "&", 1);
+	NSUInteger outputLength = 0;
+	for (NSUInteger i = 0; i < parameterCount; i++) {
+		MPOAuthSignerParameter *parameter = &parameters[i];
+		if (i > 0) {
+			CCHmacUpdate(&context, "%26", 3);
+		}
+		MPHmacUpdateEscaped(&context, parameter->name, parameter->nameLength);
+		CCHmacUpdate(&context, "%3D", 3);
+		MPHmacUpdateEscaped(&context, parameter->value, parameter->valueLength);
+		if (!parameter->signedOnly) {
+			outputLength += parameter->nameLength + parameter->valueLength + 2;
+		}
+	}
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CCHmacFinal(&context, digest);
+
+	char signature[32];
+	size_t signatureLength = sizeof(signature);
+	Base64EncodeData(digest, sizeof(digest), signature, &signatureLength);
+
+	// Now the parameter string itself, from the same escaped parameters, at the end of the buffer.
+	static const char kSignatureName[] = "oauth_signature=";
+	NSUInteger outputOffset = _bufferLength;
+	const char *oldBuffer = _buffer;
+	[self reserveBufferLength:outputLength + sizeof(kSignatureName) + 3 * signatureLength];
+	if (_buffer != oldBuffer) {
+		for (NSUInteger i = 0; i < parameterCount; i++) {
+			if (parameters[i].inBuffer) {
+				parameters[i].name = _buffer + parameters[i].valueOffset - parameters[i].nameLength;
+				parameters[i].value = _buffer + parameters[i].valueOffset;
+			}
+		}
+	}
+	char *out = _buffer + outputOffset;
+	for (NSUInteger i = 0; i < parameterCount; i++) {
+		MPOAuthSignerParameter *parameter = &parameters[i];
+		if (parameter->signedOnly) {
+			continue;
+		}
+		memcpy(out, parameter->name, parameter->nameLength);
+		out += parameter->nameLength;
+		*out++ = '=';
+		memcpy(out, parameter->value, parameter->valueLength);
+		out += parameter->valueLength;
+		*out++ = '&';
+	}
+	memcpy(out, kSignatureName, sizeof(kSignatureName) - 1);
+	out += sizeof(kSignatureName) - 1;
+	out = MPEscapeBytes(out, (const unsigned char *)signature, signatureLength);
+
+	NSString *parameterString = [[NSString alloc] initWithBytes:_buffer + outputOffset length:out - (_buffer + outputOffset) encoding:NSASCIIStringEncoding];
+
+	if (parameters != stackParameters) {
+		free(parameters);
+	}
+	_bufferLength = 0;
+	return [parameterString autorelease];
+}
+
+- (NSMutableURLRequest *)URLRequestWithMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters {
+	NSString *parameterString = [self parameterStringForMethod:inMethod URL:inURL parameters:inParameters signedParameters:nil];
+	NSMutableURLRequest *aRequest = [NSMutableURLRequest requestWithURL:inURL];
+	[aRequest setHTTPMethod:inMethod];
+
+	if ([inMethod isEqualToString:@"GET"]) {
+		NSString *urlString = [NSString stringWithFormat:@"%@?%@", [inURL absoluteString], parameterString];
+		MPLog( @"urlString - %@", urlString);
+
+		[aRequest setURL:[NSURL URLWithString:urlString]];
+	} else if ([inMethod isEqualToString:@"POST"]) {
+		NSData *postData = [parameterString dataUsingEncoding:NSUTF8StringEncoding];
+		MPLog(@"urlString - %@", inURL);
+		MPLog(@"postDataString - %@", parameterString);
+
+		[aRequest setValue:[NSString stringWithFormat:@"%d", [postData length]] forHTTPHeaderField:@"Content-Length"];
+		[aRequest setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
+		[aRequest setHTTPBody:postData];
+	} else {
+		[NSException raise:@"UnhandledHTTPMethodException" format:@"The requested HTTP method, %@, is not supported", inMethod];
+	}
+
+	return aRequest;
+}
+
+@end
@@ -0,0 +1,46 @@
+//
+//  MPURLQueryParser.h
+//  MPOAuthConnection
+//
+//  Created by Brian Dewey on 7/12/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+//  Splits a query string or OAuth response ("name=value&name=value") in a single pass over its
+//  UTF-8 bytes. Values are percent-decoded in place; names are left as they are. Only byte ranges
+//  are kept, and NSStrings are made when asked for.
+//
+//  The split is the one MPURLRequestParameter has always made with NSScanner: leading whitespace
+//  is skipped, a name runs to the next '=' (even past an '&'), a value to the next '&', and an
+//  empty name or value, or a value with a bad escape, is nil.
+//
+
+typedef struct {
+	NSRange	name;
+	NSRange	value;
+} MPURLQueryComponent;
+
+@interface MPURLQueryParser : NSObject {
+@private
+	char				*_bytes;
+	MPURLQueryComponent	*_components;
+	NSUInteger			_count;
+}
+
+- (id)initWithString:(NSString *)inString;
+
+@property (nonatomic, readonly) NSUInteger count;
+
+- (NSString *)nameAtIndex:(NSUInteger)inIndex;
+- (NSString *)valueAtIndex:(NSUInteger)inIndex;
+
+// The index of the first component named |inName|, or NSNotFound, without making any strings
+- (NSUInteger)indexOfName:(NSString *)inName;
+
+- (NSArray *)parameters;
+- (NSDictionary *)parameterDictionary;
+
+@end
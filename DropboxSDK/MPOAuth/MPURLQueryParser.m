@@ -0,0 +1,188 @@
+//
+//  MPURLQueryParser.m
+//  MPOAuthConnection
+//
+//  Created by Brian Dewey on 7/12/11.
+//  Copyright 2011 Brian Dewey. All rights reserved.
+//
+
+#import "MPURLQueryParser.h"
+#import "MPURLRequestParameter.h"
+
+static const NSRange kMPURLQueryNoRange = { NSNotFound, 0 };
+
+// Length of the character at |p| if it's in +[NSCharacterSet whitespaceAndNewlineCharacterSet],
+// which NSScanner skips by default, or 0.
+static NSUInteger MPWhitespaceLength(const unsigned char *p, const unsigned char *end) {
+	if (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+		return 1;
+	}
+	if (*p < 0xC2 || end - p < 2) {
+		return 0;
+	}
+	if (p[0] == 0xC2) {
+		return (p[1] == 0x85 || p[1] == 0xA0) ? 2 : 0;
+	}
+	if (end - p < 3) {
+		return 0;
+	}
+	switch (p[0]) {
+		case 0xE1:	// U+1680
+			return (p[1] == 0x9A && p[2] == 0x80) ? 3 : 0;
+		case 0xE2:	// U+2000-200A, U+2028, U+2029, U+202F, U+205F
+			if (p[1] == 0x80) {
+				return (p[2] <= 0x8A || p[2] == 0xA8 || p[2] == 0xA9 || p[2] == 0xAF) ? 3 : 0;
+			}
+			return (p[1] == 0x81 && p[2] == 0x9F) ? 3 : 0;
+		case 0xE3:	// U+3000
+			return (p[1] == 0x80 && p[2] == 0x80) ? 3 : 0;
+	}
+	return 0;
+}
+
+static const unsigned char *MPSkipWhitespace(const unsigned char *p, const unsigned char *end) {
+	NSUInteger length;
+	while (p < end && (length = MPWhitespaceLength(p, end))) {
+		p += length;
+	}
+	return p;
+}
+
+static int MPHexValue(unsigned char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Decodes the escapes in |range| in place, and returns the decoded range, or no range if an escape is bad.
+static NSRange MPDecodeInPlace(char *bytes, NSRange range) {
+	unsigned char *p = (unsigned char *)bytes + range.location;
+	unsigned char *end = p + range.length;
+	unsigned char *out = p;
+	while (p < end) {
+		if (*p != '%') {
+			*out++ = *p++;
+			continue;
+		}
+		int high, low;
+		if (end - p < 3 || (high = MPHexValue(p[1])) < 0 || (low = MPHexValue(p[2])) < 0) {
+			return kMPURLQueryNoRange;
+		}
+		*out++ = (high << 4) | low;
+		p += 3;
+	}
+	return NSMakeRange(range.location, out - ((unsigned char *)bytes + range.location));
+}
+
+@interface MPURLQueryParser ()
+- (NSString *)stringWithRange:(NSRange)inRange;
+@end
+
+@implementation MPURLQueryParser
+
+- (id)initWithString:(NSString *)inString {
+	if (self = [super init]) {
+		CFStringRef string = (CFStringRef)inString;
+		CFIndex length = inString ? CFStringGetLength(string) : 0;
+		CFIndex byteLength = 0;
+		_bytes = malloc(CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8) + 1);
+		if (length) {
+			CFStringGetBytes(string, CFRangeMake(0, length), kCFStringEncodingUTF8, '?', NO, (UInt8 *)_bytes, CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8), &byteLength);
+		}
+
+		const unsigned char *start = (const unsigned char *)_bytes;
+		const unsigned char *end = start + byteLength;
+		const unsigned char *p = MPSkipWhitespace(start, end);
+		NSUInteger capacity = 8;
+		_components = malloc(capacity * sizeof(MPURLQueryComponent));
+
+		while (p < end) {
+			if (_count == capacity) {
+				capacity *= 2;
+				_components = realloc(_components, capacity * sizeof(MPURLQueryComponent));
+			}
+			MPURLQueryComponent *component = &_components[_count++];
+
+			const unsigned char *tokenEnd = memchr(p, '=', end - p);
+			if (!tokenEnd) tokenEnd = end;
+			component->name = (tokenEnd > p) ? NSMakeRange(p - start, tokenEnd - p) : kMPURLQueryNoRange;
+			p = MPSkipWhitespace(tokenEnd, end);
+			if (p < end && *p == '=') p++;
+
+			p = MPSkipWhitespace(p, end);
+			tokenEnd = memchr(p, '&', end - p);
+			if (!tokenEnd) tokenEnd = end;
+			component->value = (tokenEnd > p) ? MPDecodeInPlace(_bytes, NSMakeRange(p - start, tokenEnd - p)) : kMPURLQueryNoRange;
+			p = MPSkipWhitespace(tokenEnd, end);
+			if (p < end && *p == '&') p++;
+
+			p = MPSkipWhitespace(p, end);
+		}
+	}
+	return self;
+}
+
+- (oneway void)dealloc {
+	free(_bytes);
+	free(_components);
+
+	[super dealloc];
+}
+
+@synthesize count = _count;
+
+#pragma mark -
+
+- (NSString *)stringWithRange:(NSRange)inRange {
+	if (inRange.location == NSNotFound) {
+		return nil;
+	}
+	return [[[NSString alloc] initWithBytes:_bytes + inRange.location length:inRange.length encoding:NSUTF8StringEncoding] autorelease];
+}
+
+- (NSString *)nameAtIndex:(NSUInteger)inIndex {
+	return [self stringWithRange:_components[inIndex].name];
+}
+
+- (NSString *)valueAtIndex:(NSUInteger)inIndex {
+	return [self stringWithRange:_components[inIndex].value];
+}
+
+- (NSUInteger)indexOfName:(NSString *)inName {
+	const char *name = [inName UTF8String];
+	NSUInteger length = strlen(name);
+	for (NSUInteger i = 0; i < _count; i++) {
+		NSRange range = _components[i].name;
+		if (range.location != NSNotFound && range.length == length && memcmp(_bytes + range.location, name, length) == 0) {
+			return i;
+		}
+	}
+	return NSNotFound;
+}
+
+#pragma mark -
+
+- (NSArray *)parameters {
+	NSMutableArray *foundParameters = [NSMutableArray arrayWithCapacity:_count];
+	for (NSUInteger i = 0; i < _count; i++) {
+		MPURLRequestParameter *aParameter = [[MPURLRequestParameter alloc] initWithName:[self nameAtIndex:i] andValue:[self valueAtIndex:i]];
+		[foundParameters addObject:aParameter];
+		[aParameter release];
+	}
+	return foundParameters;
+}
+
+- (NSDictionary *)parameterDictionary {
+	NSMutableDictionary *foundParameters = [NSMutableDictionary dictionaryWithCapacity:_count];
+	for (NSUInteger i = 0; i < _count; i++) {
+		NSString *name = [self nameAtIndex:i];
+		NSString *value = [self valueAtIndex:i];
+		if (name && value) {
+			[foundParameters setObject:value forKey:name];
+		}
+	}
+	return foundParameters;
+}
+
+@end
@@ -7,36 +7,15 @@
 //
 
 #import "MPURLRequestParameter.h"
+#import "MPURLQueryParser.h"
 #import "NSString+URLEscapingAdditions.h"
 
 @implementation MPURLRequestParameter
 
 + (NSArray *)parametersFromString:(NSString *)inString {
-	NSMutableArray *foundParameters = [NSMutableArray arrayWithCapacity:10];
-	NSScanner *parameterScanner = [[NSScanner alloc] initWithString:inString];
-	NSString *name = nil;
-	NSString *value = nil;
-	MPURLRequestParameter *currentParameter = nil;
-	
-	while (![parameterScanner isAtEnd]) {
-		name = nil;
-		value = nil;
-		
-		[parameterScanner scanUpToString:@"=" intoString:&name];
-		[parameterScanner scanString:@"=" intoString:NULL];
-		[parameterScanner scanUpToString:@"&" intoString:&value];
-		[parameterScanner scanString:@"&" intoString:NULL];		
-		
-		currentParameter = [[MPURLRequestParameter alloc] init];
-		currentParameter.name = name;
-		currentParameter.value = [value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
-		
-		[foundParameters addObject:currentParameter];
-		
-		[currentParameter release];
-	}
-	
-	[parameterScanner release];
+	MPURLQueryParser *parser = [[MPURLQueryParser alloc] initWithString:inString];
+	NSArray *foundParameters = [parser parameters];
+	[parser release];
 	
 	return foundParameters;
 }
@@ -58,26 +37,10 @@
 }
 
 + (NSDictionary *)parameterDictionaryFromString:(NSString *)inString {
-	NSMutableDictionary *foundParameters = [NSMutableDictionary dictionaryWithCapacity:10];
-	if (inString) {
-		NSScanner *parameterScanner = [[NSScanner alloc] initWithString:inString];
-		NSString *name = nil;
-		NSString *value = nil;
-		
-		while (![parameterScanner isAtEnd]) {
-			name = nil;
-			value = nil;
-			
-			[parameterScanner scanUpToString:@"=" intoString:&name];
-			[parameterScanner scanString:@"=" intoString:NULL];
-			[parameterScanner scanUpToString:@"&" intoString:&value];
-			[parameterScanner scanString:@"&" intoString:NULL];		
-			
-			[foundParameters setObject:[value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding] forKey:name];
-		}
-		
-		[parameterScanner release];
-	}
+	MPURLQueryParser *parser = [[MPURLQueryParser alloc] initWithString:inString];
+	NSDictionary *foundParameters = [parser parameterDictionary];
+	[parser release];
+	
 	return foundParameters;
 }
 
@@ -68,8 +68,20 @@
 - (NSString *)absoluteNormalizedString {
 	NSString *normalizedString = [self absoluteString];
 
-	if ([[self path] length] == 0 && [[self query] length] == 0) {
-		normalizedString = [NSString stringWithFormat:@"%@/", [self absoluteString]];
+	// Looks for an empty path and query in the string itself, rather than having NSURL parse them out.
+	// Anything after the authority that isn't a bare '?' or a fragment is a path or a query.
+	const char *bytes = [normalizedString UTF8String];
+	const char *authority = strstr(bytes, "://");
+	if (authority) {
+		const char *rest = authority + 3 + strcspn(authority + 3, "/?#");
+		if (*rest == '?') {
+			rest++;
+		}
+		if (*rest == '\0' || *rest == '#') {
+			normalizedString = [normalizedString stringByAppendingString:@"/"];
+		}
+	} else if ([[self path] length] == 0 && [[self query] length] == 0) {
+		normalizedString = [normalizedString stringByAppendingString:@"/"];
 	}
 	
 	return normalizedString;
@@ -0,0 +1,388 @@
+//
+//  CryptoBenchmarkTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVBenchmark.h"
+#import "Rfc2898DeriveBytes.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSData+CompressionHelpers.h"
+#import "DecryptionStateMachine.h"
+#import "Base64Transcoder.h"
+
+#define kCryptoBenchmarkWarmUp        2
+#define kCryptoBenchmarkRepetitions   10
+
+//
+//  Runs every primitive in the vault stack through |DVBenchmark|. The results
+//  of every test so far are written to |crypto-benchmarks.json| in the caches
+//  directory after each test, so runs on different builds can be compared.
+//  Every test here is a benchmark, so none run unless |DVBenchmark| is
+//  enabled.
+//
+
+static DVBenchmark *benchmark_;
+
+@interface CryptoBenchmarkTest : GTMTestCase <DecryptionStateMachineDelegate> {
+
+@private
+  NSData *key_;
+  NSData *iv_;
+  SEL pendingAction_;
+  BOOL didFinish_;
+}
+
+@end
+
+
+@implementation CryptoBenchmarkTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (double)megabytes:(NSUInteger)bytes {
+  return bytes / (1024.0 * 1024.0);
+}
+
+//
+//  Decrypts |path| with a state machine of |blockSize|, driving it from a
+//  loop rather than the run loop so only the decryption is timed.
+//
+
+- (void)decryptFile:(NSString *)path
+             toPath:(NSString *)outputPath
+          blockSize:(NSUInteger)blockSize
+         compressed:(BOOL)compressed {
+
+  DecryptionStateMachine *stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+  stateMachine.delegate = self;
+  stateMachine.blockSize = blockSize;
+  stateMachine.compressed = compressed;
+  didFinish_ = NO;
+  [stateMachine decryptFile:path toPath:outputPath withKey:key_ andIV:iv_];
+  while (pendingAction_ != NULL) {
+    SEL action = pendingAction_;
+    pendingAction_ = NULL;
+    [stateMachine performSelector:action];
+  }
+}
+
+- (void)decryptFile:(NSString *)path toPath:(NSString *)outputPath blockSize:(NSUInteger)blockSize {
+  [self decryptFile:path toPath:outputPath blockSize:blockSize compressed:NO];
+}
+
+//
+//  About |length| bytes of each kind of file people keep in a vault, keyed
+//  by a short description: prose, a document's XML, a spreadsheet export,
+//  a photo, and data that's already compressed or encrypted.
+//
+
+- (NSDictionary *)compressionCorpusOfLength:(NSUInteger)length {
+
+  NSArray *words = [NSArray arrayWithObjects:@"the", @"account", @"number", @"is", @"kept",
+                    @"in", @"a", @"safe", @"deposit", @"box", @"at", @"bank", @"with",
+                    @"passport", @"and", @"will", @"of", @"our", @"insurance", @"policy", nil];
+  unsigned int seed = 42;
+  NSMutableString *prose = [NSMutableString string];
+  while ([prose length] < length) {
+    [prose appendString:[words objectAtIndex:rand_r(&seed) % [words count]]];
+    [prose appendString:(rand_r(&seed) % 12 == 0) ? @".\n" : @" "];
+  }
+
+  NSMutableString *xml = [NSMutableString stringWithString:@"<?xml version=\"1.0\"?><w:document><w:body>"];
+  while ([xml length] < length) {
+    [xml appendFormat:@"<w:p w:rsidR=\"%08X\"><w:r><w:rPr><w:b/></w:rPr><w:t>%@</w:t></w:r></w:p>",
+     rand_r(&seed),
+     [words objectAtIndex:rand_r(&seed) % [words count]]];
+  }
+
+  NSMutableString *csv = [NSMutableString stringWithString:@"date,payee,amount,balance\n"];
+  double balance = 1000.0;
+  for (NSUInteger row = 0; [csv length] < length; row++) {
+    double amount = (rand_r(&seed) % 20000) / 100.0 - 100.0;
+    balance += amount;
+    [csv appendFormat:@"2011-%02u-%02u,%@,%.2f,%.2f\n",
+     (row / 28) % 12 + 1,
+     row % 28 + 1,
+     [words objectAtIndex:rand_r(&seed) % [words count]],
+     amount,
+     balance];
+  }
+
+  CGFloat side = 1024.0;
+  UIGraphicsBeginImageContext(CGSizeMake(side, side));
+  CGContextRef context = UIGraphicsGetCurrentContext();
+  for (NSUInteger i = 0; i < 400; i++) {
+    CGContextSetRGBFillColor(context,
+                             (rand_r(&seed) % 256) / 255.0,
+                             (rand_r(&seed) % 256) / 255.0,
+                             (rand_r(&seed) % 256) / 255.0,
+                             1.0);
+    CGContextFillEllipseInRect(context, CGRectMake(rand_r(&seed) % (int)side,
+                                                   rand_r(&seed) % (int)side,
+                                                   rand_r(&seed) % 200,
+                                                   rand_r(&seed) % 200));
+  }
+  NSData *jpeg = UIImageJPEGRepresentation(UIGraphicsGetImageFromCurrentImageContext(), 0.8);
+  UIGraphicsEndImageContext();
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [prose dataUsingEncoding:NSUTF8StringEncoding], @"text",
+          [xml dataUsingEncoding:NSUTF8StringEncoding], @"xml",
+          [csv dataUsingEncoding:NSUTF8StringEncoding], @"csv",
+          jpeg, @"jpeg",
+          [NSData dataWithRandomBytes:length], @"random",
+          nil];
+}
+
+#pragma mark -
+#pragma mark Tests
+
++ (NSArray *)testInvocations {
+
+  if (![DVBenchmark isEnabled]) {
+    return nil;
+  }
+  return [super testInvocations];
+}
+
+- (void)setUp {
+
+  if (benchmark_ == nil) {
+    benchmark_ = [[DVBenchmark alloc] initWithWarmUp:kCryptoBenchmarkWarmUp
+                                         repetitions:kCryptoBenchmarkRepetitions];
+  }
+  key_ = [[NSData dataWithRandomBytes:kCCKeySizeAES128] retain];
+  iv_ = [[NSData dataWithRandomBytes:kCCBlockSizeAES128] retain];
+}
+
+- (void)tearDown {
+
+  NSString *path = [DVBenchmark defaultResultsPathForName:@"crypto-benchmarks"];
+  [benchmark_ writeResultsToFile:path];
+  NSLog(@"%s -- results so far, written to %@\n%@", __PRETTY_FUNCTION__, path, [benchmark_ report]);
+  [key_ release];
+  [iv_ release];
+}
+
+- (void)testPBKDF2 {
+
+  NSUInteger count = 10;
+  NSData *salt = [NSData dataWithRandomBytes:8];
+  [benchmark_ measure:@"PBKDF2 key and IV" unit:@"derivations" work:count block:^(void) {
+    for (NSUInteger i = 0; i < count; i++) {
+      [Rfc2898DeriveBytes deriveKey:[NSMutableData data]
+                              andIV:[NSMutableData data]
+                       fromPassword:@"Orwell."
+                            andSalt:salt];
+    }
+  }];
+}
+
+- (void)testKeyFileUnlock {
+
+  KeyFileDecryptor *encryptor = [[[KeyFileDecryptor alloc] init] autorelease];
+  encryptor.key = key_;
+  encryptor.iv = iv_;
+  encryptor.fileName = @"C0EA1C21637F34C238D6462569474524F5C393D1.jpg";
+  encryptor.password = @"Orwell.";
+  NSData *keyFile = [encryptor encryptedBlob];
+  STAssertEqualObjects(key_, [KeyFileDecryptor decryptorWithData:keyFile andPassword:@"Orwell."].key, nil);
+
+  NSUInteger count = 10;
+  [benchmark_ measure:@"key file unlock" unit:@"unlocks" work:count block:^(void) {
+    for (NSUInteger i = 0; i < count; i++) {
+      [KeyFileDecryptor decryptorWithData:keyFile andPassword:@"Orwell."];
+    }
+  }];
+}
+
+//
+//  One-shot AES, both for key-file sized buffers and whole files.
+//
+
+- (void)testAESOneShot {
+
+  NSUInteger sizes[] = { 256, 64 * 1024, 4 * 1024 * 1024 };
+  for (NSUInteger i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    NSData *clearText = [NSData dataWithRandomBytes:sizes[i]];
+    NSData *cipherText = [clearText aesEncryptWithKey:key_ andIV:iv_];
+    STAssertEqualObjects(clearText, [cipherText aesDecryptWithKey:key_ andIV:iv_], nil);
+    NSUInteger count = MAX(1, (1024 * 1024) / sizes[i]);
+    [benchmark_ measure:[NSString stringWithFormat:@"aesDecrypt %u bytes", sizes[i]]
+                   unit:@"MB"
+                   work:[self megabytes:sizes[i] * count]
+                  block:^(void) {
+                    for (NSUInteger j = 0; j < count; j++) {
+                      [cipherText aesDecryptWithKey:key_ andIV:iv_];
+                    }
+                  }];
+  }
+}
+
+//
+//  Streaming decryption of a 4MB file at a range of block sizes.
+//
+
+- (void)testDecryptionStateMachine {
+
+  NSUInteger length = 4 * 1024 * 1024;
+  NSData *clearText = [NSData dataWithRandomBytes:length];
+  NSString *inputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CryptoBenchmarkTest.dat"];
+  NSString *outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CryptoBenchmarkTest.out"];
+  [[clearText aesEncryptWithKey:key_ andIV:iv_] writeToFile:inputPath atomically:NO];
+
+  [self decryptFile:inputPath toPath:outputPath blockSize:kDecryptionStateMachineBlockSize];
+  STAssertTrue(didFinish_, nil);
+  STAssertEqualObjects(clearText, [NSData dataWithContentsOfFile:outputPath], nil);
+
+  NSUInteger blockSizes[] = { 512, kDecryptionStateMachineBlockSize, 16 * 1024, 64 * 1024, 256 * 1024 };
+  for (NSUInteger i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); i++) {
+    NSUInteger blockSize = blockSizes[i];
+    [benchmark_ measure:[NSString stringWithFormat:@"DecryptionStateMachine %u byte blocks", blockSize]
+                   unit:@"MB"
+                   work:[self megabytes:length]
+                  block:^(void) {
+                    [self decryptFile:inputPath toPath:outputPath blockSize:blockSize];
+                  }];
+  }
+  [[NSFileManager defaultManager] removeItemAtPath:inputPath error:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:outputPath error:nil];
+}
+
+//
+//  Compressing before encrypting, over a corpus of typical vault files:
+//  how much each kind shrinks, how fast it compresses on save, and what
+//  inflating costs the streaming decryption on open.
+//
+
+- (void)testCompression {
+
+  NSString *inputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CryptoBenchmarkTest.dat"];
+  NSString *outputPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"CryptoBenchmarkTest.out"];
+  NSDictionary *corpus = [self compressionCorpusOfLength:1024 * 1024];
+  for (NSString *kind in [[corpus allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+    NSData *clearText = [corpus objectForKey:kind];
+    NSData *deflated = [clearText zlibDeflate];
+    STAssertEqualObjects(clearText, [deflated zlibInflate], nil);
+    NSLog(@"%s -- %@: %u bytes compress to %u, ratio %.2f",
+          __PRETTY_FUNCTION__,
+          kind,
+          [clearText length],
+          [deflated length],
+          (double)[clearText length] / [deflated length]);
+
+    [benchmark_ measure:[NSString stringWithFormat:@"zlibDeflate %@", kind]
+                   unit:@"MB"
+                   work:[self megabytes:[clearText length]]
+                  block:^(void) {
+                    [clearText zlibDeflate];
+                  }];
+
+    [[clearText aesEncryptWithKey:key_ andIV:iv_] writeToFile:inputPath atomically:NO];
+    [benchmark_ measure:[NSString stringWithFormat:@"DecryptionStateMachine %@", kind]
+                   unit:@"MB"
+                   work:[self megabytes:[clearText length]]
+                  block:^(void) {
+                    [self decryptFile:inputPath toPath:outputPath blockSize:kDecryptionStateMachineBlockSize];
+                  }];
+
+    [[deflated aesEncryptWithKey:key_ andIV:iv_] writeToFile:inputPath atomically:NO];
+    [self decryptFile:inputPath toPath:outputPath blockSize:kDecryptionStateMachineBlockSize compressed:YES];
+    STAssertTrue(didFinish_, nil);
+    STAssertEqualObjects(clearText, [NSData dataWithContentsOfFile:outputPath], nil);
+    [benchmark_ measure:[NSString stringWithFormat:@"DecryptionStateMachine compressed %@", kind]
+                   unit:@"MB"
+                   work:[self megabytes:[clearText length]]
+                  block:^(void) {
+                    [self decryptFile:inputPath
+                               toPath:outputPath
+                            blockSize:kDecryptionStateMachineBlockSize
+                           compressed:YES];
+                  }];
+  }
+  [[NSFileManager defaultManager] removeItemAtPath:inputPath error:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:outputPath error:nil];
+}
+
+- (void)testHex {
+
+  NSData *data = [NSData dataWithRandomBytes:64 * 1024];
+  NSString *hex = [data hexString];
+  STAssertEqualObjects(data, [NSData dataWithHexString:hex], nil);
+  [benchmark_ measure:@"hexString" unit:@"MB" work:[self megabytes:[data length]] block:^(void) {
+    [data hexString];
+  }];
+  [benchmark_ measure:@"dataWithHexString" unit:@"MB" work:[self megabytes:[data length]] block:^(void) {
+    [NSData dataWithHexString:hex];
+  }];
+}
+
+//
+//  The Base64 transcoder the OAuth signer uses.
+//
+
+- (void)testBase64 {
+
+  NSData *data = [NSData dataWithRandomBytes:64 * 1024];
+  size_t encodedCapacity = EstimateBas64EncodedDataSize([data length]);
+  NSMutableData *encoded = [NSMutableData dataWithLength:encodedCapacity];
+  size_t encodedLength = encodedCapacity;
+  STAssertTrue(Base64EncodeData([data bytes], [data length], [encoded mutableBytes], &encodedLength), nil);
+  NSMutableData *decoded = [NSMutableData dataWithLength:EstimateBas64DecodedDataSize(encodedLength)];
+  size_t decodedLength = [decoded length];
+  STAssertTrue(Base64DecodeData([encoded bytes], encodedLength, [decoded mutableBytes], &decodedLength), nil);
+  STAssertEquals((size_t)[data length], decodedLength, nil);
+
+  [benchmark_ measure:@"Base64 encode" unit:@"MB" work:[self megabytes:[data length]] block:^(void) {
+    size_t length = encodedCapacity;
+    Base64EncodeData([data bytes], [data length], [encoded mutableBytes], &length);
+  }];
+  [benchmark_ measure:@"Base64 decode" unit:@"MB" work:[self megabytes:[data length]] block:^(void) {
+    size_t length = [decoded length];
+    Base64DecodeData([encoded bytes], encodedLength, [decoded mutableBytes], &length);
+  }];
+}
+
+#pragma mark -
+#pragma mark DecryptionStateMachineDelegate
+
+- (void)decryptionStateMachine:(DecryptionStateMachine *)stateMachine
+               didDecryptBytes:(unsigned long long)bytesDecrypted
+                    outOfBytes:(unsigned long long)totalBytes {
+}
+
+- (void)decryptionStateMachineDidFinish:(DecryptionStateMachine *)stateMachine {
+  didFinish_ = YES;
+}
+
+- (void)decryptionStateMachineDidFail:(DecryptionStateMachine *)stateMachine {
+  didFinish_ = NO;
+}
+
+- (void)decryptionStateMachine:(DecryptionStateMachine *)stateMachine
+               willQueueAction:(SEL)action {
+  pendingAction_ = action;
+}
+
+@end
@@ -0,0 +1,266 @@
+//
+//  DBMetadataParserTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/6/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DropboxSDK.h"
+#import "DBMetadataParser.h"
+#import "JSON.h"
+#import "DVBenchmark.h"
+
+@interface DBMetadataParserTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DBMetadataParserTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Builds metadata the old way: a full JSON DOM, then |initWithDictionary:|.
+//
+
+- (DBMetadata *)metadataFromDOMWithData:(NSData *)data {
+
+  NSString *string = [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+  return [[[DBMetadata alloc] initWithDictionary:[string JSONValue]] autorelease];
+}
+
+//
+//  Asserts that two metadata entries, and their contents, have the same values.
+//
+
+- (void)assertMetadata:(DBMetadata *)actual equals:(DBMetadata *)expected {
+
+  STAssertEqualStrings(expected.path, actual.path, nil);
+  STAssertEqualStrings(expected.hash, actual.hash, nil);
+  STAssertEqualStrings(expected.humanReadableSize, actual.humanReadableSize, nil);
+  STAssertEqualStrings(expected.root, actual.root, nil);
+  STAssertEqualStrings(expected.icon, actual.icon, nil);
+  STAssertEquals(expected.totalBytes, actual.totalBytes, nil);
+  STAssertEquals(expected.revision, actual.revision, nil);
+  STAssertEquals(expected.isDirectory, actual.isDirectory, nil);
+  STAssertEquals(expected.isDeleted, actual.isDeleted, nil);
+  STAssertEquals(expected.thumbnailExists, actual.thumbnailExists, nil);
+  STAssertEqualObjects(expected.lastModifiedDate, actual.lastModifiedDate, nil);
+  STAssertEquals([expected.contents count], [actual.contents count], nil);
+  STAssertEquals((expected.contents == nil), (actual.contents == nil), nil);
+  for (NSUInteger i = 0; i < [expected.contents count]; i++) {
+    [self assertMetadata:[actual.contents objectAtIndex:i]
+                  equals:[expected.contents objectAtIndex:i]];
+  }
+}
+
+//
+//  Creates the JSON for a listing of |count| files, with the unknown keys and
+//  nested values a real response has.
+//
+
+- (NSData *)listingWithCount:(NSUInteger)count {
+
+  NSMutableString *json = [NSMutableString stringWithString:
+                           @"{\"hash\": \"6a29b68d106bda4473ffdaf2e94c4b61\", \"thumb_exists\": false, "
+                           @"\"bytes\": 0, \"path\": \"/StrongBox\", \"is_dir\": true, "
+                           @"\"size\": \"0 bytes\", \"root\": \"dropbox\", \"icon\": \"folder\", "
+                           @"\"extra\": {\"nested\": [1, 2, {\"deep\": null}]}, \"contents\": ["];
+  for (NSUInteger i = 0; i < count; i++) {
+    [json appendFormat:@"%@{\"revision\": %u, \"thumb_exists\": %@, \"bytes\": %u, "
+     @"\"modified\": \"Sat, 12 Mar 2011 20:%02u:00 -0800\", \"path\": \"/StrongBox/file\\u00e9-%u.dat\", "
+     @"\"is_dir\": false, \"icon\": \"page_white\", \"root\": \"dropbox\", "
+     @"\"mime_type\": \"application/octet-stream\", \"size\": \"%u bytes\"}",
+     (i == 0) ? @"" : @", ",
+     i,
+     (i % 3 == 0) ? @"true" : @"false",
+     i * 1024,
+     i % 60,
+     i,
+     i * 1024];
+  }
+  [json appendString:@"]}"];
+  return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  The parser has to produce exactly what the DOM path produces for the
+//  metadata files we test with elsewhere.
+//
+
+- (void)testMatchesDOMForTestData {
+
+  NSArray *files = [NSArray arrayWithObjects:@"DropBoxMetadata.json",
+                    @"MetadataAddFiles.json",
+                    @"MetadataRemoveFiles.json",
+                    @"MetadataSidecarFiles.json",
+                    nil];
+  NSString *bundlePath = [[NSBundle mainBundle] bundlePath];
+  for (NSString *file in files) {
+    NSData *data = [NSData dataWithContentsOfFile:[bundlePath stringByAppendingPathComponent:file]];
+    STAssertNotNil(data, @"Should load %@", file);
+    DBMetadata *metadata = [DBMetadataParser metadataWithData:data];
+    STAssertNotNil(metadata, @"Should parse %@", file);
+    [self assertMetadata:metadata equals:[self metadataFromDOMWithData:data]];
+  }
+}
+
+- (void)testMatchesDOMForListing {
+
+  NSData *data = [self listingWithCount:200];
+  DBMetadata *metadata = [DBMetadataParser metadataWithData:data];
+  STAssertNotNil(metadata, nil);
+  STAssertEquals((NSUInteger)200, [metadata.contents count], nil);
+  STAssertEqualStrings(@"/StrongBox/file\u00e9-7.dat", [[metadata.contents objectAtIndex:7] path], nil);
+  [self assertMetadata:metadata equals:[self metadataFromDOMWithData:data]];
+}
+
+//
+//  Feeding the response in chunks of any size, so tokens are cut off at every
+//  possible place, gives the same result as parsing it in one go.
+//
+
+- (void)testIncrementalMatchesWhole {
+
+  NSData *data = [self listingWithCount:50];
+  DBMetadata *expected = [DBMetadataParser metadataWithData:data];
+  const char *bytes = [data bytes];
+  NSUInteger chunkSizes[] = { 1, 2, 3, 7, 64, 1000, [data length] };
+  DBMetadataParser *parser = [[[DBMetadataParser alloc] init] autorelease];
+
+  for (NSUInteger i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+    for (NSUInteger offset = 0; offset < [data length]; offset += chunkSizes[i]) {
+      NSUInteger length = MIN(chunkSizes[i], [data length] - offset);
+      STAssertTrue([parser appendBytes:bytes + offset length:length], nil);
+    }
+    DBMetadata *metadata = [parser finish];
+    STAssertNotNil(metadata, @"Chunk size %u", chunkSizes[i]);
+    [self assertMetadata:metadata equals:expected];
+  }
+}
+
+//
+//  Errors show up as soon as the chunk with the bad byte arrives, and a
+//  response cut off partway through is reported when it's finished.
+//
+
+- (void)testIncrementalErrors {
+
+  DBMetadataParser *parser = [[[DBMetadataParser alloc] init] autorelease];
+  STAssertTrue([parser appendData:[@"{\"path\": \"/fo" dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertNil(parser.error, nil);
+  STAssertFalse([parser appendData:[@"o\", \"bytes\": 01, " dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertEquals((NSInteger)EPARSENUM, [parser.error code], nil);
+  STAssertFalse([parser appendData:[@"}" dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertNil([parser finish], nil);
+  STAssertEquals((NSInteger)EPARSENUM, [parser.error code], nil);
+
+  STAssertTrue([parser appendData:[@"{\"path\": \"/fo" dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertNil(parser.error, @"A new response starts clean");
+  STAssertNil([parser finish], nil);
+  STAssertEquals((NSInteger)EEOF, [parser.error code], nil);
+
+  STAssertTrue([parser appendData:[@"{\"bytes\": 12" dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertTrue([parser appendData:[@"34}" dataUsingEncoding:NSUTF8StringEncoding]], nil);
+  STAssertEquals(1234LL, [parser finish].totalBytes, @"Numbers continue across chunks");
+}
+
+//
+//  Malformed input is rejected with the same error codes |SBJsonParser| uses.
+//
+
+- (void)testErrors {
+
+  NSDictionary *cases = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithInt:EEOF], @"{\"path\": \"/foo\"",
+                         [NSNumber numberWithInt:ETRAILCOMMA], @"{\"path\": \"/foo\",}",
+                         [NSNumber numberWithInt:ETRAILGARBAGE], @"{} x",
+                         [NSNumber numberWithInt:EPARSENUM], @"{\"bytes\": 01}",
+                         [NSNumber numberWithInt:EESCAPE], @"{\"path\": \"\\q\"}",
+                         [NSNumber numberWithInt:EFRAGMENT], @"[1, 2]",
+                         [NSNumber numberWithInt:EPARSE], @"{\"path\" \"/foo\"}",
+                         nil];
+  for (NSString *json in cases) {
+    DBMetadataParser *parser = [[[DBMetadataParser alloc] init] autorelease];
+    const char *bytes = [json UTF8String];
+    STAssertNil([parser parseBytes:bytes length:strlen(bytes)], @"Should reject %@", json);
+    STAssertEqualStrings(SBJSONErrorDomain, [parser.error domain], nil);
+    STAssertEquals([[cases objectForKey:json] integerValue], [parser.error code],
+                   @"Error code for %@", json);
+  }
+}
+
+//
+//  Benchmark: the streaming parser against SBJsonParser + initWithDictionary:
+//  for a large directory listing.
+//
+
+- (void)testParseBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSData *data = [self listingWithCount:20000];
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [self metadataFromDOMWithData:data];
+  CFAbsoluteTime dom = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  [DBMetadataParser metadataWithData:data];
+  CFAbsoluteTime streaming = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  //
+  //  Incrementally, in network-sized chunks. What counts is how long it takes
+  //  to get the metadata once the last chunk is in.
+  //
+
+  pool = [[NSAutoreleasePool alloc] init];
+  DBMetadataParser *parser = [[[DBMetadataParser alloc] init] autorelease];
+  NSUInteger chunkSize = 16 * 1024;
+  NSUInteger lastOffset = ([data length] - 1) / chunkSize * chunkSize;
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger offset = 0; offset < lastOffset; offset += chunkSize) {
+    [parser appendBytes:(const char *)[data bytes] + offset length:chunkSize];
+  }
+  CFAbsoluteTime incremental = CFAbsoluteTimeGetCurrent() - start;
+  start = CFAbsoluteTimeGetCurrent();
+  [parser appendBytes:(const char *)[data bytes] + lastOffset length:[data length] - lastOffset];
+  STAssertNotNil([parser finish], nil);
+  CFAbsoluteTime lastChunk = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  NSLog(@"%s -- %u bytes: DOM %.3fs, streaming %.3fs, incremental %.3fs + %.4fs after the last chunk",
+        __PRETTY_FUNCTION__,
+        [data length],
+        dom,
+        streaming,
+        incremental,
+        lastChunk);
+}
+
+@end
@@ -0,0 +1,186 @@
+//
+//  DBMetadataTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/4/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DropboxSDK.h"
+#import "DVBenchmark.h"
+
+//
+//  Exposes the formatter that |DBMetadata| falls back to, so we can compare
+//  against it.
+//
+
+@interface DBMetadata (DBMetadataTest)
+
++ (NSDateFormatter *)dateFormatter;
+
+@end
+
+@interface DBMetadataTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DBMetadataTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Creates |count| date strings spread over a wide range of dates and time
+//  zones, formatted the way the DropBox API formats them.
+//
+
+- (NSArray *)dateStringsWithCount:(NSUInteger)count {
+
+  NSDateFormatter *formatter = [[[NSDateFormatter alloc] init] autorelease];
+  formatter.locale = [[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease];
+  formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss Z";
+  NSArray *timeZones = [NSArray arrayWithObjects:@"GMT", @"America/Los_Angeles", @"Asia/Kolkata",
+                        @"America/St_Johns", @"Pacific/Chatham", nil];
+
+  NSMutableArray *strings = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    formatter.timeZone = [NSTimeZone timeZoneWithName:[timeZones objectAtIndex:i % [timeZones count]]];
+    NSTimeInterval interval = (NSTimeInterval)((i * 7919u * 104729u) % 2000000000u);
+    [strings addObject:[formatter stringFromDate:[NSDate dateWithTimeIntervalSince1970:interval]]];
+  }
+  return strings;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  The fast parser has to agree with |NSDateFormatter| on everything the
+//  formatter produces.
+//
+
+- (void)testDateFromStringMatchesFormatter {
+
+  NSDateFormatter *formatter = [DBMetadata dateFormatter];
+  for (NSString *string in [self dateStringsWithCount:5000]) {
+
+    const char *bytes = [string UTF8String];
+    NSTimeInterval interval;
+    STAssertTrue(DBMetadataParseDate(bytes, strlen(bytes), &interval),
+                 @"Fast path should handle %@", string);
+    STAssertEquals([[formatter dateFromString:string] timeIntervalSince1970],
+                   interval,
+                   @"Parsed value of %@", string);
+  }
+}
+
+//
+//  Known values, including leap days and time zone offsets.
+//
+
+- (void)testKnownDates {
+
+  STAssertEquals(1299992280.0,
+                 [[DBMetadata dateFromString:@"Sat, 12 Mar 2011 20:58:00 -0800"] timeIntervalSince1970],
+                 nil);
+  STAssertEquals(951782400.0,
+                 [[DBMetadata dateFromString:@"Tue, 29 Feb 2000 00:00:00 +0000"] timeIntervalSince1970],
+                 nil);
+  STAssertEquals(0.0,
+                 [[DBMetadata dateFromString:@"Thu, 01 Jan 1970 05:30:00 +0530"] timeIntervalSince1970],
+                 nil);
+  STAssertNil([DBMetadata dateFromString:nil], nil);
+}
+
+//
+//  Anything that isn't the exact layout goes to the formatter, which gets the
+//  final say.
+//
+
+- (void)testUnexpectedInputFallsBack {
+
+  NSArray *unexpected = [NSArray arrayWithObjects:@"",
+                         @"2011-03-12T20:58:00Z",
+                         @"Sat, 12 Mar 2011 20:58:00",
+                         @"Sat, 12 mar 2011 20:58:00 -0800",
+                         @"Mon, 29 Feb 2011 20:58:00 +0000",
+                         @"Sat, 12 Mar 2011 24:00:00 +0000",
+                         @"Sat, 12 Mar 2011 20:58:00 -0800 ",
+                         nil];
+  NSDateFormatter *formatter = [DBMetadata dateFormatter];
+  for (NSString *string in unexpected) {
+
+    const char *bytes = [string UTF8String];
+    NSTimeInterval interval;
+    STAssertFalse(DBMetadataParseDate(bytes, strlen(bytes), &interval),
+                  @"Should not parse '%@'", string);
+    STAssertEqualObjects([formatter dateFromString:string],
+                         [DBMetadata dateFromString:string],
+                         @"Should match formatter for '%@'", string);
+  }
+}
+
+//
+//  Benchmark: building the metadata for a large listing, with the fast date
+//  parser and with the formatter alone.
+//
+
+- (void)testParseBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSUInteger count = 20000;
+  NSArray *dates = [self dateStringsWithCount:count];
+  NSMutableArray *contents = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    [contents addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSString stringWithFormat:@"/StrongBox/file-%u.dat", i], @"path",
+                         [dates objectAtIndex:i], @"modified",
+                         [NSNumber numberWithLongLong:i], @"bytes",
+                         nil]];
+  }
+  NSDictionary *listing = [NSDictionary dictionaryWithObjectsAndKeys:
+                           kDropVaultPath, @"path",
+                           contents, @"contents",
+                           nil];
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [[[DBMetadata alloc] initWithDictionary:listing] release];
+  CFAbsoluteTime fast = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  NSDateFormatter *formatter = [DBMetadata dateFormatter];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSString *date in dates) {
+    [formatter dateFromString:date];
+  }
+  CFAbsoluteTime formatterOnly = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  NSLog(@"%s -- %u entries: initWithDictionary: %.3fs; NSDateFormatter alone %.3fs",
+        __PRETTY_FUNCTION__,
+        count,
+        fast,
+        formatterOnly);
+}
+
+@end
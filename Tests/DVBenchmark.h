@@ -0,0 +1,141 @@
+//
+//  DVBenchmark.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+//  Keys of each result dictionary returned by |measure:...| and |results|.
+//  Rates are in |unit| per second; |samples| holds the rate of each
+//  repetition, in order.
+//
+
+#define kDVBenchmarkName                @"name"
+#define kDVBenchmarkUnit                @"unit"
+#define kDVBenchmarkWarmUp              @"warmUp"
+#define kDVBenchmarkRepetitions         @"repetitions"
+#define kDVBenchmarkSamples             @"samples"
+#define kDVBenchmarkMean                @"mean"
+#define kDVBenchmarkMedian              @"median"
+#define kDVBenchmarkMin                 @"min"
+#define kDVBenchmarkMax                 @"max"
+#define kDVBenchmarkStandardDeviation   @"stddev"
+#define kDVBenchmarkVariance            @"variance"
+
+//
+//  Benchmark tests, and tests that build very large vaults, only run when
+//  this is turned on: as an environment variable (which wins), or as a user
+//  default, which can be passed as a launch argument.
+//
+
+#define kDVBenchmarkEnabledKey          @"DVBenchmarkEnabled"
+
+//
+//  The first line of every benchmark test: returns from the test unless
+//  benchmarks are enabled.
+//
+
+#define DVBenchmarkReturnUnlessEnabled()  \
+  do {                                    \
+    if (![DVBenchmark isEnabled]) {       \
+      return;                             \
+    }                                     \
+  } while (0)
+
+//
+//  Runs microbenchmarks the same way every time: a few untimed warm-up runs,
+//  then a fixed number of timed repetitions, each in its own autorelease
+//  pool. Each result carries the rate of every repetition and its mean,
+//  median, spread, and variance, so two builds can be compared by more than
+//  a single number.
+//
+//  Results are collected in the order they're measured and can be written
+//  out as JSON.
+//
+
+@interface DVBenchmark : NSObject {
+
+@private
+  NSUInteger warmUp_;
+  NSUInteger repetitions_;
+  NSMutableArray *results_;
+}
+
+//
+//  Creates a benchmark that runs each block |warmUp| times untimed, then
+//  |repetitions| times timed. |repetitions| must be at least 1.
+//
+
+- (id)initWithWarmUp:(NSUInteger)warmUp repetitions:(NSUInteger)repetitions;
+
+@property (nonatomic, readonly) NSUInteger warmUp;
+@property (nonatomic, readonly) NSUInteger repetitions;
+
+//
+//  Every result measured so far.
+//
+
+@property (nonatomic, readonly) NSArray *results;
+
+//
+//  Times |block| and records the result under |name|. Each run of |block|
+//  does |work| units of |unit| -- operations, or megabytes -- and the rate
+//  of a repetition is |work| divided by its time.
+//
+
+- (NSDictionary *)measure:(NSString *)name
+                     unit:(NSString *)unit
+                     work:(double)work
+                    block:(void (^)(void))block;
+
+//
+//  One line per result: name, mean rate and unit, and relative standard
+//  deviation.
+//
+
+- (NSString *)report;
+
+//
+//  Writes |results| to |path| as JSON. Returns |NO| if it can't.
+//
+
+- (BOOL)writeResultsToFile:(NSString *)path;
+
+//
+//  The mean, median, min, max, standard deviation and variance of
+//  |samples|, an array of |NSNumber|. The variance is the sample variance.
+//
+
++ (NSDictionary *)statisticsForSamples:(NSArray *)samples;
+
+//
+//  YES if |kDVBenchmarkEnabledKey| is on. Benchmark tests return straight
+//  away when it isn't; see |DVBenchmarkReturnUnlessEnabled|.
+//
+
++ (BOOL)isEnabled;
+
+//
+//  Where benchmark tests write their results: |name| plus |.json| in the
+//  caches directory.
+//
+
++ (NSString *)defaultResultsPathForName:(NSString *)name;
+
+@end
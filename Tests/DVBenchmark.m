@@ -0,0 +1,155 @@
+//
+//  DVBenchmark.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "DVBenchmark.h"
+#import "NSObject+SBJSON.h"
+
+@implementation DVBenchmark
+
+@synthesize warmUp = warmUp_, repetitions = repetitions_;
+
+- (id)initWithWarmUp:(NSUInteger)warmUp repetitions:(NSUInteger)repetitions {
+
+  _GTMDevAssert(repetitions > 0, @"repetitions must be at least 1");
+  self = [super init];
+  if (self != nil) {
+    warmUp_ = warmUp;
+    repetitions_ = repetitions;
+    results_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [results_ release];
+  [super dealloc];
+}
+
+- (NSArray *)results {
+
+  return [NSArray arrayWithArray:results_];
+}
+
+- (NSDictionary *)measure:(NSString *)name
+                     unit:(NSString *)unit
+                     work:(double)work
+                    block:(void (^)(void))block {
+
+  for (NSUInteger i = 0; i < warmUp_; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    block();
+    [pool drain];
+  }
+
+  NSMutableArray *samples = [NSMutableArray arrayWithCapacity:repetitions_];
+  for (NSUInteger i = 0; i < repetitions_; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    block();
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    [pool drain];
+    [samples addObject:[NSNumber numberWithDouble:work / MAX(elapsed, 1e-9)]];
+  }
+
+  NSMutableDictionary *result = [NSMutableDictionary dictionaryWithDictionary:
+                                 [DVBenchmark statisticsForSamples:samples]];
+  [result setObject:name forKey:kDVBenchmarkName];
+  [result setObject:unit forKey:kDVBenchmarkUnit];
+  [result setObject:[NSNumber numberWithUnsignedInteger:warmUp_] forKey:kDVBenchmarkWarmUp];
+  [result setObject:[NSNumber numberWithUnsignedInteger:repetitions_] forKey:kDVBenchmarkRepetitions];
+  [result setObject:samples forKey:kDVBenchmarkSamples];
+  [results_ addObject:result];
+  return result;
+}
+
+- (NSString *)report {
+
+  NSMutableString *report = [NSMutableString string];
+  for (NSDictionary *result in results_) {
+    double mean = [[result objectForKey:kDVBenchmarkMean] doubleValue];
+    double deviation = [[result objectForKey:kDVBenchmarkStandardDeviation] doubleValue];
+    [report appendFormat:@"%@ %12.2f %@/s +/- %4.1f%%\n",
+     [[result objectForKey:kDVBenchmarkName] stringByPaddingToLength:40 withString:@" " startingAtIndex:0],
+     mean,
+     [result objectForKey:kDVBenchmarkUnit],
+     mean > 0 ? deviation / mean * 100 : 0];
+  }
+  return report;
+}
+
+- (BOOL)writeResultsToFile:(NSString *)path {
+
+  NSDictionary *output = [NSDictionary dictionaryWithObjectsAndKeys:
+                          results_, @"results",
+                          [[NSDate date] description], @"date",
+                          nil];
+  NSData *data = [[output JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+  return [data writeToFile:path atomically:YES];
+}
+
++ (NSDictionary *)statisticsForSamples:(NSArray *)samples {
+
+  NSUInteger count = [samples count];
+  if (count == 0) {
+    return [NSDictionary dictionary];
+  }
+  NSArray *sorted = [samples sortedArrayUsingSelector:@selector(compare:)];
+  double sum = 0;
+  for (NSNumber *sample in samples) {
+    sum += [sample doubleValue];
+  }
+  double mean = sum / count;
+  double squares = 0;
+  for (NSNumber *sample in samples) {
+    double difference = [sample doubleValue] - mean;
+    squares += difference * difference;
+  }
+  double variance = (count > 1) ? squares / (count - 1) : 0;
+  double median = [[sorted objectAtIndex:count / 2] doubleValue];
+  if (count % 2 == 0) {
+    median = (median + [[sorted objectAtIndex:count / 2 - 1] doubleValue]) / 2;
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithDouble:mean], kDVBenchmarkMean,
+          [NSNumber numberWithDouble:median], kDVBenchmarkMedian,
+          [sorted objectAtIndex:0], kDVBenchmarkMin,
+          [sorted lastObject], kDVBenchmarkMax,
+          [NSNumber numberWithDouble:sqrt(variance)], kDVBenchmarkStandardDeviation,
+          [NSNumber numberWithDouble:variance], kDVBenchmarkVariance,
+          nil];
+}
+
++ (BOOL)isEnabled {
+
+  NSString *environment = [[[NSProcessInfo processInfo] environment] objectForKey:kDVBenchmarkEnabledKey];
+  if (environment != nil) {
+    return [environment boolValue];
+  }
+  return [[NSUserDefaults standardUserDefaults] boolForKey:kDVBenchmarkEnabledKey];
+}
+
++ (NSString *)defaultResultsPathForName:(NSString *)name {
+
+  NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+  return [caches stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"json"]];
+}
+
+@end
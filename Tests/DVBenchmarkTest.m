@@ -0,0 +1,97 @@
+//
+//  DVBenchmarkTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVBenchmark.h"
+#import "NSString+SBJSON.h"
+
+@interface DVBenchmarkTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVBenchmarkTest
+
+- (void)testStatistics {
+
+  NSArray *samples = [NSArray arrayWithObjects:
+                      [NSNumber numberWithDouble:4],
+                      [NSNumber numberWithDouble:2],
+                      [NSNumber numberWithDouble:8],
+                      [NSNumber numberWithDouble:6],
+                      nil];
+  NSDictionary *statistics = [DVBenchmark statisticsForSamples:samples];
+  STAssertEqualsWithAccuracy(5.0, [[statistics objectForKey:kDVBenchmarkMean] doubleValue], 1e-9, nil);
+  STAssertEqualsWithAccuracy(5.0, [[statistics objectForKey:kDVBenchmarkMedian] doubleValue], 1e-9, nil);
+  STAssertEqualsWithAccuracy(2.0, [[statistics objectForKey:kDVBenchmarkMin] doubleValue], 1e-9, nil);
+  STAssertEqualsWithAccuracy(8.0, [[statistics objectForKey:kDVBenchmarkMax] doubleValue], 1e-9, nil);
+  STAssertEqualsWithAccuracy(20.0 / 3.0, [[statistics objectForKey:kDVBenchmarkVariance] doubleValue], 1e-9,
+                             @"Sample variance divides by n - 1");
+  STAssertEqualsWithAccuracy(sqrt(20.0 / 3.0),
+                             [[statistics objectForKey:kDVBenchmarkStandardDeviation] doubleValue],
+                             1e-9,
+                             nil);
+
+  statistics = [DVBenchmark statisticsForSamples:[NSArray arrayWithObject:[NSNumber numberWithDouble:3]]];
+  STAssertEqualsWithAccuracy(3.0, [[statistics objectForKey:kDVBenchmarkMedian] doubleValue], 1e-9, nil);
+  STAssertEqualsWithAccuracy(0.0, [[statistics objectForKey:kDVBenchmarkVariance] doubleValue], 1e-9, nil);
+}
+
+//
+//  Warm-up runs aren't timed; every repetition gets a sample.
+//
+
+- (void)testMeasure {
+
+  DVBenchmark *benchmark = [[[DVBenchmark alloc] initWithWarmUp:2 repetitions:5] autorelease];
+  __block NSUInteger runs = 0;
+  NSDictionary *result = [benchmark measure:@"count" unit:@"ops" work:100 block:^(void) {
+    runs++;
+  }];
+  STAssertEquals((NSUInteger)7, runs, nil);
+  STAssertEquals((NSUInteger)5, [[result objectForKey:kDVBenchmarkSamples] count], nil);
+  STAssertEqualStrings(@"count", [result objectForKey:kDVBenchmarkName], nil);
+  STAssertEqualStrings(@"ops", [result objectForKey:kDVBenchmarkUnit], nil);
+  STAssertTrue([[result objectForKey:kDVBenchmarkMin] doubleValue] > 0, nil);
+  STAssertEquals((NSUInteger)1, [benchmark.results count], nil);
+  STAssertTrue([[benchmark report] rangeOfString:@"count"].location != NSNotFound, nil);
+}
+
+- (void)testWriteResults {
+
+  DVBenchmark *benchmark = [[[DVBenchmark alloc] initWithWarmUp:0 repetitions:3] autorelease];
+  [benchmark measure:@"first" unit:@"ops" work:1 block:^(void) { }];
+  [benchmark measure:@"second" unit:@"MB" work:1 block:^(void) { }];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"DVBenchmarkTest.json"];
+  STAssertTrue([benchmark writeResultsToFile:path], nil);
+
+  NSDictionary *output = [[NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL] JSONValue];
+  NSArray *results = [output objectForKey:@"results"];
+  STAssertEquals((NSUInteger)2, [results count], nil);
+  STAssertEqualStrings(@"second", [[results objectAtIndex:1] objectForKey:kDVBenchmarkName], nil);
+  STAssertEquals((NSUInteger)3, [[[results objectAtIndex:0] objectForKey:kDVBenchmarkSamples] count], nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+@end
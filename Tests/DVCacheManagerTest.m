@@ -195,13 +195,22 @@
   
   //
   //  Now, create a new |DVCacheManager|. This should load the metadata that we
-  //  persisted from the prior incantation.
+  //  persisted from the prior incantation -- but not until it's asked for.
   //
   
   DVCacheManager *reloaded = [[[DVCacheManager alloc] init] autorelease];
+  STAssertNil([reloaded valueForKey:@"metadata_"], @"Metadata shouldn't be read during init");
   STAssertNotNil(reloaded.metadata, @"Cache managers should reload metadata");
   STAssertEqualStrings(cm.metadata.hash, reloaded.metadata.hash,
                        @"Reloaded metadata should have the same hash value");
+  
+  //
+  //  Metadata that's set before the first read wins over the saved copy.
+  //
+  
+  reloaded = [[[DVCacheManager alloc] init] autorelease];
+  reloaded.metadata = nil;
+  STAssertNil(reloaded.metadata, @"Set metadata shouldn't be replaced by the saved copy");
 }
 
 - (void)testLoadMetadataNoDelegate {
@@ -531,6 +540,72 @@
                  @"Deleted files should be tombstoned");
 }
 
+//
+//  Test batch deletion: tombstones go on together, only
+//  |kDVCacheManagerMaxConcurrentDeletes| deletes are in flight at once, and
+//  the metadata is reloaded once, at the end.
+//
+
+- (void)testDeleteDropBoxPaths {
+  
+  DVCacheManager *cm = [[[DVCacheManager alloc] init] autorelease];
+  NSString *path = [DVCacheManager cachePathForDropBoxPath:kSimpleMetadataPath];
+  DBMetadata *metadata = [[[DBMetadata alloc] initWithDictionary:[self getMetadataDictionaryForPath:@"simple-metadata.plist"]] 
+                          autorelease];
+  [cm restClient:nil loadedMetadata:metadata];
+  [self createTestContentAtPath:path];
+  
+  NSMutableArray *paths = [NSMutableArray arrayWithObject:kSimpleMetadataPath];
+  for (NSUInteger i = 0; i < 9; i++) {
+    [paths addObject:[NSString stringWithFormat:@"/StrongBox/batch%u.dat", i]];
+  }
+  id mockClient = [OCMockObject mockForClass:[DBRestClient class]];
+  for (NSUInteger i = 0; i < kDVCacheManagerMaxConcurrentDeletes; i++) {
+    [[mockClient expect] deletePath:[paths objectAtIndex:i]];
+  }
+  cm.restClient = mockClient;
+  [cm deleteDropBoxPaths:paths];
+  STAssertNoThrow([mockClient verify], @"Should only start the first deletes");
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path],
+                @"Cached copy should be deleted");
+  STAssertEquals(DVCacheStateTombstone, 
+                 [[[[DVCacheManager alloc] init] autorelease] cacheStateForPath:path], 
+                 @"Tombstones should be saved before any deletes finish");
+  
+  //
+  //  Asking again for a path in flight doesn't send it again.
+  //
+  
+  [cm deleteDropBoxPaths:[NSArray arrayWithObject:kSimpleMetadataPath]];
+  
+  //
+  //  Each delete that finishes, or fails, starts the next one. Only the
+  //  last one reloads the metadata.
+  //
+  
+  for (NSUInteger i = 0; i < [paths count]; i++) {
+    NSUInteger next = i + kDVCacheManagerMaxConcurrentDeletes;
+    if (next < [paths count]) {
+      [[mockClient expect] deletePath:[paths objectAtIndex:next]];
+    } else if (i == [paths count] - 1) {
+      [[mockClient expect] loadMetadata:kDropVaultPath];
+    }
+    if (i == 1) {
+      NSDictionary *userInfo = [NSDictionary dictionaryWithObject:[paths objectAtIndex:i] forKey:@"path"];
+      [cm restClient:nil deletePathFailedWithError:[NSError errorWithDomain:@"dropbox.com" 
+                                                                       code:500 
+                                                                   userInfo:userInfo]];
+    } else {
+      [cm restClient:nil deletedPath:[paths objectAtIndex:i]];
+    }
+    STAssertNoThrow([mockClient verify], @"Delete %u should start the right next step", i);
+  }
+  [cm restClient:nil loadedMetadata:nil];
+  STAssertEquals(DVCacheStateDoesNotExist, 
+                 [[[[DVCacheManager alloc] init] autorelease] cacheStateForPath:path], 
+                 @"Tombstone should be gone");
+}
+
 //
 //  Test uploads.
 //
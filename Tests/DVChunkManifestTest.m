@@ -0,0 +1,297 @@
+//
+//  DVChunkManifestTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVChunkManifest.h"
+#import "NSData+EncryptionHelpers.h"
+#import "DVBenchmark.h"
+
+@interface DVChunkManifestTest : GTMTestCase {
+
+@private
+  NSData *key_;
+  NSString *directory_;
+}
+
+@end
+
+
+@implementation DVChunkManifestTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  |length| bytes of notes-like text, the same every time for a |seed|.
+//
+
+- (NSData *)notesOfLength:(NSUInteger)length seed:(unsigned int)seed {
+
+  NSMutableString *notes = [NSMutableString string];
+  for (NSUInteger line = 0; [notes length] < length; line++) {
+    [notes appendFormat:@"%u. Locker %u, combination %u-%u-%u\n",
+     line,
+     rand_r(&seed) % 1000,
+     rand_r(&seed) % 60,
+     rand_r(&seed) % 60,
+     rand_r(&seed) % 60];
+  }
+  return [[notes substringToIndex:length] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+//
+//  The contents of each chunk of |data|.
+//
+
+- (NSSet *)chunksOfData:(NSData *)data {
+
+  NSMutableSet *chunks = [NSMutableSet set];
+  for (NSValue *range in [DVChunkManifest rangesOfChunksInData:data]) {
+    [chunks addObject:[data subdataWithRange:[range rangeValue]]];
+  }
+  return chunks;
+}
+
+- (NSUInteger)chunkFileCount {
+  return [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory_ error:NULL] count];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  key_ = [[NSData dataWithRandomBytes:kCCKeySizeAES128] retain];
+  directory_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"DVChunkManifestTest.chunks"] retain];
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+}
+
+- (void)tearDown {
+
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+  [key_ release];
+  [directory_ release];
+}
+
+//
+//  Chunks cover the data in order, within the size limits, and an insertion
+//  only changes the chunks around it.
+//
+
+- (void)testChunkBoundaries {
+
+  NSData *data = [self notesOfLength:256 * 1024 seed:1];
+  NSArray *ranges = [DVChunkManifest rangesOfChunksInData:data];
+  NSUInteger offset = 0;
+  for (NSUInteger i = 0; i < [ranges count]; i++) {
+    NSRange range = [[ranges objectAtIndex:i] rangeValue];
+    STAssertEquals(offset, range.location, nil);
+    STAssertTrue(range.length <= kDVChunkMaximumLength, nil);
+    if (i + 1 < [ranges count]) {
+      STAssertTrue(range.length > kDVChunkMinimumLength, nil);
+    }
+    offset = NSMaxRange(range);
+  }
+  STAssertEquals([data length], offset, nil);
+  STAssertTrue([ranges count] > 8, @"256K should be more than a few chunks (%u)", [ranges count]);
+  STAssertEquals((NSUInteger)0, [[DVChunkManifest rangesOfChunksInData:[NSData data]] count], nil);
+
+  NSMutableData *edited = [NSMutableData dataWithData:data];
+  [edited replaceBytesInRange:NSMakeRange([data length] / 2, 0) withBytes:"Safe is behind the painting.\n" length:29];
+  NSMutableSet *newChunks = [NSMutableSet setWithSet:[self chunksOfData:edited]];
+  [newChunks minusSet:[self chunksOfData:data]];
+  STAssertTrue([newChunks count] <= 2, @"An insertion should change one or two chunks, not %u", [newChunks count]);
+}
+
+//
+//  Data written as chunks reads back the same, compressed or not, and the
+//  manifest reads back from its bytes.
+//
+
+- (void)testRoundTrip {
+
+  NSData *data = [self notesOfLength:100 * 1024 seed:2];
+  for (int compressed = 0; compressed < 2; compressed++) {
+    DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithData:data
+                                                      previousManifest:nil
+                                                             directory:directory_
+                                                                   key:key_
+                                                            compressed:compressed] autorelease];
+    STAssertNotNil(manifest, nil);
+    STAssertEquals([[DVChunkManifest rangesOfChunksInData:data] count], [manifest.chunkNames count], nil);
+    STAssertEquals((NSUInteger)0, [[manifest namesOfChunksMissingFromDirectory:directory_] count], nil);
+    STAssertEqualObjects(data, [manifest dataFromDirectory:directory_ key:key_ compressed:compressed], nil);
+
+    DVChunkManifest *readManifest = [[[DVChunkManifest alloc] initWithManifestData:manifest.manifestData] autorelease];
+    STAssertEqualObjects(manifest.chunkNames, readManifest.chunkNames, nil);
+    STAssertEqualObjects(data, [readManifest dataFromDirectory:directory_ key:key_ compressed:compressed], nil);
+  }
+
+  DVChunkManifest *empty = [[[DVChunkManifest alloc] initWithData:[NSData data]
+                                                 previousManifest:nil
+                                                        directory:directory_
+                                                              key:key_
+                                                       compressed:NO] autorelease];
+  STAssertEquals((NSUInteger)0, [empty.chunkNames count], nil);
+  STAssertEqualObjects([NSData data], [empty dataFromDirectory:directory_ key:key_ compressed:NO], nil);
+}
+
+//
+//  Saving an edit writes only the chunks that changed, and never reuses a
+//  chunk that's gone from the directory.
+//
+
+- (void)testReuse {
+
+  NSData *data = [self notesOfLength:256 * 1024 seed:3];
+  DVChunkManifest *first = [[[DVChunkManifest alloc] initWithData:data
+                                                 previousManifest:nil
+                                                        directory:directory_
+                                                              key:key_
+                                                       compressed:NO] autorelease];
+  NSUInteger firstCount = [self chunkFileCount];
+  STAssertEquals([[NSSet setWithArray:first.chunkNames] count], firstCount, nil);
+
+  NSMutableData *edited = [NSMutableData dataWithData:data];
+  [edited replaceBytesInRange:NSMakeRange(1000, 10) withBytes:"Combination" length:11];
+  DVChunkManifest *second = [[[DVChunkManifest alloc] initWithData:edited
+                                                  previousManifest:first
+                                                         directory:directory_
+                                                               key:key_
+                                                        compressed:NO] autorelease];
+  NSUInteger written = [self chunkFileCount] - firstCount;
+  STAssertTrue(written > 0 && written <= 2, @"Should write one or two chunks, not %u", written);
+  STAssertEqualObjects(edited, [second dataFromDirectory:directory_ key:key_ compressed:NO], nil);
+
+  NSString *lastChunk = [first.chunkNames lastObject];
+  [[NSFileManager defaultManager] removeItemAtPath:[directory_ stringByAppendingPathComponent:lastChunk] error:NULL];
+  DVChunkManifest *third = [[[DVChunkManifest alloc] initWithData:data
+                                                 previousManifest:first
+                                                        directory:directory_
+                                                              key:key_
+                                                       compressed:NO] autorelease];
+  STAssertFalse([third.chunkNames containsObject:lastChunk], @"A deleted chunk gets a new name");
+  STAssertEqualObjects(data, [third dataFromDirectory:directory_ key:key_ compressed:NO], nil);
+}
+
+//
+//  Missing and damaged chunks, and anything that isn't a manifest.
+//
+
+- (void)testBadChunks {
+
+  NSData *data = [self notesOfLength:64 * 1024 seed:4];
+  DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithData:data
+                                                    previousManifest:nil
+                                                           directory:directory_
+                                                                 key:key_
+                                                          compressed:NO] autorelease];
+  NSString *name = [manifest.chunkNames objectAtIndex:0];
+  NSString *chunkPath = [directory_ stringByAppendingPathComponent:name];
+  NSData *chunk = [NSData dataWithContentsOfFile:chunkPath];
+
+  [[NSFileManager defaultManager] removeItemAtPath:chunkPath error:NULL];
+  STAssertEqualObjects([NSArray arrayWithObject:name], [manifest namesOfChunksMissingFromDirectory:directory_], nil);
+  STAssertNil([manifest dataFromDirectory:directory_ key:key_ compressed:NO], nil);
+
+  NSData *otherChunk = [NSData dataWithContentsOfFile:[directory_ stringByAppendingPathComponent:
+                                                       [manifest.chunkNames objectAtIndex:1]]];
+  [otherChunk writeToFile:chunkPath atomically:NO];
+  STAssertNil([manifest dataFromDirectory:directory_ key:key_ compressed:NO], @"Swapped chunks should fail");
+
+  [chunk writeToFile:chunkPath atomically:NO];
+  STAssertNil([manifest dataFromDirectory:directory_ key:[NSData dataWithRandomBytes:kCCKeySizeAES128] compressed:NO],
+              @"The wrong key should fail");
+  STAssertEqualObjects(data, [manifest dataFromDirectory:directory_ key:key_ compressed:NO], nil);
+
+  NSData *manifestData = manifest.manifestData;
+  STAssertNil([[[DVChunkManifest alloc] initWithManifestData:nil] autorelease], nil);
+  STAssertNil([[[DVChunkManifest alloc] initWithManifestData:data] autorelease], nil);
+  STAssertNil([[[DVChunkManifest alloc] initWithManifestData:
+                [manifestData subdataWithRange:NSMakeRange(0, [manifestData length] - 1)]] autorelease], nil);
+}
+
+//
+//  Benchmark: a one-line edit to 1MB of notes. Compares the bytes a save
+//  writes, and the time it takes, against encrypting the whole file.
+//
+
+- (void)testEditBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSData *data = [self notesOfLength:1024 * 1024 seed:5];
+  DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithData:data
+                                                    previousManifest:nil
+                                                           directory:directory_
+                                                                 key:key_
+                                                          compressed:NO] autorelease];
+  NSUInteger count = 20;
+  NSUInteger bytesWritten = 0;
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSSet *before = [NSSet setWithArray:manifest.chunkNames];
+    NSMutableData *edited = [NSMutableData dataWithData:data];
+    NSString *line = [NSString stringWithFormat:@"Edit %u\n", i];
+    [edited replaceBytesInRange:NSMakeRange((i * 47629) % [data length], 0)
+                      withBytes:[line UTF8String]
+                         length:[line length]];
+    manifest = [[DVChunkManifest alloc] initWithData:edited
+                                    previousManifest:manifest
+                                           directory:directory_
+                                                 key:key_
+                                          compressed:NO];
+    for (NSString *name in manifest.chunkNames) {
+      if (![before containsObject:name]) {
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:
+                                    [directory_ stringByAppendingPathComponent:name] error:NULL];
+        bytesWritten += [attributes fileSize];
+      }
+    }
+    bytesWritten += [manifest.manifestData length];
+    [pool drain];
+    [manifest autorelease];
+  }
+  CFAbsoluteTime chunked = CFAbsoluteTimeGetCurrent() - start;
+
+  NSData *iv = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+  NSString *wholePath = [directory_ stringByAppendingPathComponent:@"whole.dat"];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [[data aesEncryptWithKey:key_ andIV:iv] writeToFile:wholePath atomically:YES];
+    [pool drain];
+  }
+  CFAbsoluteTime whole = CFAbsoluteTimeGetCurrent() - start;
+
+  STAssertTrue(bytesWritten / count < [data length] / 16, nil);
+  NSLog(@"%s -- %u edits of %u bytes: chunked %.3fs, %u bytes per save; whole file %.3fs, %u bytes per save",
+        __PRETTY_FUNCTION__,
+        count,
+        [data length],
+        chunked,
+        bytesWritten / count,
+        whole,
+        [data length]);
+}
+
+@end
@@ -0,0 +1,521 @@
+//
+//  DVKeyStoreTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/13/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVKeyStore.h"
+#import "DVCacheManager.h"
+#import "NSManagedObjectModel+UnitTests.h"
+#import "DVBenchmark.h"
+
+#define kDVTestPassword         @"Orwell."
+#define kDVLargeVaultSize       50000
+
+@interface DVKeyStoreTest : GTMTestCase {
+
+@private
+  NSUInteger mergeCount_;
+  NSMutableArray *decryptionOrder_;
+}
+
+@end
+
+
+@implementation DVKeyStoreTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (NSArray *)keyEntriesWithCount:(NSUInteger)count {
+
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    [entries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                        [NSString stringWithFormat:@"/StrongBox/%05u.key", i], kDVKeyName,
+                        @"1 KB", kDVHumanReadableSize,
+                        nil]];
+  }
+  return entries;
+}
+
+- (NSArray *)objectsInContext:(NSManagedObjectContext *)context {
+
+  NSFetchRequest *fetchRequest = [[[NSFetchRequest alloc] init] autorelease];
+  [fetchRequest setEntity:[NSEntityDescription entityForName:kDVKeyEntity inManagedObjectContext:context]];
+  return [context executeFetchRequest:fetchRequest error:NULL];
+}
+
+//
+//  A URL for a scratch SQLite store, with any leftovers from a previous run
+//  removed.
+//
+
+- (NSURL *)scratchStoreURLWithName:(NSString *)name {
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+  return [NSURL fileURLWithPath:path];
+}
+
+- (NSManagedObjectModel *)modelNamed:(NSString *)name {
+
+  NSURL *modelURL = [[NSBundle mainBundle] URLForResource:name
+                                            withExtension:@"mom"
+                                             subdirectory:@"DropboxPrototype.momd"];
+  return [[[NSManagedObjectModel alloc] initWithContentsOfURL:modelURL] autorelease];
+}
+
+- (void)mainContextDidChange:(NSNotification *)notification {
+  mergeCount_++;
+  for (NSManagedObject *object in [[notification userInfo] objectForKey:NSUpdatedObjectsKey]) {
+    NSString *keyName = [object valueForKey:kDVKeyName];
+    if ([object valueForKey:kDVFileName] != nil && ![decryptionOrder_ containsObject:keyName]) {
+      [decryptionOrder_ addObject:keyName];
+    }
+  }
+}
+
+//
+//  Puts a copy of the test key file in the cache for each of |keyNames|.
+//
+
+- (void)cacheTestKeyFileForKeyNames:(NSArray *)keyNames {
+
+  NSString *source = [[[NSBundle mainBundle] bundlePath] stringByAppendingPathComponent:@"20110124210018-26185D7F.key"];
+  [DVCacheManager createCacheRootDirectory];
+  for (NSString *keyName in keyNames) {
+    NSString *cachePath = [DVCacheManager cachePathForDropBoxPath:keyName];
+    [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+    [[NSFileManager defaultManager] copyItemAtPath:source toPath:cachePath error:nil];
+  }
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Reconciling adds and removes keys in the background, and the results land
+//  in the main context.
+//
+
+- (void)testReconcile {
+
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+
+  __block NSArray *added = nil;
+  [keyStore reconcileKeyEntries:[self keyEntriesWithCount:3] completion:^(NSArray *addedKeyNames, NSError *error) {
+    STAssertTrue([NSThread isMainThread], @"Completion should run on the main thread");
+    added = [addedKeyNames retain];
+  }];
+  [keyStore waitUntilIdle];
+  STAssertEquals((NSUInteger)3, [added count], nil);
+  STAssertEquals((NSUInteger)3, [[self objectsInContext:context] count], nil);
+  [added release];
+
+  //
+  //  Drop the first key and add a fourth.
+  //
+
+  NSMutableArray *entries = [NSMutableArray arrayWithArray:[self keyEntriesWithCount:4]];
+  [entries removeObjectAtIndex:0];
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {
+    added = [addedKeyNames retain];
+  }];
+  [keyStore waitUntilIdle];
+  STAssertEqualObjects([NSArray arrayWithObject:@"/StrongBox/00003.key"], added, nil);
+  [added release];
+  NSArray *keyNames = [[self objectsInContext:context] valueForKey:kDVKeyName];
+  STAssertEquals((NSUInteger)3, [keyNames count], nil);
+  STAssertFalse([keyNames containsObject:@"/StrongBox/00000.key"], nil);
+
+  [keyStore removeAllKeys];
+  [keyStore waitUntilIdle];
+  STAssertEquals((NSUInteger)0, [[self objectsInContext:context] count], nil);
+}
+
+//
+//  A large reconcile reaches the main context in batches, not one merge per
+//  key.
+//
+
+- (void)testSavesAreCoalesced {
+
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(mainContextDidChange:)
+                                               name:NSManagedObjectContextObjectsDidChangeNotification
+                                             object:context];
+  mergeCount_ = 0;
+  NSUInteger count = 10 * kDVKeyStoreSaveBatchSize + 1;
+  [keyStore reconcileKeyEntries:[self keyEntriesWithCount:count] completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore forgetDecryptedKeys];
+  [keyStore waitUntilIdle];
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+
+  STAssertEquals(count, [[self objectsInContext:context] count], nil);
+  STAssertTrue(mergeCount_ <= 2 * (count / kDVKeyStoreSaveBatchSize + 1),
+               @"%u keys should be merged in batches, not %u times", count, mergeCount_);
+}
+
+//
+//  Decryption happens on the worker, and forgetting wipes what it found.
+//
+
+- (void)testDecrypt {
+
+  NSString *keyFile = @"/StrongBox/20110124210018-26185D7F.key";
+  NSString *cachePath = [DVCacheManager cachePathForDropBoxPath:keyFile];
+  [DVCacheManager createCacheRootDirectory];
+  [[NSFileManager defaultManager] removeItemAtPath:cachePath error:nil];
+  [[NSFileManager defaultManager] copyItemAtPath:[[[NSBundle mainBundle] bundlePath] stringByAppendingPathComponent:[keyFile lastPathComponent]]
+                                          toPath:cachePath
+                                           error:nil];
+
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  NSArray *entries = [NSArray arrayWithObject:[NSDictionary dictionaryWithObject:keyFile forKey:kDVKeyName]];
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore decryptKeyFile:[cachePath stringByAppendingPathExtension:@"missing"] withPassword:kDVTestPassword];
+  [keyStore waitUntilIdle];
+  NSManagedObject *object = [[self objectsInContext:context] lastObject];
+  STAssertNil([object valueForKey:kDVFileName], nil);
+
+  [keyStore decryptAllKeysWithPassword:kDVTestPassword];
+  [keyStore waitUntilIdle];
+  STAssertEqualStrings(@"E9AFCB203225CBB36012C61D79365070940243A0.txt", [object valueForKey:kDVFileName], nil);
+  STAssertNotNil([object valueForKey:kDVKey], nil);
+  STAssertNotNil([object valueForKey:kDVIV], nil);
+
+  [keyStore forgetDecryptedKeys];
+  [keyStore waitUntilIdle];
+  STAssertNil([object valueForKey:kDVFileName], nil);
+  STAssertNil([object valueForKey:kDVKey], nil);
+
+  [keyStore decryptKeyFile:cachePath withPassword:kDVTestPassword];
+  [keyStore waitUntilIdle];
+  STAssertNotNil([object valueForKey:kDVFileName], nil);
+
+  [keyStore removeAllKeys];
+  [keyStore waitUntilIdle];
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:cachePath],
+                @"Removing a key should remove its cached key file");
+}
+
+//
+//  Forgetting keys wins over decryption that was asked for before it, even
+//  once that decryption has been saved and is only waiting to be merged.
+//
+
+- (void)testForgetBeforeMerge {
+
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  NSArray *entries = [self keyEntriesWithCount:3];
+  [self cacheTestKeyFileForKeyNames:[entries valueForKey:kDVKeyName]];
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore waitUntilIdle];
+
+  [keyStore decryptAllKeysWithPassword:kDVTestPassword];
+  [keyStore requestDecryptionOfKeyName:@"/StrongBox/00001.key" withPassword:kDVTestPassword];
+  [keyStore forgetDecryptedKeys];
+  [keyStore waitUntilIdle];
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertNil([object valueForKey:kDVFileName], @"Queued decryption should be dropped");
+  }
+
+  //
+  //  Let the worker decrypt and save, but keep the main thread from merging
+  //  until the keys are forgotten.
+  //
+
+  [keyStore decryptAllKeysWithPassword:kDVTestPassword];
+  [NSThread sleepForTimeInterval:1.0];
+  [keyStore forgetDecryptedKeys];
+  [keyStore waitUntilIdle];
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertNil([object valueForKey:kDVFileName], @"Saved decryption should not be merged");
+    STAssertNil([object valueForKey:kDVKey], nil);
+  }
+
+  [keyStore decryptAllKeysWithPassword:kDVTestPassword];
+  [keyStore waitUntilIdle];
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertNotNil([object valueForKey:kDVFileName], @"Decryption after forgetting should work");
+  }
+  [keyStore removeAllKeys];
+  [keyStore waitUntilIdle];
+}
+
+//
+//  A store written by the first version of the model migrates to the current
+//  one, keeping its rows, and comes out with |KeyName| indexed.
+//
+
+- (void)testMigratesVersionOneStore {
+
+  NSURL *storeURL = [self scratchStoreURLWithName:@"DVKeyStoreTestMigration.sqlite"];
+  NSManagedObjectModel *oldModel = [self modelNamed:@"DropboxPrototype"];
+  STAssertNotNil(oldModel, nil);
+  NSManagedObjectContext *context = [NSManagedObjectModel sqliteMOCWithModel:oldModel storeURL:storeURL];
+  NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:kDVKeyEntity
+                                                          inManagedObjectContext:context];
+  [object setValue:@"/StrongBox/00000.key" forKey:kDVKeyName];
+  STAssertTrue([context save:NULL], nil);
+
+  NSManagedObjectModel *model = [NSManagedObjectModel mergedModelFromBundles:[NSArray arrayWithObject:[NSBundle mainBundle]]];
+  STAssertFalse([[oldModel entityVersionHashesByName] isEqual:[model entityVersionHashesByName]],
+                @"The index change has to change the version hash, or old stores never get the index");
+  NSAttributeDescription *keyName = [[[[model entitiesByName] objectForKey:kDVKeyEntity] attributesByName] objectForKey:kDVKeyName];
+  STAssertTrue([keyName isIndexed], nil);
+
+  context = [NSManagedObjectModel sqliteMOCWithModel:model storeURL:storeURL];
+  STAssertNotNil(context, @"The store should migrate");
+  STAssertEqualObjects([NSArray arrayWithObject:@"/StrongBox/00000.key"],
+                       [[self objectsInContext:context] valueForKey:kDVKeyName],
+                       nil);
+  [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil];
+}
+
+//
+//  Benchmark: a vault of |kDVLargeVaultSize| keys in a SQLite store. Times
+//  the first reconcile, which inserts everything; a reconcile with nothing to
+//  do, which is what every refresh costs; a reconcile that drops 1% of the
+//  keys; looking keys up by name; and pulling the data for each screenful of
+//  cells the way the table view does.
+//
+
+- (void)testLargeVaultBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSURL *storeURL = [self scratchStoreURLWithName:@"DVKeyStoreTestBenchmark.sqlite"];
+  NSManagedObjectModel *model = [NSManagedObjectModel mergedModelFromBundles:[NSArray arrayWithObject:[NSBundle mainBundle]]];
+  NSManagedObjectContext *context = [NSManagedObjectModel sqliteMOCWithModel:model storeURL:storeURL];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  NSArray *entries = [self keyEntriesWithCount:kDVLargeVaultSize];
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore waitUntilIdle];
+  CFAbsoluteTime insert = CFAbsoluteTimeGetCurrent() - start;
+
+  NSFetchRequest *countRequest = [[[NSFetchRequest alloc] init] autorelease];
+  [countRequest setEntity:[NSEntityDescription entityForName:kDVKeyEntity inManagedObjectContext:context]];
+  STAssertEquals((NSUInteger)kDVLargeVaultSize, [context countForFetchRequest:countRequest error:NULL], nil);
+
+  __block NSArray *added = nil;
+  start = CFAbsoluteTimeGetCurrent();
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {
+    added = [addedKeyNames retain];
+  }];
+  [keyStore waitUntilIdle];
+  CFAbsoluteTime unchanged = CFAbsoluteTimeGetCurrent() - start;
+  STAssertEquals((NSUInteger)0, [added count], nil);
+  [added release];
+
+  NSMutableArray *remaining = [NSMutableArray arrayWithCapacity:kDVLargeVaultSize];
+  for (NSUInteger i = 0; i < [entries count]; i++) {
+    if (i % 100 != 0) {
+      [remaining addObject:[entries objectAtIndex:i]];
+    }
+  }
+  start = CFAbsoluteTimeGetCurrent();
+  [keyStore reconcileKeyEntries:remaining completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore waitUntilIdle];
+  CFAbsoluteTime removal = CFAbsoluteTimeGetCurrent() - start;
+  STAssertEquals([remaining count], [context countForFetchRequest:countRequest error:NULL], nil);
+
+  //
+  //  Lookups by name, as |decryptKeyFile:withPassword:| and the detail view
+  //  do them.
+  //
+
+  NSUInteger lookups = 1000;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < lookups; i++) {
+    NSString *keyName = [[remaining objectAtIndex:(i * 37) % [remaining count]] objectForKey:kDVKeyName];
+    NSFetchRequest *fetchRequest = [[[NSFetchRequest alloc] init] autorelease];
+    [fetchRequest setEntity:[countRequest entity]];
+    [fetchRequest setPredicate:[NSPredicate predicateWithFormat:@"(KeyName == %@)", keyName]];
+    STAssertEquals((NSUInteger)1, [[context executeFetchRequest:fetchRequest error:NULL] count], nil);
+  }
+  CFAbsoluteTime fetch = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  //
+  //  Scrolling: the table view's fetch, then every cell's values, a screenful
+  //  at a time. The worst screenful is what a user would notice.
+  //
+
+  pool = [[NSAutoreleasePool alloc] init];
+  NSFetchRequest *fetchRequest = [[[NSFetchRequest alloc] init] autorelease];
+  [fetchRequest setEntity:[countRequest entity]];
+  [fetchRequest setFetchBatchSize:20];
+  [fetchRequest setSortDescriptors:[NSArray arrayWithObject:[[[NSSortDescriptor alloc] initWithKey:kDVKeyName ascending:NO] autorelease]]];
+  start = CFAbsoluteTimeGetCurrent();
+  NSArray *rows = [context executeFetchRequest:fetchRequest error:NULL];
+  CFAbsoluteTime firstFetch = CFAbsoluteTimeGetCurrent() - start;
+  CFAbsoluteTime worstPage = 0;
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger page = 0; page < [rows count]; page += 20) {
+    CFAbsoluteTime pageStart = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger i = page; i < MIN(page + 20, [rows count]); i++) {
+      NSManagedObject *object = [rows objectAtIndex:i];
+      [object valueForKey:kDVKeyName];
+      [object valueForKey:kDVHumanReadableSize];
+      [object valueForKey:kDVLastModifiedDate];
+      [object valueForKey:kDVFileName];
+    }
+    worstPage = MAX(worstPage, CFAbsoluteTimeGetCurrent() - pageStart);
+  }
+  CFAbsoluteTime scroll = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  NSLog(@"%s -- %u keys: insert %.3fs, unchanged reconcile %.3fs, 1%% removal %.3fs, "
+        @"%u lookups %.3fs, list fetch %.3fs, all cells %.3fs (worst page %.1fms)",
+        __PRETTY_FUNCTION__,
+        kDVLargeVaultSize,
+        insert,
+        unchanged,
+        removal,
+        lookups,
+        fetch,
+        firstFetch,
+        scroll,
+        worstPage * 1000);
+  [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil];
+}
+
+//
+//  Requested decryptions land in the main context; repeats are ignored, and
+//  the newest request is served first.
+//
+
+- (void)testRequestDecryption {
+
+  NSArray *keyNames = [NSArray arrayWithObjects:
+                       @"/StrongBox/request-1.key",
+                       @"/StrongBox/request-2.key",
+                       @"/StrongBox/request-3.key",
+                       nil];
+  [self cacheTestKeyFileForKeyNames:keyNames];
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  NSMutableArray *entries = [NSMutableArray array];
+  for (NSString *keyName in keyNames) {
+    [entries addObject:[NSDictionary dictionaryWithObject:keyName forKey:kDVKeyName]];
+  }
+  [keyStore reconcileKeyEntries:entries completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore waitUntilIdle];
+
+  decryptionOrder_ = [[NSMutableArray alloc] init];
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(mainContextDidChange:)
+                                               name:NSManagedObjectContextObjectsDidChangeNotification
+                                             object:context];
+
+  //
+  //  Keep the queue busy with a key file that matches no key, so every
+  //  request is waiting before the first one is picked up. Asking for the
+  //  first key again moves it back to the front.
+  //
+
+  [self cacheTestKeyFileForKeyNames:[NSArray arrayWithObject:@"/StrongBox/busy.key"]];
+  [keyStore decryptKeyFile:[DVCacheManager cachePathForDropBoxPath:@"/StrongBox/busy.key"]
+              withPassword:kDVTestPassword];
+  [keyStore requestDecryptionOfKeyName:[keyNames objectAtIndex:0] withPassword:kDVTestPassword];
+  [keyStore requestDecryptionOfKeyName:[keyNames objectAtIndex:1] withPassword:kDVTestPassword];
+  [keyStore requestDecryptionOfKeyName:[keyNames objectAtIndex:2] withPassword:kDVTestPassword];
+  [keyStore requestDecryptionOfKeyName:[keyNames objectAtIndex:0] withPassword:kDVTestPassword];
+  [keyStore waitUntilIdle];
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+
+  NSArray *expected = [NSArray arrayWithObjects:
+                       [keyNames objectAtIndex:0],
+                       [keyNames objectAtIndex:2],
+                       [keyNames objectAtIndex:1],
+                       nil];
+  STAssertEqualObjects(expected, decryptionOrder_, nil);
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertEqualStrings(@"E9AFCB203225CBB36012C61D79365070940243A0.txt", [object valueForKey:kDVFileName], nil);
+  }
+  [decryptionOrder_ release];
+  decryptionOrder_ = nil;
+
+  [keyStore forgetDecryptedKeys];
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertNil([object valueForKey:kDVFileName], @"The main context is cleared right away");
+  }
+  [keyStore removeAllKeys];
+  [keyStore waitUntilIdle];
+  [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:@"/StrongBox/busy.key"]
+                                             error:nil];
+}
+
+//
+//  Restored values land in the main context without any key files to
+//  decrypt, and read back the same way; keys that are gone are skipped. The
+//  store has its own copies, so the values handed in can be wiped at once.
+//
+
+- (void)testRestoreDecryptedKeyValues {
+
+  NSManagedObjectContext *context = [NSManagedObjectModel inMemoryMOCFromBundle:[NSBundle mainBundle]];
+  DVKeyStore *keyStore = [[[DVKeyStore alloc] initWithMainContext:context] autorelease];
+  [keyStore reconcileKeyEntries:[self keyEntriesWithCount:2] completion:^(NSArray *addedKeyNames, NSError *error) {}];
+  [keyStore waitUntilIdle];
+  STAssertEquals((NSUInteger)0, [[keyStore decryptedKeyValues] count], nil);
+
+  NSMutableDictionary *decryptedKeyValues = [NSMutableDictionary dictionary];
+  NSMutableDictionary *wipeableKeyValues = [NSMutableDictionary dictionary];
+  char wipeableKey[16];
+  memcpy(wipeableKey, "0123456789abcdef", sizeof(wipeableKey));
+  for (NSString *keyName in [NSArray arrayWithObjects:@"/StrongBox/00000.key", @"/StrongBox/00001.key", @"/StrongBox/gone.key", nil]) {
+    NSDictionary *values = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSData dataWithBytes:"0123456789abcdef" length:16], kDVKey,
+                            [NSData dataWithBytes:"fedcba9876543210" length:16], kDVIV,
+                            [[keyName lastPathComponent] stringByAppendingPathExtension:@"txt"], kDVFileName,
+                            nil];
+    [decryptedKeyValues setObject:values forKey:keyName];
+    NSMutableDictionary *wipeableValues = [NSMutableDictionary dictionaryWithDictionary:values];
+    [wipeableValues setObject:[NSData dataWithBytesNoCopy:wipeableKey length:sizeof(wipeableKey) freeWhenDone:NO]
+                       forKey:kDVKey];
+    [wipeableKeyValues setObject:wipeableValues forKey:keyName];
+  }
+  [keyStore restoreDecryptedKeyValues:wipeableKeyValues];
+  memset(wipeableKey, 0, sizeof(wipeableKey));
+  [keyStore waitUntilIdle];
+  for (NSManagedObject *object in [self objectsInContext:context]) {
+    STAssertEqualStrings([[[object valueForKey:kDVKeyName] lastPathComponent] stringByAppendingPathExtension:@"txt"],
+                         [object valueForKey:kDVFileName],
+                         nil);
+  }
+  [decryptedKeyValues removeObjectForKey:@"/StrongBox/gone.key"];
+  STAssertEqualObjects(decryptedKeyValues, [keyStore decryptedKeyValues], nil);
+
+  [keyStore forgetDecryptedKeys];
+  [keyStore waitUntilIdle];
+  STAssertEquals((NSUInteger)0, [[keyStore decryptedKeyValues] count], nil);
+}
+
+@end
@@ -0,0 +1,176 @@
+//
+//  DVLaunchTimerTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/15/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import <OCMock/OCMock.h>
+#import "DVLaunchTimer.h"
+#import "DVCacheManager.h"
+#import "RootViewController.h"
+#import "NSManagedObjectModel+UnitTests.h"
+#import "DVBenchmark.h"
+
+//
+//  How many keys are in the store the cold-start benchmark opens, and how
+//  many times it launches.
+//
+
+#define kDVLaunchVaultSize      2000
+#define kDVLaunchRuns           5
+
+@interface DVLaunchTimerTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVLaunchTimerTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (NSURL *)scratchStoreURL {
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"DVLaunchTimerTest.sqlite"];
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+  return [NSURL fileURLWithPath:path];
+}
+
+//
+//  Seconds between two of the phases in |phases|.
+//
+
+- (double)secondsFromPhase:(NSUInteger)first toPhase:(NSUInteger)last inPhases:(NSArray *)phases {
+
+  return [[[phases objectAtIndex:last] objectForKey:kDVLaunchPhaseSeconds] doubleValue] -
+         [[[phases objectAtIndex:first] objectForKey:kDVLaunchPhaseSeconds] doubleValue];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+  [DVLaunchTimer reset];
+}
+
+- (void)tearDown {
+  [DVLaunchTimer reset];
+}
+
+- (void)testPhases {
+
+  [DVLaunchTimer markPhase:@"one"];
+  [DVLaunchTimer markPhase:@"two"];
+  NSArray *phases = [DVLaunchTimer phases];
+  STAssertEquals((NSUInteger)2, [phases count], nil);
+  STAssertEqualStrings(@"one", [[phases objectAtIndex:0] objectForKey:kDVLaunchPhaseName], nil);
+  STAssertEqualStrings(@"two", [[phases objectAtIndex:1] objectForKey:kDVLaunchPhaseName], nil);
+  STAssertTrue([[[phases objectAtIndex:0] objectForKey:kDVLaunchPhaseSeconds] doubleValue] > 0,
+               @"Phases are timed from process start, which was a while ago");
+  STAssertTrue([self secondsFromPhase:0 toPhase:1 inPhases:phases] >= 0, nil);
+
+  NSArray *lines = [[DVLaunchTimer report] componentsSeparatedByString:@"\n"];
+  STAssertEquals((NSUInteger)3, [lines count], @"One line per phase, plus the trailing newline");
+  STAssertTrue([[lines objectAtIndex:1] hasSuffix:@" two"], nil);
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"DVLaunchTimerTest.plist"];
+  STAssertTrue([DVLaunchTimer writePhasesToFile:path], nil);
+  STAssertEqualObjects(phases, [NSArray arrayWithContentsOfFile:path], nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+  [DVLaunchTimer reset];
+  STAssertEquals((NSUInteger)0, [[DVLaunchTimer phases] count], nil);
+}
+
+//
+//  Benchmark: the launch path from opening the store to the first screenful
+//  of cells, against a store of |kDVLaunchVaultSize| keys, |kDVLaunchRuns|
+//  times. The DropBox session isn't linked, so nothing goes to the network;
+//  the time is all Core Data, the cache manager, and the table view.
+//
+
+- (void)testColdStartBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSURL *storeURL = [self scratchStoreURL];
+  NSManagedObjectModel *model = [NSManagedObjectModel mergedModelFromBundles:[NSArray arrayWithObject:[NSBundle mainBundle]]];
+  NSManagedObjectContext *context = [NSManagedObjectModel sqliteMOCWithModel:model storeURL:storeURL];
+  for (NSUInteger i = 0; i < kDVLaunchVaultSize; i++) {
+    NSManagedObject *object = [NSEntityDescription insertNewObjectForEntityForName:kDVKeyEntity
+                                                            inManagedObjectContext:context];
+    [object setValue:[NSString stringWithFormat:@"/StrongBox/%05u.key", i] forKey:kDVKeyName];
+    [object setValue:@"1 KB" forKey:kDVHumanReadableSize];
+  }
+  STAssertTrue([context save:NULL], nil);
+
+  BOOL isLinked = NO;
+  double total = 0;
+  for (NSUInteger run = 0; run < kDVLaunchRuns; run++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [DVLaunchTimer reset];
+    [DVLaunchTimer markPhase:@"start"];
+
+    context = [NSManagedObjectModel sqliteMOCWithModel:model storeURL:storeURL];
+    [DVLaunchTimer markPhase:@"core data ready"];
+
+    DVCacheManager *cacheManager = [[[DVCacheManager alloc] init] autorelease];
+    [DVLaunchTimer markPhase:@"cache manager"];
+
+    id mockSession = [OCMockObject mockForClass:[DBSession class]];
+    [[[mockSession stub] andReturnValue:OCMOCK_VALUE(isLinked)] isLinked];
+    RootViewController *controller = [[[RootViewController alloc] init] autorelease];
+    controller.dbSession = mockSession;
+    controller.cacheManager = cacheManager;
+    controller.managedObjectContext = context;
+    [controller loadView];
+    [controller viewDidLoad];
+
+    NSUInteger rows = MIN((NSUInteger)12, [controller tableView:controller.tableView numberOfRowsInSection:0]);
+    for (NSUInteger row = 0; row < rows; row++) {
+      [controller tableView:controller.tableView
+      cellForRowAtIndexPath:[NSIndexPath indexPathForRow:row inSection:0]];
+    }
+    [DVLaunchTimer markPhase:@"first page"];
+
+    NSArray *phases = [DVLaunchTimer phases];
+    STAssertEquals((NSUInteger)5, [phases count], nil);
+    double seconds = [self secondsFromPhase:0 toPhase:[phases count] - 1 inPhases:phases];
+    total += seconds;
+    NSLog(@"%s -- run %u, %.1f ms:\n%@",
+          __PRETTY_FUNCTION__,
+          run,
+          seconds * 1000,
+          [DVLaunchTimer report]);
+    [controller.keyStore waitUntilIdle];
+    [pool drain];
+  }
+  NSLog(@"%s -- %u keys, mean of %u runs %.1f ms",
+        __PRETTY_FUNCTION__,
+        kDVLaunchVaultSize,
+        kDVLaunchRuns,
+        total / kDVLaunchRuns * 1000);
+  [[NSFileManager defaultManager] removeItemAtURL:storeURL error:nil];
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  DVLocalDropBoxServer.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/19/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+//  A stand-in for the DropBox v0 API, serving a directory on this machine over
+//  plain HTTP on a loopback port. It implements what |DBRestClient| uses:
+//
+//    GET  /0/metadata/<root>/<path>   listings, with |hash| and 304
+//    GET  /0/files/<root>/<path>      downloads
+//    POST /0/files/<root>/<path>      multipart uploads into a directory
+//    POST /0/fileops/delete           with |path|
+//    POST /0/fileops/move             with |from_path| and |to_path|
+//    POST /0/fileops/copy             with |from_path| and |to_path|
+//
+//  The root of the DropBox namespace is |rootDirectory|. OAuth parameters are
+//  accepted and ignored.
+//
+//  Latency, bandwidth, and failures can be injected, so the real request,
+//  parse, cache, and decrypt path can be measured under network conditions
+//  that would otherwise need a phone in a basement. Each connection is served
+//  on its own GCD thread, one request per connection.
+//
+
+@interface DVLocalDropBoxServer : NSObject {
+
+@private
+  NSString *rootDirectory_;
+  int listenSocket_;
+  UInt16 port_;
+  dispatch_source_t acceptSource_;
+  NSString *host_;
+  NSString *savedAPIHost_;
+  NSString *savedContentHost_;
+  NSString *savedProtocol_;
+  NSTimeInterval latency_;
+  NSUInteger bytesPerSecond_;
+  double failureRate_;
+  NSInteger failureStatus_;
+  unsigned int randomState_;
+  NSMutableArray *requestLog_;
+  unsigned long long bytesSent_;
+  unsigned long long bytesReceived_;
+}
+
+//
+//  Creates a server for the files under |rootDirectory|. It isn't listening
+//  until |start|.
+//
+
+- (id)initWithRootDirectory:(NSString *)rootDirectory;
+
+@property (nonatomic, readonly) NSString *rootDirectory;
+
+//
+//  The loopback port the server listens on, once started.
+//
+
+@property (nonatomic, readonly) UInt16 port;
+
+//
+//  How long the server waits before it answers each request. Defaults to 0.
+//
+
+@property (nonatomic, assign) NSTimeInterval latency;
+
+//
+//  If not 0, request and response bodies are trickled at this many bytes
+//  per second. Defaults to 0.
+//
+
+@property (nonatomic, assign) NSUInteger bytesPerSecond;
+
+//
+//  The fraction of requests, from 0 to 1, answered with |failureStatus|
+//  instead of being served. Which requests fail is decided by a generator
+//  seeded in |init|, so a run is repeatable as long as requests arrive in
+//  the same order. Defaults to 0.
+//
+
+@property (nonatomic, assign) double failureRate;
+
+//
+//  The status of injected failures. Defaults to 503.
+//
+
+@property (nonatomic, assign) NSInteger failureStatus;
+
+//
+//  Every request served so far, as @"METHOD /path" without the query.
+//
+
+@property (nonatomic, readonly) NSArray *requestLog;
+
+//
+//  Body bytes sent and received so far.
+//
+
+@property (nonatomic, readonly) unsigned long long bytesSent;
+@property (nonatomic, readonly) unsigned long long bytesReceived;
+
+//
+//  Starts listening, and points |kDBDropboxAPIHost|, |kDBDropboxAPIContentHost|,
+//  and |kDBProtocolHTTPS| at this server so every |DBRestClient| request
+//  comes here. Returns |NO| if the server can't listen.
+//
+
+- (BOOL)start;
+
+//
+//  Stops listening and puts the DropBox hosts back.
+//
+
+- (void)stop;
+
+@end
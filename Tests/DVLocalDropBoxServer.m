@@ -0,0 +1,649 @@
+//
+//  DVLocalDropBoxServer.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/19/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <sys/socket.h>
+#import <netinet/in.h>
+#import <CommonCrypto/CommonDigest.h>
+#import "DVLocalDropBoxServer.h"
+#import "DBSession.h"
+#import "DBRestClient.h"
+#import "MPURLQueryParser.h"
+#import "NSObject+SBJSON.h"
+#import "NSData+EncryptionHelpers.h"
+
+//
+//  Throttled bodies go out in this many pieces a second.
+//
+
+#define kDVServerChunksPerSecond    20
+
+//
+//  Requests with longer headers than this are dropped.
+//
+
+#define kDVServerMaxHeaderLength    (64 * 1024)
+
+#define kDVServerJSONType           @"text/javascript"
+#define kDVServerFileType           @"application/octet-stream"
+
+@interface DVLocalDropBoxServer ()
+
+- (void)serveConnection:(int)connection;
+- (BOOL)receiveFrom:(int)connection into:(NSMutableData *)data length:(NSUInteger)length;
+- (BOOL)send:(NSData *)data to:(int)connection throttled:(BOOL)throttled;
+- (void)respondTo:(int)connection
+           status:(NSInteger)status
+      contentType:(NSString *)contentType
+             body:(NSData *)body;
+- (NSData *)responseForMethod:(NSString *)method
+                         path:(NSString *)path
+                   parameters:(NSDictionary *)parameters
+                      headers:(NSDictionary *)headers
+                         body:(NSData *)body
+                       status:(NSInteger *)status
+                  contentType:(NSString **)contentType;
+- (NSString *)localPathForDropBoxPath:(NSString *)path;
+- (NSMutableDictionary *)metadataForDropBoxPath:(NSString *)path;
+- (NSData *)metadataResponseForPath:(NSString *)path
+                         parameters:(NSDictionary *)parameters
+                             status:(NSInteger *)status;
+- (NSData *)uploadResponseForPath:(NSString *)path
+                          headers:(NSDictionary *)headers
+                             body:(NSData *)body
+                           status:(NSInteger *)status;
+- (NSData *)fileOperationResponse:(NSString *)operation
+                       parameters:(NSDictionary *)parameters
+                           status:(NSInteger *)status;
++ (NSData *)errorBody:(NSString *)message;
++ (NSString *)reasonForStatus:(NSInteger)status;
+
+@end
+
+@implementation DVLocalDropBoxServer
+
+@synthesize rootDirectory = rootDirectory_, port = port_;
+@synthesize latency = latency_, bytesPerSecond = bytesPerSecond_;
+@synthesize failureRate = failureRate_, failureStatus = failureStatus_;
+
+- (id)initWithRootDirectory:(NSString *)rootDirectory {
+
+  self = [super init];
+  if (self != nil) {
+    rootDirectory_ = [rootDirectory copy];
+    listenSocket_ = -1;
+    failureStatus_ = 503;
+    randomState_ = 1;
+    requestLog_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [self stop];
+  [rootDirectory_ release];
+  [requestLog_ release];
+  [super dealloc];
+}
+
+- (NSArray *)requestLog {
+
+  @synchronized(self) {
+    return [NSArray arrayWithArray:requestLog_];
+  }
+}
+
+- (unsigned long long)bytesSent {
+
+  @synchronized(self) {
+    return bytesSent_;
+  }
+}
+
+- (unsigned long long)bytesReceived {
+
+  @synchronized(self) {
+    return bytesReceived_;
+  }
+}
+
+#pragma mark -
+#pragma mark Listening
+
+- (BOOL)start {
+
+  if (acceptSource_ != NULL) {
+    return YES;
+  }
+  listenSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listenSocket_ < 0) {
+    return NO;
+  }
+  int yes = 1;
+  setsockopt(listenSocket_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_len = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_port = 0;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listenSocket_, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listenSocket_, 64) != 0 ||
+      getsockname(listenSocket_, (struct sockaddr *)&address, &length) != 0) {
+    close(listenSocket_);
+    listenSocket_ = -1;
+    return NO;
+  }
+  port_ = ntohs(address.sin_port);
+
+  int listener = listenSocket_;
+  dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+  acceptSource_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, listener, 0, queue);
+  dispatch_source_set_event_handler(acceptSource_, ^{
+    int connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      return;
+    }
+    int noSigPipe = 1;
+    setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+    dispatch_async(queue, ^{
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      [self serveConnection:connection];
+      close(connection);
+      [pool drain];
+    });
+  });
+  dispatch_source_set_cancel_handler(acceptSource_, ^{
+    close(listener);
+  });
+  dispatch_resume(acceptSource_);
+
+  host_ = [[NSString alloc] initWithFormat:@"127.0.0.1:%u", port_];
+  savedAPIHost_ = kDBDropboxAPIHost;
+  savedContentHost_ = kDBDropboxAPIContentHost;
+  savedProtocol_ = kDBProtocolHTTPS;
+  kDBDropboxAPIHost = host_;
+  kDBDropboxAPIContentHost = host_;
+  kDBProtocolHTTPS = kDBProtocolHTTP;
+  return YES;
+}
+
+- (void)stop {
+
+  if (acceptSource_ == NULL) {
+    return;
+  }
+  dispatch_source_cancel(acceptSource_);
+  dispatch_release(acceptSource_);
+  acceptSource_ = NULL;
+  listenSocket_ = -1;
+
+  kDBDropboxAPIHost = savedAPIHost_;
+  kDBDropboxAPIContentHost = savedContentHost_;
+  kDBProtocolHTTPS = savedProtocol_;
+  [host_ release];
+  host_ = nil;
+}
+
+#pragma mark -
+#pragma mark Connections
+
+//
+//  Reads |length| more bytes onto |data|, at |bytesPerSecond| if it's set.
+//
+
+- (BOOL)receiveFrom:(int)connection into:(NSMutableData *)data length:(NSUInteger)length {
+
+  NSUInteger chunkLength = bytesPerSecond_ ? MAX(1, bytesPerSecond_ / kDVServerChunksPerSecond) : 64 * 1024;
+  char *buffer = malloc(chunkLength);
+  while (length > 0) {
+    ssize_t received = recv(connection, buffer, MIN(length, chunkLength), 0);
+    if (received <= 0) {
+      break;
+    }
+    [data appendBytes:buffer length:received];
+    length -= received;
+    if (bytesPerSecond_) {
+      usleep((useconds_t)(received * 1e6 / bytesPerSecond_));
+    }
+  }
+  free(buffer);
+  return length == 0;
+}
+
+- (BOOL)send:(NSData *)data to:(int)connection throttled:(BOOL)throttled {
+
+  const char *bytes = [data bytes];
+  NSUInteger remaining = [data length];
+  NSUInteger chunkLength = (throttled && bytesPerSecond_) ? MAX(1, bytesPerSecond_ / kDVServerChunksPerSecond) : remaining;
+  while (remaining > 0) {
+    ssize_t sent = send(connection, bytes, MIN(remaining, chunkLength), 0);
+    if (sent <= 0) {
+      return NO;
+    }
+    bytes += sent;
+    remaining -= sent;
+    if (throttled && bytesPerSecond_) {
+      usleep((useconds_t)(sent * 1e6 / bytesPerSecond_));
+    }
+  }
+  return YES;
+}
+
+- (void)respondTo:(int)connection
+           status:(NSInteger)status
+      contentType:(NSString *)contentType
+             body:(NSData *)body {
+
+  NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %d %@\r\n",
+                           status,
+                           [DVLocalDropBoxServer reasonForStatus:status]];
+  if (contentType != nil) {
+    [head appendFormat:@"Content-Type: %@\r\n", contentType];
+  }
+  [head appendFormat:@"Content-Length: %u\r\nConnection: close\r\n\r\n", [body length]];
+  if ([self send:[head dataUsingEncoding:NSUTF8StringEncoding] to:connection throttled:NO] &&
+      [self send:body to:connection throttled:YES]) {
+    @synchronized(self) {
+      bytesSent_ += [body length];
+    }
+  }
+  shutdown(connection, SHUT_WR);
+}
+
+//
+//  Reads one request, waits out |latency|, and answers it -- or fails it,
+//  |failureRate| of the time.
+//
+
+- (void)serveConnection:(int)connection {
+
+  NSMutableData *request = [NSMutableData data];
+  NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSRange headerEnd = NSMakeRange(NSNotFound, 0);
+  char buffer[4096];
+  while (headerEnd.location == NSNotFound) {
+    ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+    if (received <= 0 || [request length] > kDVServerMaxHeaderLength) {
+      return;
+    }
+    [request appendBytes:buffer length:received];
+    headerEnd = [request rangeOfData:separator options:0 range:NSMakeRange(0, [request length])];
+  }
+
+  NSString *head = [[[NSString alloc] initWithData:[request subdataWithRange:NSMakeRange(0, headerEnd.location)]
+                                          encoding:NSUTF8StringEncoding] autorelease];
+  NSArray *lines = [head componentsSeparatedByString:@"\r\n"];
+  NSArray *requestLine = [[lines objectAtIndex:0] componentsSeparatedByString:@" "];
+  if ([requestLine count] < 2) {
+    [self respondTo:connection status:400 contentType:kDVServerJSONType body:[DVLocalDropBoxServer errorBody:@"Bad request"]];
+    return;
+  }
+  NSString *method = [requestLine objectAtIndex:0];
+  NSString *target = [requestLine objectAtIndex:1];
+  NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+  for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, [lines count] - 1)]) {
+    NSRange colon = [line rangeOfString:@":"];
+    if (colon.location != NSNotFound) {
+      NSString *value = [[line substringFromIndex:NSMaxRange(colon)]
+                         stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+      [headers setObject:value forKey:[[line substringToIndex:colon.location] lowercaseString]];
+    }
+  }
+
+  NSUInteger contentLength = [[headers objectForKey:@"content-length"] integerValue];
+  NSMutableData *body = [NSMutableData dataWithData:
+                         [request subdataWithRange:NSMakeRange(NSMaxRange(headerEnd),
+                                                               [request length] - NSMaxRange(headerEnd))]];
+  if ([body length] < contentLength &&
+      ![self receiveFrom:connection into:body length:contentLength - [body length]]) {
+    return;
+  }
+  @synchronized(self) {
+    bytesReceived_ += [body length];
+  }
+
+  NSString *path = target;
+  NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+  NSRange question = [target rangeOfString:@"?"];
+  if (question.location != NSNotFound) {
+    path = [target substringToIndex:question.location];
+    MPURLQueryParser *parser = [[[MPURLQueryParser alloc] initWithString:
+                                 [target substringFromIndex:NSMaxRange(question)]] autorelease];
+    [parameters addEntriesFromDictionary:[parser parameterDictionary]];
+  }
+  if ([[headers objectForKey:@"content-type"] hasPrefix:@"application/x-www-form-urlencoded"]) {
+    NSString *form = [[[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding] autorelease];
+    MPURLQueryParser *parser = [[[MPURLQueryParser alloc] initWithString:form] autorelease];
+    [parameters addEntriesFromDictionary:[parser parameterDictionary]];
+  }
+  path = [path stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+
+  if (latency_ > 0) {
+    usleep((useconds_t)(latency_ * 1e6));
+  }
+  BOOL fail = NO;
+  @synchronized(self) {
+    [requestLog_ addObject:[NSString stringWithFormat:@"%@ %@", method, path]];
+    fail = failureRate_ > 0 && rand_r(&randomState_) / ((double)RAND_MAX + 1) < failureRate_;
+  }
+  if (fail) {
+    [self respondTo:connection
+             status:failureStatus_
+        contentType:kDVServerJSONType
+               body:[DVLocalDropBoxServer errorBody:@"Injected failure"]];
+    return;
+  }
+
+  NSInteger status = 200;
+  NSString *contentType = kDVServerJSONType;
+  NSData *response = [self responseForMethod:method
+                                        path:path
+                                  parameters:parameters
+                                     headers:headers
+                                        body:body
+                                      status:&status
+                                 contentType:&contentType];
+  [self respondTo:connection status:status contentType:contentType body:response];
+}
+
+#pragma mark -
+#pragma mark Endpoints
+
+- (NSData *)responseForMethod:(NSString *)method
+                         path:(NSString *)path
+                   parameters:(NSDictionary *)parameters
+                      headers:(NSDictionary *)headers
+                         body:(NSData *)body
+                       status:(NSInteger *)status
+                  contentType:(NSString **)contentType {
+
+  NSArray *components = [path pathComponents];
+  if ([components count] < 3 || ![[components objectAtIndex:1] isEqualToString:kDBDropboxAPIVersion]) {
+    *status = 404;
+    return [DVLocalDropBoxServer errorBody:@"Unknown endpoint"];
+  }
+  NSString *endpoint = [components objectAtIndex:2];
+
+  //
+  //  /metadata and /files name the root next, then the path.
+  //
+
+  NSString *dropBoxPath = @"/";
+  if ([components count] > 4) {
+    dropBoxPath = [NSString pathWithComponents:
+                   [[NSArray arrayWithObject:@"/"] arrayByAddingObjectsFromArray:
+                    [components subarrayWithRange:NSMakeRange(4, [components count] - 4)]]];
+  }
+
+  if ([endpoint isEqualToString:@"metadata"] && [method isEqualToString:@"GET"]) {
+    return [self metadataResponseForPath:dropBoxPath parameters:parameters status:status];
+
+  } else if ([endpoint isEqualToString:@"files"] && [method isEqualToString:@"GET"]) {
+    NSString *localPath = [self localPathForDropBoxPath:dropBoxPath];
+    BOOL isDirectory = NO;
+    if (localPath == nil ||
+        ![[NSFileManager defaultManager] fileExistsAtPath:localPath isDirectory:&isDirectory] ||
+        isDirectory) {
+      *status = 404;
+      return [DVLocalDropBoxServer errorBody:@"File not found"];
+    }
+    *contentType = kDVServerFileType;
+    return [NSData dataWithContentsOfFile:localPath];
+
+  } else if ([endpoint isEqualToString:@"files"] && [method isEqualToString:@"POST"]) {
+    return [self uploadResponseForPath:dropBoxPath headers:headers body:body status:status];
+
+  } else if ([endpoint isEqualToString:@"fileops"] && [method isEqualToString:@"POST"] && [components count] == 4) {
+    return [self fileOperationResponse:[components objectAtIndex:3] parameters:parameters status:status];
+  }
+  *status = 404;
+  return [DVLocalDropBoxServer errorBody:@"Unknown endpoint"];
+}
+
+//
+//  The file under |rootDirectory| for |path|, or |nil| if |path| tries to
+//  climb out of it.
+//
+
+- (NSString *)localPathForDropBoxPath:(NSString *)path {
+
+  if ([[path pathComponents] containsObject:@".."]) {
+    return nil;
+  }
+  return [rootDirectory_ stringByAppendingPathComponent:path];
+}
+
+- (NSMutableDictionary *)metadataForDropBoxPath:(NSString *)path {
+
+  NSString *localPath = [self localPathForDropBoxPath:path];
+  NSDictionary *attributes = nil;
+  if (localPath != nil) {
+    attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:localPath error:NULL];
+  }
+  if (attributes == nil) {
+    return nil;
+  }
+  BOOL isDirectory = [[attributes fileType] isEqualToString:NSFileTypeDirectory];
+  unsigned long long bytes = isDirectory ? 0 : [attributes fileSize];
+  NSDateFormatter *formatter = [[[NSDateFormatter alloc] init] autorelease];
+  formatter.locale = [[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease];
+  formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+  formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss Z";
+  NSMutableDictionary *metadata = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                   [NSNumber numberWithLongLong:(long long)[[attributes fileModificationDate] timeIntervalSince1970]], @"revision",
+                                   [NSNumber numberWithBool:NO], @"thumb_exists",
+                                   [NSNumber numberWithUnsignedLongLong:bytes], @"bytes",
+                                   [formatter stringFromDate:[attributes fileModificationDate]], @"modified",
+                                   path, @"path",
+                                   [NSNumber numberWithBool:isDirectory], @"is_dir",
+                                   isDirectory ? @"folder" : @"page_white", @"icon",
+                                   @"dropbox", @"root",
+                                   [NSString stringWithFormat:@"%llu bytes", bytes], @"size",
+                                   nil];
+  if (!isDirectory) {
+    [metadata setObject:kDVServerFileType forKey:@"mime_type"];
+  }
+  return metadata;
+}
+
+//
+//  A directory's |hash| is the MD5 of its entries' names, sizes, and dates,
+//  so it changes whenever anything DropVault looks at changes.
+//
+
+- (NSData *)metadataResponseForPath:(NSString *)path
+                         parameters:(NSDictionary *)parameters
+                             status:(NSInteger *)status {
+
+  NSMutableDictionary *metadata = [self metadataForDropBoxPath:path];
+  if (metadata == nil) {
+    *status = 404;
+    return [DVLocalDropBoxServer errorBody:@"Path not found"];
+  }
+  if ([[metadata objectForKey:@"is_dir"] boolValue]) {
+    NSString *localPath = [self localPathForDropBoxPath:path];
+    NSArray *names = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:localPath error:NULL]
+                      sortedArrayUsingSelector:@selector(compare:)];
+    NSMutableArray *contents = [NSMutableArray arrayWithCapacity:[names count]];
+    CC_MD5_CTX context;
+    CC_MD5_Init(&context);
+    for (NSString *name in names) {
+      NSDictionary *child = [self metadataForDropBoxPath:[path stringByAppendingPathComponent:name]];
+      if (child == nil) {
+        continue;
+      }
+      [contents addObject:child];
+      const char *line = [[NSString stringWithFormat:@"%@|%@|%@\n",
+                           name,
+                           [child objectForKey:@"bytes"],
+                           [child objectForKey:@"modified"]] UTF8String];
+      CC_MD5_Update(&context, line, strlen(line));
+    }
+    NSMutableData *digest = [NSMutableData dataWithLength:CC_MD5_DIGEST_LENGTH];
+    CC_MD5_Final([digest mutableBytes], &context);
+    NSString *hash = [[digest hexString] lowercaseString];
+    if ([hash isEqualToString:[parameters objectForKey:@"hash"]]) {
+      *status = 304;
+      return [NSData data];
+    }
+    [metadata setObject:hash forKey:@"hash"];
+    if (![[parameters objectForKey:@"list"] isEqualToString:@"false"]) {
+      [metadata setObject:contents forKey:@"contents"];
+    }
+  }
+  return [[metadata JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+//
+//  |DBRestClient| uploads a single |file| part, named in its
+//  |Content-Disposition|, into the directory at |path|.
+//
+
+- (NSData *)uploadResponseForPath:(NSString *)path
+                          headers:(NSDictionary *)headers
+                             body:(NSData *)body
+                           status:(NSInteger *)status {
+
+  NSString *contentType = [headers objectForKey:@"content-type"];
+  NSRange boundaryStart = [contentType rangeOfString:@"boundary="];
+  NSString *directory = [self localPathForDropBoxPath:path];
+  if (boundaryStart.location == NSNotFound || directory == nil) {
+    *status = 400;
+    return [DVLocalDropBoxServer errorBody:@"Expected a multipart upload"];
+  }
+  NSString *boundary = [contentType substringFromIndex:NSMaxRange(boundaryStart)];
+  NSData *filenameMarker = [@"filename=\"" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *quote = [@"\"" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *partStart = [@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *partEnd = [[NSString stringWithFormat:@"\r\n--%@", boundary] dataUsingEncoding:NSUTF8StringEncoding];
+
+  NSRange nameStart = [body rangeOfData:filenameMarker options:0 range:NSMakeRange(0, [body length])];
+  NSRange nameEnd = { NSNotFound, 0 };
+  NSRange contentStart = { NSNotFound, 0 };
+  NSRange contentEnd = { NSNotFound, 0 };
+  if (nameStart.location != NSNotFound) {
+    NSRange rest = NSMakeRange(NSMaxRange(nameStart), [body length] - NSMaxRange(nameStart));
+    nameEnd = [body rangeOfData:quote options:0 range:rest];
+    contentStart = [body rangeOfData:partStart options:0 range:rest];
+  }
+  if (contentStart.location != NSNotFound) {
+    contentEnd = [body rangeOfData:partEnd
+                           options:NSDataSearchBackwards
+                             range:NSMakeRange(NSMaxRange(contentStart), [body length] - NSMaxRange(contentStart))];
+  }
+  if (nameEnd.location == NSNotFound || contentEnd.location == NSNotFound) {
+    *status = 400;
+    return [DVLocalDropBoxServer errorBody:@"Malformed upload"];
+  }
+
+  NSData *nameData = [body subdataWithRange:NSMakeRange(NSMaxRange(nameStart), nameEnd.location - NSMaxRange(nameStart))];
+  NSString *name = [[[NSString alloc] initWithData:nameData encoding:NSUTF8StringEncoding] autorelease];
+  NSData *contents = [body subdataWithRange:NSMakeRange(NSMaxRange(contentStart),
+                                                        contentEnd.location - NSMaxRange(contentStart))];
+  if ([name length] == 0 || [[name pathComponents] count] != 1 || [name isEqualToString:@".."]) {
+    *status = 400;
+    return [DVLocalDropBoxServer errorBody:@"Bad file name"];
+  }
+  [[NSFileManager defaultManager] createDirectoryAtPath:directory
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  if (![contents writeToFile:[directory stringByAppendingPathComponent:name] atomically:YES]) {
+    *status = 500;
+    return [DVLocalDropBoxServer errorBody:@"Could not write file"];
+  }
+  return [@"{\"result\": \"winner!\"}" dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSData *)fileOperationResponse:(NSString *)operation
+                       parameters:(NSDictionary *)parameters
+                           status:(NSInteger *)status {
+
+  NSFileManager *fileManager = [NSFileManager defaultManager];
+  if ([operation isEqualToString:@"delete"]) {
+    NSString *path = [parameters objectForKey:@"path"];
+    NSMutableDictionary *metadata = path ? [self metadataForDropBoxPath:path] : nil;
+    if (metadata == nil) {
+      *status = 404;
+      return [DVLocalDropBoxServer errorBody:@"Path not found"];
+    }
+    [fileManager removeItemAtPath:[self localPathForDropBoxPath:path] error:NULL];
+    [metadata setObject:[NSNumber numberWithBool:YES] forKey:@"is_deleted"];
+    return [[metadata JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+  }
+
+  if (![operation isEqualToString:@"move"] && ![operation isEqualToString:@"copy"]) {
+    *status = 404;
+    return [DVLocalDropBoxServer errorBody:@"Unknown endpoint"];
+  }
+  NSString *fromPath = [parameters objectForKey:@"from_path"];
+  NSString *toPath = [parameters objectForKey:@"to_path"];
+  NSString *from = fromPath ? [self localPathForDropBoxPath:fromPath] : nil;
+  NSString *to = toPath ? [self localPathForDropBoxPath:toPath] : nil;
+  if (from == nil || to == nil || ![fileManager fileExistsAtPath:from]) {
+    *status = 404;
+    return [DVLocalDropBoxServer errorBody:@"Path not found"];
+  }
+  if ([fileManager fileExistsAtPath:to]) {
+    *status = 403;
+    return [DVLocalDropBoxServer errorBody:@"A file already exists at the destination"];
+  }
+  [fileManager createDirectoryAtPath:[to stringByDeletingLastPathComponent]
+         withIntermediateDirectories:YES
+                          attributes:nil
+                               error:NULL];
+  BOOL succeeded = [operation isEqualToString:@"move"] ?
+    [fileManager moveItemAtPath:from toPath:to error:NULL] :
+    [fileManager copyItemAtPath:from toPath:to error:NULL];
+  if (!succeeded) {
+    *status = 500;
+    return [DVLocalDropBoxServer errorBody:@"Could not write file"];
+  }
+  return [[[self metadataForDropBoxPath:toPath] JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData *)errorBody:(NSString *)message {
+
+  NSDictionary *error = [NSDictionary dictionaryWithObject:message forKey:@"error"];
+  return [[error JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSString *)reasonForStatus:(NSInteger)status {
+
+  switch (status) {
+    case 200:
+      return @"OK";
+    case 304:
+      return @"Not Modified";
+    case 400:
+      return @"Bad Request";
+    case 403:
+      return @"Forbidden";
+    case 404:
+      return @"Not Found";
+    case 503:
+      return @"Service Unavailable";
+  }
+  return @"Error";
+}
+
+@end
@@ -0,0 +1,464 @@
+//
+//  DVLocalDropBoxServerTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/19/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DropboxSDK.h"
+#import "DVLocalDropBoxServer.h"
+#import "DVCacheManager.h"
+#import "DVVaultGenerator.h"
+#import "DVVaultIndex.h"
+#import "DVBenchmark.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+
+//
+//  How long to wait for the server before giving up.
+//
+
+#define kServerTestTimeout      (30.0)
+
+@interface DVLocalDropBoxServerTest : GTMTestCase <DBRestClientDelegate, DVCacheManagerDelegate> {
+
+@private
+  NSString *root_;
+  DVLocalDropBoxServer *server_;
+  DBSession *session_;
+  DBRestClient *client_;
+  DBMetadata *metadata_;
+  NSError *error_;
+  NSUInteger callbacks_;
+  BOOL unchanged_;
+  NSMutableSet *cachedFiles_;
+  NSUInteger uploads_;
+  NSUInteger failures_;
+}
+
+@end
+
+
+@implementation DVLocalDropBoxServerTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Runs the run loop until |callbacks_| reaches |count|, or the timeout.
+//
+
+- (BOOL)waitForCallbacks:(NSUInteger)count {
+
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:kServerTestTimeout];
+  while (callbacks_ < count && [timeout timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  return callbacks_ >= count;
+}
+
+- (void)resetCallbacks {
+
+  callbacks_ = 0;
+  unchanged_ = NO;
+  failures_ = 0;
+  uploads_ = 0;
+  [metadata_ release];
+  metadata_ = nil;
+  [error_ release];
+  error_ = nil;
+  [cachedFiles_ removeAllObjects];
+}
+
+- (NSString *)serverPath:(NSString *)path {
+  return [root_ stringByAppendingPathComponent:path];
+}
+
+//
+//  A cache manager talking to the server through its own client.
+//
+
+- (DVCacheManager *)cacheManager {
+
+  DVCacheManager *cacheManager = [[[DVCacheManager alloc] init] autorelease];
+  DBRestClient *client = [[[DBRestClient alloc] initWithSession:session_] autorelease];
+  client.delegate = cacheManager;
+  cacheManager.restClient = client;
+  cacheManager.delegate = self;
+  return cacheManager;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  root_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"DVLocalDropBoxServerTest"] retain];
+  [[NSFileManager defaultManager] removeItemAtPath:root_ error:NULL];
+  [[NSFileManager defaultManager] createDirectoryAtPath:[self serverPath:kDropVaultPath]
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  [[@"key" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[self serverPath:@"/StrongBox/foo.key"]
+                                                    atomically:NO];
+  [[@"data" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:[self serverPath:@"/StrongBox/foo.dat"]
+                                                     atomically:NO];
+
+  server_ = [[DVLocalDropBoxServer alloc] initWithRootDirectory:root_];
+  STAssertTrue([server_ start], nil);
+  session_ = [[DBSession alloc] initWithConsumerKey:@"consumer" consumerSecret:@"secret"];
+  client_ = [[DBRestClient alloc] initWithSession:session_];
+  client_.delegate = self;
+  cachedFiles_ = [[NSMutableSet alloc] init];
+}
+
+- (void)tearDown {
+
+  [self resetCallbacks];
+  [cachedFiles_ release];
+  [client_ release];
+  [session_ release];
+  [server_ stop];
+  [server_ release];
+  [[NSFileManager defaultManager] removeItemAtPath:root_ error:NULL];
+  [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:kDropVaultPath]
+                                             error:NULL];
+  [root_ release];
+}
+
+//
+//  A listing comes back with its hash, and asking again with the hash gets
+//  a 304.
+//
+
+- (void)testMetadata {
+
+  [client_ loadMetadata:kDropVaultPath];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertNotNil(metadata_, @"%@", error_);
+  STAssertEquals((NSUInteger)2, [metadata_.contents count], nil);
+  STAssertEqualStrings(@"/StrongBox/foo.dat", [[metadata_.contents objectAtIndex:0] path], nil);
+  STAssertEquals(3LL, [[metadata_.contents objectAtIndex:1] totalBytes], nil);
+  STAssertNotNil(metadata_.hash, nil);
+
+  NSString *hash = [[metadata_.hash retain] autorelease];
+  [self resetCallbacks];
+  [client_ loadMetadata:kDropVaultPath withHash:hash];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertTrue(unchanged_, nil);
+
+  [[NSData data] writeToFile:[self serverPath:@"/StrongBox/bar.key"] atomically:NO];
+  [self resetCallbacks];
+  [client_ loadMetadata:kDropVaultPath withHash:hash];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals((NSUInteger)3, [metadata_.contents count], @"A new file changes the hash");
+
+  [self resetCallbacks];
+  [client_ loadMetadata:@"/Missing"];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals(404, [error_ code], nil);
+}
+
+//
+//  Cancelled requests call back with nothing, and a new request after them
+//  starts clean.
+//
+
+- (void)testCancelAllRequests {
+
+  [client_ loadMetadata:kDropVaultPath];
+  [client_ loadMetadata:@"/Missing"];
+  [client_ cancelAllRequests];
+  [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+  STAssertEquals((NSUInteger)0, callbacks_, nil);
+
+  [client_ loadMetadata:kDropVaultPath];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals((NSUInteger)2, [metadata_.contents count], @"%@", error_);
+}
+
+- (void)testLoadAndUpload {
+
+  NSString *destination = [NSTemporaryDirectory() stringByAppendingPathComponent:@"foo.dat"];
+  [client_ loadFile:@"/StrongBox/foo.dat" intoPath:destination];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEqualStrings(@"data", [NSString stringWithContentsOfFile:destination
+                                                          encoding:NSUTF8StringEncoding
+                                                             error:NULL], nil);
+
+  NSData *upload = [NSData dataWithRandomBytes:100000];
+  [upload writeToFile:destination atomically:NO];
+  [self resetCallbacks];
+  [client_ uploadFile:@"uploaded.dat" toPath:kDropVaultPath fromPath:destination];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals((NSUInteger)1, uploads_, @"%@", error_);
+  STAssertEqualObjects(upload, [NSData dataWithContentsOfFile:[self serverPath:@"/StrongBox/uploaded.dat"]], nil);
+  [[NSFileManager defaultManager] removeItemAtPath:destination error:NULL];
+
+  [self resetCallbacks];
+  [client_ loadFile:@"/StrongBox/missing.dat" intoPath:destination];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals(404, [error_ code], nil);
+}
+
+- (void)testFileOperations {
+
+  [client_ copyFrom:@"/StrongBox/foo.dat" toPath:@"/StrongBox/copy.dat"];
+  [client_ moveFrom:@"/StrongBox/foo.key" toPath:@"/Moved/foo.key"];
+  STAssertTrue([self waitForCallbacks:2], nil);
+  STAssertNil(error_, @"%@", error_);
+  NSFileManager *fileManager = [NSFileManager defaultManager];
+  STAssertTrue([fileManager fileExistsAtPath:[self serverPath:@"/StrongBox/copy.dat"]], nil);
+  STAssertTrue([fileManager fileExistsAtPath:[self serverPath:@"/StrongBox/foo.dat"]], nil);
+  STAssertTrue([fileManager fileExistsAtPath:[self serverPath:@"/Moved/foo.key"]], nil);
+  STAssertFalse([fileManager fileExistsAtPath:[self serverPath:@"/StrongBox/foo.key"]], nil);
+
+  [self resetCallbacks];
+  [client_ deletePath:@"/StrongBox/copy.dat"];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertFalse([fileManager fileExistsAtPath:[self serverPath:@"/StrongBox/copy.dat"]], nil);
+
+  [self resetCallbacks];
+  [client_ copyFrom:@"/StrongBox/foo.dat" toPath:@"/Moved/foo.key"];
+  [client_ deletePath:@"/StrongBox/../../escape"];
+  STAssertTrue([self waitForCallbacks:2], nil);
+  STAssertEquals((NSUInteger)2, failures_, @"Existing destinations and paths outside the root fail");
+}
+
+//
+//  Injected failures come back as errors with the injected status, and
+//  latency holds each request up.
+//
+
+- (void)testInjectedConditions {
+
+  server_.failureRate = 1;
+  server_.failureStatus = 503;
+  [client_ loadMetadata:kDropVaultPath];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertEquals(503, [error_ code], nil);
+
+  server_.failureRate = 0;
+  server_.latency = 0.2;
+  [self resetCallbacks];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [client_ loadMetadata:kDropVaultPath];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertTrue(CFAbsoluteTimeGetCurrent() - start >= 0.2, nil);
+
+  server_.latency = 0;
+  server_.bytesPerSecond = 50000;
+  [[NSData dataWithRandomBytes:25000] writeToFile:[self serverPath:@"/StrongBox/slow.dat"] atomically:NO];
+  [self resetCallbacks];
+  start = CFAbsoluteTimeGetCurrent();
+  [client_ loadFile:@"/StrongBox/slow.dat"
+           intoPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"slow.dat"]];
+  STAssertTrue([self waitForCallbacks:1], nil);
+  STAssertTrue(CFAbsoluteTimeGetCurrent() - start >= 0.4, @"25KB at 50KB/s takes half a second");
+  STAssertEquals((NSUInteger)4, [server_.requestLog count], nil);
+}
+
+//
+//  Benchmark: DVCacheManager against a generated vault over a link with
+//  50ms of latency and 1MB/s of bandwidth. Reports the time to list the
+//  vault, the time to open one entry (download its key and data, unlock the
+//  key, decrypt the data), and download and upload throughput. Results go
+//  to |sync-benchmarks.json| in the caches directory.
+//
+
+- (void)testEndToEndBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  DVVaultGenerator *generator = [[[DVVaultGenerator alloc] initWithFileCount:100 seed:11] autorelease];
+  generator.sizeDistribution = [NSArray arrayWithObject:
+                                [NSDictionary dictionaryWithObjectsAndKeys:
+                                 [NSNumber numberWithInt:32 * 1024], kDVVaultGeneratorSizeLimit,
+                                 [NSNumber numberWithInt:1], kDVVaultGeneratorSizeWeight,
+                                 nil]];
+  [[NSFileManager defaultManager] removeItemAtPath:[self serverPath:kDropVaultPath] error:NULL];
+  STAssertTrue([generator writeVaultToDirectory:root_], nil);
+  server_.latency = 0.05;
+  server_.bytesPerSecond = 1024 * 1024;
+  DVBenchmark *benchmark = [[[DVBenchmark alloc] initWithWarmUp:1 repetitions:3] autorelease];
+
+  DVCacheManager *cacheManager = [self cacheManager];
+  [benchmark measure:@"time to list" unit:@"lists" work:1 block:^(void) {
+    [self resetCallbacks];
+    [cacheManager loadMetadata];
+    STAssertTrue([self waitForCallbacks:1], nil);
+  }];
+  STAssertEquals((NSUInteger)100, [cacheManager.vaultIndex.keyedItems count], nil);
+
+  DVVaultItem *item = [cacheManager.vaultIndex.keyedItems objectAtIndex:0];
+  NSString *keyPath = [item pathForKind:DVVaultEntryKindKey];
+  NSString *dataPath = [item pathForKind:DVVaultEntryKindData];
+  [benchmark measure:@"time to open" unit:@"opens" work:1 block:^(void) {
+    [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:keyPath] error:NULL];
+    [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:dataPath] error:NULL];
+    [self resetCallbacks];
+    [cacheManager cacheCopyOfDropBoxPath:keyPath];
+    [cacheManager cacheCopyOfDropBoxPath:dataPath];
+    STAssertTrue([self waitForCallbacks:2], nil);
+    NSData *keyFile = [NSData dataWithContentsOfFile:[DVCacheManager cachePathForDropBoxPath:keyPath]];
+    KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyFile andPassword:@"Orwell."];
+    NSData *cipherText = [NSData dataWithContentsOfFile:[DVCacheManager cachePathForDropBoxPath:dataPath]];
+    STAssertNotNil([cipherText aesDecryptWithKey:decryptor.key andIV:decryptor.iv], nil);
+  }];
+
+  NSMutableArray *dataPaths = [NSMutableArray array];
+  unsigned long long dataBytes = 0;
+  for (DVVaultItem *keyedItem in cacheManager.vaultIndex.keyedItems) {
+    [dataPaths addObject:[keyedItem pathForKind:DVVaultEntryKindData]];
+    dataBytes += [[keyedItem metadataForKind:DVVaultEntryKindData] totalBytes];
+  }
+  [benchmark measure:@"download" unit:@"MB" work:dataBytes / (1024.0 * 1024.0) block:^(void) {
+    for (NSString *path in dataPaths) {
+      [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:path] error:NULL];
+    }
+    [self resetCallbacks];
+    for (NSString *path in dataPaths) {
+      [cacheManager cacheCopyOfDropBoxPath:path];
+    }
+    STAssertTrue([self waitForCallbacks:[dataPaths count]], nil);
+    STAssertEquals([dataPaths count], [cachedFiles_ count], nil);
+  }];
+
+  NSArray *uploadPaths = [dataPaths subarrayWithRange:NSMakeRange(0, 20)];
+  unsigned long long uploadBytes = 0;
+  for (NSString *path in uploadPaths) {
+    uploadBytes += [[cacheManager metadataForPath:[DVCacheManager cachePathForDropBoxPath:path]] totalBytes];
+  }
+  [benchmark measure:@"upload" unit:@"MB" work:uploadBytes / (1024.0 * 1024.0) block:^(void) {
+    [self resetCallbacks];
+    for (NSString *path in uploadPaths) {
+      [cacheManager uploadCacheToDropBoxPath:path];
+    }
+    STAssertTrue([self waitForCallbacks:[uploadPaths count]], nil);
+    STAssertEquals([uploadPaths count], uploads_, nil);
+  }];
+
+  [benchmark writeResultsToFile:[DVBenchmark defaultResultsPathForName:@"sync-benchmarks"]];
+  NSLog(@"%s -- %u requests, %llu bytes down, %llu bytes up\n%@",
+        __PRETTY_FUNCTION__,
+        [server_.requestLog count],
+        server_.bytesSent,
+        server_.bytesReceived,
+        [benchmark report]);
+}
+
+#pragma mark -
+#pragma mark DBRestClientDelegate
+
+- (void)restClient:(DBRestClient *)client loadedMetadata:(DBMetadata *)metadata {
+  metadata_ = [metadata retain];
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client metadataUnchangedAtPath:(NSString *)path {
+  unchanged_ = YES;
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client loadMetadataFailedWithError:(NSError *)error {
+  error_ = [error retain];
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client loadedFile:(NSString *)destPath {
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client loadFileFailedWithError:(NSError *)error {
+  error_ = [error retain];
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client uploadedFile:(NSString *)destPath from:(NSString *)srcPath {
+  uploads_++;
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client uploadFileFailedWithError:(NSError *)error {
+  error_ = [error retain];
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client movedPath:(NSString *)from toPath:(NSString *)to {
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client movePathFailedWithError:(NSError *)error {
+  error_ = [error retain];
+  failures_++;
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client copiedPath:(NSString *)from toPath:(NSString *)to {
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client copyPathFailedWithError:(NSError *)error {
+  failures_++;
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client deletedPath:(NSString *)path {
+  callbacks_++;
+}
+
+- (void)restClient:(DBRestClient *)client deletePathFailedWithError:(NSError *)error {
+  failures_++;
+  callbacks_++;
+}
+
+#pragma mark -
+#pragma mark DVCacheManagerDelegate
+
+- (void)cacheManagerDidLoadMetadata:(DVCacheManager *)cacheManager {
+  callbacks_++;
+}
+
+- (void)cacheManagerLoadMetadataFailed:(DVCacheManager *)cacheManager {
+  failures_++;
+  callbacks_++;
+}
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didCacheCopyOfFile:(NSString *)path {
+  [cachedFiles_ addObject:path];
+  callbacks_++;
+}
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didFailCacheOfFile:(NSString *)path {
+  failures_++;
+  callbacks_++;
+}
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didUploadFile:(NSString *)path {
+  uploads_++;
+  callbacks_++;
+}
+
+- (void)cacheManager:(DVCacheManager *)cacheManager didFailUploadOfFile:(NSString *)path {
+  failures_++;
+  callbacks_++;
+}
+
+@end
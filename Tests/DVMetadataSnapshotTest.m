@@ -0,0 +1,258 @@
+//
+//  DVMetadataSnapshotTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/2/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVMetadataSnapshot.h"
+#import "DVBenchmark.h"
+
+@interface DVMetadataSnapshotTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVMetadataSnapshotTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Gets a scratch path in the temporary directory.
+//
+
+- (NSString *)temporaryPathForName:(NSString *)name {
+  return [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+}
+
+//
+//  Creates metadata for a vault directory with |count| key / data file pairs
+//  worth of entries.
+//
+
+- (DBMetadata *)metadataWithEntryCount:(NSUInteger)count {
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSMutableArray *contents = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    NSString *path = [NSString stringWithFormat:@"/StrongBox/%08x-%04x.%@",
+                      i * 2654435761u,
+                      i,
+                      (i % 2) ? @"dat" : @"key"];
+    NSDictionary *entry = [NSDictionary dictionaryWithObjectsAndKeys:
+                           path, @"path",
+                           @"Sat, 12 Mar 2011 20:58:00 -0800", @"modified",
+                           [NSNumber numberWithLongLong:i * 37], @"bytes",
+                           [NSNumber numberWithLongLong:i], @"revision",
+                           @"1.2KB", @"size",
+                           @"dropbox", @"root",
+                           @"page_white", @"icon",
+                           [NSNumber numberWithBool:NO], @"is_dir",
+                           nil];
+    [contents addObject:entry];
+  }
+  NSDictionary *root = [NSDictionary dictionaryWithObjectsAndKeys:
+                        kDropVaultPath, @"path",
+                        @"dropbox", @"root",
+                        @"folder", @"icon",
+                        [NSNumber numberWithBool:YES], @"is_dir",
+                        [NSString stringWithFormat:@"hash-%u", count], @"hash",
+                        contents, @"contents",
+                        nil];
+  DBMetadata *metadata = [[DBMetadata alloc] initWithDictionary:root];
+  [pool drain];
+  return [metadata autorelease];
+}
+
+//
+//  Asserts that two metadata entries have the same values.
+//
+
+- (void)assertMetadata:(DBMetadata *)actual equals:(DBMetadata *)expected {
+
+  STAssertEqualStrings(expected.path, actual.path, nil);
+  STAssertEqualStrings(expected.hash, actual.hash, nil);
+  STAssertEqualStrings(expected.humanReadableSize, actual.humanReadableSize, nil);
+  STAssertEqualStrings(expected.root, actual.root, nil);
+  STAssertEqualStrings(expected.icon, actual.icon, nil);
+  STAssertEquals(expected.totalBytes, actual.totalBytes, nil);
+  STAssertEquals(expected.revision, actual.revision, nil);
+  STAssertEquals(expected.isDirectory, actual.isDirectory, nil);
+  STAssertEquals(expected.isDeleted, actual.isDeleted, nil);
+  STAssertEquals(expected.thumbnailExists, actual.thumbnailExists, nil);
+  STAssertEquals([expected.lastModifiedDate timeIntervalSince1970],
+                 [actual.lastModifiedDate timeIntervalSince1970],
+                 nil);
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Writes metadata and reads it back.
+//
+
+- (void)testRoundTrip {
+
+  NSString *path = [self temporaryPathForName:@"roundtrip.snapshot"];
+  DBMetadata *metadata = [self metadataWithEntryCount:100];
+  STAssertTrue([DVMetadataSnapshot writeMetadata:metadata toFile:path],
+               @"Should write snapshot");
+
+  DVMetadataSnapshot *snapshot = [DVMetadataSnapshot snapshotWithContentsOfFile:path];
+  STAssertNotNil(snapshot, @"Should open snapshot");
+  STAssertEquals([metadata.contents count], snapshot.count, nil);
+  STAssertEqualStrings(metadata.hash, snapshot.rootHash, nil);
+
+  DBMetadata *reloaded = [snapshot rootMetadata];
+  [self assertMetadata:reloaded equals:metadata];
+  STAssertEquals([metadata.contents count], [reloaded.contents count], nil);
+  for (NSUInteger i = 0; i < [metadata.contents count]; i++) {
+    [self assertMetadata:[reloaded.contents objectAtIndex:i]
+                  equals:[metadata.contents objectAtIndex:i]];
+  }
+  STAssertTrue([reloaded.contents objectAtIndex:5] == [reloaded.contents objectAtIndex:5],
+               @"Decoded entries should be remembered");
+}
+
+//
+//  Path lookups go through the sorted path index.
+//
+
+- (void)testIndexOfMetadataWithPath {
+
+  NSString *path = [self temporaryPathForName:@"lookup.snapshot"];
+  DBMetadata *metadata = [self metadataWithEntryCount:1000];
+  STAssertTrue([DVMetadataSnapshot writeMetadata:metadata toFile:path], nil);
+  DVMetadataSnapshot *snapshot = [DVMetadataSnapshot snapshotWithContentsOfFile:path];
+
+  for (NSUInteger i = 0; i < [metadata.contents count]; i += 7) {
+    NSString *entryPath = [[metadata.contents objectAtIndex:i] path];
+    STAssertEquals(i, [snapshot indexOfMetadataWithPath:entryPath],
+                   @"Should find %@", entryPath);
+  }
+  STAssertEquals((NSUInteger)NSNotFound,
+                 [snapshot indexOfMetadataWithPath:@"/StrongBox/missing.dat"], nil);
+  STAssertEquals((NSUInteger)NSNotFound, [snapshot indexOfMetadataWithPath:nil], nil);
+}
+
+//
+//  Nothing to write for nil metadata.
+//
+
+- (void)testWriteNilMetadata {
+
+  NSString *path = [self temporaryPathForName:@"nil.snapshot"];
+  [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+  STAssertFalse([DVMetadataSnapshot writeMetadata:nil toFile:path], nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], nil);
+}
+
+//
+//  Truncated or foreign files must be rejected, not read out of bounds.
+//
+
+- (void)testRejectsInvalidFiles {
+
+  NSString *path = [self temporaryPathForName:@"invalid.snapshot"];
+  STAssertTrue([DVMetadataSnapshot writeMetadata:[self metadataWithEntryCount:10] toFile:path], nil);
+  NSData *data = [NSData dataWithContentsOfFile:path];
+
+  for (NSUInteger length = 0; length < [data length]; length += 13) {
+    NSData *truncated = [data subdataWithRange:NSMakeRange(0, length)];
+    STAssertNil([[[DVMetadataSnapshot alloc] initWithData:truncated] autorelease],
+                @"Should reject %u byte prefix", length);
+  }
+
+  NSMutableData *badMagic = [[data mutableCopy] autorelease];
+  ((char *)[badMagic mutableBytes])[0] ^= 0xFF;
+  STAssertNil([[[DVMetadataSnapshot alloc] initWithData:badMagic] autorelease], nil);
+
+  STAssertNil([DVMetadataSnapshot snapshotWithContentsOfFile:[self temporaryPathForName:@"does-not-exist"]],
+              nil);
+}
+
+//
+//  Cold start benchmark: time to get from a file on disk to the metadata for
+//  one entry, for the old |NSKeyedArchiver| archive and for the snapshot.
+//
+
+- (void)runColdStartBenchmarkWithEntryCount:(NSUInteger)count {
+
+  DBMetadata *metadata = [self metadataWithEntryCount:count];
+  NSString *archivePath = [self temporaryPathForName:@"benchmark.dat"];
+  NSString *snapshotPath = [self temporaryPathForName:@"benchmark.snapshot"];
+  NSString *probe = [[metadata.contents objectAtIndex:count / 2] path];
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  [NSKeyedArchiver archiveRootObject:metadata toFile:archivePath];
+  CFAbsoluteTime archiveWrite = CFAbsoluteTimeGetCurrent() - start;
+
+  start = CFAbsoluteTimeGetCurrent();
+  STAssertTrue([DVMetadataSnapshot writeMetadata:metadata toFile:snapshotPath], nil);
+  CFAbsoluteTime snapshotWrite = CFAbsoluteTimeGetCurrent() - start;
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  DBMetadata *archived = [NSKeyedUnarchiver unarchiveObjectWithFile:archivePath];
+  NSUInteger archivedIndex = [archived.contents indexOfObjectPassingTest:^(id obj, NSUInteger idx, BOOL *stop) {
+    return [[obj path] isEqualToString:probe];
+  }];
+  CFAbsoluteTime archiveRead = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  DVMetadataSnapshot *snapshot = [DVMetadataSnapshot snapshotWithContentsOfFile:snapshotPath];
+  DBMetadata *root = [snapshot rootMetadata];
+  NSUInteger snapshotIndex = [snapshot indexOfMetadataWithPath:probe];
+  DBMetadata *entry = [root.contents objectAtIndex:snapshotIndex];
+  CFAbsoluteTime snapshotRead = CFAbsoluteTimeGetCurrent() - start;
+  STAssertEqualStrings(probe, entry.path, nil);
+  [pool drain];
+
+  STAssertEquals(archivedIndex, (NSUInteger)count / 2, nil);
+  STAssertEquals(snapshotIndex, (NSUInteger)count / 2, nil);
+  NSLog(@"%s -- %u entries: NSKeyedArchiver write %.3fs read %.3fs (%llu bytes); "
+        @"snapshot write %.3fs read %.6fs (%llu bytes)",
+        __PRETTY_FUNCTION__,
+        count,
+        archiveWrite,
+        archiveRead,
+        [[[NSFileManager defaultManager] attributesOfItemAtPath:archivePath error:NULL] fileSize],
+        snapshotWrite,
+        snapshotRead,
+        [[[NSFileManager defaultManager] attributesOfItemAtPath:snapshotPath error:NULL] fileSize]);
+}
+
+- (void)testColdStartBenchmark10K {
+  DVBenchmarkReturnUnlessEnabled();
+
+  [self runColdStartBenchmarkWithEntryCount:10000];
+}
+
+- (void)testColdStartBenchmark100K {
+  DVBenchmarkReturnUnlessEnabled();
+
+  [self runColdStartBenchmarkWithEntryCount:100000];
+}
+
+@end
@@ -0,0 +1,582 @@
+//
+//  DVNotesDocumentTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/20/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <OCMock/OCMock.h>
+#import <UIKit/UIKit.h>
+#import "DVNotesDocument.h"
+#import "DVCacheManager.h"
+#import "DVChunkManifest.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSData+CompressionHelpers.h"
+#import "DVBenchmark.h"
+
+#define kDVTestPassword   @"Orwell."
+#define kDVTestDataPath   @"/StrongBox/20110124210018-1B2F353C.dat"
+
+@interface DVNotesDocumentTest : GTMTestCase {
+
+@private
+  NSString *cacheDataPath_;
+}
+
+@end
+
+
+@implementation DVNotesDocumentTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (DVNotesDocument *)notesWithCacheManager:(id)cacheManager {
+
+  DVNotesDocument *notes = [[[DVNotesDocument alloc] initWithCacheDataPath:cacheDataPath_
+                                                                  password:kDVTestPassword
+                                                              cacheManager:cacheManager] autorelease];
+  notes.synchronousSaves = YES;
+  return notes;
+}
+
+- (NSString *)dropBoxPath:(NSString *)cachePath {
+  return [DVCacheManager dropBoxPathForCachePath:cachePath];
+}
+
+//
+//  Decrypts the cached notes the long way, straight from the files.
+//
+
+- (NSString *)decryptNotes:(DVNotesDocument *)notes {
+
+  KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:notes.notesKeyPath]
+                                                        andPassword:kDVTestPassword];
+  NSData *clearData = [[NSData dataWithContentsOfFile:notes.notesDataPath] aesDecryptWithKey:decryptor.key
+                                                                                      andIV:decryptor.iv];
+  if (decryptor.chunked) {
+    DVChunkManifest *manifest = [[[DVChunkManifest alloc] initWithManifestData:clearData] autorelease];
+    clearData = [manifest dataFromDirectory:notes.notesChunksPath key:decryptor.key compressed:decryptor.compressed];
+  } else if (decryptor.compressed) {
+    clearData = [clearData zlibInflate];
+  }
+  return [[[NSString alloc] initWithData:clearData encoding:NSUTF8StringEncoding] autorelease];
+}
+
+//
+//  Writes a sidecar key and notes into the cache.
+//
+
+- (void)writeNotes:(NSString *)text forNotes:(DVNotesDocument *)notes {
+
+  KeyFileDecryptor *decryptor = [[[KeyFileDecryptor alloc] init] autorelease];
+  decryptor.key = [NSData dataWithRandomBytes:16];
+  decryptor.iv = [NSData dataWithRandomBytes:16];
+  decryptor.fileName = @"notes.txt";
+  decryptor.password = kDVTestPassword;
+  [[decryptor encryptedBlob] writeToFile:notes.notesKeyPath atomically:NO];
+  [[[text dataUsingEncoding:NSUTF8StringEncoding] aesEncryptWithKey:decryptor.key andIV:decryptor.iv]
+   writeToFile:notes.notesDataPath
+   atomically:NO];
+}
+
+//
+//  How many chunks of |text| aren't chunks of |oldText|.
+//
+
+- (NSUInteger)newChunksInText:(NSString *)text oldText:(NSString *)oldText {
+
+  NSMutableSet *chunks[2];
+  NSString *texts[] = { text, oldText };
+  for (int i = 0; i < 2; i++) {
+    NSData *data = [texts[i] dataUsingEncoding:NSUTF8StringEncoding];
+    chunks[i] = [NSMutableSet set];
+    for (NSValue *range in [DVChunkManifest rangesOfChunksInData:data]) {
+      [chunks[i] addObject:[data subdataWithRange:[range rangeValue]]];
+    }
+  }
+  [chunks[0] minusSet:chunks[1]];
+  return [chunks[0] count];
+}
+
+- (void)runFor:(NSTimeInterval)interval {
+  [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  cacheDataPath_ = [[DVCacheManager cachePathForDropBoxPath:kDVTestDataPath] retain];
+  [[NSFileManager defaultManager] createDirectoryAtPath:[cacheDataPath_ stringByDeletingLastPathComponent]
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+}
+
+- (void)tearDown {
+
+  DVNotesDocument *notes = [self notesWithCacheManager:nil];
+  [[NSFileManager defaultManager] removeItemAtPath:notes.notesDataPath error:NULL];
+  [[NSFileManager defaultManager] removeItemAtPath:notes.notesKeyPath error:NULL];
+  [[NSFileManager defaultManager] removeItemAtPath:notes.notesChunksPath error:NULL];
+  [cacheDataPath_ release];
+}
+
+//
+//  With no sidecar files, the notes start empty. The first save makes a key
+//  and uploads it along with the notes.
+//
+
+- (void)testNewNotes {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  STAssertEqualStrings(@"", notes.text, nil);
+  STAssertFalse(notes.hasUnsavedChanges, nil);
+  [notes save];
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:notes.notesKeyPath],
+                @"Nothing to save, so no key yet");
+
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesKeyPath]];
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  notes.text = @"Combination is 12-34-56";
+  STAssertTrue(notes.hasUnsavedChanges, nil);
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertFalse(notes.hasUnsavedChanges, nil);
+  STAssertEqualStrings(@"Combination is 12-34-56", [self decryptNotes:notes], nil);
+
+  //
+  //  Later saves only upload the notes, once the last upload is done.
+  //
+
+  [notes didFinishUploadOfFile:[self dropBoxPath:notes.notesKeyPath]];
+  [notes didFinishUploadOfFile:[self dropBoxPath:notes.notesDataPath]];
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  notes.text = @"Combination is 65-43-21";
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertEqualStrings(@"Combination is 65-43-21", [self decryptNotes:notes], nil);
+}
+
+//
+//  Compressed notes say so in their key, and read back the same.
+//
+
+- (void)testCompressedNotes {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  STAssertFalse(notes.compressesNewNotes, nil);
+  notes.compressesNewNotes = YES;
+  NSString *text = [@"" stringByPaddingToLength:4000
+                                     withString:@"Combination is 12-34-56. "
+                                startingAtIndex:0];
+
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesKeyPath]];
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  notes.text = text;
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+
+  KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:notes.notesKeyPath]
+                                                        andPassword:kDVTestPassword];
+  STAssertTrue(decryptor.compressed, nil);
+  NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:notes.notesDataPath
+                                                                              error:NULL];
+  STAssertTrue([attributes fileSize] < 1000, @"Notes should be compressed (%llu bytes)", [attributes fileSize]);
+  STAssertEqualStrings(text, [self decryptNotes:notes], nil);
+  STAssertEqualStrings(text, [self notesWithCacheManager:mockManager].text, nil);
+}
+
+//
+//  Chunked notes upload their chunks and then the manifest. Another copy of
+//  the notes reads them back, and an edit there uploads only the chunks that
+//  changed.
+//
+
+- (void)testChunkedNotes {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVCacheState equivalent = DVCacheStateEquivalent;
+  [[[mockManager stub] andReturnValue:OCMOCK_VALUE(equivalent)] cacheStateForPath:[OCMArg any]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  notes.chunksNewNotes = YES;
+  NSMutableString *text = [NSMutableString string];
+  for (int i = 0; i < 2000; i++) {
+    [text appendFormat:@"%d. Locker %d, combination %d-%d-%d\n", i, i * 7 % 1000, i % 60, i * 3 % 60, i * 11 % 60];
+  }
+
+  //
+  //  The key and the chunks go up first; the manifest waits for the last
+  //  chunk.
+  //
+
+  NSUInteger chunkCount = [self newChunksInText:text oldText:@""];
+  STAssertTrue(chunkCount > 1, nil);
+  for (NSUInteger i = 0; i < chunkCount + 1; i++) {
+    [[mockManager expect] uploadCacheToDropBoxPath:[OCMArg any]];
+  }
+  notes.text = text;
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+  NSArray *chunkNames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:notes.notesChunksPath error:NULL];
+  STAssertEquals(chunkCount, [chunkNames count], nil);
+  STAssertEqualStrings(text, [self decryptNotes:notes], nil);
+
+  [notes didFinishUploadOfFile:[self dropBoxPath:notes.notesKeyPath]];
+  for (NSUInteger i = 0; i < [chunkNames count]; i++) {
+    NSString *chunkPath = [notes.notesChunksPath stringByAppendingPathComponent:[chunkNames objectAtIndex:i]];
+    if (i + 1 == [chunkNames count]) {
+      [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+    }
+    [notes didFinishUploadOfFile:[self dropBoxPath:chunkPath]];
+  }
+  STAssertNoThrow([mockManager verify], nil);
+  [notes didFinishUploadOfFile:[self dropBoxPath:notes.notesDataPath]];
+
+  //
+  //  Another copy of the notes, reading what DropBox has.
+  //
+
+  DVNotesDocument *otherNotes = [self notesWithCacheManager:mockManager];
+  STAssertEqualStrings(text, otherNotes.text, nil);
+  NSString *editedText = [text stringByReplacingOccurrencesOfString:@"1000. Locker"
+                                                         withString:@"1000. Safe deposit box"];
+  NSUInteger newChunkCount = [self newChunksInText:editedText oldText:text];
+  STAssertTrue(newChunkCount > 0 && newChunkCount <= 2, nil);
+  for (NSUInteger i = 0; i < newChunkCount; i++) {
+    [[mockManager expect] uploadCacheToDropBoxPath:[OCMArg any]];
+  }
+  otherNotes.text = editedText;
+  [otherNotes save];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertEqualStrings(editedText, [self decryptNotes:otherNotes], nil);
+
+  //
+  //  A failed chunk holds the manifest back.
+  //
+
+  NSArray *newChunkNames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:notes.notesChunksPath error:NULL];
+  for (NSString *name in newChunkNames) {
+    if (![chunkNames containsObject:name]) {
+      [otherNotes didFailUploadOfFile:[self dropBoxPath:[notes.notesChunksPath stringByAppendingPathComponent:name]]];
+    }
+  }
+  STAssertNoThrow([mockManager verify], nil);
+}
+
+//
+//  Chunked notes with chunks that aren't cached ask for them, and read as
+//  empty until they come.
+//
+
+- (void)testMissingChunks {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVCacheState equivalent = DVCacheStateEquivalent;
+  [[[mockManager stub] andReturnValue:OCMOCK_VALUE(equivalent)] cacheStateForPath:[OCMArg any]];
+  [[mockManager stub] uploadCacheToDropBoxPath:[OCMArg any]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  notes.chunksNewNotes = YES;
+  notes.text = @"Combination is 12-34-56";
+  [notes save];
+
+  NSString *chunkName = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:notes.notesChunksPath
+                                                                             error:NULL] lastObject];
+  NSString *chunkPath = [notes.notesChunksPath stringByAppendingPathComponent:chunkName];
+  STAssertTrue([notes isNotesFile:chunkPath], nil);
+  STAssertTrue([notes isNotesFile:notes.notesDataPath], nil);
+  STAssertFalse([notes isNotesFile:cacheDataPath_], nil);
+  NSData *chunk = [NSData dataWithContentsOfFile:chunkPath];
+  NSData *manifestFile = [NSData dataWithContentsOfFile:notes.notesDataPath];
+  [[NSFileManager defaultManager] removeItemAtPath:chunkPath error:NULL];
+
+  DVNotesDocument *otherNotes = [self notesWithCacheManager:mockManager];
+  [[mockManager expect] cacheCopyOfDropBoxPath:[self dropBoxPath:chunkPath]];
+  STAssertNil(otherNotes.text, @"Notes missing a chunk haven't loaded");
+  STAssertNoThrow([mockManager verify], nil);
+
+  [[mockManager expect] cacheCopyOfDropBoxPath:[self dropBoxPath:chunkPath]];
+  [otherNotes cacheMissingChunks];
+  STAssertNoThrow([mockManager verify], nil);
+
+  //
+  //  Edits before the notes load are dropped, and never saved over them.
+  //
+
+  [[mockManager expect] cacheCopyOfDropBoxPath:[self dropBoxPath:chunkPath]];
+  otherNotes.text = @"";
+  [otherNotes save];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertFalse(otherNotes.hasUnsavedChanges, nil);
+  STAssertEqualObjects(manifestFile, [NSData dataWithContentsOfFile:notes.notesDataPath], nil);
+
+  //
+  //  Once the chunk arrives, the notes load.
+  //
+
+  [chunk writeToFile:chunkPath atomically:NO];
+  [otherNotes reload];
+  STAssertTrue(otherNotes.loaded, nil);
+  STAssertEqualStrings(@"Combination is 12-34-56", otherNotes.text, nil);
+}
+
+//
+//  Existing notes are decrypted once. Saving without a change uploads
+//  nothing; saving a change uploads only the notes, never the key.
+//
+
+- (void)testExistingNotes {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  [self writeNotes:@"Locker 12" forNotes:notes];
+  NSData *keyFile = [NSData dataWithContentsOfFile:notes.notesKeyPath];
+  STAssertEqualStrings(@"Locker 12", notes.text, nil);
+
+  //
+  //  The key is cached, so replacing the key file doesn't matter now.
+  //
+
+  [[NSData data] writeToFile:notes.notesKeyPath atomically:NO];
+  STAssertEqualStrings(@"Locker 12", notes.text, nil);
+  notes.text = @"Locker 12";
+  [notes save];
+
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  notes.text = @"Locker 13";
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+  [keyFile writeToFile:notes.notesKeyPath atomically:NO];
+  STAssertEqualStrings(@"Locker 13", [self decryptNotes:notes], nil);
+
+  //
+  //  A newer download gets read again.
+  //
+
+  [self writeNotes:@"Locker 14" forNotes:notes];
+  [notes reload];
+  STAssertEqualStrings(@"Locker 14", notes.text, nil);
+}
+
+//
+//  Edits in quick succession make a single save, after the last one.
+//
+
+- (void)testDebouncedSaves {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  [self writeNotes:@"" forNotes:notes];
+  notes.saveDelay = 0.2;
+  notes.text = @"a";
+  [self runFor:0.05];
+  notes.text = @"ab";
+  [self runFor:0.05];
+  notes.text = @"abc";
+  STAssertTrue(notes.hasUnsavedChanges, nil);
+
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  [self runFor:0.5];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertFalse(notes.hasUnsavedChanges, nil);
+  STAssertEqualStrings(@"abc", [self decryptNotes:notes], nil);
+}
+
+//
+//  A save while an upload is in flight waits for it, and saves in between
+//  share one upload.
+//
+
+- (void)testUploadInFlight {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  [self writeNotes:@"1" forNotes:notes];
+  NSString *notesPath = [self dropBoxPath:notes.notesDataPath];
+
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  notes.text = @"2";
+  [notes save];
+  notes.text = @"3";
+  [notes save];
+  notes.text = @"4";
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertEqualStrings(@"4", [self decryptNotes:notes], nil);
+
+  [notes didFinishUploadOfFile:@"/StrongBox/other.dat"];
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  [notes didFinishUploadOfFile:notesPath];
+  STAssertNoThrow([mockManager verify], nil);
+
+  //
+  //  A failed upload of an unknown file lets the next one go, too.
+  //
+
+  notes.text = @"5";
+  [notes save];
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  [notes didFinishUploadOfFile:nil];
+  STAssertNoThrow([mockManager verify], nil);
+}
+
+//
+//  A failed upload is reported with its cache path, and still lets the next
+//  upload go.
+//
+
+- (void)testFailedUpload {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  [self writeNotes:@"1" forNotes:notes];
+  NSString *notesPath = [self dropBoxPath:notes.notesDataPath];
+
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  notes.text = @"2";
+  [notes save];
+  notes.text = @"3";
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  [notes didFailUploadOfFile:notes.notesDataPath];
+  STAssertNoThrow([mockManager verify], nil);
+
+  [notes didFailUploadOfFile:notes.notesDataPath];
+  [[mockManager expect] uploadCacheToDropBoxPath:notesPath];
+  notes.text = @"4";
+  [notes save];
+  STAssertNoThrow([mockManager verify], nil);
+}
+
+//
+//  A sidecar key that won't decrypt with the password is left alone. The
+//  save fails and tells the delegate, rather than making a new key.
+//
+
+- (void)testUnreadableKey {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  id mockDelegate = [OCMockObject mockForProtocol:@protocol(DVNotesDocumentDelegate)];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  notes.delegate = mockDelegate;
+  KeyFileDecryptor *decryptor = [[[KeyFileDecryptor alloc] init] autorelease];
+  decryptor.key = [NSData dataWithRandomBytes:16];
+  decryptor.iv = [NSData dataWithRandomBytes:16];
+  decryptor.fileName = @"notes.txt";
+  decryptor.password = @"Huxley.";
+  [[decryptor encryptedBlob] writeToFile:notes.notesKeyPath atomically:NO];
+  NSData *keyFile = [NSData dataWithContentsOfFile:notes.notesKeyPath];
+
+  [[mockDelegate expect] notesDocumentDidFailToSave:notes];
+  notes.text = @"Locker 12";
+  [notes save];
+  STAssertNoThrow([mockDelegate verify], nil);
+  STAssertNoThrow([mockManager verify], @"Nothing should be uploaded");
+  STAssertEqualObjects(keyFile, [NSData dataWithContentsOfFile:notes.notesKeyPath], 
+                       @"The key should not be replaced");
+  STAssertTrue(notes.hasUnsavedChanges, nil);
+}
+
+//
+//  Cancelling puts back the text from before editing, and saves it only if
+//  the edits were saved.
+//
+
+- (void)testCancelEditing {
+
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  [self writeNotes:@"before" forNotes:notes];
+  [notes beginEditing];
+  notes.text = @"during";
+  [notes cancelEditing];
+  STAssertEqualStrings(@"before", notes.text, nil);
+  STAssertFalse(notes.hasUnsavedChanges, nil);
+
+  [notes beginEditing];
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  notes.text = @"during";
+  [notes save];
+  [notes didFinishUploadOfFile:[self dropBoxPath:notes.notesDataPath]];
+  [[mockManager expect] uploadCacheToDropBoxPath:[self dropBoxPath:notes.notesDataPath]];
+  [notes cancelEditing];
+  STAssertNoThrow([mockManager verify], nil);
+  STAssertEqualStrings(@"before", [self decryptNotes:notes], nil);
+}
+
+//
+//  Benchmark: editing 1MB of notes. Compares one keystroke against the old
+//  way of saving, which unlocked the key and encrypted the notes every time.
+//
+
+- (void)testLargeNotesBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  id mockManager = [OCMockObject niceMockForClass:[DVCacheManager class]];
+  DVNotesDocument *notes = [self notesWithCacheManager:mockManager];
+  NSMutableString *text = [NSMutableString stringWithCapacity:1024 * 1024];
+  while ([text length] < 1024 * 1024) {
+    [text appendString:@"The quick brown fox jumps over the lazy dog. "];
+  }
+  [self writeNotes:text forNotes:notes];
+  NSUInteger count = 20;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  STAssertEquals([text length], [notes.text length], nil);
+  CFAbsoluteTime load = CFAbsoluteTimeGetCurrent() - start;
+
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [text appendString:@"x"];
+    notes.text = text;
+  }
+  CFAbsoluteTime edits = (CFAbsoluteTimeGetCurrent() - start) / count;
+  start = CFAbsoluteTimeGetCurrent();
+  [notes save];
+  CFAbsoluteTime save = CFAbsoluteTimeGetCurrent() - start;
+
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:notes.notesKeyPath]
+                                                          andPassword:kDVTestPassword];
+    [[[text dataUsingEncoding:NSUTF8StringEncoding] aesEncryptWithKey:decryptor.key andIV:decryptor.iv]
+     writeToFile:notes.notesDataPath
+     atomically:YES];
+    [pool drain];
+  }
+  CFAbsoluteTime oldSaves = (CFAbsoluteTimeGetCurrent() - start) / count;
+
+  NSLog(@"%s -- %u bytes: load %.3fs, edit %.6fs, save %.3fs, old save %.3fs",
+        __PRETTY_FUNCTION__,
+        [text length],
+        load,
+        edits,
+        save,
+        oldSaves);
+}
+
+@end
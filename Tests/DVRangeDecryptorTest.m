@@ -0,0 +1,219 @@
+//
+//  DVRangeDecryptorTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/22/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVRangeDecryptor.h"
+#import "DVThumbnailCache.h"
+#import "NSData+EncryptionHelpers.h"
+#import "DVBenchmark.h"
+
+@interface DVRangeDecryptorTest : GTMTestCase {
+
+@private
+  NSData *key_;
+  NSData *iv_;
+  NSString *path_;
+}
+
+@end
+
+
+@implementation DVRangeDecryptorTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Encrypts |clearText| into |path_|, and opens it.
+//
+
+- (DVRangeDecryptor *)decryptorForClearText:(NSData *)clearText {
+
+  [[clearText aesEncryptWithKey:key_ andIV:iv_] writeToFile:path_ atomically:NO];
+  return [[[DVRangeDecryptor alloc] initWithFile:path_ key:key_ iv:iv_] autorelease];
+}
+
+//
+//  Writes a PDF with |pageCount| pages of text, and returns it.
+//
+
+- (NSData *)pdfWithPageCount:(NSUInteger)pageCount {
+
+  NSMutableData *pdf = [NSMutableData data];
+  UIFont *font = [UIFont systemFontOfSize:10];
+  UIGraphicsBeginPDFContextToData(pdf, CGRectMake(0, 0, 612, 792), nil);
+  for (NSUInteger page = 0; page < pageCount; page++) {
+    UIGraphicsBeginPDFPage();
+    for (NSUInteger line = 0; line < 60; line++) {
+      NSString *text = [NSString stringWithFormat:@"Page %u, line %u: %@",
+                        page,
+                        line,
+                        [[NSData dataWithRandomBytes:24] hexString]];
+      [text drawAtPoint:CGPointMake(36, 36 + line * 12) withFont:font];
+    }
+  }
+  UIGraphicsEndPDFContext();
+  return pdf;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  key_ = [[NSData dataWithHexString:@"7F1B5F19AA935154FC9F04C7CE41F6B5"] retain];
+  iv_ = [[NSData dataWithHexString:@"356624F105CB9C29B507C5F9933913CA"] retain];
+  path_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"range-decryptor-test.dat"] retain];
+}
+
+- (void)tearDown {
+
+  [[NSFileManager defaultManager] removeItemAtPath:path_ error:NULL];
+  [key_ release];
+  [iv_ release];
+  [path_ release];
+}
+
+//
+//  Any range decrypts to the same bytes as decrypting the whole file, for
+//  lengths on and off the block size.
+//
+
+- (void)testRanges {
+
+  NSUInteger lengths[] = { 0, 1, 15, 16, 17, 1000, 4096 };
+  for (NSUInteger i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    NSData *clearText = [NSData dataWithRandomBytes:lengths[i]];
+    DVRangeDecryptor *decryptor = [self decryptorForClearText:clearText];
+    STAssertNotNil(decryptor, nil);
+    STAssertEquals((unsigned long long)lengths[i], decryptor.length, nil);
+
+    NSMutableData *buffer = [NSMutableData dataWithLength:lengths[i] + 32];
+    for (NSUInteger offset = 0; offset <= lengths[i]; offset += 7) {
+      NSUInteger count = MIN((NSUInteger)37, lengths[i] - offset);
+      STAssertEquals((size_t)count,
+                     [decryptor getBytes:[buffer mutableBytes] atOffset:offset count:37],
+                     @"Length %u, offset %u", lengths[i], offset);
+      STAssertEqualObjects([clearText subdataWithRange:NSMakeRange(offset, count)],
+                           [buffer subdataWithRange:NSMakeRange(0, count)],
+                           @"Length %u, offset %u", lengths[i], offset);
+    }
+    STAssertEquals((size_t)lengths[i],
+                   [decryptor getBytes:[buffer mutableBytes] atOffset:0 count:[buffer length]],
+                   @"Reads stop at the end of the cleartext");
+    STAssertEquals((size_t)0, [decryptor getBytes:[buffer mutableBytes] atOffset:lengths[i] + 1 count:1], nil);
+  }
+}
+
+//
+//  A range only decrypts the blocks it covers.
+//
+
+- (void)testBytesDecrypted {
+
+  DVRangeDecryptor *decryptor = [self decryptorForClearText:[NSData dataWithRandomBytes:100000]];
+  char buffer[10];
+  STAssertEquals((unsigned long long)0, decryptor.bytesDecrypted, nil);
+  [decryptor getBytes:buffer atOffset:50000 count:sizeof(buffer)];
+  STAssertEquals((unsigned long long)16, decryptor.bytesDecrypted, nil);
+  [decryptor getBytes:buffer atOffset:70010 count:sizeof(buffer)];
+  STAssertEquals((unsigned long long)48, decryptor.bytesDecrypted, @"A range across a block boundary needs both blocks");
+}
+
+- (void)testBadFiles {
+
+  [self decryptorForClearText:[@"DropVault" dataUsingEncoding:NSUTF8StringEncoding]];
+  NSData *wrongKey = [NSData dataWithHexString:@"00112233445566778899AABBCCDDEEFF"];
+  STAssertNil([[[DVRangeDecryptor alloc] initWithFile:path_ key:wrongKey iv:iv_] autorelease],
+              @"The wrong key should fail the padding check");
+
+  NSData *cipherText = [NSData dataWithContentsOfFile:path_];
+  [[cipherText subdataWithRange:NSMakeRange(0, 15)] writeToFile:path_ atomically:NO];
+  STAssertNil([[[DVRangeDecryptor alloc] initWithFile:path_ key:key_ iv:iv_] autorelease],
+              @"A truncated file can't be decrypted");
+  STAssertNil([[[DVRangeDecryptor alloc] initWithFile:@"/missing.dat" key:key_ iv:iv_] autorelease], nil);
+}
+
+//
+//  Core Graphics can draw the first page of an encrypted PDF through the
+//  data provider, without it all being decrypted.
+//
+
+- (void)testFirstPage {
+
+  DVRangeDecryptor *decryptor = [self decryptorForClearText:[self pdfWithPageCount:200]];
+  CGDataProviderRef provider = [decryptor newDataProvider];
+  CGPDFDocumentRef document = CGPDFDocumentCreateWithProvider(provider);
+  CGDataProviderRelease(provider);
+  STAssertTrue(document != NULL, nil);
+  STAssertEquals((size_t)200, CGPDFDocumentGetNumberOfPages(document), nil);
+
+  CGImageRef image = [DVThumbnailCache newImageOfPDFPage:CGPDFDocumentGetPage(document, 1)
+                                             fittingSize:CGSizeMake(768, 1024)];
+  CGPDFDocumentRelease(document);
+  STAssertEquals((size_t)768, CGImageGetWidth(image), nil);
+  STAssertEquals((size_t)994, CGImageGetHeight(image), nil);
+  CGImageRelease(image);
+  STAssertTrue(decryptor.bytesDecrypted < decryptor.length / 2,
+               @"Decrypted %llu of %llu bytes", decryptor.bytesDecrypted, decryptor.length);
+}
+
+//
+//  Benchmark: the time to the first page, against decrypting the whole file,
+//  as the document grows.
+//
+
+- (void)testFirstPageBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSUInteger pageCounts[] = { 10, 100, 1000 };
+  for (NSUInteger i = 0; i < sizeof(pageCounts) / sizeof(pageCounts[0]); i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    DVRangeDecryptor *decryptor = [self decryptorForClearText:[self pdfWithPageCount:pageCounts[i]]];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    CGDataProviderRef provider = [decryptor newDataProvider];
+    CGPDFDocumentRef document = CGPDFDocumentCreateWithProvider(provider);
+    CGImageRef image = [DVThumbnailCache newImageOfPDFPage:CGPDFDocumentGetPage(document, 1)
+                                               fittingSize:CGSizeMake(768, 1024)];
+    CFAbsoluteTime firstPage = CFAbsoluteTimeGetCurrent() - start;
+    CGImageRelease(image);
+    CGPDFDocumentRelease(document);
+    CGDataProviderRelease(provider);
+
+    start = CFAbsoluteTimeGetCurrent();
+    [[NSData dataWithContentsOfFile:path_] aesDecryptWithKey:key_ andIV:iv_];
+    CFAbsoluteTime whole = CFAbsoluteTimeGetCurrent() - start;
+
+    NSLog(@"%s -- %u pages, %llu bytes: first page %.4fs (%llu bytes decrypted), whole file %.4fs",
+          __PRETTY_FUNCTION__,
+          pageCounts[i],
+          decryptor.length,
+          firstPage,
+          decryptor.bytesDecrypted,
+          whole);
+    [pool drain];
+  }
+}
+
+@end
@@ -24,8 +24,10 @@
 #import "DVTextEditController.h"
 
 
-@interface DVTextEditControllerTest : SenTestCase {
+@interface DVTextEditControllerTest : SenTestCase <DVTextEditDelegate> {
   
+@private
+  NSUInteger changeCount_;
 }
 
 @end
@@ -85,4 +87,31 @@
   STAssertNoThrow([mockDelegate verify], @"Done message should get sent");
 }
 
+//
+//  Make sure the delegate hears about changes to the text.
+//
+
+- (void)testChange {
+  
+  DVTextEditController *controller = [[[DVTextEditController alloc] init] autorelease];
+  STAssertNotNil(controller.view, @"Controller should have a view");
+  STAssertEquals((id)controller, (id)controller.textView.delegate, 
+                 @"Controller should be the text view's delegate");
+  controller.delegate = self;
+  [controller textViewDidChange:controller.textView];
+  STAssertEquals((NSUInteger)1, changeCount_, @"Change message should get sent");
+}
+
+#pragma mark - DVTextEditDelegate
+
+- (void)textEditControllerDidCancel:(DVTextEditController *)controller {
+}
+
+- (void)textEditControllerDidFinish:(DVTextEditController *)controller {
+}
+
+- (void)textEditControllerDidChange:(DVTextEditController *)controller {
+  changeCount_++;
+}
+
 @end
@@ -0,0 +1,328 @@
+//
+//  DVThumbnailCacheTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/21/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVThumbnailCache.h"
+#import "NSData+EncryptionHelpers.h"
+#import "DVBenchmark.h"
+
+#define kDVThumbnailTestTimeout   (10.0)
+
+@interface DVThumbnailCacheTest : GTMTestCase {
+
+@private
+  NSString *directory_;
+  NSData *key_;
+  NSUInteger completions_;
+  BOOL made_;
+  UIImage *loaded_;
+}
+
+@end
+
+
+@implementation DVThumbnailCacheTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Writes a solid red |width| x |height| PNG, and returns its path.
+//
+
+- (NSString *)imageFileWithWidth:(CGFloat)width height:(CGFloat)height {
+
+  UIGraphicsBeginImageContext(CGSizeMake(width, height));
+  [[UIColor redColor] setFill];
+  UIRectFill(CGRectMake(0, 0, width, height));
+  UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+  UIGraphicsEndImageContext();
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"thumbnail-test.png"];
+  [UIImagePNGRepresentation(image) writeToFile:path atomically:NO];
+  return path;
+}
+
+//
+//  Writes a one page, US Letter PDF, and returns its path.
+//
+
+- (NSString *)pdfFile {
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"thumbnail-test.pdf"];
+  UIGraphicsBeginPDFContextToFile(path, CGRectMake(0, 0, 612, 792), nil);
+  UIGraphicsBeginPDFPage();
+  [@"DropVault" drawAtPoint:CGPointMake(72, 72) withFont:[UIFont systemFontOfSize:24]];
+  UIGraphicsEndPDFContext();
+  return path;
+}
+
+//
+//  Asks |cache| for a thumbnail, and runs the run loop until it's done.
+//
+
+- (BOOL)makeThumbnailInCache:(DVThumbnailCache *)cache
+                  forKeyName:(NSString *)keyName
+                    fromFile:(NSString *)path {
+
+  NSUInteger expected = completions_ + 1;
+  [cache makeThumbnailForKeyName:keyName fromFile:path withKey:key_ completion:^(BOOL made) {
+    made_ = made;
+    completions_++;
+  }];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:kDVThumbnailTestTimeout];
+  while (completions_ < expected && [timeout timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertEquals(expected, completions_, @"Completion should run");
+  return made_;
+}
+
+//
+//  Asks |cache| to load a thumbnail, and runs the run loop until it's done.
+//
+
+- (UIImage *)loadThumbnailInCache:(DVThumbnailCache *)cache
+                       forKeyName:(NSString *)keyName
+                          withKey:(NSData *)key {
+
+  NSUInteger expected = completions_ + 1;
+  loaded_ = nil;
+  [cache loadThumbnailForKeyName:keyName withKey:key completion:^(UIImage *thumbnail) {
+    loaded_ = thumbnail;
+    completions_++;
+  }];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:kDVThumbnailTestTimeout];
+  while (completions_ < expected && [timeout timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertEquals(expected, completions_, @"Completion should run");
+  return loaded_;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  directory_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"DVThumbnailCacheTest"] retain];
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+  key_ = [[NSData dataWithRandomBytes:16] retain];
+  completions_ = 0;
+}
+
+- (void)tearDown {
+
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+  [directory_ release];
+  [key_ release];
+}
+
+- (void)testCanMakeThumbnail {
+
+  STAssertTrue([DVThumbnailCache canMakeThumbnailForFileName:@"scan.PDF"], nil);
+  STAssertTrue([DVThumbnailCache canMakeThumbnailForFileName:@"photo.jpg"], nil);
+  STAssertTrue([DVThumbnailCache canMakeThumbnailForFileName:@"/tmp/diagram.png"], nil);
+  STAssertFalse([DVThumbnailCache canMakeThumbnailForFileName:@"letter.docx"], nil);
+  STAssertFalse([DVThumbnailCache canMakeThumbnailForFileName:@"README"], nil);
+}
+
+//
+//  An image gets a thumbnail that fits in |kDVThumbnailSize| pixels, shown
+//  at half that in points. On disk, it's encrypted.
+//
+
+- (void)testImageThumbnail {
+
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  NSString *keyName = @"/StrongBox/20110124210018-1B2F353C.key";
+  STAssertFalse([cache hasThumbnailForKeyName:keyName], nil);
+  STAssertNil([self loadThumbnailInCache:cache forKeyName:keyName withKey:key_], nil);
+
+  STAssertTrue([self makeThumbnailInCache:cache
+                               forKeyName:keyName
+                                 fromFile:[self imageFileWithWidth:400 height:200]], nil);
+  STAssertTrue([cache hasThumbnailForKeyName:keyName], nil);
+  STAssertNil([cache cachedThumbnailForKeyName:keyName], @"Nothing is read until it's asked for");
+  UIImage *thumbnail = [self loadThumbnailInCache:cache forKeyName:keyName withKey:key_];
+  STAssertNotNil(thumbnail, nil);
+  STAssertEquals(thumbnail, [cache cachedThumbnailForKeyName:keyName], nil);
+  STAssertEquals(CGSizeMake(kDVThumbnailSize / 2, kDVThumbnailSize / 4), thumbnail.size, nil);
+
+  NSString *path = [directory_ stringByAppendingPathComponent:@"20110124210018-1B2F353C.thumb"];
+  NSData *blob = [NSData dataWithContentsOfFile:path];
+  STAssertNotNil(blob, nil);
+  const unsigned char jpegMagic[] = { 0xFF, 0xD8 };
+  STAssertFalse(memcmp([blob bytes] + 16, jpegMagic, sizeof(jpegMagic)) == 0,
+                @"The thumbnail should not be a readable JPEG");
+
+  //
+  //  A second request does nothing; a new cache finds the thumbnail, but
+  //  can't read it without the right key.
+  //
+
+  STAssertFalse([self makeThumbnailInCache:cache
+                                forKeyName:keyName
+                                  fromFile:[self imageFileWithWidth:400 height:200]], nil);
+  DVThumbnailCache *otherCache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  STAssertTrue([otherCache hasThumbnailForKeyName:keyName], nil);
+  STAssertNil([self loadThumbnailInCache:otherCache forKeyName:keyName withKey:[NSData dataWithRandomBytes:16]], nil);
+
+  [cache removeThumbnailForKeyName:keyName];
+  STAssertFalse([cache hasThumbnailForKeyName:keyName], nil);
+  STAssertNil([cache cachedThumbnailForKeyName:keyName], nil);
+  STAssertNil([self loadThumbnailInCache:cache forKeyName:keyName withKey:key_], nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], nil);
+}
+
+- (void)testPDFThumbnail {
+
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  STAssertTrue([self makeThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" fromFile:[self pdfFile]], nil);
+  UIImage *thumbnail = [self loadThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" withKey:key_];
+  STAssertEquals(CGSizeMake(37, 48), thumbnail.size, nil);
+
+  [cache removeAllThumbnails];
+  STAssertFalse([cache hasThumbnailForKeyName:@"/StrongBox/a.key"], nil);
+}
+
+//
+//  Forgetting decrypted images leaves the thumbnail on disk, but it can't be
+//  shown again without the key. A load that was still going is dropped.
+//
+
+- (void)testForgetDecryptedImages {
+
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  STAssertTrue([self makeThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" fromFile:[self pdfFile]], nil);
+  STAssertNotNil([self loadThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" withKey:key_], nil);
+  STAssertNotNil([self loadThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" withKey:nil], nil);
+
+  [cache forgetDecryptedImages];
+  STAssertTrue([cache hasThumbnailForKeyName:@"/StrongBox/a.key"], nil);
+  STAssertNil([cache cachedThumbnailForKeyName:@"/StrongBox/a.key"], nil);
+  STAssertNil([self loadThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" withKey:nil], nil);
+
+  __block BOOL called = NO;
+  [cache loadThumbnailForKeyName:@"/StrongBox/a.key" withKey:key_ completion:^(UIImage *thumbnail) {
+    called = YES;
+  }];
+  [cache forgetDecryptedImages];
+  NSDate *until = [NSDate dateWithTimeIntervalSinceNow:1.0];
+  while ([until timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertFalse(called, nil);
+  STAssertNil([cache cachedThumbnailForKeyName:@"/StrongBox/a.key"], nil);
+  STAssertNotNil([self loadThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" withKey:key_], nil);
+}
+
+//
+//  A thumbnail is thrown away when the revision of its data file changes,
+//  including one made before its revision was known.
+//
+
+- (void)testRevisions {
+
+  NSString *keyName = @"/StrongBox/a.key";
+  NSString *otherKeyName = @"/StrongBox/b.key";
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  STAssertTrue([self makeThumbnailInCache:cache forKeyName:keyName fromFile:[self pdfFile]], nil);
+  [cache updateRevisions:[NSDictionary dictionaryWithObject:[NSNumber numberWithLongLong:3] forKey:keyName]];
+  STAssertFalse([cache hasThumbnailForKeyName:keyName], nil);
+  STAssertNil([self loadThumbnailInCache:cache forKeyName:keyName withKey:key_], nil);
+
+  STAssertTrue([self makeThumbnailInCache:cache forKeyName:keyName fromFile:[self pdfFile]], nil);
+  STAssertTrue([self makeThumbnailInCache:cache forKeyName:otherKeyName fromFile:[self pdfFile]], nil);
+  STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[directory_ stringByAppendingPathComponent:@"a.3.thumb"]], nil);
+  [cache updateRevisions:[NSDictionary dictionaryWithObject:[NSNumber numberWithLongLong:3] forKey:keyName]];
+  STAssertTrue([cache hasThumbnailForKeyName:keyName], nil);
+
+  //
+  //  A new cache reads the revision back from the file name.
+  //
+
+  DVThumbnailCache *otherCache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  STAssertTrue([otherCache hasThumbnailForKeyName:keyName], nil);
+  [otherCache updateRevisions:[NSDictionary dictionaryWithObject:[NSNumber numberWithLongLong:4] forKey:keyName]];
+  STAssertFalse([otherCache hasThumbnailForKeyName:keyName], nil);
+  STAssertTrue([otherCache hasThumbnailForKeyName:otherKeyName], nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[directory_ stringByAppendingPathComponent:@"a.3.thumb"]], nil);
+}
+
+//
+//  Documents that can't have thumbnails, or can't be read, don't get one.
+//
+
+- (void)testNoThumbnail {
+
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"thumbnail-test.docx"];
+  [[NSData dataWithRandomBytes:100] writeToFile:path atomically:NO];
+  STAssertFalse([self makeThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" fromFile:path], nil);
+
+  path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"thumbnail-test.jpg"];
+  [[NSData dataWithRandomBytes:100] writeToFile:path atomically:NO];
+  STAssertFalse([self makeThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" fromFile:path], nil);
+  STAssertFalse([self makeThumbnailInCache:cache forKeyName:@"/StrongBox/a.key" fromFile:@"/missing.pdf"], nil);
+  STAssertFalse([cache hasThumbnailForKeyName:@"/StrongBox/a.key"], nil);
+}
+
+//
+//  Benchmark: making a thumbnail of a 2048 x 1536 image, against showing
+//  it once it's made.
+//
+
+- (void)testThumbnailBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  DVThumbnailCache *cache = [[[DVThumbnailCache alloc] initWithDirectory:directory_] autorelease];
+  NSString *path = [self imageFileWithWidth:2048 height:1536];
+  NSUInteger count = 10;
+
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [self makeThumbnailInCache:cache forKeyName:[NSString stringWithFormat:@"%u.key", i] fromFile:path];
+  }
+  CFAbsoluteTime make = (CFAbsoluteTimeGetCurrent() - start) / count;
+
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    DVThumbnailCache *coldCache = [[DVThumbnailCache alloc] initWithDirectory:directory_];
+    STAssertNotNil([self loadThumbnailInCache:coldCache
+                                   forKeyName:[NSString stringWithFormat:@"%u.key", i]
+                                      withKey:key_], nil);
+    [coldCache release];
+  }
+  CFAbsoluteTime show = (CFAbsoluteTimeGetCurrent() - start) / count;
+
+  NSLog(@"%s -- make %.4fs, show %.4fs, %u bytes on disk",
+        __PRETTY_FUNCTION__,
+        make,
+        show,
+        [[NSData dataWithContentsOfFile:[directory_ stringByAppendingPathComponent:@"0.thumb"]] length]);
+}
+
+@end
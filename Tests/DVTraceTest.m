@@ -0,0 +1,224 @@
+//
+//  DVTraceTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/17/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import <OCMock/OCMock.h>
+#import "DVTrace.h"
+#import "DVCacheManager.h"
+#import "NSString+SBJSON.h"
+#import "DVBenchmark.h"
+
+@interface DVTraceTest : GTMTestCase {
+
+@private
+  NSUInteger namesBuilt_;
+}
+
+@end
+
+
+@implementation DVTraceTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (NSString *)spanName {
+  namesBuilt_++;
+  return @"counted";
+}
+
+//
+//  The events named |name|, in order.
+//
+
+- (NSArray *)eventsNamed:(NSString *)name {
+
+  return [[DVTrace events] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"name == %@", name]];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+  [DVTrace reset];
+}
+
+- (void)tearDown {
+  [DVTrace setEnabled:NO];
+  [DVTrace reset];
+}
+
+//
+//  With tracing off, nothing is recorded, and the arguments to the macros
+//  aren't even evaluated.
+//
+
+- (void)testDisabled {
+
+  [DVTrace setEnabled:NO];
+  DVTraceSpan span = DVTraceBegin([self spanName], kDVTraceCrypto);
+  STAssertEquals(kDVTraceNoSpan, span, nil);
+  DVTraceEnd(span);
+  span = DVTraceBeginAsync([self spanName], kDVTraceNetwork, kDVTraceNoSpan);
+  DVTraceEnd(span);
+  STAssertEquals((NSUInteger)0, namesBuilt_, nil);
+  STAssertEquals((NSUInteger)0, [[DVTrace events] count], nil);
+}
+
+//
+//  Scoped spans nest in the enclosing scoped span on the same thread; async
+//  spans nest only under the parent they're given.
+//
+
+- (void)testNesting {
+
+  [DVTrace setEnabled:YES];
+  DVTraceSpan outer = DVTraceBegin(@"outer", kDVTraceUI);
+  DVTraceSpan inner = DVTraceBegin(@"inner", kDVTraceCrypto);
+  DVTraceSpan child = DVTraceBeginAsync(@"child", kDVTraceNetwork, outer);
+  DVTraceSpan loose = DVTraceBeginAsync(@"loose", kDVTraceNetwork, kDVTraceNoSpan);
+  DVTraceEnd(inner);
+  __block DVTraceSpan other = kDVTraceNoSpan;
+  dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    other = DVTraceBegin(@"other thread", kDVTraceCoreData);
+    DVTraceEnd(other);
+  });
+  DVTraceSpan after = DVTraceBegin(@"after", kDVTraceUI);
+  DVTraceEnd(after);
+  DVTraceEnd(outer);
+  DVTraceEnd(child);
+  DVTraceEnd(loose);
+  DVTraceEnd(loose);
+
+  STAssertEquals((NSUInteger)12, [[DVTrace events] count], @"One begin and one end per span");
+  NSString *outerID = [[[self eventsNamed:@"outer"] objectAtIndex:0] objectForKey:@"id"];
+  for (NSString *name in [NSArray arrayWithObjects:@"outer", @"inner", @"child", @"after", nil]) {
+    NSArray *events = [self eventsNamed:name];
+    STAssertEquals((NSUInteger)2, [events count], @"%@", name);
+    STAssertEqualStrings(@"b", [[events objectAtIndex:0] objectForKey:@"ph"], nil);
+    STAssertEqualStrings(@"e", [[events objectAtIndex:1] objectForKey:@"ph"], nil);
+    for (NSDictionary *event in events) {
+      STAssertEqualStrings(outerID, [event objectForKey:@"id"], @"%@ should nest under outer", name);
+    }
+  }
+  STAssertFalse([outerID isEqual:[[[self eventsNamed:@"loose"] lastObject] objectForKey:@"id"]], nil);
+  STAssertFalse([outerID isEqual:[[[self eventsNamed:@"other thread"] lastObject] objectForKey:@"id"]],
+                @"Scoped spans don't nest across threads");
+  STAssertEqualStrings(kDVTraceCrypto,
+                       [[[[self eventsNamed:@"inner"] objectAtIndex:0] objectForKey:@"args"] objectForKey:@"stage"],
+                       nil);
+}
+
+//
+//  The trace file is Chrome's format: an object with a |traceEvents| array.
+//
+
+- (void)testWriteTrace {
+
+  [DVTrace setEnabled:YES];
+  DVTraceSpan span = DVTraceBegin(@"written", kDVTraceParse);
+  DVTraceEnd(span);
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"DVTraceTest.json"];
+  STAssertTrue([DVTrace writeTraceToFile:path], nil);
+
+  NSDictionary *trace = [[NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL] JSONValue];
+  NSArray *events = [trace objectForKey:@"traceEvents"];
+  STAssertEquals((NSUInteger)2, [events count], nil);
+  NSDictionary *begin = [events objectAtIndex:0];
+  for (NSString *key in [NSArray arrayWithObjects:@"name", @"ph", @"cat", @"id", @"ts", @"pid", @"tid", nil]) {
+    STAssertNotNil([begin objectForKey:key], @"Events need %@", key);
+  }
+  STAssertTrue([[[events objectAtIndex:1] objectForKey:@"ts"] doubleValue] >= [[begin objectForKey:@"ts"] doubleValue], nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+//
+//  The metadata request is traced from the request to the response.
+//
+
+- (void)testTracesMetadataRequest {
+
+  [DVTrace setEnabled:YES];
+  DVCacheManager *cm = [[[DVCacheManager alloc] init] autorelease];
+  id mockClient = [OCMockObject niceMockForClass:[DBRestClient class]];
+  cm.restClient = mockClient;
+  [cm loadMetadata];
+  STAssertEquals((NSUInteger)1, [[self eventsNamed:@"metadata request"] count], nil);
+  [cm restClient:nil loadMetadataFailedWithError:nil];
+  STAssertEquals((NSUInteger)2, [[self eventsNamed:@"metadata request"] count], nil);
+}
+
+//
+//  The rest client hands each step of parsing the listing to the cache
+//  manager, which runs it once inside a span.
+//
+
+- (void)testTracesMetadataParse {
+
+  [DVTrace setEnabled:YES];
+  DVCacheManager *cm = [[[DVCacheManager alloc] init] autorelease];
+  __block NSUInteger runs = 0;
+  [cm restClient:nil parseMetadataStep:@"parse metadata chunk" usingBlock:^{
+    runs++;
+  }];
+  STAssertEquals((NSUInteger)1, runs, nil);
+  STAssertEquals((NSUInteger)2, [[self eventsNamed:@"parse metadata chunk"] count], nil);
+}
+
+//
+//  Benchmark: a million begin/end pairs with tracing off, against a hundred
+//  thousand with it on.
+//
+
+- (void)testOverheadBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSUInteger count = 1000000;
+  [DVTrace setEnabled:NO];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    DVTraceSpan span = DVTraceBegin(@"off", kDVTraceCrypto);
+    DVTraceEnd(span);
+  }
+  CFAbsoluteTime disabled = CFAbsoluteTimeGetCurrent() - start;
+
+  NSUInteger enabledCount = kDVTraceMaxEvents / 2;
+  [DVTrace setEnabled:YES];
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < enabledCount; i++) {
+    DVTraceSpan span = DVTraceBegin(@"on", kDVTraceCrypto);
+    DVTraceEnd(span);
+  }
+  CFAbsoluteTime enabled = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+  STAssertEquals((NSUInteger)kDVTraceMaxEvents, [[DVTrace events] count], nil);
+
+  NSLog(@"%s -- disabled %.1f ns/span, enabled %.1f us/span",
+        __PRETTY_FUNCTION__,
+        disabled / count * 1e9,
+        enabled / enabledCount * 1e6);
+}
+
+@end
@@ -0,0 +1,172 @@
+//
+//  DVVaultCryptoTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVVaultCrypto.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+
+#define kDVVaultCryptoTestPassword          @"Orwell."
+
+@interface DVVaultCryptoTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVVaultCryptoTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Encrypts |data| through a |DVVaultCryptor|, |pieceLength| bytes at a
+//  time, the way the command line encryptor streams a file.
+//
+
+- (NSData *)streamEncrypt:(NSData *)data
+                  withKey:(NSData *)key
+                       iv:(NSData *)iv
+              pieceLength:(NSUInteger)pieceLength {
+
+  NSMutableData *encrypted = [NSMutableData dataWithLength:DVVaultEncryptedLength([data length])];
+  unsigned char *output = [encrypted mutableBytes];
+  size_t encryptedLength = 0;
+  size_t length = 0;
+  DVVaultCryptor *cryptor = DVVaultCryptorCreate([key bytes], [iv bytes]);
+  STAssertTrue(cryptor != NULL, nil);
+  for (NSUInteger offset = 0; offset < [data length]; offset += pieceLength) {
+    NSUInteger thisPiece = MIN(pieceLength, [data length] - offset);
+    STAssertTrue(DVVaultCryptorUpdate(cryptor,
+                                      (const char *)[data bytes] + offset,
+                                      thisPiece,
+                                      output + encryptedLength,
+                                      &length), nil);
+    encryptedLength += length;
+  }
+  STAssertTrue(DVVaultCryptorFinal(cryptor, output + encryptedLength, &length), nil);
+  encryptedLength += length;
+  DVVaultCryptorRelease(cryptor);
+  STAssertEquals((size_t)[encrypted length], encryptedLength, nil);
+  return encrypted;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Rebuilding each checked-in key and data file, from its own salt, key,
+//  and IV, gives back exactly the same bytes.
+//
+
+- (void)testMatchesTestData {
+
+  NSArray *keyPaths = [[NSBundle mainBundle] pathsForResourcesOfType:@"key" inDirectory:nil];
+  STAssertTrue([keyPaths count] > 0, nil);
+  const char *password = [kDVVaultCryptoTestPassword UTF8String];
+  for (NSString *keyPath in keyPaths) {
+    NSData *keyFile = [NSData dataWithContentsOfFile:keyPath];
+    KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyFile
+                                                          andPassword:kDVVaultCryptoTestPassword];
+    STAssertNotNil(decryptor, @"Decrypting %@", keyPath);
+
+    const char *fileName = [decryptor.fileName UTF8String];
+    NSMutableData *rebuilt = [NSMutableData dataWithLength:DVVaultKeyFileLength(strlen(fileName), 0)];
+    STAssertTrue(DVVaultWriteKeyFile(password,
+                                     strlen(password),
+                                     [keyFile bytes],
+                                     [decryptor.key bytes],
+                                     [decryptor.iv bytes],
+                                     fileName,
+                                     strlen(fileName),
+                                     0,
+                                     [rebuilt mutableBytes]), nil);
+    STAssertEqualObjects(keyFile, rebuilt, @"Key file %@", keyPath);
+
+    NSString *dataPath = [[keyPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"];
+    NSData *dataFile = [NSData dataWithContentsOfFile:dataPath];
+    NSData *clearText = [dataFile aesDecryptWithKey:decryptor.key andIV:decryptor.iv];
+    STAssertNotNil(clearText, nil);
+    STAssertEqualObjects(dataFile,
+                         [self streamEncrypt:clearText withKey:decryptor.key iv:decryptor.iv pieceLength:7],
+                         @"Data file %@", dataPath);
+  }
+}
+
+//
+//  Streaming gives the same bytes as encrypting all at once, whatever the
+//  pieces, including none at all.
+//
+
+- (void)testStreaming {
+
+  NSData *key = [NSData dataWithRandomBytes:kDVVaultKeyLength];
+  NSData *iv = [NSData dataWithRandomBytes:kDVVaultIVLength];
+  NSUInteger lengths[] = { 0, 1, 15, 16, 17, 100000 };
+  NSUInteger pieceLengths[] = { 1, 16, 1000, 65536 };
+  for (NSUInteger i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    NSData *data = [NSData dataWithRandomBytes:lengths[i]];
+    NSData *expected = [data aesEncryptWithKey:key andIV:iv];
+    for (NSUInteger j = 0; j < sizeof(pieceLengths) / sizeof(pieceLengths[0]); j++) {
+      STAssertEqualObjects(expected,
+                           [self streamEncrypt:data withKey:key iv:iv pieceLength:pieceLengths[j]],
+                           @"%u bytes in pieces of %u", lengths[i], pieceLengths[j]);
+    }
+  }
+}
+
+//
+//  Key files with options decrypt with the flags and name intact.
+//
+
+- (void)testKeyFileOptions {
+
+  NSData *key = [NSData dataWithRandomBytes:kDVVaultKeyLength];
+  NSData *iv = [NSData dataWithRandomBytes:kDVVaultIVLength];
+  NSData *salt = [NSData dataWithRandomBytes:kDVVaultSaltLength];
+  const char *password = [kDVVaultCryptoTestPassword UTF8String];
+  const char *fileName = "Caf\xC3\xA9 notes.txt";
+  unsigned char options = kKeyFileOptionCompressed | kKeyFileOptionChunked;
+  NSMutableData *keyFile = [NSMutableData dataWithLength:DVVaultKeyFileLength(strlen(fileName), options)];
+  STAssertTrue(DVVaultWriteKeyFile(password,
+                                   strlen(password),
+                                   [salt bytes],
+                                   [key bytes],
+                                   [iv bytes],
+                                   fileName,
+                                   strlen(fileName),
+                                   options,
+                                   [keyFile mutableBytes]), nil);
+
+  KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:keyFile
+                                                        andPassword:kDVVaultCryptoTestPassword];
+  STAssertEqualStrings([NSString stringWithUTF8String:fileName], decryptor.fileName, nil);
+  STAssertEqualObjects(key, decryptor.key, nil);
+  STAssertEqualObjects(iv, decryptor.iv, nil);
+  STAssertTrue(decryptor.compressed, nil);
+  STAssertTrue(decryptor.chunked, nil);
+
+  decryptor.password = kDVVaultCryptoTestPassword;
+  STAssertEqualObjects(keyFile, [decryptor encryptedBlobWithSalt:salt], nil);
+}
+
+@end
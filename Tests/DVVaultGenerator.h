@@ -0,0 +1,124 @@
+//
+//  DVVaultGenerator.h
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <Foundation/Foundation.h>
+
+//
+//  The most files a generated vault can have.
+//
+
+#define kDVVaultGeneratorMaxFileCount   100000
+
+//
+//  Keys of each bucket of a size distribution. A file lands in a bucket with
+//  probability |weight| over the sum of all weights, and its size is spread
+//  evenly between the previous bucket's |limit| and this one's.
+//
+
+#define kDVVaultGeneratorSizeLimit      @"limit"
+#define kDVVaultGeneratorSizeWeight     @"weight"
+
+//
+//  Writes synthetic vaults for scale and performance tests: |fileCount|
+//  entries, each a |.key| file made by |KeyFileDecryptor::encryptedBlob| and
+//  an AES-CBC |.dat| file, plus a |-sidecar| pair holding notes for
+//  |sidecarRatio| of them. Also produces the DropBox |/metadata| listing of
+//  the vault directory, so a vault can be fed through the parser, cache, Core
+//  Data, and unlock paths without a network.
+//
+//  Everything -- names, sizes, dates, keys, salts, and contents -- comes
+//  from |seed|, so the same settings always give the same bytes. Each entry
+//  has its own random stream, so the listing can be made without writing
+//  any files.
+//
+
+@interface DVVaultGenerator : NSObject {
+
+@private
+  NSUInteger fileCount_;
+  uint64_t seed_;
+  NSArray *sizeDistribution_;
+  double sidecarRatio_;
+  NSString *password_;
+  BOOL writesDataFiles_;
+}
+
+//
+//  Creates a generator for |fileCount| entries, which can be at most
+//  |kDVVaultGeneratorMaxFileCount|.
+//
+
+- (id)initWithFileCount:(NSUInteger)fileCount seed:(uint64_t)seed;
+
+@property (nonatomic, readonly) NSUInteger fileCount;
+@property (nonatomic, readonly) uint64_t seed;
+
+//
+//  The buckets file sizes are drawn from, in increasing order of
+//  |kDVVaultGeneratorSizeLimit|. Defaults to |defaultSizeDistribution|.
+//
+
+@property (nonatomic, copy) NSArray *sizeDistribution;
+
+//
+//  The fraction of entries, from 0 to 1, that get notes sidecars. Defaults
+//  to 0.1.
+//
+
+@property (nonatomic, assign) double sidecarRatio;
+
+//
+//  The password the key files are encrypted with. Defaults to |@"Orwell."|,
+//  the password of the checked-in test data.
+//
+
+@property (nonatomic, copy) NSString *password;
+
+//
+//  If |NO|, only key files are written; the listing still has the data
+//  files, with their sizes. For vaults too big to put on disk. Defaults to
+//  |YES|.
+//
+
+@property (nonatomic, assign) BOOL writesDataFiles;
+
+//
+//  Mostly small documents and photos, with a few larger files: 60% up to
+//  64KB, 30% up to 1MB, and 10% up to 8MB.
+//
+
++ (NSArray *)defaultSizeDistribution;
+
+//
+//  The DropBox |/metadata| response for |kDropVaultPath|, as the dictionary
+//  the JSON is made from.
+//
+
+- (NSDictionary *)metadata;
+
+//
+//  Writes the vault files into a |StrongBox| directory under |directory|,
+//  and the JSON of |metadata| to |metadata.json| beside it. Returns |NO| if
+//  anything can't be written.
+//
+
+- (BOOL)writeVaultToDirectory:(NSString *)directory;
+
+@end
@@ -0,0 +1,404 @@
+//
+//  DVVaultGenerator.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import <CommonCrypto/CommonCryptor.h>
+#import "DVVaultGenerator.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSObject+SBJSON.h"
+
+//
+//  Keys of the private description of one entry.
+//
+
+#define kDVEntryBasePath      @"basePath"
+#define kDVEntryFileName      @"fileName"
+#define kDVEntryNotes         @"notes"
+#define kDVEntrySize          @"size"
+#define kDVEntryModified      @"modified"
+
+//
+//  The test data was made on 1/24/11, so generated vaults start there and
+//  spread their modification dates over the following |kDVVaultDateSpread|
+//  seconds.
+//
+
+#define kDVVaultFirstDate     (317595618.0)
+#define kDVVaultDateSpread    (180 * 24 * 60 * 60)
+
+#define kDVKeyFileSaltBytes   8
+
+//
+//  SplitMix64: small, fast, and the same on every platform, which is all a
+//  test data generator needs. This is not a source of keys for real files.
+//
+
+static uint64_t DVVaultNextRandom(uint64_t *state) {
+
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+//
+//  A number in [0, 1).
+//
+
+static double DVVaultRandomFraction(uint64_t *state) {
+
+  return (DVVaultNextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static NSData *DVVaultRandomData(uint64_t *state, NSUInteger length) {
+
+  NSMutableData *data = [NSMutableData dataWithLength:length];
+  unsigned char *bytes = [data mutableBytes];
+  for (NSUInteger i = 0; i < length; i += sizeof(uint64_t)) {
+    uint64_t value = DVVaultNextRandom(state);
+    memcpy(bytes + i, &value, MIN(sizeof(value), length - i));
+  }
+  return data;
+}
+
+//
+//  How long |clearLength| bytes are once AES-CBC with PKCS7 padding is done
+//  with them.
+//
+
+static unsigned long long DVVaultCipherLength(unsigned long long clearLength) {
+
+  return (clearLength / kCCBlockSizeAES128 + 1) * kCCBlockSizeAES128;
+}
+
+//
+//  Sizes the way DropBox writes them in |size|: "0 bytes", "12.3 KB".
+//
+
+static NSString *DVVaultHumanReadableSize(unsigned long long bytes) {
+
+  if (bytes < 1024) {
+    return [NSString stringWithFormat:@"%llu bytes", bytes];
+  }
+  NSArray *units = [NSArray arrayWithObjects:@"KB", @"MB", @"GB", nil];
+  double size = bytes / 1024.0;
+  NSUInteger unit = 0;
+  while (size >= 1024 && unit + 1 < [units count]) {
+    size /= 1024;
+    unit++;
+  }
+  return [NSString stringWithFormat:@"%.1f %@", size, [units objectAtIndex:unit]];
+}
+
+@interface DVVaultGenerator ()
+
+- (uint64_t)initialStateForEntry:(NSUInteger)index;
+- (NSDictionary *)entryAtIndex:(NSUInteger)index state:(uint64_t *)state;
+- (NSData *)keyFileWithFileName:(NSString *)fileName
+                            key:(NSData **)key
+                             iv:(NSData **)iv
+                          state:(uint64_t *)state;
+- (NSDictionary *)metadataForPath:(NSString *)path
+                            bytes:(unsigned long long)bytes
+                         modified:(NSDate *)modified
+                         revision:(NSUInteger)revision
+                        formatter:(NSDateFormatter *)formatter;
++ (NSDateFormatter *)formatterWithFormat:(NSString *)format;
+
+@end
+
+@implementation DVVaultGenerator
+
+@synthesize fileCount = fileCount_, seed = seed_;
+@synthesize sizeDistribution = sizeDistribution_, sidecarRatio = sidecarRatio_;
+@synthesize password = password_, writesDataFiles = writesDataFiles_;
+
+- (id)initWithFileCount:(NSUInteger)fileCount seed:(uint64_t)seed {
+
+  _GTMDevAssert(fileCount <= kDVVaultGeneratorMaxFileCount,
+                @"At most %d files", kDVVaultGeneratorMaxFileCount);
+  self = [super init];
+  if (self != nil) {
+    fileCount_ = MIN(fileCount, kDVVaultGeneratorMaxFileCount);
+    seed_ = seed;
+    sizeDistribution_ = [[DVVaultGenerator defaultSizeDistribution] retain];
+    sidecarRatio_ = 0.1;
+    password_ = [@"Orwell." copy];
+    writesDataFiles_ = YES;
+  }
+  return self;
+}
+
+- (void)dealloc {
+
+  [sizeDistribution_ release];
+  [password_ release];
+  [super dealloc];
+}
+
++ (NSArray *)defaultSizeDistribution {
+
+  return [NSArray arrayWithObjects:
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithUnsignedLongLong:64 * 1024], kDVVaultGeneratorSizeLimit,
+           [NSNumber numberWithDouble:0.6], kDVVaultGeneratorSizeWeight,
+           nil],
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithUnsignedLongLong:1024 * 1024], kDVVaultGeneratorSizeLimit,
+           [NSNumber numberWithDouble:0.3], kDVVaultGeneratorSizeWeight,
+           nil],
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithUnsignedLongLong:8 * 1024 * 1024], kDVVaultGeneratorSizeLimit,
+           [NSNumber numberWithDouble:0.1], kDVVaultGeneratorSizeWeight,
+           nil],
+          nil];
+}
+
+#pragma mark -
+#pragma mark Entries
+
+- (uint64_t)initialStateForEntry:(NSUInteger)index {
+
+  uint64_t state = seed_ ^ ((uint64_t)(index + 1) * 0xD1B54A32D192ED03ULL);
+  DVVaultNextRandom(&state);
+  return state;
+}
+
+//
+//  Draws everything about an entry but its keys and contents from |state|.
+//  Base names look like the test data's: the creation time, then eight hex
+//  digits. The digits are a scramble of |index|, so they never collide.
+//
+
+- (NSDictionary *)entryAtIndex:(NSUInteger)index state:(uint64_t *)state {
+
+  NSDate *modified = [NSDate dateWithTimeIntervalSinceReferenceDate:
+                      kDVVaultFirstDate + DVVaultNextRandom(state) % kDVVaultDateSpread];
+
+  double totalWeight = 0;
+  for (NSDictionary *bucket in sizeDistribution_) {
+    totalWeight += [[bucket objectForKey:kDVVaultGeneratorSizeWeight] doubleValue];
+  }
+  double pick = DVVaultRandomFraction(state) * totalWeight;
+  unsigned long long lower = 0;
+  unsigned long long upper = 0;
+  for (NSDictionary *bucket in sizeDistribution_) {
+    lower = upper;
+    upper = [[bucket objectForKey:kDVVaultGeneratorSizeLimit] unsignedLongLongValue];
+    pick -= [[bucket objectForKey:kDVVaultGeneratorSizeWeight] doubleValue];
+    if (pick < 0) {
+      break;
+    }
+  }
+  unsigned long long size = lower + DVVaultNextRandom(state) % (upper - lower + 1);
+
+  NSArray *extensions = [NSArray arrayWithObjects:@"pdf", @"jpg", @"txt", @"docx", @"png", nil];
+  NSString *extension = [extensions objectAtIndex:DVVaultNextRandom(state) % [extensions count]];
+  NSString *fileName = [NSString stringWithFormat:@"Document %05u.%@", index, extension];
+  BOOL hasSidecar = DVVaultRandomFraction(state) < sidecarRatio_;
+
+  NSString *timestamp = [[DVVaultGenerator formatterWithFormat:@"yyyyMMddHHmmss"] stringFromDate:modified];
+  uint32_t suffix = ((uint32_t)index * 0x9E3779B1U) ^ (uint32_t)seed_;
+  NSString *basePath = [kDropVaultPath stringByAppendingPathComponent:
+                        [NSString stringWithFormat:@"%@-%08X", timestamp, suffix]];
+
+  NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                basePath, kDVEntryBasePath,
+                                fileName, kDVEntryFileName,
+                                [NSNumber numberWithUnsignedLongLong:size], kDVEntrySize,
+                                modified, kDVEntryModified,
+                                nil];
+  if (hasSidecar) {
+    [entry setObject:[NSString stringWithFormat:@"Notes for %@", fileName] forKey:kDVEntryNotes];
+  }
+  return entry;
+}
+
+//
+//  Makes a key file for |fileName| with a key, IV, and salt from |state|.
+//
+
+- (NSData *)keyFileWithFileName:(NSString *)fileName
+                            key:(NSData **)key
+                             iv:(NSData **)iv
+                          state:(uint64_t *)state {
+
+  KeyFileDecryptor *encryptor = [[[KeyFileDecryptor alloc] init] autorelease];
+  encryptor.key = DVVaultRandomData(state, kCCKeySizeAES128);
+  encryptor.iv = DVVaultRandomData(state, kCCBlockSizeAES128);
+  encryptor.fileName = fileName;
+  encryptor.password = password_;
+  *key = encryptor.key;
+  *iv = encryptor.iv;
+  return [encryptor encryptedBlobWithSalt:DVVaultRandomData(state, kDVKeyFileSaltBytes)];
+}
+
+#pragma mark -
+#pragma mark Metadata
+
++ (NSDateFormatter *)formatterWithFormat:(NSString *)format {
+
+  NSDateFormatter *formatter = [[[NSDateFormatter alloc] init] autorelease];
+  formatter.locale = [[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease];
+  formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+  formatter.dateFormat = format;
+  return formatter;
+}
+
+- (NSDictionary *)metadataForPath:(NSString *)path
+                            bytes:(unsigned long long)bytes
+                         modified:(NSDate *)modified
+                         revision:(NSUInteger)revision
+                        formatter:(NSDateFormatter *)formatter {
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithUnsignedInteger:revision], @"revision",
+          [NSNumber numberWithBool:NO], @"thumb_exists",
+          [NSNumber numberWithUnsignedLongLong:bytes], @"bytes",
+          [formatter stringFromDate:modified], @"modified",
+          path, @"path",
+          [NSNumber numberWithBool:NO], @"is_dir",
+          @"page_white", @"icon",
+          @"dropbox", @"root",
+          @"application/octet-stream", @"mime_type",
+          DVVaultHumanReadableSize(bytes), @"size",
+          nil];
+}
+
+//
+//  Each entry lists its key, data, and then sidecar files, with sizes worked
+//  out from the lengths of what would be encrypted.
+//
+
+- (NSDictionary *)metadata {
+
+  NSDateFormatter *formatter = [DVVaultGenerator formatterWithFormat:@"EEE, dd MMM yyyy HH:mm:ss Z"];
+  NSMutableArray *contents = [NSMutableArray arrayWithCapacity:fileCount_ * 2];
+  NSUInteger revision = 0;
+  for (NSUInteger i = 0; i < fileCount_; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    uint64_t state = [self initialStateForEntry:i];
+    NSDictionary *entry = [self entryAtIndex:i state:&state];
+    NSString *basePath = [entry objectForKey:kDVEntryBasePath];
+    NSDate *modified = [entry objectForKey:kDVEntryModified];
+    unsigned long long keyBytes = kDVKeyFileSaltBytes +
+      DVVaultCipherLength(kCCKeySizeAES128 + kCCBlockSizeAES128 +
+                          strlen([[entry objectForKey:kDVEntryFileName] UTF8String]));
+    [contents addObject:[self metadataForPath:[basePath stringByAppendingPathExtension:@"key"]
+                                        bytes:keyBytes
+                                     modified:modified
+                                     revision:++revision
+                                    formatter:formatter]];
+    [contents addObject:[self metadataForPath:[basePath stringByAppendingPathExtension:@"dat"]
+                                        bytes:DVVaultCipherLength([[entry objectForKey:kDVEntrySize] unsignedLongLongValue])
+                                     modified:modified
+                                     revision:++revision
+                                    formatter:formatter]];
+    NSString *notes = [entry objectForKey:kDVEntryNotes];
+    if (notes != nil) {
+      NSString *sidecarPath = [basePath stringByAppendingString:@"-sidecar"];
+      keyBytes = kDVKeyFileSaltBytes +
+        DVVaultCipherLength(kCCKeySizeAES128 + kCCBlockSizeAES128 + strlen("notes.txt"));
+      [contents addObject:[self metadataForPath:[sidecarPath stringByAppendingPathExtension:@"key"]
+                                          bytes:keyBytes
+                                       modified:modified
+                                       revision:++revision
+                                      formatter:formatter]];
+      [contents addObject:[self metadataForPath:[sidecarPath stringByAppendingPathExtension:@"dat"]
+                                          bytes:DVVaultCipherLength(strlen([notes UTF8String]))
+                                       modified:modified
+                                       revision:++revision
+                                      formatter:formatter]];
+    }
+    [pool drain];
+  }
+
+  uint64_t state = seed_;
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [DVVaultRandomData(&state, 16) hexString], @"hash",
+          [NSNumber numberWithBool:NO], @"thumb_exists",
+          [NSNumber numberWithInt:0], @"bytes",
+          kDropVaultPath, @"path",
+          [NSNumber numberWithBool:YES], @"is_dir",
+          @"0 bytes", @"size",
+          @"dropbox", @"root",
+          @"folder", @"icon",
+          contents, @"contents",
+          nil];
+}
+
+#pragma mark -
+#pragma mark Writing
+
+- (BOOL)writeVaultToDirectory:(NSString *)directory {
+
+  NSString *vaultDirectory = [directory stringByAppendingPathComponent:[kDropVaultPath lastPathComponent]];
+  if (![[NSFileManager defaultManager] createDirectoryAtPath:vaultDirectory
+                                 withIntermediateDirectories:YES
+                                                  attributes:nil
+                                                       error:NULL]) {
+    return NO;
+  }
+
+  BOOL succeeded = YES;
+  for (NSUInteger i = 0; i < fileCount_ && succeeded; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    uint64_t state = [self initialStateForEntry:i];
+    NSDictionary *entry = [self entryAtIndex:i state:&state];
+    NSString *basePath = [directory stringByAppendingPathComponent:[entry objectForKey:kDVEntryBasePath]];
+    NSData *key = nil;
+    NSData *iv = nil;
+    NSData *keyFile = [self keyFileWithFileName:[entry objectForKey:kDVEntryFileName]
+                                            key:&key
+                                             iv:&iv
+                                          state:&state];
+    succeeded = [keyFile writeToFile:[basePath stringByAppendingPathExtension:@"key"] atomically:NO];
+
+    //
+    //  The sidecar is drawn before the contents, so it's the same whether or
+    //  not the contents get written.
+    //
+
+    NSString *notes = [entry objectForKey:kDVEntryNotes];
+    if (succeeded && notes != nil) {
+      NSString *sidecarPath = [basePath stringByAppendingString:@"-sidecar"];
+      NSData *notesKey = nil;
+      NSData *notesIV = nil;
+      NSData *notesKeyFile = [self keyFileWithFileName:@"notes.txt" key:&notesKey iv:&notesIV state:&state];
+      NSData *cipherText = [[notes dataUsingEncoding:NSUTF8StringEncoding] aesEncryptWithKey:notesKey andIV:notesIV];
+      succeeded = [notesKeyFile writeToFile:[sidecarPath stringByAppendingPathExtension:@"key"] atomically:NO] &&
+        [cipherText writeToFile:[sidecarPath stringByAppendingPathExtension:@"dat"] atomically:NO];
+    }
+    if (succeeded && writesDataFiles_) {
+      NSData *clearText = DVVaultRandomData(&state, [[entry objectForKey:kDVEntrySize] unsignedIntegerValue]);
+      succeeded = [[clearText aesEncryptWithKey:key andIV:iv] writeToFile:[basePath stringByAppendingPathExtension:@"dat"]
+                                                                atomically:NO];
+    }
+    [pool drain];
+  }
+  if (!succeeded) {
+    return NO;
+  }
+
+  NSData *json = [[[self metadata] JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+  return [json writeToFile:[directory stringByAppendingPathComponent:@"metadata.json"] atomically:YES];
+}
+
+@end
@@ -0,0 +1,226 @@
+//
+//  DVVaultGeneratorTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/18/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVVaultGenerator.h"
+#import "DVVaultIndex.h"
+#import "DBMetadataParser.h"
+#import "KeyFileDecryptor.h"
+#import "NSData+EncryptionHelpers.h"
+#import "NSObject+SBJSON.h"
+#import "DVBenchmark.h"
+
+@interface DVVaultGeneratorTest : GTMTestCase {
+
+@private
+  NSString *directory_;
+}
+
+@end
+
+
+@implementation DVVaultGeneratorTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (NSArray *)smallSizeDistribution {
+
+  return [NSArray arrayWithObjects:
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithInt:100], kDVVaultGeneratorSizeLimit,
+           [NSNumber numberWithInt:1], kDVVaultGeneratorSizeWeight,
+           nil],
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithInt:4096], kDVVaultGeneratorSizeLimit,
+           [NSNumber numberWithInt:1], kDVVaultGeneratorSizeWeight,
+           nil],
+          nil];
+}
+
+- (NSArray *)fileNamesInVault {
+
+  NSString *vault = [directory_ stringByAppendingPathComponent:@"StrongBox"];
+  return [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:vault error:NULL]
+          sortedArrayUsingSelector:@selector(compare:)];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)setUp {
+
+  directory_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"DVVaultGeneratorTest"] retain];
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+}
+
+- (void)tearDown {
+
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+  [directory_ release];
+}
+
+//
+//  The same seed gives the same listing; a different one doesn't.
+//
+
+- (void)testRepeatable {
+
+  DVVaultGenerator *first = [[[DVVaultGenerator alloc] initWithFileCount:50 seed:42] autorelease];
+  DVVaultGenerator *second = [[[DVVaultGenerator alloc] initWithFileCount:50 seed:42] autorelease];
+  DVVaultGenerator *other = [[[DVVaultGenerator alloc] initWithFileCount:50 seed:43] autorelease];
+  STAssertEqualObjects([first metadata], [second metadata], nil);
+  STAssertFalse([[first metadata] isEqual:[other metadata]], nil);
+
+  NSArray *contents = [[first metadata] objectForKey:@"contents"];
+  NSSet *paths = [NSSet setWithArray:[contents valueForKey:@"path"]];
+  STAssertEquals([contents count], [paths count], @"Paths should be unique");
+}
+
+//
+//  Every file decrypts with the vault password, and the listing describes
+//  exactly the files written, with their sizes.
+//
+
+- (void)testWriteVault {
+
+  DVVaultGenerator *generator = [[[DVVaultGenerator alloc] initWithFileCount:12 seed:7] autorelease];
+  generator.sizeDistribution = [self smallSizeDistribution];
+  generator.sidecarRatio = 0.5;
+  STAssertTrue([generator writeVaultToDirectory:directory_], nil);
+
+  NSData *json = [NSData dataWithContentsOfFile:[directory_ stringByAppendingPathComponent:@"metadata.json"]];
+  DBMetadata *metadata = [DBMetadataParser metadataWithData:json];
+  STAssertNotNil(metadata, nil);
+  STAssertEqualStrings(kDropVaultPath, metadata.path, nil);
+  STAssertEquals([metadata.contents count], [[self fileNamesInVault] count], nil);
+
+  DVVaultIndex *index = [[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease];
+  STAssertEquals((NSUInteger)12, [index.keyedItems count], nil);
+  NSUInteger sidecars = 0;
+  for (DVVaultItem *item in index.keyedItems) {
+    for (DVVaultEntryKind kind = DVVaultEntryKindKey; kind < DVVaultEntryKindCount; kind++) {
+      DBMetadata *file = [item metadataForKind:kind];
+      if (file == nil) {
+        continue;
+      }
+      NSString *path = [directory_ stringByAppendingPathComponent:file.path];
+      NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+      STAssertEquals(file.totalBytes, [[attributes objectForKey:NSFileSize] longLongValue], @"%@", file.path);
+    }
+
+    NSString *keyPath = [directory_ stringByAppendingPathComponent:[item pathForKind:DVVaultEntryKindKey]];
+    KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:keyPath]
+                                                          andPassword:@"Orwell."];
+    STAssertTrue([decryptor.fileName hasPrefix:@"Document "], nil);
+    NSString *dataPath = [directory_ stringByAppendingPathComponent:[item pathForKind:DVVaultEntryKindData]];
+    NSData *clearText = [[NSData dataWithContentsOfFile:dataPath] aesDecryptWithKey:decryptor.key
+                                                                             andIV:decryptor.iv];
+    STAssertNotNil(clearText, nil);
+    STAssertTrue([clearText length] <= 4096, nil);
+
+    if ([item metadataForKind:DVVaultEntryKindKeySidecar] != nil) {
+      sidecars++;
+      keyPath = [directory_ stringByAppendingPathComponent:[item pathForKind:DVVaultEntryKindKeySidecar]];
+      KeyFileDecryptor *notesDecryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:keyPath]
+                                                                 andPassword:@"Orwell."];
+      STAssertEqualStrings(@"notes.txt", notesDecryptor.fileName, nil);
+      dataPath = [directory_ stringByAppendingPathComponent:[item pathForKind:DVVaultEntryKindDataSidecar]];
+      NSData *notes = [[NSData dataWithContentsOfFile:dataPath] aesDecryptWithKey:notesDecryptor.key
+                                                                           andIV:notesDecryptor.iv];
+      NSString *expected = [NSString stringWithFormat:@"Notes for %@", decryptor.fileName];
+      STAssertEqualStrings(expected,
+                           [[[NSString alloc] initWithData:notes encoding:NSUTF8StringEncoding] autorelease],
+                           nil);
+    }
+  }
+  STAssertTrue(sidecars > 0 && sidecars < 12, @"About half should have sidecars, saw %u", sidecars);
+}
+
+//
+//  Without data files, the key files and sidecars are byte for byte the same
+//  as a full vault's, and the listing still has the data files.
+//
+
+- (void)testWithoutDataFiles {
+
+  DVVaultGenerator *generator = [[[DVVaultGenerator alloc] initWithFileCount:8 seed:3] autorelease];
+  generator.sizeDistribution = [self smallSizeDistribution];
+  generator.sidecarRatio = 1;
+  STAssertTrue([generator writeVaultToDirectory:directory_], nil);
+  NSString *vault = [directory_ stringByAppendingPathComponent:@"StrongBox"];
+  NSMutableDictionary *fullVault = [NSMutableDictionary dictionary];
+  for (NSString *name in [self fileNamesInVault]) {
+    [fullVault setObject:[NSData dataWithContentsOfFile:[vault stringByAppendingPathComponent:name]] forKey:name];
+  }
+  [[NSFileManager defaultManager] removeItemAtPath:directory_ error:NULL];
+
+  generator.writesDataFiles = NO;
+  STAssertTrue([generator writeVaultToDirectory:directory_], nil);
+  NSArray *names = [self fileNamesInVault];
+  STAssertEquals((NSUInteger)24, [names count], @"Key files and both sidecar files");
+  for (NSString *name in names) {
+    STAssertEqualObjects([fullVault objectForKey:name],
+                         [NSData dataWithContentsOfFile:[vault stringByAppendingPathComponent:name]],
+                         @"%@", name);
+  }
+  STAssertEquals((NSUInteger)32, [[[generator metadata] objectForKey:@"contents"] count], nil);
+}
+
+//
+//  Benchmark: a 100,000 entry listing through JSON, the metadata parser, and
+//  the vault index.
+//
+
+- (void)testListingBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  DVVaultGenerator *generator = [[[DVVaultGenerator alloc] initWithFileCount:kDVVaultGeneratorMaxFileCount
+                                                                        seed:1] autorelease];
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  NSData *json = [[[[generator metadata] JSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding] retain];
+  CFAbsoluteTime generate = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  DBMetadata *metadata = [DBMetadataParser metadataWithData:json];
+  CFAbsoluteTime parse = CFAbsoluteTimeGetCurrent() - start;
+  start = CFAbsoluteTimeGetCurrent();
+  DVVaultIndex *index = [[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease];
+  CFAbsoluteTime indexing = CFAbsoluteTimeGetCurrent() - start;
+  STAssertEquals((NSUInteger)kDVVaultGeneratorMaxFileCount, [index.keyedItems count], nil);
+  [pool drain];
+
+  NSLog(@"%s -- %u entries, %u bytes of JSON: generate %.3fs, parse %.3fs, index %.3fs",
+        __PRETTY_FUNCTION__,
+        kDVVaultGeneratorMaxFileCount,
+        [json length],
+        generate,
+        parse,
+        indexing);
+  [json release];
+}
+
+@end
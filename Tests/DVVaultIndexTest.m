@@ -0,0 +1,185 @@
+//
+//  DVVaultIndexTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/14/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVVaultIndex.h"
+#import "DVBenchmark.h"
+
+@interface DVVaultIndexTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVVaultIndexTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (DBMetadata *)metadataWithPaths:(NSArray *)paths {
+
+  NSMutableArray *contents = [NSMutableArray arrayWithCapacity:[paths count]];
+  for (NSString *path in paths) {
+    [contents addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                         path, @"path",
+                         @"1 KB", @"size",
+                         [NSNumber numberWithLongLong:[contents count] + 1], @"revision",
+                         nil]];
+  }
+  NSDictionary *root = [NSDictionary dictionaryWithObjectsAndKeys:
+                        @"/StrongBox", @"path",
+                        [NSNumber numberWithBool:YES], @"is_dir",
+                        contents, @"contents",
+                        nil];
+  return [[[DBMetadata alloc] initWithDictionary:root] autorelease];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)testKindOfPath {
+
+  NSString *basePath = nil;
+  STAssertEquals(DVVaultEntryKindKey, [DVVaultIndex kindOfPath:@"/StrongBox/foo.key" basePath:&basePath], nil);
+  STAssertEqualStrings(@"/StrongBox/foo", basePath, nil);
+  STAssertEquals(DVVaultEntryKindData, [DVVaultIndex kindOfPath:@"/StrongBox/foo.dat" basePath:&basePath], nil);
+  STAssertEqualStrings(@"/StrongBox/foo", basePath, nil);
+  STAssertEquals(DVVaultEntryKindKeySidecar, [DVVaultIndex kindOfPath:@"/StrongBox/foo-sidecar.key" basePath:&basePath], nil);
+  STAssertEqualStrings(@"/StrongBox/foo", basePath, nil);
+  STAssertEquals(DVVaultEntryKindDataSidecar, [DVVaultIndex kindOfPath:@"foo-sidecar.dat" basePath:&basePath], nil);
+  STAssertEqualStrings(@"foo", basePath, nil);
+
+  STAssertEquals(DVVaultEntryKindOther, [DVVaultIndex kindOfPath:@"/StrongBox/foo.txt" basePath:NULL], nil);
+  STAssertEquals(DVVaultEntryKindOther, [DVVaultIndex kindOfPath:@"/StrongBox/foo" basePath:NULL], nil);
+  STAssertEquals(DVVaultEntryKindOther, [DVVaultIndex kindOfPath:@"/StrongBox/foo.KEY" basePath:NULL], nil);
+  STAssertEquals(DVVaultEntryKindOther, [DVVaultIndex kindOfPath:@"/StrongBox/-sidecar.key" basePath:NULL], nil);
+
+  STAssertEqualStrings(@"/StrongBox/foo.dat",
+                       [DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:@"/StrongBox/foo.key"],
+                       nil);
+  STAssertEqualStrings(@"/StrongBox/foo-sidecar.key",
+                       [DVVaultIndex pathForKind:DVVaultEntryKindKeySidecar companionOfPath:@"/StrongBox/foo.dat"],
+                       nil);
+  STAssertEqualStrings(@"/StrongBox/foo.key",
+                       [DVVaultIndex pathForKind:DVVaultEntryKindKey companionOfPath:@"/StrongBox/foo-sidecar.dat"],
+                       nil);
+  STAssertNil([DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:@"/StrongBox/notes.txt"], nil);
+}
+
+- (void)testPairing {
+
+  NSArray *paths = [NSArray arrayWithObjects:
+                    @"/StrongBox/b.dat",
+                    @"/StrongBox/b.key",
+                    @"/StrongBox/a.key",
+                    @"/StrongBox/a.dat",
+                    @"/StrongBox/a-sidecar.key",
+                    @"/StrongBox/a-sidecar.dat",
+                    @"/StrongBox/orphan.dat",
+                    @"/StrongBox/readme.txt",
+                    nil];
+  DVVaultIndex *index = [[[DVVaultIndex alloc] initWithMetadata:[self metadataWithPaths:paths]] autorelease];
+
+  STAssertEquals((NSUInteger)2, [index.keyedItems count], nil);
+  STAssertEqualStrings(@"/StrongBox/b", [[index.keyedItems objectAtIndex:0] basePath],
+                       @"Keyed items should be in listing order");
+
+  DVVaultItem *item = [index itemForPath:@"/StrongBox/a-sidecar.dat"];
+  STAssertEquals(item, [index itemForPath:@"/StrongBox/a.key"], nil);
+  for (DVVaultEntryKind kind = 0; kind < DVVaultEntryKindCount; kind++) {
+    STAssertEqualStrings([item pathForKind:kind], [item metadataForKind:kind].path, nil);
+  }
+  STAssertEqualStrings(@"1 KB", [item metadataForKind:DVVaultEntryKindData].humanReadableSize, nil);
+  STAssertEquals(4LL, [item metadataForKind:DVVaultEntryKindData].revision, nil);
+
+  item = [index itemForPath:@"/StrongBox/b.key"];
+  STAssertNotNil([item metadataForKind:DVVaultEntryKindData], nil);
+  STAssertNil([item metadataForKind:DVVaultEntryKindKeySidecar], nil);
+  STAssertNil([item metadataForKind:DVVaultEntryKindDataSidecar], nil);
+
+  STAssertNil([[index itemForPath:@"/StrongBox/orphan.key"] metadataForKind:DVVaultEntryKindKey], nil);
+  STAssertNil([index itemForPath:@"/StrongBox/readme.txt"], nil);
+  STAssertNil([index itemForPath:@"/StrongBox/missing.key"], nil);
+}
+
+//
+//  Benchmark: finding the keys and their data files in a large listing, the
+//  old way (a |LIKE| predicate per path, then a scan for each data file)
+//  against the index.
+//
+
+- (void)testIndexBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSUInteger count = 2000;
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity:4 * count];
+  for (NSUInteger i = 0; i < count; i++) {
+    NSString *base = [NSString stringWithFormat:@"/StrongBox/20110714%06u", i];
+    [paths addObject:[base stringByAppendingPathExtension:@"key"]];
+    [paths addObject:[base stringByAppendingPathExtension:@"dat"]];
+    [paths addObject:[base stringByAppendingString:@"-sidecar.key"]];
+    [paths addObject:[base stringByAppendingString:@"-sidecar.dat"]];
+  }
+  DBMetadata *metadata = [self metadataWithPaths:paths];
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  NSPredicate *matcher = [NSPredicate predicateWithFormat:@"(SELF like '*.key') AND NOT (SELF like '*-sidecar.key')"];
+  NSUInteger found = 0;
+  for (DBMetadata *child in metadata.contents) {
+    if ([matcher evaluateWithObject:child.path]) {
+      NSString *dataPath = [[child.path stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"];
+      for (DBMetadata *candidate in metadata.contents) {
+        if ([candidate.path isEqualToString:dataPath]) {
+          found++;
+          break;
+        }
+      }
+    }
+  }
+  CFAbsoluteTime scan = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+  STAssertEquals(count, found, nil);
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  DVVaultIndex *index = [[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease];
+  found = 0;
+  for (DVVaultItem *item in index.keyedItems) {
+    if ([item metadataForKind:DVVaultEntryKindData] != nil) {
+      found++;
+    }
+  }
+  CFAbsoluteTime indexed = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+  STAssertEquals(count, found, nil);
+
+  NSLog(@"%s -- %u entries: predicate and scan %.3fs, index %.3fs",
+        __PRETTY_FUNCTION__,
+        [paths count],
+        scan,
+        indexed);
+}
+
+@end
@@ -0,0 +1,115 @@
+//
+//  DVVaultSessionTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/16/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "DVVaultSession.h"
+
+@interface DVVaultSessionTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation DVVaultSessionTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (NSDictionary *)valuesWithFileName:(NSString *)fileName {
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [@"0123456789abcdef" dataUsingEncoding:NSUTF8StringEncoding], kDVKey,
+          [@"fedcba9876543210" dataUsingEncoding:NSUTF8StringEncoding], kDVIV,
+          fileName, kDVFileName,
+          nil];
+}
+
+//
+//  Copies of the values |session| hands out, which only last as long
+//  as the call.
+//
+
+- (NSDictionary *)decryptedKeyValuesOfSession:(DVVaultSession *)session {
+
+  NSMutableDictionary *copies = [NSMutableDictionary dictionary];
+  [session useDecryptedKeyValues:^(NSDictionary *decryptedKeyValues) {
+    for (NSString *keyName in decryptedKeyValues) {
+      NSDictionary *values = [decryptedKeyValues objectForKey:keyName];
+      NSMutableDictionary *valueCopies = [NSMutableDictionary dictionaryWithDictionary:values];
+      [valueCopies setObject:[NSData dataWithBytes:[[values objectForKey:kDVKey] bytes]
+                                            length:[[values objectForKey:kDVKey] length]]
+                      forKey:kDVKey];
+      [valueCopies setObject:[NSData dataWithBytes:[[values objectForKey:kDVIV] bytes]
+                                            length:[[values objectForKey:kDVIV] length]]
+                      forKey:kDVIV];
+      [valueCopies setObject:[NSString stringWithString:[[[values objectForKey:kDVFileName] mutableCopy] autorelease]]
+                      forKey:kDVFileName];
+      [copies setObject:valueCopies forKey:keyName];
+    }
+  }];
+  return copies;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+- (void)testRoundTrip {
+
+  NSMutableDictionary *decryptedKeyValues = [NSMutableDictionary dictionary];
+  [decryptedKeyValues setObject:[self valuesWithFileName:@"report.doc"] forKey:@"/StrongBox/1.key"];
+  [decryptedKeyValues setObject:[self valuesWithFileName:@"café.txt"] forKey:@"/StrongBox/2.key"];
+  [decryptedKeyValues setObject:[NSDictionary dictionaryWithObject:@"partial.txt" forKey:kDVFileName]
+                         forKey:@"/StrongBox/3.key"];
+  NSMutableDictionary *compressedValues = [NSMutableDictionary dictionaryWithDictionary:
+                                           [self valuesWithFileName:@"notes.txt"]];
+  [compressedValues setObject:[NSNumber numberWithBool:YES] forKey:kDVCompressed];
+  [decryptedKeyValues setObject:compressedValues forKey:@"/StrongBox/4.key"];
+
+  DVVaultSession *session = [[[DVVaultSession alloc] initWithDecryptedKeyValues:decryptedKeyValues
+                                                                   gracePeriod:60] autorelease];
+  STAssertFalse(session.expired, nil);
+  [decryptedKeyValues removeObjectForKey:@"/StrongBox/3.key"];
+  STAssertEqualObjects(decryptedKeyValues, [self decryptedKeyValuesOfSession:session],
+                       @"Keys missing any value should be left out");
+
+  [session wipe];
+  STAssertTrue(session.expired, nil);
+  STAssertEquals((NSUInteger)0, [[self decryptedKeyValuesOfSession:session] count], nil);
+  [session wipe];
+}
+
+- (void)testExpires {
+
+  NSDictionary *decryptedKeyValues = [NSDictionary dictionaryWithObject:[self valuesWithFileName:@"report.doc"]
+                                                                 forKey:@"/StrongBox/1.key"];
+  DVVaultSession *session = [[[DVVaultSession alloc] initWithDecryptedKeyValues:decryptedKeyValues
+                                                                   gracePeriod:0.05] autorelease];
+  STAssertFalse(session.expired, nil);
+  [NSThread sleepForTimeInterval:0.1];
+  STAssertTrue(session.expired, nil);
+  STAssertEqualObjects(decryptedKeyValues, [self decryptedKeyValuesOfSession:session],
+                       @"Expiring doesn't wipe; whoever holds the session does");
+}
+
+@end
@@ -22,6 +22,7 @@
 #import <UIKit/UIKit.h>
 #import "NSString+FileSystemHelper.h"
 #import "NSData+EncryptionHelpers.h"
+#import "NSData+CompressionHelpers.h"
 #import "DecryptionStateMachine.h"
 #import <CommonCrypto/CommonDigest.h>
 #import "KeyFileDecryptor.h"
@@ -144,6 +145,131 @@ unsigned char ivBytes[] = {
     STAssertEquals(16, keysTested, @"Should test 16 keys, but tested %d", keysTested);
 }
 
+//
+//  A smaller block size decrypts the same bytes with more progress messages.
+//
+
+- (void)testBlockSize {
+    DecryptionStateMachine *stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+    STAssertEquals((NSUInteger)kDecryptionStateMachineBlockSize, stateMachine.blockSize, nil);
+    stateMachine.delegate = self;
+    stateMachine.blockSize = 1000;
+    NSString *bundlePath = [[NSBundle mainBundle] bundlePath];
+    NSArray *keyFiles = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:bundlePath error:nil]
+                         pathsMatchingExtensions:[NSArray arrayWithObject:@"key"]];
+    STAssertTrue([keyFiles count] > 0, nil);
+    NSString *fileName = [bundlePath stringByAppendingPathComponent:[keyFiles objectAtIndex:0]];
+    KeyFileDecryptor *decryptor = [KeyFileDecryptor decryptorWithData:[NSData dataWithContentsOfFile:fileName]
+                                                          andPassword:kPassword];
+    NSString *outputFileName = [decryptor.fileName asPathInDocumentsFolder];
+    NSString *dataFileName = [[fileName stringByDeletingPathExtension] stringByAppendingPathExtension:@"dat"];
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:decryptor.key
+                        andIV:decryptor.iv];
+    STAssertTrue(didSucceed_, nil);
+
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:dataFileName error:nil];
+    unsigned int expectedNotifications = ceil([[attributes objectForKey:NSFileSize] doubleValue] / 1000.0);
+    STAssertEquals(expectedNotifications, progressNotifications_, nil);
+    STAssertEqualStrings([[decryptor.fileName lastPathComponent] stringByDeletingPathExtension],
+                         [self hashForFile:outputFileName],
+                         @"Block sizes that aren't a multiple of the AES block size should still decrypt");
+}
+
+//
+//  Compressed files are inflated as they're decrypted, and a stream that's
+//  cut short or isn't compressed at all fails.
+//
+
+- (void)testCompressed {
+    NSMutableString *text = [NSMutableString string];
+    for (int i = 0; i < 2000; i++) {
+        [text appendFormat:@"Account %d: username brian%d, password hunter%d\n", i, i % 7, i % 13];
+    }
+    NSData *clearText = [text dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *deflated = [clearText zlibDeflate];
+    NSData *key = [NSData dataWithBytes:keyBytes length:sizeof(keyBytes)];
+    NSData *iv = [NSData dataWithBytes:ivBytes length:sizeof(ivBytes)];
+    NSString *dataFileName = [@"compressed-test.dat" asPathInDocumentsFolder];
+    NSString *outputFileName = [@"compressed-test.txt" asPathInDocumentsFolder];
+    [[deflated aesEncryptWithKey:key andIV:iv] writeToFile:dataFileName atomically:NO];
+
+    DecryptionStateMachine *stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+    stateMachine.delegate = self;
+    stateMachine.blockSize = 1000;
+    stateMachine.compressed = YES;
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:key
+                        andIV:iv];
+    STAssertTrue(didSucceed_, nil);
+    STAssertEqualObjects(clearText, [NSData dataWithContentsOfFile:outputFileName], 
+                         @"Should inflate the whole file, a block at a time");
+
+    NSData *truncated = [deflated subdataWithRange:NSMakeRange(0, [deflated length] / 2)];
+    [[truncated aesEncryptWithKey:key andIV:iv] writeToFile:dataFileName atomically:NO];
+    stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+    stateMachine.delegate = self;
+    stateMachine.compressed = YES;
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:key
+                        andIV:iv];
+    STAssertTrue(didComplete_, nil);
+    STAssertFalse(didSucceed_, @"A truncated stream should fail");
+
+    [[clearText aesEncryptWithKey:key andIV:iv] writeToFile:dataFileName atomically:NO];
+    stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+    stateMachine.delegate = self;
+    stateMachine.compressed = YES;
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:key
+                        andIV:iv];
+    STAssertTrue(didComplete_, nil);
+    STAssertFalse(didSucceed_, @"Uncompressed data should fail");
+}
+
+//
+//  Decrypting with the wrong key fails. With this key, the last block
+//  doesn't end in valid padding.
+//
+
+- (void)testWrongKey {
+    NSData *clearText = [@"The quick brown fox jumps over the lazy dog, again and again and again.\n"
+                         dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *key = [NSData dataWithBytes:keyBytes length:sizeof(keyBytes)];
+    NSData *iv = [NSData dataWithBytes:ivBytes length:sizeof(ivBytes)];
+    NSString *dataFileName = [@"wrong-key-test.dat" asPathInDocumentsFolder];
+    NSString *outputFileName = [@"wrong-key-test.txt" asPathInDocumentsFolder];
+    [[clearText aesEncryptWithKey:key andIV:iv] writeToFile:dataFileName atomically:NO];
+
+    NSMutableData *wrongKey = [NSMutableData dataWithData:key];
+    ((unsigned char *)[wrongKey mutableBytes])[0] = 0x00;
+    DecryptionStateMachine *stateMachine = [[[DecryptionStateMachine alloc] init] autorelease];
+    stateMachine.delegate = self;
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:wrongKey
+                        andIV:iv];
+    STAssertTrue(didComplete_, nil);
+    STAssertFalse(didSucceed_, @"The wrong key should fail");
+
+    [self resetStateMachineFlags];
+    [stateMachine decryptFile:dataFileName
+                       toPath:outputFileName
+                      withKey:key
+                        andIV:iv];
+    STAssertTrue(didSucceed_, nil);
+    STAssertEqualObjects(clearText, [NSData dataWithContentsOfFile:outputFileName], nil);
+}
+
 #pragma mark -
 #pragma mark DecryptionStateMachineDelegate
 
@@ -242,6 +242,7 @@ createObjectFixture(void) {
 - (void)testSuccessfulDownload {
   id mockError = [OCMockObject mockForClass:[DVErrorHandler class]];
   id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  [[[mockManager stub] andReturn:nil] vaultIndex];
 
   //
   //  We get one message for the main file, then two messages for the notes files.
@@ -319,6 +320,34 @@ createObjectFixture(void) {
   STAssertNoThrow([mockWebView verify], @"DetailViewController should send loadRequest: to web view");
 }
 
+//
+//  With a listing to go on, only the sidecars that exist are requested.
+//
+
+- (void)testSkipsMissingSidecars {
+  
+  NSArray *paths = [NSArray arrayWithObjects:
+                    @"20110124210018-1B2F353C.key",
+                    @"20110124210018-1B2F353C.dat",
+                    @"20110124210018-1B2F353C-sidecar.key",
+                    nil];
+  NSMutableArray *contents = [NSMutableArray array];
+  for (NSString *path in paths) {
+    [contents addObject:[NSDictionary dictionaryWithObject:path forKey:@"path"]];
+  }
+  DBMetadata *metadata = [[[DBMetadata alloc] initWithDictionary:[NSDictionary dictionaryWithObject:contents forKey:@"contents"]] autorelease];
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  [[[mockManager stub] andReturn:[[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease]] vaultIndex];
+  [[mockManager expect] cacheCopyOfDropBoxPath:@"20110124210018-1B2F353C.dat"];
+  [[mockManager expect] cacheCopyOfDropBoxPath:@"20110124210018-1B2F353C-sidecar.key"];
+  DetailViewController *controller = [self createControllerWithErrorHandler:nil 
+                                                               andDBSession:nil
+                                                            andCacheManager:mockManager
+                                                                 andWebView:nil];
+  controller.detailItem = createObjectFixture();
+  STAssertNoThrow([mockManager verify], @"Should only ask for files in the listing");
+}
+
 //
 //  Test failed download.
 //
@@ -358,6 +387,7 @@ createObjectFixture(void) {
   [[[mockDbSession stub] andReturnValue:OCMOCK_VALUE(isLinked)] isLinked];
 
   id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  [[[mockManager stub] andReturn:nil] vaultIndex];
   DetailViewController *controller = [self createControllerWithErrorHandler:nil 
                                                                andDBSession:mockDbSession
                                                             andCacheManager:mockManager
@@ -24,6 +24,7 @@
 #import "DropboxPrototypeAppDelegate.h"
 #import "RootViewController.h"
 #import "DetailViewController.h"
+#import "DVVaultSession.h"
 
 
 @interface DropboxPrototypeAppDelegateTest : GTMTestCase {
@@ -42,13 +43,11 @@
 
 - (void)testDidBecomeActive {
     //
-    //  The rootViewController should get a lookForNewDropBoxFiles message.
+    //  The rootViewController should be asked to look for new DropBox files.
     //
     
     id mockRoot = [OCMockObject mockForClass:[RootViewController class]];
-    [[mockRoot expect] performSelector:@selector(lookForNewDropBoxFiles) 
-                            withObject:nil 
-                            afterDelay:0];
+    [[mockRoot expect] scheduleLookForNewDropBoxFiles];
     
     //
     //  The detailViewController should get a presentPasswordController message.
@@ -121,4 +120,96 @@
                     @"AppDelegate should send proper messages to detailViewController on applicationDidEnterBackground:");
 }
 
+//
+//  With vault sessions on, the decrypted keys are put away when the app
+//  enters the background, and handed back if it comes back within the grace
+//  period. The password isn't asked for until something needs it.
+//
+
+- (void)testResumeVaultSession {
+    
+    [[NSUserDefaults standardUserDefaults] setDouble:60 forKey:kDVVaultSessionGracePeriodKey];
+    
+    //
+    //  The root hands over its decrypted keys, and then gets wiped as usual.
+    //
+    
+    NSDictionary *values = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSData dataWithBytes:"0123456789abcdef" length:16], kDVKey,
+                            [NSData dataWithBytes:"fedcba9876543210" length:16], kDVIV,
+                            @"report.doc", kDVFileName,
+                            nil];
+    NSDictionary *decryptedKeyValues = [NSDictionary dictionaryWithObject:values forKey:@"/StrongBox/1.key"];
+    id mockKeyStore = [OCMockObject mockForClass:[DVKeyStore class]];
+    [[[mockKeyStore expect] andReturn:decryptedKeyValues] decryptedKeyValues];
+    id mockRoot = [OCMockObject mockForClass:[RootViewController class]];
+    [[[mockRoot stub] andReturn:mockKeyStore] keyStore];
+    [[mockRoot expect] setPassword:nil];
+    id mockDetail = [OCMockObject mockForClass:[DetailViewController class]];
+    [[mockDetail expect] setPassword:nil];
+    [[mockDetail expect] setDetailItem:nil];
+    
+    DropboxPrototypeAppDelegate *appDelegate = [[[DropboxPrototypeAppDelegate alloc] init] autorelease];
+    appDelegate.rootViewController = mockRoot;
+    appDelegate.detailViewController = mockDetail;
+    [appDelegate applicationDidEnterBackground:nil];
+    STAssertNoThrow([mockKeyStore verify], nil);
+    
+    //
+    //  Coming back resumes the session, without prompting for the password.
+    //  |mockDetail| would throw if it got |presentPasswordController|.
+    //
+    
+    [[mockDetail expect] resumeSession:[OCMArg any]];
+    [[mockRoot expect] scheduleLookForNewDropBoxFiles];
+    [appDelegate applicationDidBecomeActive:nil];
+    STAssertNoThrow([mockRoot verify], nil);
+    STAssertNoThrow([mockDetail verify], nil);
+    
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kDVVaultSessionGracePeriodKey];
+}
+
+//
+//  Once the grace period is over, coming back is the same as with sessions
+//  off.
+//
+
+- (void)testVaultSessionExpires {
+    
+    [[NSUserDefaults standardUserDefaults] setDouble:0.05 forKey:kDVVaultSessionGracePeriodKey];
+    id mockKeyStore = [OCMockObject niceMockForClass:[DVKeyStore class]];
+    NSDictionary *values = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSData dataWithBytes:"0123456789abcdef" length:16], kDVKey,
+                            [NSData dataWithBytes:"fedcba9876543210" length:16], kDVIV,
+                            @"report.doc", kDVFileName,
+                            nil];
+    [[[mockKeyStore stub] andReturn:[NSDictionary dictionaryWithObject:values forKey:@"/StrongBox/1.key"]] decryptedKeyValues];
+    id mockRoot = [OCMockObject mockForClass:[RootViewController class]];
+    [[[mockRoot stub] andReturn:mockKeyStore] keyStore];
+    [[mockRoot expect] setPassword:nil];
+    id mockDetail = [OCMockObject mockForClass:[DetailViewController class]];
+    [[mockDetail expect] setPassword:nil];
+    [[mockDetail expect] setDetailItem:nil];
+    
+    DropboxPrototypeAppDelegate *appDelegate = [[[DropboxPrototypeAppDelegate alloc] init] autorelease];
+    appDelegate.rootViewController = mockRoot;
+    appDelegate.detailViewController = mockDetail;
+    [appDelegate applicationDidEnterBackground:nil];
+    [NSThread sleepForTimeInterval:0.1];
+    
+    //
+    //  |mockDetail| would throw if it got |resumeSession:|.
+    //
+    
+    [[mockDetail expect] performSelector:@selector(presentPasswordController) 
+                              withObject:nil
+                              afterDelay:0];
+    [[mockRoot expect] scheduleLookForNewDropBoxFiles];
+    [appDelegate applicationDidBecomeActive:nil];
+    STAssertNoThrow([mockRoot verify], nil);
+    STAssertNoThrow([mockDetail verify], nil);
+    
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:kDVVaultSessionGracePeriodKey];
+}
+
 @end
@@ -22,6 +22,7 @@
 #import <UIKit/UIKit.h>
 #import "KeyFileDecryptor.h"
 #import "NSData+EncryptionHelpers.h"
+#import "Rfc2898DeriveBytes.h"
 #import <CommonCrypto/CommonCryptor.h>
 
 #define kKeyFileDecryptorTestPassword       @"Orwell."
@@ -100,4 +101,97 @@
                        @"Should decrypt IV");
 }
 
+//
+//  Key files too short to hold a salt, or whose cleartext is too short to
+//  hold a key and IV, don't decrypt.
+//
+
+- (void)testShortKeyFile {
+  STAssertNil([KeyFileDecryptor decryptorWithData:[NSData dataWithRandomBytes:4]
+                                      andPassword:kKeyFileDecryptorTestPassword], nil);
+  
+  NSData *salt = [NSData dataWithRandomBytes:8];
+  NSMutableData *key = [NSMutableData data];
+  NSMutableData *iv = [NSMutableData data];
+  [Rfc2898DeriveBytes deriveKey:key andIV:iv fromPassword:kKeyFileDecryptorTestPassword andSalt:salt];
+  NSMutableData *blob = [NSMutableData dataWithData:salt];
+  [blob appendData:[[NSData dataWithRandomBytes:kCCKeySizeAES128] aesEncryptWithKey:key andIV:iv]];
+  STAssertNil([KeyFileDecryptor decryptorWithData:blob andPassword:kKeyFileDecryptorTestPassword],
+              @"A key without an IV should not decrypt");
+}
+
+//
+//  The compression flag round-trips, and leaves the file name alone for
+//  clients that read the name as a C string.
+//
+
+- (void)testCompressedOption {
+  KeyFileDecryptor *kfd = [[[KeyFileDecryptor alloc] init] autorelease];
+  NSString *testFileName = @"test-compressed.txt";
+  kfd.key = [NSData dataWithRandomBytes:kCCKeySizeAES128];
+  kfd.iv  = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+  kfd.fileName = testFileName;
+  kfd.password = kKeyFileDecryptorTestPassword;
+  STAssertFalse(kfd.compressed, @"Should default to uncompressed");
+  
+  KeyFileDecryptor *decrypted = [KeyFileDecryptor decryptorWithData:[kfd encryptedBlob] 
+                                                        andPassword:kKeyFileDecryptorTestPassword];
+  STAssertFalse(decrypted.compressed, nil);
+  STAssertEqualStrings(testFileName, decrypted.fileName, nil);
+  
+  kfd.compressed = YES;
+  NSData *blob = [kfd encryptedBlob];
+  decrypted = [KeyFileDecryptor decryptorWithData:blob 
+                                      andPassword:kKeyFileDecryptorTestPassword];
+  STAssertTrue(decrypted.compressed, @"Should decrypt compression flag");
+  STAssertEqualStrings(testFileName, decrypted.fileName, nil);
+  STAssertEqualStrings([kfd.key hexString], [decrypted.key hexString], nil);
+  STAssertEqualStrings([kfd.iv hexString], [decrypted.iv hexString], nil);
+  
+  //
+  //  Decrypt the payload by hand, the way older clients do, and read the
+  //  file name as a C string.
+  //
+  
+  NSData *salt = [blob subdataWithRange:NSMakeRange(0, 8)];
+  NSMutableData *blobKey = [NSMutableData data];
+  NSMutableData *blobIV  = [NSMutableData data];
+  [Rfc2898DeriveBytes deriveKey:blobKey 
+                          andIV:blobIV 
+                   fromPassword:kKeyFileDecryptorTestPassword 
+                        andSalt:salt];
+  NSData *cipherText = [blob subdataWithRange:NSMakeRange(8, [blob length] - 8)];
+  NSMutableData *payload = [NSMutableData dataWithData:[cipherText aesDecryptWithKey:blobKey 
+                                                                               andIV:blobIV]];
+  const char terminator = 0;
+  [payload appendBytes:&terminator length:sizeof(terminator)];
+  NSString *oldFileName = [NSString stringWithUTF8String:(const char *)[payload bytes] + 
+                           kCCKeySizeAES128 + kCCBlockSizeAES128];
+  STAssertEqualStrings(testFileName, oldFileName, 
+                       @"Older clients should still see the plain file name");
+}
+
+//
+//  The chunked flag round-trips on its own and alongside compression.
+//
+
+- (void)testChunkedOption {
+  KeyFileDecryptor *kfd = [[[KeyFileDecryptor alloc] init] autorelease];
+  kfd.key = [NSData dataWithRandomBytes:kCCKeySizeAES128];
+  kfd.iv  = [NSData dataWithRandomBytes:kCCBlockSizeAES128];
+  kfd.fileName = @"notes.txt";
+  kfd.password = kKeyFileDecryptorTestPassword;
+  STAssertFalse(kfd.chunked, @"Should default to unchunked");
+  
+  for (int compressed = 0; compressed < 2; compressed++) {
+    kfd.chunked = YES;
+    kfd.compressed = compressed;
+    KeyFileDecryptor *decrypted = [KeyFileDecryptor decryptorWithData:[kfd encryptedBlob] 
+                                                          andPassword:kKeyFileDecryptorTestPassword];
+    STAssertTrue(decrypted.chunked, nil);
+    STAssertEquals((BOOL)compressed, decrypted.compressed, nil);
+    STAssertEqualStrings(@"notes.txt", decrypted.fileName, nil);
+  }
+}
+
 @end
@@ -0,0 +1,214 @@
+//
+//  MPOAuthRequestSignerTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/11/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "MPOAuthRequestSigner.h"
+#import "MPOAuthURLRequest.h"
+#import "MPOAuthSignatureParameter.h"
+#import "MPURLRequestParameter.h"
+#import "NSString+URLEscapingAdditions.h"
+#import "DVBenchmark.h"
+
+#define kConsumerKey      @"consumer key/é"
+#define kConsumerSecret   @"consumer+secret"
+#define kToken            @"token~1"
+#define kTokenSecret      @"token secret&more"
+#define kTimestamp        "1310400000"
+#define kNonce            "0123456789ABCDEF0123456789ABCDEF"
+
+@interface MPOAuthRequestSigner (MPOAuthRequestSignerTest)
+
+- (NSString *)parameterStringForMethod:(NSString *)inMethod URL:(NSURL *)inURL parameters:(NSDictionary *)inParameters signedParameters:(NSDictionary *)inSignedParameters timestamp:(const char *)inTimestamp nonce:(const char *)inNonce;
+
+@end
+
+@interface MPOAuthRequestSignerTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation MPOAuthRequestSignerTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+- (MPOAuthRequestSigner *)signer {
+
+  return [[[MPOAuthRequestSigner alloc] initWithConsumerKey:kConsumerKey
+                                             consumerSecret:kConsumerSecret
+                                                      token:kToken
+                                                tokenSecret:kTokenSecret] autorelease];
+}
+
+//
+//  Signs a request the old way, through |MPOAuthURLRequest|, with the same
+//  timestamp and nonce the signer is given.
+//
+
+- (NSMutableURLRequest *)requestFromURLRequestWithMethod:(NSString *)method
+                                                     URL:(NSURL *)url
+                                              parameters:(NSDictionary *)parameters {
+
+  NSMutableArray *paramList = [NSMutableArray arrayWithObjects:
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_consumer_key" andValue:kConsumerKey] autorelease],
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_token" andValue:kToken] autorelease],
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_signature_method" andValue:kMPOAuthSignatureMethodHMACSHA1] autorelease],
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_timestamp" andValue:@kTimestamp] autorelease],
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_nonce" andValue:@kNonce] autorelease],
+                               [[[MPURLRequestParameter alloc] initWithName:@"oauth_version" andValue:@"1.0"] autorelease],
+                               nil];
+  [paramList addObjectsFromArray:[MPURLRequestParameter parametersFromDictionary:parameters]];
+  MPOAuthURLRequest *oauthRequest = [[[MPOAuthURLRequest alloc] initWithURL:url andParameters:paramList] autorelease];
+  oauthRequest.HTTPMethod = method;
+  NSString *secret = [NSString stringWithFormat:@"%@&%@",
+                      [kConsumerSecret stringByAddingURIPercentEscapesUsingEncoding:NSUTF8StringEncoding],
+                      [kTokenSecret stringByAddingURIPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+  return [oauthRequest urlRequestSignedWithSecret:secret usingMethod:kMPOAuthSignatureMethodHMACSHA1];
+}
+
+- (NSDictionary *)parameters {
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          @"dropbox", @"root",
+          @"café \U0001F600", @"path",
+          @":/?=,!$&'()*+;[]@# -._~", @"reserved",
+          @"", @"empty",
+          nil];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Query strings and signatures are exactly what |MPOAuthURLRequest| makes.
+//
+
+- (void)testMatchesURLRequest {
+
+  MPOAuthRequestSigner *signer = [self signer];
+  NSURL *url = [NSURL URLWithString:@"https://api.dropbox.com/0/metadata/dropbox/Str%C3%B6ngBox"];
+  NSMutableURLRequest *expected = [self requestFromURLRequestWithMethod:@"GET" URL:url parameters:[self parameters]];
+  NSString *actual = [signer parameterStringForMethod:@"GET"
+                                                  URL:url
+                                           parameters:[self parameters]
+                                     signedParameters:nil
+                                            timestamp:kTimestamp
+                                                nonce:kNonce];
+  STAssertEqualStrings([[expected URL] query], actual, nil);
+
+  expected = [self requestFromURLRequestWithMethod:@"POST" URL:url parameters:nil];
+  actual = [signer parameterStringForMethod:@"POST"
+                                        URL:url
+                                 parameters:nil
+                           signedParameters:nil
+                                  timestamp:kTimestamp
+                                      nonce:kNonce];
+  NSString *body = [[[NSString alloc] initWithData:[expected HTTPBody] encoding:NSUTF8StringEncoding] autorelease];
+  STAssertEqualStrings(body, actual, nil);
+
+  NSMutableURLRequest *request = [signer URLRequestWithMethod:@"POST" URL:url parameters:[self parameters]];
+  STAssertEqualStrings(@"POST", [request HTTPMethod], nil);
+  STAssertEqualObjects(url, [request URL], nil);
+  STAssertTrue([[request HTTPBody] length] > 0, nil);
+  STAssertThrows([signer URLRequestWithMethod:@"PUT" URL:url parameters:nil], nil);
+}
+
+//
+//  Signed-only parameters change the signature but stay out of the result,
+//  the way the upload request signs its file name.
+//
+
+- (void)testSignedParameters {
+
+  MPOAuthRequestSigner *signer = [self signer];
+  NSURL *url = [NSURL URLWithString:@"https://api-content.dropbox.com/0/files/dropbox/StrongBox"];
+  NSDictionary *file = [NSDictionary dictionaryWithObject:@"a file;name.dat" forKey:@"file"];
+  NSMutableURLRequest *expected = [self requestFromURLRequestWithMethod:@"POST" URL:url parameters:file];
+  NSString *expectedSignature = [[[[[NSString alloc] initWithData:[expected HTTPBody] encoding:NSUTF8StringEncoding] autorelease]
+                                  componentsSeparatedByString:@"&oauth_signature="] lastObject];
+
+  NSString *actual = [signer parameterStringForMethod:@"POST"
+                                                  URL:url
+                                           parameters:nil
+                                     signedParameters:file
+                                            timestamp:kTimestamp
+                                                nonce:kNonce];
+  STAssertTrue([actual rangeOfString:@"file"].location == NSNotFound, nil);
+  STAssertTrue([actual hasSuffix:[@"&oauth_signature=" stringByAppendingString:expectedSignature]], nil);
+}
+
+//
+//  Nothing hangs over from one request to the next.
+//
+
+- (void)testReuse {
+
+  MPOAuthRequestSigner *signer = [self signer];
+  NSURL *url = [NSURL URLWithString:@"https://api.dropbox.com/0/account/info"];
+  NSString *first = [signer parameterStringForMethod:@"GET" URL:url parameters:nil signedParameters:nil timestamp:kTimestamp nonce:kNonce];
+  NSMutableDictionary *many = [NSMutableDictionary dictionary];
+  for (NSUInteger i = 0; i < 100; i++) {
+    [many setObject:[NSString stringWithFormat:@"value %u", i] forKey:[NSString stringWithFormat:@"name%03u", i]];
+  }
+  NSString *large = [signer parameterStringForMethod:@"GET" URL:url parameters:many signedParameters:nil timestamp:kTimestamp nonce:kNonce];
+  STAssertEqualStrings([[[self requestFromURLRequestWithMethod:@"GET" URL:url parameters:many] URL] query], large, nil);
+  STAssertEqualStrings(first, [signer parameterStringForMethod:@"GET" URL:url parameters:nil signedParameters:nil timestamp:kTimestamp nonce:kNonce], nil);
+}
+
+//
+//  Benchmark: signatures per second, against |MPOAuthURLRequest|.
+//
+
+- (void)testSigningBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  MPOAuthRequestSigner *signer = [self signer];
+  NSURL *url = [NSURL URLWithString:@"https://api.dropbox.com/0/metadata/dropbox/StrongBox"];
+  NSDictionary *parameters = [NSDictionary dictionaryWithObjectsAndKeys:@"dropbox", @"root", @"true", @"list", nil];
+  NSUInteger count = 5000;
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [self requestFromURLRequestWithMethod:@"GET" URL:url parameters:parameters];
+  }
+  CFAbsoluteTime urlRequest = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [signer URLRequestWithMethod:@"GET" URL:url parameters:parameters];
+  }
+  CFAbsoluteTime signerTime = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  NSLog(@"%s -- %u requests: MPOAuthURLRequest %.0f/s, MPOAuthRequestSigner %.0f/s",
+        __PRETTY_FUNCTION__,
+        count,
+        count / urlRequest,
+        count / signerTime);
+}
+
+@end
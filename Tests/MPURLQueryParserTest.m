@@ -0,0 +1,198 @@
+//
+//  MPURLQueryParserTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/12/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "MPURLQueryParser.h"
+#import "MPURLRequestParameter.h"
+#import "NSURL+MPURLParameterAdditions.h"
+#import "DVBenchmark.h"
+
+@interface MPURLQueryParserTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation MPURLQueryParserTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  The NSScanner loop |MPURLRequestParameter| used to split strings with,
+//  returning [name, value] pairs with NSNull for nil.
+//
+
+- (NSArray *)scannerComponentsFromString:(NSString *)string {
+
+  NSMutableArray *components = [NSMutableArray array];
+  NSScanner *scanner = [[[NSScanner alloc] initWithString:string] autorelease];
+  while (![scanner isAtEnd]) {
+    NSString *name = nil;
+    NSString *value = nil;
+    [scanner scanUpToString:@"=" intoString:&name];
+    [scanner scanString:@"=" intoString:NULL];
+    [scanner scanUpToString:@"&" intoString:&value];
+    [scanner scanString:@"&" intoString:NULL];
+    value = [value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    [components addObject:[NSArray arrayWithObjects:
+                           name ? (id)name : [NSNull null],
+                           value ? (id)value : [NSNull null],
+                           nil]];
+  }
+  return components;
+}
+
+- (NSArray *)parserComponentsFromString:(NSString *)string {
+
+  NSMutableArray *components = [NSMutableArray array];
+  MPURLQueryParser *parser = [[[MPURLQueryParser alloc] initWithString:string] autorelease];
+  for (NSUInteger i = 0; i < parser.count; i++) {
+    NSString *name = [parser nameAtIndex:i];
+    NSString *value = [parser valueAtIndex:i];
+    [components addObject:[NSArray arrayWithObjects:
+                           name ? (id)name : [NSNull null],
+                           value ? (id)value : [NSNull null],
+                           nil]];
+  }
+  return components;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Well-formed and malformed strings split exactly the way NSScanner split them.
+//
+
+- (void)testMatchesScanner {
+
+  NSArray *strings = [NSArray arrayWithObjects:
+                      @"",
+                      @"oauth_token=abc&oauth_token_secret=def",
+                      @"oauth_token=a%2Bb%3D%3D&uid=12345",
+                      @"path=%2FStr%C3%B6ngBox%2Fcaf%c3%a9&x=+",
+                      @"a=&b=2",
+                      @"=1&b=2",
+                      @"a&b=2",
+                      @"a=1&&b=2",
+                      @"a=1&",
+                      @"lonely",
+                      @"  a = 1 & b=\t2 \n",
+                      @"a=%zz&b=%4&c=%C3",
+                      @"a=1=2&b",
+                      @"café=thé& c=　d",
+                      @"&&&",
+                      nil];
+  for (NSString *string in strings) {
+    STAssertEqualObjects([self scannerComponentsFromString:string],
+                         [self parserComponentsFromString:string],
+                         @"Components of \"%@\"", string);
+  }
+}
+
+- (void)testParameters {
+
+  NSString *response = @"oauth_token=abc&oauth_token_secret=d%26f&oauth_token=later";
+  NSDictionary *dictionary = [MPURLRequestParameter parameterDictionaryFromString:response];
+  STAssertEquals((NSUInteger)2, [dictionary count], nil);
+  STAssertEqualStrings(@"later", [dictionary objectForKey:@"oauth_token"], nil);
+  STAssertEqualStrings(@"d&f", [dictionary objectForKey:@"oauth_token_secret"], nil);
+  STAssertEquals((NSUInteger)0, [[MPURLRequestParameter parameterDictionaryFromString:nil] count], nil);
+  STAssertEquals((NSUInteger)1, [[MPURLRequestParameter parameterDictionaryFromString:@"a=&=b&c=1"] count],
+                 @"Components missing a name or value are left out");
+
+  NSArray *parameters = [MPURLRequestParameter parametersFromString:response];
+  STAssertEquals((NSUInteger)3, [parameters count], nil);
+  STAssertEqualStrings(@"oauth_token_secret", [[parameters objectAtIndex:1] name], nil);
+  STAssertEqualStrings(@"d&f", [[parameters objectAtIndex:1] value], nil);
+
+  MPURLQueryParser *parser = [[[MPURLQueryParser alloc] initWithString:response] autorelease];
+  STAssertEquals((NSUInteger)1, [parser indexOfName:@"oauth_token_secret"], nil);
+  STAssertEquals((NSUInteger)0, [parser indexOfName:@"oauth_token"], nil);
+  STAssertEquals((NSUInteger)NSNotFound, [parser indexOfName:@"oauth"], nil);
+}
+
+//
+//  The normalized string matches what NSURL's own path and query give.
+//
+
+- (void)testAbsoluteNormalizedString {
+
+  NSArray *urls = [NSArray arrayWithObjects:
+                   @"https://api.dropbox.com",
+                   @"https://api.dropbox.com/",
+                   @"https://api.dropbox.com:443",
+                   @"https://api.dropbox.com/0/metadata/dropbox/StrongBox",
+                   @"https://api.dropbox.com?a=1",
+                   @"https://api.dropbox.com?",
+                   @"https://api.dropbox.com#top",
+                   nil];
+  for (NSString *string in urls) {
+    NSURL *url = [NSURL URLWithString:string];
+    NSString *expected = string;
+    if ([[url path] length] == 0 && [[url query] length] == 0) {
+      expected = [string stringByAppendingString:@"/"];
+    }
+    STAssertEqualStrings(expected, [url absoluteNormalizedString], nil);
+  }
+}
+
+//
+//  Benchmark: an OAuth response with many parameters, NSScanner against the parser.
+//
+
+- (void)testParseBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSMutableString *response = [NSMutableString stringWithString:@"oauth_token=abc&oauth_token_secret=def"];
+  for (NSUInteger i = 0; i < 50; i++) {
+    [response appendFormat:@"&name%u=value%%20%u", i, i];
+  }
+  NSUInteger count = 2000;
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [self scannerComponentsFromString:response];
+  }
+  CFAbsoluteTime scanner = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    [self parserComponentsFromString:response];
+  }
+  CFAbsoluteTime parser = CFAbsoluteTimeGetCurrent() - start;
+  [pool drain];
+
+  NSLog(@"%s -- %u responses of %u bytes: NSScanner %.3fs, parser %.3fs",
+        __PRETTY_FUNCTION__,
+        count,
+        [response length],
+        scanner,
+        parser);
+}
+
+@end
@@ -0,0 +1,81 @@
+//
+//  NSData+CompressionHelpersTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import "NSData+CompressionHelpers.h"
+#import "NSData+EncryptionHelpers.h"
+
+@interface NSData_CompressionHelpersTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation NSData_CompressionHelpersTest
+
+//
+//  Text, nothing at all, and data that won't compress all come back intact.
+//
+
+- (void)testRoundTrip {
+
+  NSMutableString *text = [NSMutableString string];
+  for (int i = 0; i < 500; i++) {
+    [text appendFormat:@"Line %d of the combinations file.\n", i];
+  }
+  NSData *textData = [text dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *deflated = [textData zlibDeflate];
+  STAssertNotNil(deflated, nil);
+  STAssertTrue([deflated length] < [textData length] / 4,
+               @"Repetitive text should compress well (%u of %u bytes)",
+               [deflated length],
+               [textData length]);
+  STAssertEqualObjects(textData, [deflated zlibInflate], nil);
+
+  NSData *empty = [NSData data];
+  STAssertEqualObjects(empty, [[empty zlibDeflate] zlibInflate], nil);
+
+  NSData *random = [NSData dataWithRandomBytes:100000];
+  STAssertEqualObjects(random, [[random zlibDeflate] zlibInflate], nil);
+}
+
+//
+//  Anything that isn't exactly one whole stream is an error.
+//
+
+- (void)testBadStreams {
+
+  NSData *textData = [@"The quick brown fox jumps over the lazy dog. The quick brown fox."
+                      dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *deflated = [textData zlibDeflate];
+
+  NSData *truncated = [deflated subdataWithRange:NSMakeRange(0, [deflated length] - 4)];
+  STAssertNil([truncated zlibInflate], @"Missing checksum should fail");
+
+  NSMutableData *trailing = [NSMutableData dataWithData:deflated];
+  [trailing appendData:textData];
+  STAssertNil([trailing zlibInflate], @"Trailing data should fail");
+
+  STAssertNil([textData zlibInflate], @"Text isn't a zlib stream");
+  STAssertNil([[NSData data] zlibInflate], @"An empty buffer isn't a zlib stream");
+}
+
+@end
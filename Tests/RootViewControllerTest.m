@@ -110,7 +110,7 @@
 
 //
 //  When the view loads, it should call |loadMetadata| on its restClient
-//  object.
+//  object -- once, and not until the view has finished loading.
 //
 
 - (void)testLoadMetadata {
@@ -130,18 +130,27 @@
   //
   
   id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
-  [[mockManager expect] loadMetadata];
   
   RootViewController *controller = [self rootControllerWithSession:mockSession 
                                                    andCacheManager:mockManager];
   
   //
-  //  Finally, load the controller views and verify we got the loadMetadata
-  //  call.
+  //  Load the controller views. |mockManager| doesn't expect anything yet, so
+  //  it throws if |loadMetadata| is called while the view is loading. Then
+  //  ask again, the way the application delegate does when it becomes active.
   //
   
   [controller loadView];
   [controller viewDidLoad];
+  [controller scheduleLookForNewDropBoxFiles];
+  
+  //
+  //  Finally, let the run loop go and verify we got exactly one loadMetadata
+  //  call.
+  //
+  
+  [[mockManager expect] loadMetadata];
+  [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
   [mockManager verify];
 }
 
@@ -204,6 +213,7 @@
   id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
   [[mockManager expect] cacheCopyOfDropBoxPath:OCMOCK_ANY];
   [[[mockManager stub] andReturn:metadata] metadata];
+  [[[mockManager stub] andReturn:[[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease]] vaultIndex];
   [[[mockManager stub] andReturn:nil] metadataForPath:OCMOCK_ANY];
   
   RootViewController *controller = [self rootControllerWithSession:nil 
@@ -214,6 +224,7 @@
   //
   
   [controller cacheManagerDidLoadMetadata:mockManager];
+  [controller.keyStore waitUntilIdle];
   
   //
   //  Make sure we got our loadFile:intoPath: message.
@@ -257,7 +268,9 @@
     [[cacheManager expect] cacheCopyOfDropBoxPath:OCMOCK_ANY];
   }
   [[[cacheManager stub] andReturn:metadata] metadata];
+  [[[cacheManager stub] andReturn:[[[DVVaultIndex alloc] initWithMetadata:metadata] autorelease]] vaultIndex];
   [controller cacheManagerDidLoadMetadata:cacheManager];
+  [controller.keyStore waitUntilIdle];
   STAssertNoThrow([cacheManager verify], 
                   @"Should get the expected cacheCopyOfDropBoxPath: messages");
   NSArray *objects = [controller fetchObjectsForPredicate:nil error:nil];
@@ -349,13 +362,16 @@
   STAssertNotNil(victim, @"Should have a victim");
   
   //
-  //  We will get 2 calls to deletePath, one for the key and one for the dat
+  //  We will get one batch delete, with the key and the dat.
   //
   
   id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
   controller.cacheManager = mockManager;
-  [[mockManager expect] deleteDropBoxPath:OCMOCK_ANY];
-  [[mockManager expect] deleteDropBoxPath:OCMOCK_ANY];
+  NSString *keyPath = [victim valueForKey:kDVKeyName];
+  [[mockManager expect] deleteDropBoxPaths:[NSArray arrayWithObjects:
+                                            keyPath,
+                                            [DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:keyPath],
+                                            nil]];
   
   //
   //  For some reason, I can't save the deletes. It's probably something I'm
@@ -371,8 +387,37 @@
   STAssertEquals((NSUInteger)1, 
                  [[controller fetchObjectsForPredicate:nil error:nil] count],
                  @"Should have deleted victim");
-  STAssertNoThrow([mockManager verify], @"Should have received 2 deletePath: messages");
+  STAssertNoThrow([mockManager verify], @"Should have received a deleteDropBoxPaths: message");
   STAssertNoThrow([mockErrorHandler verify], @"Should have received spurious error");
+  
+  //
+  //  Now check the last object in editing mode and delete it. Selecting a 
+  //  row in editing mode only checks it.
+  //
+  
+  [controller setEditing:YES animated:NO];
+  STAssertNotNil(controller.navigationItem.rightBarButtonItem, @"Should show the Delete button");
+  STAssertFalse(controller.navigationItem.rightBarButtonItem.enabled, @"Nothing to delete yet");
+  [controller.fetchedResultsController performFetch:nil];
+  victim = [controller.fetchedResultsController objectAtIndexPath:indexPath];
+  keyPath = [victim valueForKey:kDVKeyName];
+  [controller tableView:nil didSelectRowAtIndexPath:indexPath];
+  [controller tableView:nil didSelectRowAtIndexPath:indexPath];
+  [controller tableView:nil didSelectRowAtIndexPath:indexPath];
+  STAssertTrue(controller.navigationItem.rightBarButtonItem.enabled, @"One row checked");
+  
+  [[mockManager expect] deleteDropBoxPaths:[NSArray arrayWithObjects:
+                                            keyPath,
+                                            [DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:keyPath],
+                                            nil]];
+  [[mockErrorHandler expect] displayMessage:OCMOCK_ANY forError:OCMOCK_ANY];
+  [controller deleteSelectedObjects];
+  STAssertEquals((NSUInteger)0, 
+                 [[controller fetchObjectsForPredicate:nil error:nil] count],
+                 @"Should have deleted the checked row");
+  STAssertFalse(controller.editing, @"Should leave editing mode");
+  STAssertNil(controller.navigationItem.rightBarButtonItem, @"Should hide the Delete button");
+  STAssertNoThrow([mockManager verify], @"Should have received a deleteDropBoxPaths: message");
 }
 
 //
@@ -472,6 +517,7 @@
   [DVCacheManager createCacheRootDirectory];
   [self copyFileFromBundleToCache:keyFile];
   [controller cacheManager:mockManager didCacheCopyOfFile:[DVCacheManager cachePathForDropBoxPath:keyFile]];
+  [controller.keyStore waitUntilIdle];
   
   for (NSManagedObject *object in [controller fetchObjectsForPredicate:nil error:nil]) {
     
@@ -484,6 +530,7 @@
   }
   
   controller.password = kDVTestPassword;
+  [controller.keyStore waitUntilIdle];
   
   //
   //  Now, find the corresponding Core Data object and validate that the
@@ -522,6 +569,7 @@
   [self copyFileFromBundleToCache:keyFile2];
   STAssertNoThrow([controller cacheManager:mockManager didCacheCopyOfFile:[DVCacheManager cachePathForDropBoxPath:keyFile2]],
                   nil);
+  [controller.keyStore waitUntilIdle];
   for (NSManagedObject *object in [controller fetchObjectsForPredicate:nil error:nil]) {
     NSString *keyName = [object valueForKey:kDVKeyName];
     STAssertEqualStrings([keyToClearNames valueForKey:keyName],
@@ -535,6 +583,7 @@
   //
   
   controller.password = nil;
+  [controller.keyStore waitUntilIdle];
   for (NSManagedObject *object in [controller fetchObjectsForPredicate:nil error:nil]) {
     STAssertNotNil([object valueForKey:kDVKeyName], @"RootViewController should remember key name");
     STAssertNil([object valueForKey:kDVFileName], @"RootViewController should forget cleartext file name");
@@ -543,4 +592,110 @@
   }
 }
 
+//
+//  Selecting a row whose key isn't decrypted yet asks the key store for it.
+//
+
+- (void)testSelectDecrypts {
+  NSString *bundlePath = [[NSBundle mainBundle] bundlePath];
+  id mockSession = [OCMockObject mockForClass:[DBSession class]];
+  BOOL isLinked = NO;
+  [[[mockSession stub] andReturnValue:OCMOCK_VALUE(isLinked)] isLinked];
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  RootViewController *controller = [self rootControllerWithSession:mockSession
+                                                   andCacheManager:mockManager];
+  DBMetadata *metadata = [self loadMetadataFromJsonFile:[bundlePath stringByAppendingPathComponent:@"MetadataAddFiles.json"]];
+  [self verifyLoadMetadataObjectsForController:controller 
+                                   andMetadata:metadata 
+                                newObjectCount:3
+                              totalObjectCount:3];
+  NSString *keyFile = @"/StrongBox/20110124210018-26185D7F.key";
+  [[NSFileManager defaultManager] removeItemAtPath:[DVCacheManager cachePathForDropBoxPath:keyFile] 
+                                             error:nil];
+  controller.password = kDVTestPassword;
+  [controller.keyStore waitUntilIdle];
+  
+  //
+  //  The key file arrives without the controller hearing about it, so only
+  //  selecting its row decrypts it.
+  //
+  
+  [DVCacheManager createCacheRootDirectory];
+  [self copyFileFromBundleToCache:keyFile];
+  [controller.fetchedResultsController performFetch:nil];
+  NSManagedObject *object = nil;
+  for (NSManagedObject *candidate in [controller.fetchedResultsController fetchedObjects]) {
+    if ([[candidate valueForKey:kDVKeyName] isEqualToString:keyFile]) {
+      object = candidate;
+    }
+  }
+  STAssertNotNil(object, nil);
+  STAssertNil([object valueForKey:kDVFileName], nil);
+  [controller tableView:nil didSelectRowAtIndexPath:[controller.fetchedResultsController indexPathForObject:object]];
+  [controller.keyStore waitUntilIdle];
+  STAssertEqualStrings(@"E9AFCB203225CBB36012C61D79365070940243A0.txt",
+                       [object valueForKey:kDVFileName],
+                       @"Selecting the row should decrypt its key");
+}
+
+//
+//  Swiping a row deletes just that row, without turning on multiple
+//  selection.
+//
+
+- (void)testSwipeToDelete {
+  NSString *bundlePath = [[NSBundle mainBundle] bundlePath];
+  id mockSession = [OCMockObject mockForClass:[DBSession class]];
+  id mockErrorHandler = [OCMockObject mockForClass:[DVErrorHandler class]];
+  BOOL isLinked = NO;
+  [[[mockSession stub] andReturnValue:OCMOCK_VALUE(isLinked)] isLinked];
+  RootViewController *controller = [self rootControllerWithSession:mockSession
+                                                   andCacheManager:nil];
+  controller.errorHandler = mockErrorHandler;
+  DBMetadata *metadata = [self loadMetadataFromJsonFile:[bundlePath stringByAppendingPathComponent:@"MetadataAddFiles.json"]];
+  [self verifyLoadMetadataObjectsForController:controller 
+                                   andMetadata:metadata 
+                                newObjectCount:3
+                              totalObjectCount:3];
+  [controller.fetchedResultsController performFetch:nil];
+  NSUInteger indexes[] = { 0, 0 };
+  NSIndexPath *indexPath = [NSIndexPath indexPathWithIndexes:indexes 
+                                                      length:sizeof(indexes) / sizeof(NSUInteger)];
+  NSManagedObject *victim = [controller.fetchedResultsController objectAtIndexPath:indexPath];
+  NSString *keyPath = [victim valueForKey:kDVKeyName];
+  
+  [controller tableView:controller.tableView willBeginEditingRowAtIndexPath:indexPath];
+  STAssertEquals(UITableViewCellEditingStyleDelete,
+                 [controller tableView:controller.tableView editingStyleForRowAtIndexPath:indexPath],
+                 @"A swiped row should get a delete button");
+  STAssertNil(controller.navigationItem.rightBarButtonItem, @"A swipe shouldn't show the Delete button");
+  
+  id mockManager = [OCMockObject mockForClass:[DVCacheManager class]];
+  controller.cacheManager = mockManager;
+  [[mockManager expect] deleteDropBoxPaths:[NSArray arrayWithObjects:
+                                            keyPath,
+                                            [DVVaultIndex pathForKind:DVVaultEntryKindData companionOfPath:keyPath],
+                                            nil]];
+  [[mockErrorHandler expect] displayMessage:OCMOCK_ANY forError:OCMOCK_ANY];
+  [controller tableView:controller.tableView 
+     commitEditingStyle:UITableViewCellEditingStyleDelete 
+      forRowAtIndexPath:indexPath];
+  [controller tableView:controller.tableView didEndEditingRowAtIndexPath:indexPath];
+  STAssertEquals((NSUInteger)2, 
+                 [[controller fetchObjectsForPredicate:nil error:nil] count],
+                 @"Should have deleted the swiped row");
+  STAssertNoThrow([mockManager verify], @"Should have received a deleteDropBoxPaths: message");
+  
+  //
+  //  The Edit button still turns on multiple selection afterwards.
+  //
+  
+  [controller setEditing:YES animated:NO];
+  STAssertEquals(UITableViewCellEditingStyleNone,
+                 [controller tableView:controller.tableView editingStyleForRowAtIndexPath:indexPath],
+                 nil);
+  STAssertNotNil(controller.navigationItem.rightBarButtonItem, @"Should show the Delete button");
+  [controller setEditing:NO animated:NO];
+}
+
 @end
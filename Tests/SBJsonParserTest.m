@@ -0,0 +1,217 @@
+//
+//  SBJsonParserTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/9/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "JSON.h"
+#import "DVBenchmark.h"
+
+@interface SBJsonParserTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation SBJsonParserTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  Parses |json| from its UTF-8 bytes.
+//
+
+- (id)objectWithJSON:(NSString *)json parser:(SBJsonParser *)parser {
+  return [parser objectWithData:[json dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  String, data and raw byte input give the same answer.
+//
+
+- (void)testInputKinds {
+
+  NSString *json = @"{\"path\": \"/StrongBox/foo.dat\", \"bytes\": 1024, \"is_dir\": false}";
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  id fromString = [parser objectWithString:json];
+  id fromData = [self objectWithJSON:json parser:parser];
+  const char *bytes = [json UTF8String];
+  id fromBytes = [parser objectWithBytes:bytes length:strlen(bytes)];
+
+  STAssertNotNil(fromString, nil);
+  STAssertEqualObjects(fromString, fromData, nil);
+  STAssertEqualObjects(fromString, fromBytes, nil);
+
+  //
+  //  Raw bytes don't need a terminator; only |length| bytes are read.
+  //
+
+  const char padded[] = "[1, 2]garbage";
+  STAssertEqualObjects([NSArray arrayWithObjects:[NSNumber numberWithInt:1], [NSNumber numberWithInt:2], nil],
+                       [parser objectWithBytes:padded length:6],
+                       nil);
+  STAssertNil([parser objectWithData:nil], nil);
+}
+
+//
+//  Integers become long longs, fractions and exponents become doubles, and
+//  only numbers too big for either fall back to NSDecimalNumber.
+//
+
+- (void)testNumbers {
+
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  NSArray *numbers = [self objectWithJSON:@"[0, -7, 123456789012345678, 1.5, -2.5e3, 1E-2, 12345678901234567890123]"
+                                   parser:parser];
+  STAssertEquals((NSUInteger)7, [numbers count], nil);
+  STAssertEquals(0LL, [[numbers objectAtIndex:0] longLongValue], nil);
+  STAssertEquals(-7LL, [[numbers objectAtIndex:1] longLongValue], nil);
+  STAssertEquals(123456789012345678LL, [[numbers objectAtIndex:2] longLongValue], nil);
+  STAssertEqualsWithAccuracy(1.5, [[numbers objectAtIndex:3] doubleValue], 0.0, nil);
+  STAssertEqualsWithAccuracy(-2500.0, [[numbers objectAtIndex:4] doubleValue], 0.0, nil);
+  STAssertEqualsWithAccuracy(0.01, [[numbers objectAtIndex:5] doubleValue], 1e-15, nil);
+  STAssertTrue([[numbers objectAtIndex:6] isKindOfClass:[NSDecimalNumber class]], nil);
+  STAssertEqualStrings(@"12345678901234567890123", [[numbers objectAtIndex:6] stringValue], nil);
+  STAssertFalse([[numbers objectAtIndex:2] isKindOfClass:[NSDecimalNumber class]],
+                @"Integers should take the fast path");
+}
+
+//
+//  Escapes, surrogate pairs, and strings long enough to exercise the
+//  word-at-a-time scanning on both sides of a word boundary.
+//
+
+- (void)testStrings {
+
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  NSArray *strings = [self objectWithJSON:@"[\"plain\", \"a\\\"b\\\\c\\/d\\n\", \"\\u00e9\\ud83d\\ude00\", \"caf\u00e9\"]"
+                                   parser:parser];
+  STAssertEqualStrings(@"plain", [strings objectAtIndex:0], nil);
+  STAssertEqualStrings(@"a\"b\\c/d\n", [strings objectAtIndex:1], nil);
+  STAssertEqualStrings(@"\u00e9\U0001F600", [strings objectAtIndex:2], nil);
+  STAssertEqualStrings(@"caf\u00e9", [strings objectAtIndex:3], nil);
+
+  for (NSUInteger length = 0; length < 40; length++) {
+    NSString *body = [@"" stringByPaddingToLength:length withString:@"x" startingAtIndex:0];
+    for (NSUInteger split = 0; split <= length; split++) {
+      NSString *escaped = [NSString stringWithFormat:@"[\"%@\\t%@\"]",
+                           [body substringToIndex:split],
+                           [body substringFromIndex:split]];
+      NSString *expected = [NSString stringWithFormat:@"%@\t%@",
+                            [body substringToIndex:split],
+                            [body substringFromIndex:split]];
+      STAssertEqualStrings(expected, [[self objectWithJSON:escaped parser:parser] objectAtIndex:0], nil);
+    }
+  }
+}
+
+//
+//  Repeated keys share one string, within a document and across documents.
+//
+
+- (void)testKeyInterning {
+
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  NSArray *first = [self objectWithJSON:@"[{\"path\": 1}, {\"path\": 2}]" parser:parser];
+  NSArray *second = [self objectWithJSON:@"{\"path\": 3}" parser:parser];
+  NSString *key1 = [[[first objectAtIndex:0] allKeys] objectAtIndex:0];
+  NSString *key2 = [[[first objectAtIndex:1] allKeys] objectAtIndex:0];
+  NSString *key3 = [[(NSDictionary *)second allKeys] objectAtIndex:0];
+  STAssertEqualStrings(@"path", key1, nil);
+  STAssertTrue(key1 == key2, @"Keys in one document should be interned");
+  STAssertTrue(key1 == key3, @"Keys across documents should be interned");
+}
+
+//
+//  The error codes are the same as they have always been.
+//
+
+- (void)testErrorCodes {
+
+  NSDictionary *cases = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithInt:EEOF], @"",
+                         [NSNumber numberWithInt:EEOF], @"[1, 2",
+                         [NSNumber numberWithInt:EEOF], @"[\"abc",
+                         [NSNumber numberWithInt:EPARSE], @"[1, ?]",
+                         [NSNumber numberWithInt:EPARSENUM], @"[01]",
+                         [NSNumber numberWithInt:EPARSENUM], @"[-]",
+                         [NSNumber numberWithInt:EPARSENUM], @"[+1]",
+                         [NSNumber numberWithInt:ETRAILCOMMA], @"[1,]",
+                         [NSNumber numberWithInt:ETRAILCOMMA], @"{\"a\": 1,}",
+                         [NSNumber numberWithInt:ETRAILGARBAGE], @"[1] x",
+                         [NSNumber numberWithInt:EFRAGMENT], @"\"fragment\"",
+                         [NSNumber numberWithInt:ECTRL], @"[\"a\tb\"]",
+                         [NSNumber numberWithInt:EESCAPE], @"[\"\\q\"]",
+                         [NSNumber numberWithInt:EUNICODE], @"[\"\\u12\"]",
+                         [NSNumber numberWithInt:EUNICODE], @"[\"\\ud83d\"]",
+                         nil];
+  for (NSString *json in cases) {
+    SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+    STAssertNil([self objectWithJSON:json parser:parser], @"Should reject %@", json);
+    NSArray *trace = [parser errorTrace];
+    STAssertTrue([trace count] > 0, nil);
+    STAssertEquals([[cases objectForKey:json] integerValue], [[trace objectAtIndex:0] code],
+                   @"First error for %@ was %@", json, trace);
+  }
+
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  parser.maxDepth = 4;
+  STAssertNil([self objectWithJSON:@"[[[[[1]]]]]" parser:parser], nil);
+  STAssertEquals((NSInteger)EDEPTH, [[[parser errorTrace] objectAtIndex:0] code], nil);
+}
+
+//
+//  Benchmark: a large, indented directory listing.
+//
+
+- (void)testParseBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  NSMutableString *json = [NSMutableString stringWithString:@"{\n  \"contents\": [\n"];
+  for (NSUInteger i = 0; i < 20000; i++) {
+    [json appendFormat:@"%@    {\n      \"revision\": %u,\n      \"bytes\": %u,\n"
+     @"      \"modified\": \"Sat, 12 Mar 2011 20:58:00 -0800\",\n"
+     @"      \"path\": \"/StrongBox/20110124210018-%08X.dat\",\n      \"is_dir\": false\n    }",
+     (i == 0) ? @"" : @",\n", i, i * 1024, i];
+  }
+  [json appendString:@"\n  ]\n}\n"];
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+
+  SBJsonParser *parser = [[[SBJsonParser alloc] init] autorelease];
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  id result = [parser objectWithData:data];
+  CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+  STAssertNotNil(result, nil);
+  [pool drain];
+
+  NSLog(@"%s -- parsed %u bytes in %.3fs (%.1f MB/s)",
+        __PRETTY_FUNCTION__,
+        [data length],
+        elapsed,
+        [data length] / elapsed / (1024 * 1024));
+}
+
+@end
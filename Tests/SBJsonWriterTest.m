@@ -0,0 +1,198 @@
+//
+//  SBJsonWriterTest.m
+//  DropVault
+//
+//  Created by Brian Dewey on 7/10/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#import "GTMSenTestCase.h"
+#import <UIKit/UIKit.h>
+#import "JSON.h"
+#import "DVBenchmark.h"
+
+@interface SBJsonWriterTest : GTMTestCase {
+
+}
+
+@end
+
+
+@implementation SBJsonWriterTest
+
+#pragma mark -
+#pragma mark Helper functions
+
+//
+//  A listing shaped like exported metadata, with |count| entries.
+//
+
+- (NSArray *)listingWithCount:(NSUInteger)count {
+
+  NSMutableArray *listing = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; i++) {
+    [listing addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                        [NSString stringWithFormat:@"/StrongBox/caf\u00e9-%u.dat", i], @"path",
+                        [NSNumber numberWithLongLong:i * 1024], @"bytes",
+                        [NSNumber numberWithBool:(i % 2 == 0)], @"is_dir",
+                        @"Sat, 12 Mar 2011 20:58:00 -0800", @"modified",
+                        [NSNull null], @"icon",
+                        nil]];
+  }
+  return listing;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+//
+//  Every kind of value, escaped and formatted the way the writer always has.
+//
+
+- (void)testValues {
+
+  SBJsonWriter *writer = [[[SBJsonWriter alloc] init] autorelease];
+  NSArray *values = [NSArray arrayWithObjects:
+                     @"plain",
+                     @"q\"b\\t\tn\nr\rb\bf\f",
+                     [NSString stringWithFormat:@"%C%C", (unichar)0x01, (unichar)0x1f],
+                     @"caf\u00e9 \U0001F600",
+                     [NSNumber numberWithBool:YES],
+                     [NSNumber numberWithBool:NO],
+                     [NSNumber numberWithInt:-42],
+                     [NSNumber numberWithLongLong:LLONG_MAX],
+                     [NSNumber numberWithUnsignedLongLong:ULLONG_MAX],
+                     [NSNumber numberWithDouble:1.5],
+                     [NSNull null],
+                     nil];
+  NSString *expected = @"[\"plain\",\"q\\\"b\\\\t\\tn\\nr\\rb\\bf\\f\",\"\\u0001\\u001f\","
+                       @"\"caf\u00e9 \U0001F600\",true,false,-42,9223372036854775807,"
+                       @"18446744073709551615,1.5,null]";
+  STAssertEqualStrings(expected, [writer stringWithObject:values], nil);
+  STAssertEqualObjects([expected dataUsingEncoding:NSUTF8StringEncoding], [writer dataWithObject:values], nil);
+
+  writer.sortKeys = YES;
+  NSDictionary *object = [NSDictionary dictionaryWithObjectsAndKeys:
+                          [NSArray array], @"b",
+                          [NSDictionary dictionary], @"a",
+                          nil];
+  STAssertEqualStrings(@"{\"a\":{},\"b\":[]}", [writer stringWithObject:object], nil);
+}
+
+//
+//  Indentation, including deeper than the precomputed indent string.
+//
+
+- (void)testHumanReadable {
+
+  SBJsonWriter *writer = [[[SBJsonWriter alloc] init] autorelease];
+  writer.humanReadable = YES;
+  NSDictionary *object = [NSDictionary dictionaryWithObject:[NSArray arrayWithObjects:@"x", [NSArray array], nil]
+                                                     forKey:@"a"];
+  STAssertEqualStrings(@"{\n  \"a\" : [\n    \"x\",\n    []\n  ]\n}", [writer stringWithObject:object], nil);
+
+  id nested = [NSNumber numberWithInt:1];
+  NSUInteger levels = 100;
+  for (NSUInteger i = 0; i < levels; i++) {
+    nested = [NSArray arrayWithObject:nested];
+  }
+  NSString *json = [writer stringWithObject:nested];
+  NSRange one = [json rangeOfString:@"1"];
+  STAssertEquals(1 + 2 * levels, one.location - [json rangeOfString:@"\n" options:NSBackwardSearch range:NSMakeRange(0, one.location)].location,
+                 @"Innermost value indented %u levels", levels);
+  STAssertEqualObjects(nested, [json JSONValue], nil);
+}
+
+//
+//  Streams and files get exactly the bytes -dataWithObject: gives, however
+//  many times the stream buffer fills up.
+//
+
+- (void)testStreamAndFile {
+
+  SBJsonWriter *writer = [[[SBJsonWriter alloc] init] autorelease];
+  NSArray *listing = [self listingWithCount:2000];
+  NSData *expected = [writer dataWithObject:listing];
+  STAssertTrue([expected length] > 64 * 1024, @"Should be several stream buffers");
+
+  NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+  [stream open];
+  STAssertTrue([writer writeObject:listing toStream:stream], nil);
+  STAssertEqualObjects(expected, [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey], nil);
+  [stream close];
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SBJsonWriterTest.json"];
+  STAssertTrue([writer writeObject:listing toFile:path], nil);
+  STAssertEqualObjects(expected, [NSData dataWithContentsOfFile:path], nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[path stringByAppendingPathExtension:@"tmp"]], nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+//
+//  Errors are the same whichever way the output goes.
+//
+
+- (void)testErrors {
+
+  SBJsonWriter *writer = [[[SBJsonWriter alloc] init] autorelease];
+  STAssertNil([writer dataWithObject:@"fragment"], nil);
+  STAssertEquals((NSInteger)EFRAGMENT, [[[writer errorTrace] objectAtIndex:0] code], nil);
+  STAssertEqualStrings(@"\"fragment\"", [writer stringWithFragment:@"fragment"], nil);
+
+  NSArray *unsupported = [NSArray arrayWithObject:[NSDate date]];
+  STAssertNil([writer stringWithObject:unsupported], nil);
+  STAssertEquals((NSInteger)EUNSUPPORTED, [[[writer errorTrace] objectAtIndex:0] code], nil);
+
+  NSOutputStream *closed = [NSOutputStream outputStreamToFileAtPath:@"/nonexistent/SBJsonWriterTest.json" append:NO];
+  [closed open];
+  STAssertFalse([writer writeObject:[NSArray arrayWithObject:@"x"] toStream:closed], nil);
+  STAssertEquals((NSInteger)EOUTPUT, [[[writer errorTrace] objectAtIndex:0] code], nil);
+}
+
+//
+//  Benchmark: a large listing as a string and as UTF-8 data.
+//
+
+- (void)testWriteBenchmark {
+
+  DVBenchmarkReturnUnlessEnabled();
+
+  SBJsonWriter *writer = [[[SBJsonWriter alloc] init] autorelease];
+  writer.humanReadable = YES;
+  NSArray *listing = [self listingWithCount:20000];
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+  NSString *string = [writer stringWithObject:listing];
+  CFAbsoluteTime stringTime = CFAbsoluteTimeGetCurrent() - start;
+  STAssertNotNil(string, nil);
+  [pool drain];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  start = CFAbsoluteTimeGetCurrent();
+  NSData *data = [writer dataWithObject:listing];
+  CFAbsoluteTime dataTime = CFAbsoluteTimeGetCurrent() - start;
+  NSUInteger length = [data length];
+  [pool drain];
+
+  NSLog(@"%s -- %u entries, %u bytes: string %.3fs, data %.3fs",
+        __PRETTY_FUNCTION__,
+        [listing count],
+        length,
+        stringTime,
+        dataTime);
+}
+
+@end
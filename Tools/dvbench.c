@@ -0,0 +1,391 @@
+//
+//  dvbench.c
+//  DropVault
+//
+//  Created by Brian Dewey on 7/24/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+//
+//  Times the portable vault crypto in |DVVaultCrypto|: deriving keys from a
+//  password, writing key files, and streaming data through a
+//  |DVVaultCryptor| the way dvencrypt does. It runs each benchmark the way
+//  |DVBenchmark| does in the unit tests -- untimed warm-up runs, then timed
+//  repetitions -- and reports the same statistics, so numbers from a
+//  desktop and from a device can be put side by side.
+//
+//  To build it on Linux:
+//
+//    cc -std=c99 -O2 -IClasses -o dvbench Tools/dvbench.c Classes/DVVaultCrypto.c -lcrypto -lm
+//
+//  On Mac OS X, leave out |-lcrypto|.
+//
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "DVVaultCrypto.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+//
+//  The password and salt every derivation uses.
+//
+
+#define kDVBenchPassword            "Orwell."
+#define kDVBenchSalt                "DropVlt!"
+
+//
+//  How many derivations, or key files, one repetition makes.
+//
+
+#define kDVBenchKeyCount            20
+
+//
+//  How much data one repetition of a streaming benchmark encrypts.
+//
+
+#define kDVBenchStreamLength        (16 * 1024 * 1024)
+
+//
+//  The most repetitions a benchmark can have.
+//
+
+#define kDVBenchMaxRepetitions      1000
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  double work;
+  size_t warmUp;
+  size_t repetitions;
+  double samples[kDVBenchMaxRepetitions];
+  double mean;
+  double median;
+  double min;
+  double max;
+  double variance;
+} DVBenchResult;
+
+typedef bool (*DVBenchBlock)(void *context);
+
+//
+//  The buffers a streaming benchmark encrypts through.
+//
+
+typedef struct {
+  size_t bufferLength;
+  unsigned char *input;
+  unsigned char *output;
+} DVBenchStream;
+
+static void DVBenchUsage(void) {
+  fprintf(stderr,
+          "usage: dvbench [-w warm-up] [-r repetitions] [-o results.json]\n"
+          "\n"
+          "  -w warm-up      untimed runs of each benchmark (default: 2)\n"
+          "  -r repetitions  timed runs of each benchmark (default: 10)\n"
+          "  -o results      also write the results as JSON\n");
+  exit(2);
+}
+
+static double DVBenchNow(void) {
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+static int DVBenchCompare(const void *a, const void *b) {
+
+  double difference = *(const double *)a - *(const double *)b;
+  return (difference > 0) - (difference < 0);
+}
+
+//
+//  Fills in the mean, median, min, max, and sample variance of |result|'s
+//  samples. Matches |+[DVBenchmark statisticsForSamples:]|.
+//
+
+static void DVBenchComputeStatistics(DVBenchResult *result) {
+
+  size_t count = result->repetitions;
+  double sorted[kDVBenchMaxRepetitions];
+  memcpy(sorted, result->samples, count * sizeof(double));
+  qsort(sorted, count, sizeof(double), DVBenchCompare);
+  double sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += result->samples[i];
+  }
+  result->mean = sum / count;
+  double squares = 0;
+  for (size_t i = 0; i < count; i++) {
+    double difference = result->samples[i] - result->mean;
+    squares += difference * difference;
+  }
+  result->variance = (count > 1) ? squares / (count - 1) : 0;
+  result->median = sorted[count / 2];
+  if (count % 2 == 0) {
+    result->median = (result->median + sorted[count / 2 - 1]) / 2;
+  }
+  result->min = sorted[0];
+  result->max = sorted[count - 1];
+}
+
+//
+//  Runs |block| |warmUp| times untimed, then |repetitions| times timed. Each
+//  run does |work| units of |unit|. Returns false if any run fails.
+//
+
+static bool DVBenchMeasure(DVBenchResult *result,
+                           const char *name,
+                           const char *unit,
+                           double work,
+                           size_t warmUp,
+                           size_t repetitions,
+                           DVBenchBlock block,
+                           void *context) {
+
+  memset(result, 0, sizeof(*result));
+  result->name = name;
+  result->unit = unit;
+  result->work = work;
+  result->warmUp = warmUp;
+  result->repetitions = repetitions;
+  for (size_t i = 0; i < warmUp; i++) {
+    if (!block(context)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < repetitions; i++) {
+    double start = DVBenchNow();
+    if (!block(context)) {
+      return false;
+    }
+    double elapsed = DVBenchNow() - start;
+    result->samples[i] = work / (elapsed > 1e-9 ? elapsed : 1e-9);
+  }
+  DVBenchComputeStatistics(result);
+  return true;
+}
+
+static bool DVBenchDeriveBytes(void *context) {
+
+  unsigned char bytes[kDVVaultKeyLength + kDVVaultIVLength];
+  for (int i = 0; i < kDVBenchKeyCount; i++) {
+    DVVaultDeriveBytes(kDVBenchPassword,
+                       strlen(kDVBenchPassword),
+                       kDVBenchSalt,
+                       kDVVaultSaltLength,
+                       bytes,
+                       sizeof(bytes));
+  }
+  return true;
+}
+
+static bool DVBenchWriteKeyFile(void *context) {
+
+  static const char fileName[] = "Passport scan.pdf";
+  unsigned char key[kDVVaultKeyLength] = { 0 };
+  unsigned char iv[kDVVaultIVLength] = { 0 };
+  unsigned char keyFile[256];
+  if (DVVaultKeyFileLength(strlen(fileName), 0) > sizeof(keyFile)) {
+    return false;
+  }
+  for (int i = 0; i < kDVBenchKeyCount; i++) {
+    if (!DVVaultWriteKeyFile(kDVBenchPassword,
+                             strlen(kDVBenchPassword),
+                             (const unsigned char *)kDVBenchSalt,
+                             key,
+                             iv,
+                             fileName,
+                             strlen(fileName),
+                             0,
+                             keyFile)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+//  Encrypts |kDVBenchStreamLength| bytes, |bufferLength| at a time, the way
+//  dvencrypt streams a file.
+//
+
+static bool DVBenchEncryptStream(void *context) {
+
+  DVBenchStream *stream = context;
+  unsigned char key[kDVVaultKeyLength] = { 1 };
+  unsigned char iv[kDVVaultIVLength] = { 2 };
+  DVVaultCryptor *cryptor = DVVaultCryptorCreate(key, iv);
+  if (cryptor == NULL) {
+    return false;
+  }
+  bool succeeded = true;
+  size_t outputLength;
+  for (size_t offset = 0; succeeded && offset < kDVBenchStreamLength; offset += stream->bufferLength) {
+    succeeded = DVVaultCryptorUpdate(cryptor,
+                                     stream->input,
+                                     stream->bufferLength,
+                                     stream->output,
+                                     &outputLength);
+  }
+  if (succeeded) {
+    succeeded = DVVaultCryptorFinal(cryptor, stream->output, &outputLength);
+  }
+  DVVaultCryptorRelease(cryptor);
+  return succeeded;
+}
+
+static void DVBenchPrintResult(const DVBenchResult *result) {
+
+  printf("%-40s %12.2f %s/s +/- %4.1f%%\n",
+         result->name,
+         result->mean,
+         result->unit,
+         result->mean > 0 ? sqrt(result->variance) / result->mean * 100 : 0);
+}
+
+//
+//  Writes |results| in the same JSON layout as
+//  |-[DVBenchmark writeResultsToFile:]|.
+//
+
+static bool DVBenchWriteResults(const char *path, const DVBenchResult *results, size_t count) {
+
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  fprintf(file, "{\"results\":[");
+  for (size_t i = 0; i < count; i++) {
+    const DVBenchResult *result = &results[i];
+    fprintf(file,
+            "%s{\"name\":\"%s\",\"unit\":\"%s\",\"warmUp\":%zu,\"repetitions\":%zu,\"samples\":[",
+            i > 0 ? "," : "",
+            result->name,
+            result->unit,
+            result->warmUp,
+            result->repetitions);
+    for (size_t j = 0; j < result->repetitions; j++) {
+      fprintf(file, "%s%.17g", j > 0 ? "," : "", result->samples[j]);
+    }
+    fprintf(file,
+            "],\"mean\":%.17g,\"median\":%.17g,\"min\":%.17g,\"max\":%.17g,\"stddev\":%.17g,\"variance\":%.17g}",
+            result->mean,
+            result->median,
+            result->min,
+            result->max,
+            sqrt(result->variance),
+            result->variance);
+  }
+  fprintf(file, "]}\n");
+  return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+
+  long warmUp = 2;
+  long repetitions = 10;
+  const char *resultsPath = NULL;
+  int option;
+  while ((option = getopt(argc, argv, "w:r:o:")) != -1) {
+    switch (option) {
+      case 'w':
+        warmUp = strtol(optarg, NULL, 10);
+        if (warmUp < 0) {
+          DVBenchUsage();
+        }
+        break;
+      case 'r':
+        repetitions = strtol(optarg, NULL, 10);
+        if (repetitions < 1 || repetitions > kDVBenchMaxRepetitions) {
+          DVBenchUsage();
+        }
+        break;
+      case 'o':
+        resultsPath = optarg;
+        break;
+      default:
+        DVBenchUsage();
+    }
+  }
+  if (optind != argc) {
+    DVBenchUsage();
+  }
+
+  static const size_t bufferLengths[] = { 4 * 1024, 64 * 1024 };
+  size_t largestBuffer = bufferLengths[sizeof(bufferLengths) / sizeof(bufferLengths[0]) - 1];
+  DVBenchStream stream;
+  stream.input = calloc(largestBuffer, 1);
+  stream.output = malloc(largestBuffer + kDVVaultBlockLength);
+  if (stream.input == NULL || stream.output == NULL) {
+    fprintf(stderr, "dvbench: out of memory\n");
+    return 1;
+  }
+
+  static DVBenchResult results[4];
+  size_t count = 0;
+  bool succeeded = DVBenchMeasure(&results[count++],
+                                  "DVVaultDeriveBytes (32 bytes)",
+                                  "ops",
+                                  kDVBenchKeyCount,
+                                  warmUp,
+                                  repetitions,
+                                  DVBenchDeriveBytes,
+                                  NULL);
+  succeeded = succeeded && DVBenchMeasure(&results[count++],
+                                          "DVVaultWriteKeyFile",
+                                          "ops",
+                                          kDVBenchKeyCount,
+                                          warmUp,
+                                          repetitions,
+                                          DVBenchWriteKeyFile,
+                                          NULL);
+  static const char *streamNames[] = { "DVVaultCryptor, 4KB buffers", "DVVaultCryptor, 64KB buffers" };
+  for (size_t i = 0; succeeded && i < sizeof(bufferLengths) / sizeof(bufferLengths[0]); i++) {
+    stream.bufferLength = bufferLengths[i];
+    succeeded = DVBenchMeasure(&results[count++],
+                               streamNames[i],
+                               "MB",
+                               kDVBenchStreamLength / (1024.0 * 1024.0),
+                               warmUp,
+                               repetitions,
+                               DVBenchEncryptStream,
+                               &stream);
+  }
+  free(stream.input);
+  free(stream.output);
+  if (!succeeded) {
+    fprintf(stderr, "dvbench: %s failed\n", results[count - 1].name);
+    return 1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    DVBenchPrintResult(&results[i]);
+  }
+  if (resultsPath != NULL && !DVBenchWriteResults(resultsPath, results, count)) {
+    fprintf(stderr, "dvbench: %s: %s\n", resultsPath, strerror(errno));
+    return 1;
+  }
+  return 0;
+}
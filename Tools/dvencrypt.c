@@ -0,0 +1,641 @@
+//
+//  dvencrypt.c
+//  DropVault
+//
+//  Created by Brian Dewey on 7/23/11.
+//  Copyright 2011 Brian Dewey.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+//
+//  Encrypts files into the StrongBox layout: each file gets a |.dat| file
+//  with its contents encrypted under a random key and IV, and a |.key| file
+//  with that key, IV, and the file's name, encrypted with a password. It
+//  walks directory trees and encrypts a file per core at a time, and reads
+//  each file through fixed buffers, so files of any size take the same
+//  memory.
+//
+//  It shares |DVVaultCrypto| with the app. To build it on Linux:
+//
+//    cc -std=c99 -O2 -IClasses -o dvencrypt Tools/dvencrypt.c Classes/DVVaultCrypto.c -lcrypto -lz -lpthread
+//
+//  On Mac OS X, leave out |-lcrypto|.
+//
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "DVVaultCrypto.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+//
+//  How much of a file is read at a time.
+//
+
+#define kDVEncryptBufferLength      (64 * 1024)
+
+//
+//  How many paths can wait for a worker before the walk blocks.
+//
+
+#define kDVEncryptQueueLength       256
+
+//
+//  The longest password we'll read.
+//
+
+#define kDVEncryptPasswordLength    1024
+
+//
+//  How many names to try before giving up on finding an unused one.
+//
+
+#define kDVEncryptNameAttempts      100
+
+//
+//  Room for a path in the vault directory, with its extension.
+//
+
+#define kDVEncryptPathLength        (PATH_MAX + 16)
+
+typedef struct {
+  const char *destination;
+  dev_t destinationDevice;
+  ino_t destinationInode;
+  const char *password;
+  size_t passwordLength;
+  bool compress;
+  bool verbose;
+  int randomFile;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  char *paths[kDVEncryptQueueLength];
+  size_t head;
+  size_t count;
+  bool walkFinished;
+
+  unsigned long long fileCount;
+  unsigned long long byteCount;
+  unsigned long long failureCount;
+} DVEncryptState;
+
+//
+//  The buffers a worker reuses for every file it encrypts.
+//
+
+typedef struct {
+  unsigned char input[kDVEncryptBufferLength];
+  unsigned char compressed[kDVEncryptBufferLength];
+  unsigned char encrypted[kDVEncryptBufferLength + kDVVaultBlockLength];
+} DVEncryptBuffers;
+
+static void DVEncryptUsage(void) {
+  fprintf(stderr,
+          "usage: dvencrypt [-j jobs] [-p password-file] [-v] [-z] source ... vault-directory\n"
+          "\n"
+          "  -j jobs           files to encrypt at once (default: one per core)\n"
+          "  -p password-file  read the password from the first line of a file\n"
+          "  -v                print each file's source path and base name\n"
+          "  -z                compress files before encrypting them\n");
+  exit(2);
+}
+
+static bool DVEncryptRandomBytes(DVEncryptState *state, void *bytes, size_t length) {
+
+  unsigned char *p = bytes;
+  while (length > 0) {
+    ssize_t bytesRead = read(state->randomFile, p, length);
+    if (bytesRead <= 0) {
+      if (bytesRead < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += bytesRead;
+    length -= bytesRead;
+  }
+  return true;
+}
+
+static bool DVEncryptWriteAll(int fd, const void *bytes, size_t length) {
+
+  const unsigned char *p = bytes;
+  while (length > 0) {
+    ssize_t bytesWritten = write(fd, p, length);
+    if (bytesWritten < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += bytesWritten;
+    length -= bytesWritten;
+  }
+  return true;
+}
+
+//
+//  Hands |path| to a worker, waiting while the queue is full. The queue
+//  takes ownership of |path|.
+//
+
+static void DVEncryptEnqueue(DVEncryptState *state, char *path) {
+
+  pthread_mutex_lock(&state->mutex);
+  while (state->count == kDVEncryptQueueLength) {
+    pthread_cond_wait(&state->notFull, &state->mutex);
+  }
+  state->paths[(state->head + state->count) % kDVEncryptQueueLength] = path;
+  state->count++;
+  pthread_cond_signal(&state->notEmpty);
+  pthread_mutex_unlock(&state->mutex);
+}
+
+//
+//  Takes the next path off the queue, or returns NULL once the walk is done
+//  and the queue is empty. The caller frees the path.
+//
+
+static char *DVEncryptDequeue(DVEncryptState *state) {
+
+  pthread_mutex_lock(&state->mutex);
+  while (state->count == 0 && !state->walkFinished) {
+    pthread_cond_wait(&state->notEmpty, &state->mutex);
+  }
+  char *path = NULL;
+  if (state->count > 0) {
+    path = state->paths[state->head];
+    state->head = (state->head + 1) % kDVEncryptQueueLength;
+    state->count--;
+    pthread_cond_signal(&state->notFull);
+  }
+  pthread_mutex_unlock(&state->mutex);
+  return path;
+}
+
+static void DVEncryptFinishWalk(DVEncryptState *state) {
+
+  pthread_mutex_lock(&state->mutex);
+  state->walkFinished = true;
+  pthread_cond_broadcast(&state->notEmpty);
+  pthread_mutex_unlock(&state->mutex);
+}
+
+//
+//  Reserves a base name in the vault directory by creating its |.dat| file.
+//  Base names look like the ones the PowerShell scripts made: the time, then
+//  eight random hex digits. Returns the open data file, or -1.
+//
+
+static int DVEncryptCreateDataFile(DVEncryptState *state, char *baseName, size_t baseNameLength) {
+
+  char timestamp[32];
+  time_t now = time(NULL);
+  struct tm local;
+  localtime_r(&now, &local);
+  strftime(timestamp, sizeof(timestamp), "%Y%m%d%H%M%S", &local);
+
+  for (int attempt = 0; attempt < kDVEncryptNameAttempts; attempt++) {
+    uint32_t suffix;
+    if (!DVEncryptRandomBytes(state, &suffix, sizeof(suffix))) {
+      return -1;
+    }
+    if (snprintf(baseName, baseNameLength, "%s/%s-%08X",
+                 state->destination, timestamp, (unsigned int)suffix) >= (int)baseNameLength) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+
+    char keyPath[kDVEncryptPathLength];
+    snprintf(keyPath, sizeof(keyPath), "%s.key", baseName);
+    if (access(keyPath, F_OK) == 0) {
+      continue;
+    }
+    char dataPath[kDVEncryptPathLength];
+    snprintf(dataPath, sizeof(dataPath), "%s.dat", baseName);
+    int fd = open(dataPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) {
+      errno = 0;
+      return fd;
+    }
+    if (errno != EEXIST) {
+      return -1;
+    }
+  }
+  errno = EEXIST;
+  return -1;
+}
+
+//
+//  Encrypts |length| bytes into |fd|.
+//
+
+static bool DVEncryptWriteEncrypted(DVVaultCryptor *cryptor,
+                                    int fd,
+                                    const void *bytes,
+                                    size_t length,
+                                    DVEncryptBuffers *buffers) {
+
+  size_t encryptedLength = 0;
+  return DVVaultCryptorUpdate(cryptor, bytes, length, buffers->encrypted, &encryptedLength) &&
+         DVEncryptWriteAll(fd, buffers->encrypted, encryptedLength);
+}
+
+//
+//  Streams |source| through the compressor, if there is one, and the
+//  cryptor into |fd|.
+//
+
+static bool DVEncryptStream(int source,
+                            int fd,
+                            DVVaultCryptor *cryptor,
+                            z_stream *deflater,
+                            DVEncryptBuffers *buffers,
+                            unsigned long long *byteCount) {
+
+  bool finished = false;
+  while (!finished) {
+    ssize_t bytesRead = read(source, buffers->input, kDVEncryptBufferLength);
+    if (bytesRead < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    finished = (bytesRead == 0);
+    *byteCount += bytesRead;
+
+    if (deflater == NULL) {
+      if (!DVEncryptWriteEncrypted(cryptor, fd, buffers->input, bytesRead, buffers)) {
+        return false;
+      }
+      continue;
+    }
+
+    deflater->next_in = buffers->input;
+    deflater->avail_in = (uInt)bytesRead;
+    int status;
+    do {
+      deflater->next_out = buffers->compressed;
+      deflater->avail_out = kDVEncryptBufferLength;
+      status = deflate(deflater, finished ? Z_FINISH : Z_NO_FLUSH);
+      if (status == Z_STREAM_ERROR) {
+        return false;
+      }
+      size_t compressedLength = kDVEncryptBufferLength - deflater->avail_out;
+      if (!DVEncryptWriteEncrypted(cryptor, fd, buffers->compressed, compressedLength, buffers)) {
+        return false;
+      }
+    } while (deflater->avail_out == 0 || (finished && status != Z_STREAM_END));
+  }
+
+  size_t finalLength = 0;
+  return DVVaultCryptorFinal(cryptor, buffers->encrypted, &finalLength) &&
+         DVEncryptWriteAll(fd, buffers->encrypted, finalLength);
+}
+
+//
+//  Writes the key file for |baseName| under a temporary name and then moves
+//  it into place, so a |.key| file never shows up before its |.dat| file is
+//  complete, or half written.
+//
+
+static bool DVEncryptWriteKeyFile(DVEncryptState *state,
+                                  const char *baseName,
+                                  const char *fileName,
+                                  const unsigned char key[kDVVaultKeyLength],
+                                  const unsigned char iv[kDVVaultIVLength]) {
+
+  unsigned char salt[kDVVaultSaltLength];
+  if (!DVEncryptRandomBytes(state, salt, sizeof(salt))) {
+    return false;
+  }
+  unsigned char options = state->compress ? kKeyFileOptionCompressed : 0;
+  size_t fileNameLength = strlen(fileName);
+  size_t keyFileLength = DVVaultKeyFileLength(fileNameLength, options);
+  unsigned char *keyFile = malloc(keyFileLength);
+  if (keyFile == NULL) {
+    return false;
+  }
+  bool succeeded = DVVaultWriteKeyFile(state->password,
+                                       state->passwordLength,
+                                       salt,
+                                       key,
+                                       iv,
+                                       fileName,
+                                       fileNameLength,
+                                       options,
+                                       keyFile);
+
+  char temporaryPath[kDVEncryptPathLength];
+  char keyPath[kDVEncryptPathLength];
+  snprintf(temporaryPath, sizeof(temporaryPath), "%s.key.tmp", baseName);
+  snprintf(keyPath, sizeof(keyPath), "%s.key", baseName);
+  int fd = succeeded ? open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+  if (fd < 0) {
+    succeeded = false;
+  } else {
+    succeeded = DVEncryptWriteAll(fd, keyFile, keyFileLength);
+    succeeded = (close(fd) == 0) && succeeded;
+    succeeded = succeeded && (rename(temporaryPath, keyPath) == 0);
+    if (!succeeded) {
+      unlink(temporaryPath);
+    }
+  }
+  free(keyFile);
+  return succeeded;
+}
+
+//
+//  Encrypts the file at |path| into a new pair of vault files. Returns
+//  false, and leaves nothing behind, if anything fails.
+//
+
+static bool DVEncryptFile(DVEncryptState *state, const char *path, DVEncryptBuffers *buffers) {
+
+  int source = open(path, O_RDONLY);
+  if (source < 0) {
+    return false;
+  }
+  char baseName[PATH_MAX];
+  int fd = DVEncryptCreateDataFile(state, baseName, sizeof(baseName));
+  if (fd < 0) {
+    close(source);
+    return false;
+  }
+
+  unsigned char key[kDVVaultKeyLength];
+  unsigned char iv[kDVVaultIVLength];
+  bool succeeded = DVEncryptRandomBytes(state, key, sizeof(key)) &&
+                   DVEncryptRandomBytes(state, iv, sizeof(iv));
+  DVVaultCryptor *cryptor = succeeded ? DVVaultCryptorCreate(key, iv) : NULL;
+  z_stream deflater;
+  memset(&deflater, 0, sizeof(deflater));
+  bool compressing = state->compress && deflateInit(&deflater, Z_DEFAULT_COMPRESSION) == Z_OK;
+
+  unsigned long long byteCount = 0;
+  succeeded = cryptor != NULL &&
+              compressing == state->compress &&
+              DVEncryptStream(source, fd, cryptor, compressing ? &deflater : NULL, buffers, &byteCount);
+  succeeded = (close(fd) == 0) && succeeded;
+  close(source);
+  if (compressing) {
+    deflateEnd(&deflater);
+  }
+  DVVaultCryptorRelease(cryptor);
+
+  const char *fileName = strrchr(path, '/');
+  fileName = (fileName != NULL) ? fileName + 1 : path;
+  succeeded = succeeded && DVEncryptWriteKeyFile(state, baseName, fileName, key, iv);
+  if (!succeeded) {
+    int error = errno;
+    char dataPath[kDVEncryptPathLength];
+    snprintf(dataPath, sizeof(dataPath), "%s.dat", baseName);
+    unlink(dataPath);
+    errno = error;
+    return false;
+  }
+
+  pthread_mutex_lock(&state->mutex);
+  state->fileCount++;
+  state->byteCount += byteCount;
+  if (state->verbose) {
+    printf("%s\t%s\n", path, strrchr(baseName, '/') + 1);
+  }
+  pthread_mutex_unlock(&state->mutex);
+  return true;
+}
+
+static void *DVEncryptWorker(void *context) {
+
+  DVEncryptState *state = context;
+  DVEncryptBuffers *buffers = malloc(sizeof(DVEncryptBuffers));
+  char *path;
+  while ((path = DVEncryptDequeue(state)) != NULL) {
+    if (buffers == NULL || !DVEncryptFile(state, path, buffers)) {
+      int error = (buffers == NULL) ? ENOMEM : errno;
+      pthread_mutex_lock(&state->mutex);
+      state->failureCount++;
+      fprintf(stderr, "dvencrypt: %s: %s\n", path, error ? strerror(error) : "could not encrypt");
+      pthread_mutex_unlock(&state->mutex);
+    }
+    free(path);
+  }
+  free(buffers);
+  return NULL;
+}
+
+//
+//  Queues every regular file at or under |path|. Hidden files and the vault
+//  directory itself are skipped, and symbolic links to directories aren't
+//  followed, so the walk can't loop.
+//
+
+static void DVEncryptWalk(DVEncryptState *state, const char *path, bool followLinks) {
+
+  struct stat status;
+  if ((followLinks ? stat(path, &status) : lstat(path, &status)) != 0) {
+    pthread_mutex_lock(&state->mutex);
+    state->failureCount++;
+    fprintf(stderr, "dvencrypt: %s: %s\n", path, strerror(errno));
+    pthread_mutex_unlock(&state->mutex);
+    return;
+  }
+  if (S_ISLNK(status.st_mode)) {
+    if (stat(path, &status) != 0 || !S_ISREG(status.st_mode)) {
+      return;
+    }
+  }
+  if (S_ISREG(status.st_mode)) {
+    DVEncryptEnqueue(state, strdup(path));
+    return;
+  }
+  if (!S_ISDIR(status.st_mode) ||
+      (status.st_dev == state->destinationDevice && status.st_ino == state->destinationInode)) {
+    return;
+  }
+
+  DIR *directory = opendir(path);
+  if (directory == NULL) {
+    pthread_mutex_lock(&state->mutex);
+    state->failureCount++;
+    fprintf(stderr, "dvencrypt: %s: %s\n", path, strerror(errno));
+    pthread_mutex_unlock(&state->mutex);
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    char childPath[PATH_MAX];
+    if (snprintf(childPath, sizeof(childPath), "%s/%s", path, entry->d_name) >= (int)sizeof(childPath)) {
+      continue;
+    }
+    DVEncryptWalk(state, childPath, false);
+  }
+  closedir(directory);
+}
+
+//
+//  Reads the password from the first line of |path|.
+//
+
+static char *DVEncryptReadPassword(const char *path) {
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  char *password = calloc(kDVEncryptPasswordLength, 1);
+  if (password != NULL && fgets(password, kDVEncryptPasswordLength, file) != NULL) {
+    password[strcspn(password, "\r\n")] = 0;
+  }
+  fclose(file);
+  return password;
+}
+
+int main(int argc, char **argv) {
+
+  DVEncryptState state;
+  memset(&state, 0, sizeof(state));
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *passwordPath = NULL;
+  int option;
+  while ((option = getopt(argc, argv, "j:p:vz")) != -1) {
+    switch (option) {
+      case 'j':
+        jobs = strtol(optarg, NULL, 10);
+        if (jobs < 1) {
+          DVEncryptUsage();
+        }
+        break;
+      case 'p':
+        passwordPath = optarg;
+        break;
+      case 'v':
+        state.verbose = true;
+        break;
+      case 'z':
+        state.compress = true;
+        break;
+      default:
+        DVEncryptUsage();
+    }
+  }
+  argc -= optind;
+  argv += optind;
+  if (argc < 2) {
+    DVEncryptUsage();
+  }
+  if (jobs < 1) {
+    jobs = 1;
+  }
+
+  char *password = NULL;
+  if (passwordPath != NULL) {
+    password = DVEncryptReadPassword(passwordPath);
+    if (password == NULL) {
+      fprintf(stderr, "dvencrypt: %s: %s\n", passwordPath, strerror(errno));
+      return 1;
+    }
+  } else {
+    char *entered = getpass("Password: ");
+    password = strdup(entered != NULL ? entered : "");
+    entered = getpass("Confirm password: ");
+    if (entered == NULL || strcmp(password, entered) != 0) {
+      fprintf(stderr, "dvencrypt: passwords don't match\n");
+      return 1;
+    }
+  }
+  if (password == NULL || password[0] == 0) {
+    fprintf(stderr, "dvencrypt: the password is empty\n");
+    return 1;
+  }
+  state.password = password;
+  state.passwordLength = strlen(password);
+
+  state.destination = argv[argc - 1];
+  struct stat status;
+  if (stat(state.destination, &status) != 0 || !S_ISDIR(status.st_mode)) {
+    fprintf(stderr, "dvencrypt: %s is not a directory\n", state.destination);
+    return 1;
+  }
+  state.destinationDevice = status.st_dev;
+  state.destinationInode = status.st_ino;
+  state.randomFile = open("/dev/urandom", O_RDONLY);
+  if (state.randomFile < 0) {
+    fprintf(stderr, "dvencrypt: /dev/urandom: %s\n", strerror(errno));
+    return 1;
+  }
+
+  pthread_mutex_init(&state.mutex, NULL);
+  pthread_cond_init(&state.notEmpty, NULL);
+  pthread_cond_init(&state.notFull, NULL);
+  pthread_t *workers = calloc(jobs, sizeof(pthread_t));
+  long workerCount = 0;
+  while (workers != NULL && workerCount < jobs &&
+         pthread_create(&workers[workerCount], NULL, DVEncryptWorker, &state) == 0) {
+    workerCount++;
+  }
+  if (workerCount == 0) {
+    fprintf(stderr, "dvencrypt: could not start any workers\n");
+    return 1;
+  }
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (int i = 0; i < argc - 1; i++) {
+    DVEncryptWalk(&state, argv[i], true);
+  }
+  DVEncryptFinishWalk(&state);
+  for (long i = 0; i < workerCount; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+  fprintf(stderr,
+          "dvencrypt: encrypted %llu files, %.1f MB, in %.2fs with %ld workers\n",
+          state.fileCount,
+          state.byteCount / (1024.0 * 1024.0),
+          seconds,
+          workerCount);
+  if (state.failureCount > 0) {
+    fprintf(stderr, "dvencrypt: %llu files could not be encrypted\n", state.failureCount);
+  }
+
+  memset(password, 0, state.passwordLength);
+  free(password);
+  free(workers);
+  close(state.randomFile);
+  return state.failureCount > 0 ? 1 : 0;
+}
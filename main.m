@@ -19,10 +19,12 @@
 //
 
 #import <UIKit/UIKit.h>
+#import "DVLaunchTimer.h"
 
 int main(int argc, char *argv[]) {
     
     NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+    [DVLaunchTimer markPhase:@"main"];
     int retVal = UIApplicationMain(argc, argv, nil, nil);
     [pool release];
     return retVal;